@@ -0,0 +1,586 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Benchmark of the RX pipeline (rx_buffer_pop, sx1302_parse, lgw_receive),
+    replaying SX1302 RX buffer captures on the software device.
+    Captures use the format written by rx_buffer_dump(): one fetch per line,
+    bytes as hexadecimal separated by spaces.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* EXIT_FAILURE, malloc */
+#include <string.h>     /* memset, memcpy */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getopt */
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_mock.h"
+#include "loragw_sx1302.h"
+#include "loragw_sx1302_rx.h"
+#include "loragw_handle.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_NB_LOOP     2000
+#define RX_BUFFER_SIZE      4096    /* SX1302 RX buffer */
+#define FETCH_NB_MAX        256     /* fetches of a capture */
+#define FETCH_PKT_NB_MAX    16      /* packets returned by one lgw_receive() call */
+#define SYNTH_FETCH_NB      8       /* fetches of a synthetic capture */
+
+#define PKT_HEAD_METADATA   9
+#define PKT_TAIL_METADATA   14
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct fetch_s {
+    uint16_t size;
+    uint8_t nb_pkt;
+    uint8_t data[RX_BUFFER_SIZE];
+};
+
+struct capture_s {
+    const char * name;
+    int nb_fetch;
+    struct fetch_s fetch[FETCH_NB_MAX];
+};
+
+/* synthetic capture: packets on the 8 multi-SF channels and the LoRa service channel */
+struct synth_s {
+    const char * name;
+    uint8_t sf_min;
+    uint8_t sf_max;
+    uint16_t size_min;
+    uint16_t size_max;
+    uint8_t nb_ts_metrics;
+};
+
+struct result_s {
+    uint32_t nb_pkt;
+    double time_ns;
+    uint32_t nb_alloc;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const struct synth_s synth_list[] = {
+    { "SF7 20B",             7,  7,  20,  20,  0 },
+    { "SF7-12 10-60B",       7, 12,  10,  60,  0 },
+    { "SF7-12 255B",         7, 12, 255, 255,  0 },
+    { "SF7-12 10-60B ts16",  7, 12,  10,  60, 16 },
+    { "SF7-12 10-60B ts64",  7, 12,  10,  60, 64 },
+};
+
+static struct capture_s capture;
+static struct lgw_pkt_rx_s rxpkt[FETCH_PKT_NB_MAX];
+
+/* heap allocations done by the library, counted with the linker --wrap option */
+static uint32_t nb_alloc = 0;
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t nmemb, size_t size);
+void * __real_realloc(void * ptr, size_t size);
+
+void * __wrap_malloc(size_t size) {
+    nb_alloc += 1;
+    return __real_malloc(size);
+}
+
+void * __wrap_calloc(size_t nmemb, size_t size) {
+    nb_alloc += 1;
+    return __real_calloc(nmemb, size);
+}
+
+void * __wrap_realloc(void * ptr, size_t size) {
+    nb_alloc += 1;
+    return __real_realloc(ptr, size);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+static void usage(void) {
+    printf("Library version information: %s\n", lgw_version_info());
+    printf("Available options:\n");
+    printf(" -h         print this help\n");
+    printf(" -c <path>  RX buffer capture to be replayed (rx_buffer_dump format), instead of the synthetic ones\n");
+    printf(" -w <path>  write the synthetic captures (rx_buffer_dump format) and exit\n");
+    printf(" -n <uint>  number of replays of each capture (default %d)\n", DEFAULT_NB_LOOP);
+    printf(" -f         enable fine timestamping\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double elapsed_ns(struct timespec start, struct timespec stop) {
+    return ((double)(stop.tv_sec - start.tv_sec) * 1E9) + (double)(stop.tv_nsec - start.tv_nsec);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* count the packets of a fetch, as rx_buffer_fetch() does */
+static int fetch_count(struct fetch_s * f) {
+    int idx = 0;
+    uint8_t len;
+
+    f->nb_pkt = 0;
+    while ((idx + PKT_HEAD_METADATA + PKT_TAIL_METADATA) <= f->size) {
+        if ((f->data[idx] != 0xA5) || (f->data[idx + 1] != 0xC0)) {
+            return -1;
+        }
+        len = f->data[idx + 2];
+        if ((idx + PKT_HEAD_METADATA + len + PKT_TAIL_METADATA) > f->size) {
+            return -1;
+        }
+        idx += PKT_HEAD_METADATA + len + PKT_TAIL_METADATA + (2 * f->data[idx + len + 21]);
+        f->nb_pkt += 1;
+    }
+
+    return (idx == f->size) ? 0 : -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int capture_load(const char * path, struct capture_s * c) {
+    static char line[(3 * RX_BUFFER_SIZE) + 64];
+    FILE * file;
+    struct fetch_s * f;
+    char * p;
+    char * q;
+    unsigned long byte;
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        printf("ERROR: failed to open capture %s\n", path);
+        return -1;
+    }
+
+    c->name = path;
+    c->nb_fetch = 0;
+    while ((c->nb_fetch < FETCH_NB_MAX) && (fgets(line, sizeof line, file) != NULL)) {
+        if (line[0] == '#') {
+            continue;
+        }
+        f = &c->fetch[c->nb_fetch];
+        f->size = 0;
+        p = line;
+        while (1) {
+            byte = strtoul(p, &q, 16);
+            if ((q == p) || (byte > 0xFF)) {
+                break;
+            }
+            if (f->size == RX_BUFFER_SIZE) {
+                printf("ERROR: capture %s: fetch %d is larger than the RX buffer\n", path, c->nb_fetch);
+                fclose(file);
+                return -1;
+            }
+            f->data[f->size++] = (uint8_t)byte;
+            p = q;
+        }
+        if (f->size == 0) {
+            continue;
+        }
+        if (fetch_count(f) != 0) {
+            printf("ERROR: capture %s: fetch %d is not a sequence of complete packets\n", path, c->nb_fetch);
+            fclose(file);
+            return -1;
+        }
+        c->nb_fetch += 1;
+    }
+    fclose(file);
+
+    if (c->nb_fetch == 0) {
+        printf("ERROR: capture %s is empty\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void capture_synth(const struct synth_s * s, struct capture_s * c) {
+    struct lgw_mock_rx_s pkt;
+    struct fetch_s * f;
+    uint32_t time_us = 1000000;
+    int i, j, k = 0, n;
+
+    c->name = s->name;
+    c->nb_fetch = SYNTH_FETCH_NB;
+    for (i = 0; i < SYNTH_FETCH_NB; i++) {
+        f = &c->fetch[i];
+        f->size = 0;
+        f->nb_pkt = 0;
+        while (f->nb_pkt < FETCH_PKT_NB_MAX) {
+            memset(&pkt, 0, sizeof pkt);
+            pkt.time_us = time_us;
+            pkt.if_chain = (uint8_t)(k % 9);
+            pkt.datarate = (pkt.if_chain == 8) ? 7 : (uint8_t)(s->sf_min + (k % (s->sf_max - s->sf_min + 1)));
+            pkt.coderate = 1;
+            pkt.crc_en = true;
+            pkt.crc_error = ((k % 10) == 9);
+            pkt.snr = 5.25;
+            pkt.rssi = 110;
+            pkt.size = (uint16_t)(s->size_min + ((k * 7) % (s->size_max - s->size_min + 1)));
+            for (j = 0; j < pkt.size; j++) {
+                pkt.payload[j] = (uint8_t)(k + j);
+            }
+            pkt.nb_ts_metrics = s->nb_ts_metrics;
+            n = lgw_mock_rx_format(&pkt, &f->data[f->size], RX_BUFFER_SIZE - f->size);
+            if (n < 0) {
+                break; /* RX buffer full */
+            }
+            f->size += (uint16_t)n;
+            f->nb_pkt += 1;
+            time_us += 5000;
+            k += 1;
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int capture_write(FILE * file, const struct capture_s * c) {
+    int i, j;
+
+    fprintf(file, "# %s\n", c->name);
+    for (i = 0; i < c->nb_fetch; i++) {
+        for (j = 0; j < c->fetch[i].size; j++) {
+            fprintf(file, "%02X ", c->fetch[i].data[j]);
+        }
+        fprintf(file, "\n");
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int configure(bool ftime) {
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_conf_ftime_s tsconf;
+    const int32_t channel_if[9] = { -400000, -200000, 0, -400000, -200000, 0, 200000, 400000, -200000 };
+    const uint8_t channel_rfchain[9] = { 1, 1, 1, 0, 0, 0, 0, 0, 1 };
+    int i;
+
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 0;
+    boardconf.full_duplex = false;
+    boardconf.com_type = LGW_COM_MOCK;
+    strncpy(boardconf.com_path, LGW_MOCK_PATH_NONE, sizeof boardconf.com_path);
+    if (lgw_board_setconf(&boardconf) != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to configure board\n");
+        return -1;
+    }
+
+    for (i = 0; i < 2; i++) {
+        memset(&rfconf, 0, sizeof rfconf);
+        rfconf.enable = true;
+        rfconf.freq_hz = (i == 0) ? 867500000 : 868500000;
+        rfconf.type = LGW_RADIO_TYPE_SX1250;
+        rfconf.rssi_offset = -215.4;
+        if (lgw_rxrf_setconf(i, &rfconf) != LGW_HAL_SUCCESS) {
+            printf("ERROR: failed to configure rxrf %d\n", i);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < 9; i++) {
+        memset(&ifconf, 0, sizeof ifconf);
+        ifconf.enable = true;
+        ifconf.rf_chain = channel_rfchain[i];
+        ifconf.freq_hz = channel_if[i];
+        if (i == 8) {
+            ifconf.bandwidth = BW_250KHZ;
+            ifconf.datarate = DR_LORA_SF7;
+        }
+        if (lgw_rxif_setconf(i, &ifconf) != LGW_HAL_SUCCESS) {
+            printf("ERROR: failed to configure rxif %d\n", i);
+            return -1;
+        }
+    }
+
+    if (ftime == true) {
+        memset(&tsconf, 0, sizeof tsconf);
+        tsconf.enable = true;
+        tsconf.mode = LGW_FTIME_MODE_ALL_SF;
+        if (lgw_ftime_setconf(&tsconf) != LGW_HAL_SUCCESS) {
+            printf("ERROR: failed to configure fine timestamp\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* rx_buffer_pop() on the fetched bytes: RX buffer format decoding only */
+static int bench_pop(const struct capture_s * c, unsigned int nb_loop, struct result_s * r) {
+    static rx_buffer_t rb;
+    rx_packet_t pkt;
+    struct timespec start, stop;
+    uint32_t alloc_start;
+    unsigned int l;
+    int i;
+
+    memset(r, 0, sizeof *r);
+    alloc_start = nb_alloc;
+    for (l = 0; l < nb_loop; l++) {
+        for (i = 0; i < c->nb_fetch; i++) {
+            memcpy(rb.buffer, c->fetch[i].data, c->fetch[i].size);
+            rb.buffer_size = c->fetch[i].size;
+            rb.buffer_index = 0;
+            rb.buffer_pkt_nb = c->fetch[i].nb_pkt;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            while (rb.buffer_pkt_nb > 0) {
+                if (rx_buffer_pop(&rb, &pkt) != LGW_REG_SUCCESS) {
+                    printf("ERROR: %s: rx_buffer_pop failed on fetch %d\n", c->name, i);
+                    return -1;
+                }
+                r->nb_pkt += 1;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            r->time_ns += elapsed_ns(start, stop);
+        }
+    }
+    r->nb_alloc = nb_alloc - alloc_start;
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* sx1302_parse() on the fetched bytes: decoding and metadata computation, no bus access */
+static int bench_parse(const struct capture_s * c, unsigned int nb_loop, struct result_s * r) {
+    struct timespec start, stop;
+    uint32_t alloc_start;
+    unsigned int l;
+    int i, x;
+
+    memset(r, 0, sizeof *r);
+    alloc_start = nb_alloc;
+    for (l = 0; l < nb_loop; l++) {
+        for (i = 0; i < c->nb_fetch; i++) {
+            memcpy(lgw_inst->rx_buffer.buffer, c->fetch[i].data, c->fetch[i].size);
+            lgw_inst->rx_buffer.buffer_size = c->fetch[i].size;
+            lgw_inst->rx_buffer.buffer_index = 0;
+            lgw_inst->rx_buffer.buffer_pkt_nb = c->fetch[i].nb_pkt;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            while (lgw_inst->rx_buffer.buffer_pkt_nb > 0) {
+                x = sx1302_parse(&lgw_inst->context, &rxpkt[0]);
+                if (x != LGW_REG_SUCCESS) {
+                    printf("ERROR: %s: sx1302_parse failed on fetch %d\n", c->name, i);
+                    return -1;
+                }
+                r->nb_pkt += 1;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            r->time_ns += elapsed_ns(start, stop);
+        }
+    }
+    r->nb_alloc = nb_alloc - alloc_start;
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* lgw_receive(): RX buffer read on the software device, parsing, timestamp and RSSI corrections */
+static int bench_receive(const struct capture_s * c, unsigned int nb_loop, struct result_s * r) {
+    struct timespec start, stop;
+    uint32_t alloc_start;
+    unsigned int l;
+    int i, n, nb_rx;
+
+    memset(r, 0, sizeof *r);
+    alloc_start = nb_alloc;
+    for (l = 0; l < nb_loop; l++) {
+        for (i = 0; i < c->nb_fetch; i++) {
+            if (lgw_mock_rx_raw(c->fetch[i].data, c->fetch[i].size) != LGW_MOCK_SUCCESS) {
+                return -1;
+            }
+            nb_rx = 0;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            do {
+                n = lgw_receive(FETCH_PKT_NB_MAX, rxpkt);
+                if (n < 0) {
+                    printf("ERROR: %s: lgw_receive failed on fetch %d\n", c->name, i);
+                    return -1;
+                }
+                nb_rx += n;
+            } while ((n > 0) && (nb_rx < c->fetch[i].nb_pkt));
+            clock_gettime(CLOCK_MONOTONIC, &stop);
+            r->time_ns += elapsed_ns(start, stop);
+            r->nb_pkt += (uint32_t)nb_rx;
+        }
+    }
+    r->nb_alloc = nb_alloc - alloc_start;
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void print_result(const char * name, double pkt_per_fetch, const char * stage, const struct result_s * r) {
+    if ((r->nb_pkt == 0) || (r->time_ns <= 0.0)) {
+        printf("%-22s %6.1f  %-12s %12s %10s %10s\n", name, pkt_per_fetch, stage, "-", "-", "-");
+        return;
+    }
+    printf("%-22s %6.1f  %-12s %12.0f %10.1f %10.3f\n", name, pkt_per_fetch, stage,
+            (double)r->nb_pkt * 1E9 / r->time_ns, r->time_ns / r->nb_pkt, (double)r->nb_alloc / r->nb_pkt);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int bench_capture(const struct capture_s * c, unsigned int nb_loop) {
+    struct result_s r;
+    uint32_t nb_pkt = 0;
+    double pkt_per_fetch;
+    int i;
+
+    for (i = 0; i < c->nb_fetch; i++) {
+        nb_pkt += c->fetch[i].nb_pkt;
+    }
+    pkt_per_fetch = (double)nb_pkt / c->nb_fetch;
+
+    /* warm-up: caches and branch predictors are not part of the measure */
+    if ((bench_pop(c, 1 + nb_loop / 10, &r) != 0) || (bench_parse(c, 1 + nb_loop / 10, &r) != 0) || (bench_receive(c, 1 + nb_loop / 10, &r) != 0)) {
+        return -1;
+    }
+
+    if (bench_pop(c, nb_loop, &r) != 0) {
+        return -1;
+    }
+    print_result(c->name, pkt_per_fetch, "pop", &r);
+    if (bench_parse(c, nb_loop, &r) != 0) {
+        return -1;
+    }
+    print_result(c->name, pkt_per_fetch, "parse", &r);
+    if (bench_receive(c, nb_loop, &r) != 0) {
+        return -1;
+    }
+    print_result(c->name, pkt_per_fetch, "lgw_receive", &r);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv) {
+    int i, x;
+    unsigned int arg_u;
+    unsigned int nb_loop = DEFAULT_NB_LOOP;
+    const char * capture_path = NULL;
+    const char * write_path = NULL;
+    bool ftime = false;
+    FILE * file;
+    int ret = EXIT_SUCCESS;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "hc:w:n:f")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'c':
+                capture_path = optarg;
+                break;
+            case 'w':
+                write_path = optarg;
+                break;
+            case 'n':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u == 0)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_loop = arg_u;
+                break;
+            case 'f':
+                ftime = true;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (write_path != NULL) {
+        file = fopen(write_path, "w");
+        if (file == NULL) {
+            printf("ERROR: failed to open %s\n", write_path);
+            return EXIT_FAILURE;
+        }
+        for (i = 0; i < (int)(sizeof synth_list / sizeof synth_list[0]); i++) {
+            capture_synth(&synth_list[i], &capture);
+            capture_write(file, &capture);
+        }
+        fclose(file);
+        printf("INFO: synthetic captures written to %s\n", write_path);
+        return EXIT_SUCCESS;
+    }
+
+    if ((capture_path != NULL) && (capture_load(capture_path, &capture) != 0)) {
+        return EXIT_FAILURE;
+    }
+
+    if (configure(ftime) != 0) {
+        return EXIT_FAILURE;
+    }
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the concentrator\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("===== RX pipeline benchmark: %u replays, fine timestamp %s =====\n", nb_loop, ftime ? "enabled" : "disabled");
+    printf("%-22s %6s  %-12s %12s %10s %10s\n", "capture", "pkt/f", "stage", "pkt/s", "ns/pkt", "alloc/pkt");
+    if (capture_path != NULL) {
+        if (bench_capture(&capture, nb_loop) != 0) {
+            ret = EXIT_FAILURE;
+        }
+    } else {
+        for (i = 0; i < (int)(sizeof synth_list / sizeof synth_list[0]); i++) {
+            capture_synth(&synth_list[i], &capture);
+            if (bench_capture(&capture, nb_loop) != 0) {
+                ret = EXIT_FAILURE;
+                break;
+            }
+        }
+    }
+
+    lgw_stop();
+
+    return ret;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -23,6 +23,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include <stdbool.h>    /* bool type */
 #include <sys/time.h>   /* gettimeofday, structtimeval */
 
+#include "loragw_hal.h"
 #include "config.h"     /* library configuration options (dynamically generated) */
 
 /* -------------------------------------------------------------------------- */
@@ -102,18 +103,18 @@ uint32_t lora_packet_time_on_air( const uint8_t bw,
                                   uint16_t * t_symbol_us);
 
 /**
-@brief Record the current time, for measure start
-@param tm Pointer to the current time value
+@brief Record the current time (monotonic clock), for measure start
+@param tm Pointer to the current time value in nanoseconds, zeroed if performance counters are disabled
 */
-void _meas_time_start(struct timeval *tm);
+void _meas_time_start(uint64_t *tm);
 
 /**
-@brief Measure the ellapsed time since given time
-@param debug_level  debug print debug level to be used
+@brief Measure the ellapsed time since given time, and account it in the call site performance counters
+@param id           call site identifier
+@param debug_level  debug print debug level to be used (DEBUG_PERF)
 @param start_time   start time of the measure to be used
-@param str          string to be used for debug print
 */
-void _meas_time_stop(int debug_level, struct timeval start_time, const char *str);
+void _meas_time_stop(lgw_perf_id_t id, int debug_level, uint64_t start_time);
 
 /**
 @brief Get the current time for later timeout check
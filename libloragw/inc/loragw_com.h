@@ -22,6 +22,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
 #include <stdint.h>   /* C99 types*/
+#include <stdbool.h>  /* bool type */
 
 #include "config.h"   /* library configuration options (dynamically generated) */
 
@@ -41,6 +42,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 typedef enum com_type_e {
     LGW_COM_SPI,
     LGW_COM_USB,
+    LGW_COM_MOCK,
     LGW_COM_UNKNOWN
 } lgw_com_type_t;
 
@@ -50,6 +52,36 @@ typedef enum com_write_mode_e {
     LGW_COM_WRITE_MODE_UNKNOWN
 } lgw_com_write_mode_t;
 
+/**
+@enum lgw_com_sub_t
+@brief HAL subsystems the bus transactions are accounted to, see lgw_com_set_subsystem()
+*/
+typedef enum com_sub_e {
+    LGW_COM_SUB_CONFIG,     /*!> configuration, calibration and anything not listed below */
+    LGW_COM_SUB_RX,         /*!> RX buffer fetch */
+    LGW_COM_SUB_TX,         /*!> TX programming, TX status, LBT */
+    LGW_COM_SUB_COUNTER,    /*!> internal counter reads */
+    LGW_COM_SUB_SCAN,       /*!> spectral scan */
+    LGW_COM_SUB_GPS,        /*!> PPS counter read for GPS synchronization */
+    LGW_COM_SUB_NB
+} lgw_com_sub_t;
+
+/**
+@struct lgw_com_stat_s
+@brief Bus transactions counters of one subsystem, see lgw_com_stat_get()
+*/
+struct lgw_com_stat_s {
+    uint32_t nb_access;     /*!> number of register/burst/command accesses */
+    uint32_t nb_error;      /*!> number of accesses which failed */
+    uint64_t data_w;        /*!> number of data bytes written */
+    uint64_t data_r;        /*!> number of data bytes read */
+    uint32_t usb_nb_req;    /*!> USB only: number of requests sent to the MCU */
+    uint32_t usb_nb_ack;    /*!> USB only: number of ACKs received from the MCU */
+    uint32_t usb_nb_flush;  /*!> USB only: number of bulk requests flushed */
+    uint64_t usb_wire_w;    /*!> USB only: number of bytes written on the wire, headers included */
+    uint64_t usb_wire_r;    /*!> USB only: number of bytes read on the wire, headers included */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
@@ -98,6 +130,11 @@ int lgw_com_set_write_mode(lgw_com_write_mode_t write_mode);
 */
 int lgw_com_flush(void);
 
+/**
+@brief Drop the write requests pending in bulk mode without sending them, and restore single write mode
+*/
+void lgw_com_discard(void);
+
 /**
  *
 */
@@ -118,6 +155,50 @@ void* lgw_com_target(void);
  **/
 lgw_com_type_t lgw_com_type(void);
 
+/**
+@brief Set the subsystem the next bus transactions of the calling thread are accounted to
+@param sub subsystem to be used
+@return the subsystem previously used, to be restored by the caller
+*/
+lgw_com_sub_t lgw_com_set_subsystem(lgw_com_sub_t sub);
+
+/**
+@brief Account bus transactions to the current subsystem of the current instance
+@param nb_access number of accesses done
+@param size_w number of data bytes written
+@param size_r number of data bytes read
+@param status status of the accesses (LGW_COM_SUCCESS or error)
+*/
+void lgw_com_stat_account(uint32_t nb_access, uint32_t size_w, uint32_t size_r, int status);
+
+/**
+@brief Account USB MCU requests/ACKs to the current subsystem of the current instance
+@param nb_req number of requests sent
+@param nb_ack number of ACKs received
+@param nb_flush number of bulk flushes
+@param size_w number of bytes written on the wire
+@param size_r number of bytes read on the wire
+*/
+void lgw_com_stat_account_usb(uint32_t nb_req, uint32_t nb_ack, uint32_t nb_flush, uint32_t size_w, uint32_t size_r);
+
+/**
+@brief Get a snapshot of the bus transactions counters of the current instance
+@param stat an array of LGW_COM_SUB_NB elements, indexed by lgw_com_sub_t
+@param reset set counters back to zero once read
+@return LGW_COM_SUCCESS if no error, LGW_COM_ERROR otherwise
+
+The transport the counters relate to is given by lgw_com_type(). Both the
+SX1302 and the SX1261 accesses are counted.
+*/
+int lgw_com_stat_get(struct lgw_com_stat_s stat[LGW_COM_SUB_NB], bool reset);
+
+/**
+@brief Get the name of a subsystem, as used in logs and reports
+@param sub subsystem
+@return pointer on a null terminated string ("" if the subsystem is invalid)
+*/
+const char * lgw_com_subsystem_name(lgw_com_sub_t sub);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
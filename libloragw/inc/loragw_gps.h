@@ -32,6 +32,19 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
+#define LGW_GPS_FIT_SIZE          (32)  /* max number of PPS samples the time model is fitted on */
+#define LGW_GPS_FIT_SPAN          (64)  /* PPS samples older than that many seconds are not fitted */
+
+/**
+@struct lgw_gps_sample_s
+@brief PPS sample the time model of a time reference is fitted on
+*/
+struct lgw_gps_sample_s {
+    uint32_t        count_us;   /*!> concentrator internal timestamp of the PPS */
+    struct timespec utc;        /*!> UTC time of the PPS */
+    struct timespec gps;        /*!> GPS time of the PPS */
+};
+
 /**
 @struct coord_s
 @brief Time solution required for timestamp to absolute time conversion
@@ -42,6 +55,12 @@ struct tref {
     struct timespec utc;        /*!> reference UTC time (from GPS/NMEA) */
     struct timespec gps;        /*!> reference GPS time (since 01.Jan.1980) */
     double          xtal_err;   /*!> raw clock error (eg. <1 'slow' XTAL) */
+    uint8_t         nb_sync;    /*!> number of PPS samples the time model is fitted on */
+    double          xtal_err_sd;/*!> standard deviation of the clock error estimate */
+    double          jitter_us;  /*!> RMS deviation of the PPS samples from the time model, in us */
+    uint8_t         fit_nb;     /*!> number of PPS samples held in fit[] */
+    uint8_t         fit_head;   /*!> index of the next PPS sample in fit[] */
+    struct lgw_gps_sample_s fit[LGW_GPS_FIT_SIZE]; /*!> latest PPS samples, see lgw_gps_sync */
 };
 
 /**
@@ -92,6 +111,32 @@ enum gps_msg {
 #define LGW_GPS_UBX_SYNC_CHAR     (0xB5)
 #define LGW_GPS_NMEA_SYNC_CHAR    (0x24)
 
+#define LGW_GPS_READ_VMIN         (1)   /* read() returns as soon as chars are received ... */
+#define LGW_GPS_READ_VTIME        (0)   /* ... with no inter-char timer, frames are completed by the parser */
+#define LGW_GPS_READ_SIZE         (256) /* recommended read() size for lgw_gps_parse_stream() */
+
+#define LGW_GPS_NMEA_MAX_SIZE     (100) /* 82 chars max per NMEA 0183, with some margin */
+#define LGW_GPS_UBX_MAX_SIZE      (1024) /* longest UBX payload accepted before resync */
+#define LGW_GPS_NB_FIELDS         (6)   /* max number of NMEA fields stored per sentence */
+#define LGW_GPS_FIELD_SIZE        (16)  /* max length of a stored NMEA field (incl. null char) */
+
+/**
+@struct lgw_gps_parser_s
+@brief State of the incremental NMEA/UBX stream parser (see lgw_gps_parse_stream)
+*/
+struct lgw_gps_parser_s {
+    uint8_t     state;          /*!> framing state */
+    uint8_t     msg;            /*!> type of the NMEA sentence being received */
+    uint16_t    size;           /*!> NMEA sentence length so far, or UBX payload length */
+    uint16_t    field_idx;      /*!> index of the current NMEA field */
+    uint16_t    char_idx;       /*!> index in the current NMEA field or UBX payload */
+    uint8_t     ck_a;           /*!> NMEA XOR checksum, or UBX Fletcher checksum A */
+    uint8_t     ck_b;           /*!> received NMEA checksum, or UBX Fletcher checksum B */
+    char        addr[5];        /*!> NMEA address field (eg. GPRMC), or UBX class and ID */
+    char        field[LGW_GPS_NB_FIELDS][LGW_GPS_FIELD_SIZE]; /*!> NMEA fields of interest */
+    uint8_t     payload[16];    /*!> UBX NAV-TIMEGPS payload */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
@@ -128,6 +173,33 @@ lock must be acquired before calling either function.
 */
 enum gps_msg lgw_parse_nmea(const char* serial_buff, int buff_size);
 
+/**
+@brief Reset the state of an incremental GPS stream parser
+
+@param parser pointer to the parser state to be reset
+*/
+void lgw_gps_parser_init(struct lgw_gps_parser_s *parser);
+
+/**
+@brief Parse raw bytes coming from the GPS serial port, NMEA and UBX mixed
+
+@param parser pointer to a parser state, initialized with lgw_gps_parser_init
+@param buff pointer to the bytes read from the serial port
+@param buff_size number of bytes available in buff
+@param nb_read number of bytes consumed from buff
+@return type of the frame completed, or INCOMPLETE if all bytes were consumed
+
+Frames can be split across any number of calls: checksums are computed and the
+fields of interest (RMC, GGA, NAV-TIMEGPS) are extracted as the bytes arrive,
+and a frame completes as soon as its last checksum byte is received.
+The function returns after each completed frame, so that the caller can react
+to it (eg. sample the PPS counter on UBX_NAV_TIMEGPS) before calling it again
+on the remaining buff_size - nb_read bytes.
+The global set of variables shared with lgw_gps_get is only updated by frames
+with a valid checksum, the same mutex rules as lgw_parse_nmea apply.
+*/
+enum gps_msg lgw_gps_parse_stream(struct lgw_gps_parser_s *parser, const uint8_t *buff, size_t buff_size, size_t *nb_read);
+
 /**
 @brief Parse Ublox proprietary messages coming from the GPS system
 
@@ -170,9 +242,27 @@ int lgw_gps_get(struct timespec *utc, struct timespec *gps_time, struct coord_s
 @return success if timestamp was read and time reference could be refreshed
 
 Set systime to 0 in ref to trigger initial synchronization.
+
+The time reference is a least-squares fit of the last LGW_GPS_FIT_SIZE PPS
+samples (at most LGW_GPS_FIT_SPAN seconds old), held in ref: xtal_err is the fitted clock
+error, and the reference times are those of the fitted line at count_us. A
+sample too far from the prediction of the current reference is rejected, 3
+successive rejections resetting the synchronization.
 */
 int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struct timespec gps_time);
 
+/**
+@brief Estimate the error of the conversions made with a time reference
+@param ref time reference structure
+@param age_s time elapsed since the last synchronization of the reference, in seconds
+@return expected error of the conversions (1 sigma), in microseconds
+
+The error grows with the age of the reference, due to the uncertainty of the
+fitted clock error and to the XTAL frequency wander. It tells how long a
+reference can be used in holdover, once GPS synchronization is lost.
+*/
+double lgw_gps_holdover_us(struct tref ref, double age_s);
+
 /**
 @brief Convert concentrator timestamp counter value to UTC time
 
@@ -184,6 +274,8 @@ int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struc
 This function is typically used when a packet is received to transform the
 internal counter-based timestamp in an absolute timestamp with an accuracy in
 the order of a couple microseconds (ns resolution).
+count_us can be before or after the reference counter value, by up to half the
+counter period (about 35 minutes).
 */
 int lgw_cnt2utc(struct tref ref, uint32_t count_us, struct timespec* utc);
 
@@ -212,6 +304,8 @@ int lgw_utc2cnt(struct tref ref,struct timespec utc, uint32_t* count_us);
 This function is typically used when a packet is received to transform the
 internal counter-based timestamp in an absolute timestamp with an accuracy in
 the order of a millisecond.
+count_us can be before or after the reference counter value, by up to half the
+counter period (about 35 minutes).
 */
 int lgw_cnt2gps(struct tref ref, uint32_t count_us, struct timespec* gps_time);
 
@@ -57,6 +57,18 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define LGW_MULTI_NB        8       /* number of LoRa 'multi SF' chains */
 #define LGW_MULTI_SF_EN     0xFF    /* bitmask to enable/disable SF for multi-sf correlators  (12 11 10 9 8 7 6 5) */
 
+/* received packets */
+#define LGW_PKT_PAYLOAD_MAX 255     /* maximum size of a received payload */
+#define LGW_RX_PAYLOAD_ARENA_SIZE(nb_pkt)   ((uint32_t)(nb_pkt) * LGW_PKT_PAYLOAD_MAX) /* payload arena size needed by lgw_receive_compact */
+
+/* performance counters */
+#define LGW_PERF_HIST_NB    20      /* number of log2 latency histogram buckets (last one is >= 2^18 us) */
+
+/* prepared TX requests */
+#define LGW_TX_PREP_OP_NB       64      /* maximum number of register operations of a prepared TX request */
+#define LGW_TX_PREP_DATA_SIZE   320     /* burst data of a prepared TX request (payload, multi-byte registers) */
+#define LGW_TX_STAGE_ADVANCE_MIN 2000   /* min time left (us) before a staged timestamped request to commit it */
+
 /* values available for the 'modulation' parameters */
 /* NOTE: arbitrary values */
 #define MOD_UNDEFINED   0
@@ -242,6 +254,37 @@ struct lgw_pkt_rx_s {
     uint32_t    ftime;          /*!> packet fine timestamp (nanoseconds since last PPS) */
 };
 
+/**
+@struct lgw_pkt_rx_meta_s
+@brief Metadata of a packet that was received, payload stored in a separate arena (see lgw_receive_compact)
+
+Fields are ordered by size to avoid padding (56 bytes), so that an array of
+metadata can be scanned without touching the payloads.
+*/
+struct lgw_pkt_rx_meta_s {
+    uint32_t    count_us;       /*!> internal concentrator counter for timestamping, 1 microsecond resolution */
+    uint32_t    freq_hz;        /*!> central frequency of the IF chain */
+    int32_t     freq_offset;
+    uint32_t    datarate;       /*!> RX datarate of the packet (SF for LoRa) */
+    uint32_t    ftime;          /*!> packet fine timestamp (nanoseconds since last PPS) */
+    float       rssic;          /*!> average RSSI of the channel in dB */
+    float       rssis;          /*!> average RSSI of the signal in dB */
+    float       snr;            /*!> average packet SNR, in dB (LoRa only) */
+    float       snr_min;        /*!> minimum packet SNR, in dB (LoRa only) */
+    float       snr_max;        /*!> maximum packet SNR, in dB (LoRa only) */
+    uint16_t    payload_offset; /*!> offset of the payload in the payload arena */
+    uint16_t    crc;            /*!> CRC that was received in the payload */
+    uint16_t    size;           /*!> payload size in bytes */
+    uint8_t     if_chain;       /*!> by which IF chain was packet received */
+    uint8_t     status;         /*!> status of the received packet */
+    uint8_t     rf_chain;       /*!> through which RF chain the packet was received */
+    uint8_t     modem_id;
+    uint8_t     modulation;     /*!> modulation used by the packet */
+    uint8_t     bandwidth;      /*!> modulation bandwidth (LoRa only) */
+    uint8_t     coderate;       /*!> error-correcting code of the packet (LoRa only) */
+    bool        ftime_received; /*!> a fine timestamp has been received */
+};
+
 /**
 @struct lgw_pkt_tx_s
 @brief Structure containing the configuration of a packet to send and a pointer to the payload
@@ -266,6 +309,38 @@ struct lgw_pkt_tx_s {
     uint8_t     payload[256];   /*!> buffer containing the payload */
 };
 
+/**
+@struct lgw_tx_op_s
+@brief Register operation of a prepared TX request (see lgw_send_prepare)
+*/
+struct lgw_tx_op_s {
+    uint16_t    addr;           /*!> SX1302 register or memory address */
+    uint8_t     type;           /*!> direct write, read-modify-write, register or memory burst write */
+    uint8_t     mask;           /*!> bits written by a read-modify-write */
+    uint16_t    value;          /*!> byte to be written, or offset of a burst in the data buffer */
+    uint16_t    size;           /*!> size of a burst, in bytes */
+};
+
+/**
+@struct lgw_tx_prep_s
+@brief TX request prepared by lgw_send_prepare, to be sent by lgw_send_commit
+*/
+struct lgw_tx_prep_s {
+    struct lgw_pkt_tx_s pkt;    /*!> packet, as checked and completed (eg. default preamble) */
+    uint16_t    nb_op;          /*!> number of register operations */
+    uint16_t    data_size;      /*!> number of bytes used in the data buffer */
+    struct lgw_tx_op_s op[LGW_TX_PREP_OP_NB];   /*!> register operations, in write order */
+    uint8_t     data[LGW_TX_PREP_DATA_SIZE];    /*!> data of the burst operations */
+};
+
+/**
+@brief Callback of the TX status transitions, see lgw_tx_event_setcb
+@param rf_chain RF chain of the transition
+@param status new TX status (TX_FREE, TX_SCHEDULED, TX_EMITTING)
+@param arg argument given to lgw_tx_event_setcb
+*/
+typedef void (*lgw_tx_event_cb_t)(uint8_t rf_chain, uint8_t status, void * arg);
+
 /**
 @struct lgw_tx_gain_s
 @brief Structure containing all gains of Tx chain
@@ -400,9 +475,90 @@ typedef enum lgw_spectral_scan_status_e {
     LGW_SPECTRAL_SCAN_STATUS_UNKNOWN
 } lgw_spectral_scan_status_t;
 
+/**
+@enum lgw_perf_id_t
+@brief Instrumented call sites, see lgw_perf_get()
+*/
+typedef enum lgw_perf_id_e {
+    LGW_PERF_RECEIVE,                   /* lgw_receive */
+    LGW_PERF_RECEIVE_COMPACT,           /* lgw_receive_compact */
+    LGW_PERF_SEND,                      /* lgw_send, lgw_send_commit */
+    LGW_PERF_SEND_PREPARE,              /* lgw_send_prepare */
+    LGW_PERF_SX1302_UPDATE,             /* timestamp counter update */
+    LGW_PERF_SX1302_FETCH,              /* RX buffer fetch */
+    LGW_PERF_SX1302_PARSE,              /* RX packet parsing */
+    LGW_PERF_SX1302_SEND,               /* TX packet programming */
+    LGW_PERF_COM_W,                     /* SX1302 register write */
+    LGW_PERF_COM_R,                     /* SX1302 register read */
+    LGW_PERF_COM_RMW,                   /* SX1302 register read-modify-write */
+    LGW_PERF_COM_WB,                    /* SX1302 burst write */
+    LGW_PERF_COM_RB,                    /* SX1302 burst read */
+    LGW_PERF_MCU_WRITE_REQ,             /* USB: request to the MCU */
+    LGW_PERF_MCU_READ_ACK_HDR,          /* USB: MCU acknowledge header */
+    LGW_PERF_MCU_READ_ACK_PAYLOAD,      /* USB: MCU acknowledge payload */
+    LGW_PERF_LBT_START,
+    LGW_PERF_LBT_TX_STATUS,
+    LGW_PERF_LBT_STOP,
+    LGW_PERF_SX1261_SET_RX_PARAMS,
+    LGW_PERF_SX1261_LBT_START,
+    LGW_PERF_SX1261_LBT_STOP,
+    LGW_PERF_SX1261_SCAN_START,
+    LGW_PERF_SX1261_SCAN_RESULTS,
+    LGW_PERF_SX1261_SCAN_STATUS,
+    LGW_PERF_SX1261_SCAN_ABORT,
+    LGW_PERF_NB                         /* number of call sites, not a call site */
+} lgw_perf_id_t;
+
+/**
+@struct lgw_perf_s
+@brief Latency statistics of a call site
+*/
+struct lgw_perf_s {
+    uint32_t    count;                      /*!> number of calls measured */
+    uint64_t    total_us;                   /*!> cumulated duration of the calls, in microseconds */
+    uint32_t    max_us;                     /*!> longest call, in microseconds */
+    uint32_t    hist[LGW_PERF_HIST_NB];     /*!> log2 histogram: [0] < 1us, [k] in [2^(k-1), 2^k[ us, last bucket is open */
+};
+
+/**
+@struct lgw_handle_t
+@brief Opaque handle on a concentrator instance (configuration, com interface, RX buffer, counters...)
+*/
+typedef struct lgw_handle_s lgw_handle_t;
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
+/**
+@brief Allocate a new concentrator instance, initialized with the default configuration
+@return a pointer on the new instance, NULL if the allocation failed
+*/
+lgw_handle_t * lgw_handle_new(void);
+
+/**
+@brief Free a concentrator instance previously allocated with lgw_handle_new
+@param handle instance to be freed, must be stopped and not be the default instance
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_handle_delete(lgw_handle_t * handle);
+
+/**
+@brief Select the concentrator instance used by all the lgw_* functions called from the calling thread
+@param handle instance to be used, NULL to select the default instance
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+Each thread starts with the default instance selected, so that single
+concentrator applications do not need to care about handles.
+An instance must not be used by several threads at the same time without locking.
+*/
+int lgw_handle_select(lgw_handle_t * handle);
+
+/**
+@brief Get the concentrator instance currently selected by the calling thread
+@return a pointer on the selected instance
+*/
+lgw_handle_t * lgw_handle_get(void);
+
 /**
 @brief Configure the gateway board
 @param conf structure containing the configuration parameters
@@ -437,9 +593,21 @@ int lgw_demod_setconf(struct lgw_conf_demod_s * conf);
 @brief Configure the Tx gain LUT
 @param conf pointer to structure defining the LUT
 @return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+The LUT entry and the register values to be used for each RF power between
+-10 and 30 dBm are precomputed, so that no LUT search is done when sending.
 */
 int lgw_txgain_setconf(uint8_t rf_chain, struct lgw_tx_gain_lut_s * conf);
 
+/**
+@brief Get the RF power of the Tx gain LUT entry used for a requested RF power
+@param rf_chain RF chain of the Tx gain LUT
+@param rf_power requested RF power, in dBm
+@param rf_power_used pointer to receive the RF power actually used, in dBm
+@return LGW_HAL_ERROR id the operation failed or no LUT entry has a lower or equal power (the lowest index is then used), LGW_HAL_SUCCESS else
+*/
+int lgw_txgain_getpower(uint8_t rf_chain, int8_t rf_power, int8_t * rf_power_used);
+
 /**
 @brief Configure the fine timestamping
 @param conf pointer to structure defining the config to be applied
@@ -481,6 +649,29 @@ int lgw_stop(void);
 */
 int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s * pkt_data);
 
+/**
+@brief Same as lgw_receive, but packets metadata and payloads are returned in separate buffers
+@param max_pkt maximum number of packet that must be retrieved (equal to the size of the array of metadata)
+@param meta pointer to an array of struct that will receive the packets metadata
+@param payload pointer to the arena that will receive the payloads, back to back (see meta[].payload_offset)
+@param payload_size size of the payload arena, at least LGW_RX_PAYLOAD_ARENA_SIZE(max_pkt)
+@return LGW_HAL_ERROR id the operation failed, else the number of packets retrieved
+*/
+int lgw_receive_compact(uint8_t max_pkt, struct lgw_pkt_rx_meta_s * meta, uint8_t * payload, uint32_t payload_size);
+
+/**
+@brief Remove the duplicated packets from an array of received packets, and sort it by ascending timestamp
+@param pkt_data array of received packets, updated in place
+@param nb_pkt pointer to the number of packets in the array, updated with the number of packets kept
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+Packets received within 24us on the same channel, with same datarate and payload
+are duplicates (double demodulation when fine timestamping is enabled): the one
+with a valid CRC, then with a fine timestamp, is kept.
+Called by lgw_receive() when fine timestamping is enabled.
+*/
+int lgw_merge_packets(struct lgw_pkt_rx_s * pkt_data, uint8_t * nb_pkt);
+
 /**
 @brief Schedule a packet to be send immediately or after a delay depending on tx_mode
 @param pkt_data structure containing the data and metadata for the packet to send
@@ -507,6 +698,101 @@ the protocol.
 */
 int lgw_send(struct lgw_pkt_tx_s * pkt_data);
 
+/**
+@brief Check a packet and precompute all the register writes needed to send it
+@param pkt_data structure containing the data and metadata for the packet to send
+@param prep structure to receive the prepared TX request
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+No bus access is done: the TX gain LUT lookup, the frequency and modem
+registers, the TX start delay, the trigger time and the payload are encoded in
+a list of register operations, merged per register address and in bursts of
+consecutive addresses, so that it can be done when the packet is queued,
+outside of the concentrator lock and ahead of the TX deadline.
+The request must be committed on the same instance, before any change of its
+TX configuration (eg. TX gain LUT).
+*/
+int lgw_send_prepare(struct lgw_pkt_tx_s * pkt_data, struct lgw_tx_prep_s * prep);
+
+/**
+@brief Send a TX request prepared by lgw_send_prepare
+@param prep prepared TX request
+@return LGW_HAL_ERROR id the operation failed, LGW_LBT_NOT_ALLOWED if LBT prevented the TX, LGW_HAL_SUCCESS else
+
+The register operations are flushed in a single USB bulk request, or in as
+few SPI transactions as possible. Listen-Before-Talk is handled as for lgw_send.
+lgw_send(pkt) is equivalent to lgw_send_prepare(pkt, &prep) followed by
+lgw_send_commit(&prep).
+*/
+int lgw_send_commit(struct lgw_tx_prep_s * prep);
+
+/**
+@brief Pre-arm Listen-Before-Talk for a prepared TX request
+@param prep TX request prepared by lgw_send_prepare
+@return LGW_HAL_ERROR id the operation failed (eg. not a LBT channel), LGW_HAL_SUCCESS else
+
+Tunes the SX1261 on the LBT channel of the request, so that lgw_send_commit
+(or lgw_tx_dispatch for a staged request) only has to start the scan. It is
+typically called while the previous packet is emitted. The SX1261 keeps its
+RX parameters between two LBT, so nothing is written if the channel is the
+same as the previous TX. Does nothing if LBT is disabled.
+*/
+int lgw_send_arm(const struct lgw_tx_prep_s * prep);
+
+/**
+@brief Stage a prepared TX request, to be committed as soon as the RF chain is free
+@param prep TX request prepared by lgw_send_prepare
+@return LGW_HAL_ERROR id the operation failed (eg. a request is already staged), LGW_HAL_SUCCESS else
+
+One request can be staged per RF chain, typically while the previous one is
+scheduled or emitting. No bus access is done: the request is committed by the
+first call to lgw_tx_dispatch which finds the RF chain free, so that
+back-to-back downlinks are only separated by the polling period and the commit
+time. A staged timestamped request with less than LGW_TX_STAGE_ADVANCE_MIN
+left before its timestamp is dropped by lgw_tx_dispatch: the end of the
+previous emission must leave that much time, plus the polling period.
+*/
+int lgw_send_stage(struct lgw_tx_prep_s * prep);
+
+/**
+@brief Commit the staged TX request of a RF chain if its previous emission is over
+@param rf_chain RF chain to be checked
+@param code pointer to receive the TX status (as lgw_status), after the commit if any
+@param staged pointer to receive if a request is still staged (can be NULL)
+@return LGW_HAL_ERROR id the operation failed or the staged request was dropped, LGW_LBT_NOT_ALLOWED if LBT prevented the TX, LGW_HAL_SUCCESS else
+
+The returned value is the one of the commit, if the staged request has been
+committed (or dropped) by this call.
+*/
+int lgw_tx_dispatch(uint8_t rf_chain, uint8_t * code, bool * staged);
+
+/**
+@brief Register a callback for the TX status transitions of the selected instance
+@param cb function to be called on each transition, NULL to disable
+@param arg argument given to the callback
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+The callback is called from the HAL function which detects the transition
+(lgw_send, lgw_send_commit, lgw_tx_dispatch, lgw_tx_track, lgw_status,
+lgw_abort_tx), in the calling thread. It must not call the HAL.
+*/
+int lgw_tx_event_setcb(lgw_tx_event_cb_t cb, void * arg);
+
+/**
+@brief Update the TX status tracker, and get the TX status of all RF chains
+@param status array to receive the TX status of each RF chain (can be NULL)
+@param next_us pointer to receive the time until the next status read, in us (UINT32_MAX if none, can be NULL)
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+The TX status is only read from the SX1302 when a transition is expected:
+at the predicted start of the emission (known for immediate and timestamped
+requests), then at its predicted end (from the time on air), with retries
+until the transition is seen. The retry period is a fraction of the time on
+air (1 to 10 ms), the prediction error growing with the emission duration. Otherwise the known status is returned
+without any bus access, so it can be called as often as needed.
+*/
+int lgw_tx_track(uint8_t status[LGW_RF_CHAIN_NB], uint32_t * next_us);
+
 /**
 @brief Give the the status of different part of the LoRa concentrator
 @param select is used to select what status we want to know
@@ -516,7 +802,7 @@ int lgw_send(struct lgw_pkt_tx_s * pkt_data);
 int lgw_status(uint8_t rf_chain, uint8_t select, uint8_t * code);
 
 /**
-@brief Abort a currently scheduled or ongoing TX
+@brief Abort a currently scheduled or ongoing TX, and drop the staged TX request if any
 @return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
 */
 int lgw_abort_tx(uint8_t rf_chain);
@@ -591,6 +877,51 @@ int lgw_spectral_scan_get_results(int16_t levels_dbm[static LGW_SPECTRAL_SCAN_RE
 */
 int lgw_spectral_scan_abort();
 
+/**
+@brief Enable or disable the performance counters (enabled by default)
+@param enable true to measure the call sites latency, false to stop measuring
+*/
+void lgw_perf_enable(bool enable);
+
+/**
+@brief Get the latency statistics of all the instrumented call sites
+@param perf an array of LGW_PERF_NB elements, indexed by lgw_perf_id_t
+@param reset true to reset the statistics once read
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+The statistics are shared by all the concentrator instances of the process.
+They are updated without lock, a snapshot taken during calls may be off by
+the calls in progress.
+*/
+int lgw_perf_get(struct lgw_perf_s perf[LGW_PERF_NB], bool reset);
+
+/**
+@brief Get the name of an instrumented call site
+@param id call site identifier
+@return pointer on a null terminated string ("" if the identifier is invalid)
+*/
+const char * lgw_perf_name(lgw_perf_id_t id);
+
+/**
+@brief Get the bus transactions counters of the concentrator instance, per subsystem
+@param com_type pointer to return the transport the counters relate to (SPI/USB)
+@param stat an array of LGW_COM_SUB_NB elements, indexed by lgw_com_sub_t
+@param reset true to reset the counters once read
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+Both the SX1302 and SX1261 accesses are counted. The USB fields count the
+requests/ACKs exchanged with the MCU and the bytes on the wire, headers
+included; they stay at zero on SPI.
+*/
+int lgw_bus_stat_get(lgw_com_type_t * com_type, struct lgw_com_stat_s stat[LGW_COM_SUB_NB], bool reset);
+
+/**
+@brief Get the name of a bus transactions subsystem
+@param sub subsystem identifier
+@return pointer on a null terminated string ("" if the identifier is invalid)
+*/
+const char * lgw_bus_subsystem_name(lgw_com_sub_t sub);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
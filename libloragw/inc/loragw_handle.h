@@ -0,0 +1,111 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    LoRa concentrator instance handle.
+    Holds all the state needed to drive one concentrator (HAL configuration,
+    communication interface, RX buffer, timestamp counter...), so that several
+    concentrators can be driven from the same process.
+    Internal to libloragw, applications only see the opaque lgw_handle_t type.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_HANDLE_H
+#define _LORAGW_HANDLE_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types*/
+#include <stdbool.h>    /* boolean type */
+#include <stdio.h>      /* FILE */
+
+#include "loragw_hal.h"
+#include "loragw_com.h"
+#include "loragw_mcu.h"
+#include "loragw_sx1261.h"
+#include "loragw_sx1302.h"
+#include "loragw_sx1302_rx.h"
+#include "loragw_sx1302_timestamp.h"
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_tx_track_s
+@brief TX status of one RF chain, as last read or predicted from the TX requests sent
+*/
+struct lgw_tx_track_s {
+    uint8_t     status;     /*!> last known TX status (TX_FREE, TX_SCHEDULED, TX_EMITTING...) */
+    bool        check;      /*!> the status has to be read at check_us */
+    uint64_t    check_us;   /*!> host time of the next status read, in us */
+    uint64_t    end_us;     /*!> predicted end of the emission, host time in us */
+    uint32_t    toa_us;     /*!> time on air of the emission, in us */
+    uint32_t    retry_us;   /*!> delay between 2 reads while a transition is late */
+};
+
+/**
+@struct lgw_handle_s
+@brief State of one concentrator instance
+*/
+struct lgw_handle_s {
+    /* HAL (loragw_hal.c) */
+    lgw_context_t           context;                            /*!> gateway configuration provided by the user */
+    FILE *                  log_file;                           /*!> file handle to write debug logs */
+    int                     ts_fd;                              /*!> I2C temperature sensor file descriptor */
+    uint8_t                 ts_addr;                            /*!> I2C temperature sensor address */
+    int                     ad_fd;                              /*!> I2C AD5338R file descriptor */
+    struct lgw_tx_prep_s    tx_staged[LGW_RF_CHAIN_NB];         /*!> TX request to be committed at the end of the current emission */
+    bool                    tx_staged_valid[LGW_RF_CHAIN_NB];   /*!> a TX request is staged on the RF chain */
+    struct sx1302_tx_power_s tx_power[LGW_RF_CHAIN_NB][TX_POWER_TABLE_SIZE]; /*!> TX gain LUT entry per requested RF power */
+    bool                    tx_power_valid[LGW_RF_CHAIN_NB];    /*!> TX power table built for the current radio and LUT */
+    struct lgw_tx_track_s   tx_track[LGW_RF_CHAIN_NB];          /*!> TX status tracker */
+    lgw_tx_event_cb_t       tx_event_cb;                        /*!> TX status transitions callback */
+    void *                  tx_event_arg;                       /*!> TX status transitions callback argument */
+    uint32_t                cnt_ref_us;                         /*!> counter value at the last instantaneous counter read */
+    uint64_t                cnt_ref_host;                       /*!> host time of the last instantaneous counter read, in us (0 if none) */
+    /* SX1302 communication (loragw_com.c, loragw_usb.c, loragw_mcu.c) */
+    lgw_com_type_t          com_type;                           /*!> communication type in use (SPI, USB) */
+    void *                  com_target;                         /*!> generic pointer to the COM device (file descriptor) */
+    lgw_com_write_mode_t    usb_write_mode;                     /*!> USB write mode (single or bulk) */
+    uint8_t                 usb_spi_req_nb;                     /*!> USB SPI request ID */
+    uint8_t                 mcu_buf_hdr[CMD_OFFSET__DATA];      /*!> last MCU ACK header received */
+    spi_req_bulk_t          mcu_bulk_buffer;                    /*!> MCU SPI requests waiting for bulk flush */
+    struct lgw_com_stat_s   com_stat[LGW_COM_SUB_NB];           /*!> bus transactions counters, SX1302 and SX1261 */
+    /* SX1261 communication (sx1261_com.c, sx1261_usb.c) */
+    lgw_com_type_t          sx1261_com_type;                    /*!> communication type in use (SPI, USB) */
+    void *                  sx1261_com_target;                  /*!> generic pointer to the COM device (file descriptor) */
+    lgw_com_write_mode_t    sx1261_write_mode;                  /*!> USB write mode (single or bulk) */
+    uint8_t                 sx1261_spi_req_nb;                  /*!> USB SPI request ID */
+    /* SX1261 (loragw_sx1261.c, loragw_lbt.c) */
+    sx1261_rx_state_t       sx1261_rx_state;                    /*!> validity of the RX parameters below */
+    uint32_t                sx1261_rx_freq_hz;                  /*!> frequency set by sx1261_set_rx_params */
+    uint8_t                 sx1261_rx_bw;                       /*!> bandwidth set by sx1261_set_rx_params */
+    /* SX1302 (loragw_sx1302.c, loragw_sx1302_timestamp.c, loragw_cal.c) */
+    rx_buffer_t             rx_buffer;                          /*!> buffer to hold RX data */
+    timestamp_counter_t     counter_us;                         /*!> internal timestamp counter */
+    struct timestamp_pps_history_s pps_history;                 /*!> history of the last PPS timestamps */
+    int8_t                  rf_rx_image_amp[LGW_RF_CHAIN_NB];   /*!> Rx IQ mismatch amplitude correction from calibration */
+    int8_t                  rf_rx_image_phi[LGW_RF_CHAIN_NB];   /*!> Rx IQ mismatch phase correction from calibration */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC VARIABLES ----------------------------------------------------- */
+
+/**
+@brief Instance used by the calling thread, see lgw_handle_select()
+*/
+extern __thread struct lgw_handle_s * lgw_inst;
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
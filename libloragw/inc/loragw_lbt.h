@@ -38,13 +38,26 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
+/**
+@brief Check the LBT channel of a packet and tune the SX1261 on it, without starting the scan
+@param sx1261_context the sx1261 radio parameters to take into account for scanning
+@param pkt description of the packet to be transmitted
+@return index of the LBT channel for success, -1 for failure
+
+The SX1261 is not accessed if it is already tuned on that channel, so this can
+be called ahead of time (eg. while the previous packet is emitted) to keep the
+retuning out of lgw_lbt_start().
+*/
+int lgw_lbt_tune(const struct lgw_conf_sx1261_s * sx1261_context, const struct lgw_pkt_tx_s * pkt);
+
 /**
 @brief Configure the SX1261 and start LBT channel scanning
 @param sx1261_context the sx1261 radio parameters to take into account for scanning
 @param pkt description of the packet to be transmitted
+@param tx_delay_us time until the TX is triggered, the rest of the scan time is waited for if shorter
 @return 0 for success, -1 for failure
 */
-int lgw_lbt_start(const struct lgw_conf_sx1261_s * sx1261_context, const struct lgw_pkt_tx_s * pkt);
+int lgw_lbt_start(const struct lgw_conf_sx1261_s * sx1261_context, const struct lgw_pkt_tx_s * pkt, uint32_t tx_delay_us);
 
 /**
 @brief Stop LBT scanning
@@ -38,6 +38,16 @@ static const char mcu_version_string[] = "01.00.00";
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
+/**
+@struct spi_req_bulk_s
+@brief SPI requests stored until the next bulk flush to the MCU
+*/
+typedef struct spi_req_bulk_s {
+    uint16_t size;
+    uint8_t nb_req;
+    uint8_t buffer[LGW_USB_BURST_CHUNK];
+} spi_req_bulk_t;
+
 typedef enum order_id_e
 {
     ORDER_ID__REQ_PING            = 0x00,
@@ -190,6 +200,11 @@ int mcu_spi_store(uint8_t * in_out_buf, size_t buf_size);
 */
 int mcu_spi_flush(int fd);
 
+/**
+@brief Drop the SPI requests stored since the last bulk flush, without sending them to the MCU
+*/
+void mcu_spi_discard(void);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,306 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Software model of the SX1302 and its SX1250 radios, used as a
+    communication interface to run the HAL without hardware.
+    Single-byte read/write and burst read/write, RX packets injection and
+    TX packets capture, SX1261 Listen-Before-Talk.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_MOCK_H
+#define _LORAGW_MOCK_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types*/
+#include <stdbool.h>    /* bool type */
+
+#include "sx1250_defs.h"
+#include "sx1261_defs.h"
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_MOCK_SUCCESS    0
+#define LGW_MOCK_ERROR      -1
+
+#define LGW_MOCK_PATH_NONE  "none"  /* com_path to be used when no RX trace file is replayed */
+
+#define LGW_MOCK_TX_SIZE_MAX    256 /* size of the TX buffer of one RF chain */
+#define LGW_MOCK_TS_METRICS_MAX 127 /* fine timestamp metrics pairs stored with a packet */
+
+#define LGW_MOCK_WARP_MAX_US    (1U << 31)  /* largest time warp, so that pending RX and TX events are not skipped */
+
+#define LGW_MOCK_TRIG_IMMEDIATE 0
+#define LGW_MOCK_TRIG_DELAYED   1
+#define LGW_MOCK_TRIG_GPS       2
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_mock_rx_s
+@brief Packet to be pushed in the RX buffer of the model, see lgw_mock_rx_inject()
+*/
+struct lgw_mock_rx_s {
+    uint32_t    time_us;    /*!> SX1302 timestamp of the packet, in microseconds since the device has been opened (before HAL correction) */
+    uint8_t     if_chain;   /*!> IF chain on which the packet is received (8: LoRa service, 9: FSK) */
+    uint8_t     datarate;   /*!> LoRa spreading factor (ignored on the FSK channel) */
+    uint8_t     coderate;   /*!> LoRa coding rate, 1 (4/5) to 4 (4/8) */
+    bool        crc_en;     /*!> payload CRC is present */
+    bool        crc_error;  /*!> payload CRC is present and wrong */
+    float       snr;        /*!> average SNR, in dB (0.25 dB resolution) */
+    uint8_t     rssi;       /*!> channel and signal RSSI, raw value before HAL offset correction */
+    uint16_t    size;       /*!> payload size, in bytes */
+    uint8_t     payload[256]; /*!> payload */
+    uint8_t     nb_ts_metrics; /*!> number of fine timestamp metrics pairs stored after the packet */
+};
+
+/**
+@struct lgw_mock_tx_s
+@brief Packet emitted by the model, see lgw_mock_tx_get()
+*/
+struct lgw_mock_tx_s {
+    uint8_t     rf_chain;   /*!> RF chain used for emission */
+    uint8_t     trig;       /*!> trigger used: LGW_MOCK_TRIG_IMMEDIATE/DELAYED/GPS */
+    uint32_t    count_us;   /*!> internal counter value at the start of the emission */
+    uint16_t    size;       /*!> number of bytes written in the TX buffer (FSK: payload size byte included) */
+    uint8_t     payload[LGW_MOCK_TX_SIZE_MAX]; /*!> content of the TX buffer */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Create a software SX1302 device
+@param com_path path to a RX trace file to be replayed, or "" or LGW_MOCK_PATH_NONE
+@param com_target_ptr pointer on a generic pointer to the device (implementation dependant)
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+
+The RX trace is a text file with one packet per line, '#' starting a comment:
+<time_us> <if_chain> <sf> <cr> <ok|bad|none> <snr_db> <rssi_raw> <hex_payload>
+Packets are pushed in the RX buffer when the device counter reaches time_us,
+so lines must be sorted by ascending time.
+Lines starting with '@' are directives, applied when they are read:
+@origin <clock_monotonic_us>: times of the following packets are relative to
+this CLOCK_MONOTONIC instant instead of the device opening, so that another
+process can measure the latency of the packets.
+@txlog <path>: each triggered TX is appended to this file as
+<clock_monotonic_us> <rf_chain> <trig> <count_us> <size> <hex_payload>
+@timescale <factor>: the device counter runs <factor> times faster than the
+host clock, see lgw_mock_time_scale() (@origin then only holds for 1.0).
+*/
+int lgw_mock_open(const char * com_path, void **com_target_ptr);
+
+/**
+@brief Release a software SX1302 device
+@param com_target generic pointer to the device (implementation dependant)
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+*/
+int lgw_mock_close(void *com_target);
+
+/**
+@brief Software SX1302 single-byte write
+@param com_target generic pointer to the device (implementation dependant)
+@param spi_mux_target SPI mux target (only LGW_SPI_MUX_TARGET_SX1302 is allowed)
+@param address register address
+@param data data byte to write
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+*/
+int lgw_mock_w(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t data);
+
+/**
+@brief Software SX1302 single-byte read
+@param com_target generic pointer to the device (implementation dependant)
+@param spi_mux_target SPI mux target (only LGW_SPI_MUX_TARGET_SX1302 is allowed)
+@param address register address
+@param data pointer to the byte read
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+*/
+int lgw_mock_r(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t *data);
+
+/**
+@brief Software SX1302 single-byte read-modify-write
+@param com_target generic pointer to the device (implementation dependant)
+@param spi_mux_target SPI mux target (only LGW_SPI_MUX_TARGET_SX1302 is allowed)
+@param address register address
+@param offs start offset of the bits to be modified
+@param leng number of bits to be modified
+@param data value to be written in the selected bits
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+*/
+int lgw_mock_rmw(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t offs, uint8_t leng, uint8_t data);
+
+/**
+@brief Software SX1302 burst (multiple-byte) write
+@param com_target generic pointer to the device (implementation dependant)
+@param spi_mux_target SPI mux target (only LGW_SPI_MUX_TARGET_SX1302 is allowed)
+@param address register or memory address
+@param data pointer to byte array to be written
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+*/
+int lgw_mock_wb(void *com_target, uint8_t spi_mux_target, uint16_t address, const uint8_t *data, uint16_t size);
+
+/**
+@brief Software SX1302 burst (multiple-byte) read
+@param com_target generic pointer to the device (implementation dependant)
+@param spi_mux_target SPI mux target (only LGW_SPI_MUX_TARGET_SX1302 is allowed)
+@param address register or memory address, reading the RX buffer address pops the RX FIFO
+@param data pointer to byte array to be filled
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+*/
+int lgw_mock_rb(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t *data, uint16_t size);
+
+/**
+ *
+ **/
+uint16_t lgw_mock_chunk_size(void);
+
+/**
+@brief Get the board temperature of the software device (constant)
+@param com_target generic pointer to the device (implementation dependant)
+@param temperature pointer to the temperature, in degrees Celsius
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+*/
+int lgw_mock_get_temperature(void *com_target, float * temperature);
+
+/**
+@brief Software SX1250 command write
+@param com_target generic pointer to the device (implementation dependant)
+@param spi_mux_target radio to be addressed (LGW_SPI_MUX_TARGET_RADIOA/B)
+@param op_code SX1250 command
+@param data command parameters
+@param size number of parameters
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+*/
+int sx1250_mock_w(void *com_target, uint8_t spi_mux_target, sx1250_op_code_t op_code, uint8_t *data, uint16_t size);
+
+/**
+@brief Software SX1250 command read, only the chip mode is modelled (GET_STATUS)
+@param com_target generic pointer to the device (implementation dependant)
+@param spi_mux_target radio to be addressed (LGW_SPI_MUX_TARGET_RADIOA/B)
+@param op_code SX1250 command
+@param data command parameters, overwritten with the response
+@param size number of bytes
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+*/
+int sx1250_mock_r(void *com_target, uint8_t spi_mux_target, sx1250_op_code_t op_code, uint8_t *data, uint16_t size);
+
+/**
+@brief Software SX1261 command write, only the chip mode, the registers and the LBT scan are modelled
+@param com_target generic pointer to the device (implementation dependant)
+@param op_code SX1261 command
+@param data command parameters
+@param size number of parameters
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+*/
+int sx1261_mock_w(void *com_target, sx1261_op_code_t op_code, uint8_t *data, uint16_t size);
+
+/**
+@brief Software SX1261 command read (GET_STATUS and READ_REGISTER, other commands read zeros)
+@param com_target generic pointer to the device (implementation dependant)
+@param op_code SX1261 command
+@param data command parameters, overwritten with the response
+@param size number of bytes
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+*/
+int sx1261_mock_r(void *com_target, sx1261_op_code_t op_code, uint8_t *data, uint16_t size);
+
+/**
+@brief Format a packet as stored by the SX1302 in its RX buffer
+@param pkt packet to be formatted, pkt->time_us gives the timestamp
+@param buf buffer to be filled
+@param buf_size size of the buffer, in bytes
+@return number of bytes written, LGW_MOCK_ERROR if the packet does not fit
+*/
+int lgw_mock_rx_format(const struct lgw_mock_rx_s * pkt, uint8_t * buf, uint16_t buf_size);
+
+/**
+@brief Append raw bytes to the RX buffer of the software device of the current instance
+@param data bytes in the format of the SX1302 RX buffer (see lgw_mock_rx_format())
+@param size number of bytes
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+
+The bytes are available immediately, as when replaying a RX buffer capture.
+*/
+int lgw_mock_rx_raw(const uint8_t * data, uint16_t size);
+
+/**
+@brief Inject a packet in the RX buffer of the software device of the current instance
+@param pkt packet to be received, when the device counter reaches pkt->time_us
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+
+Packets are queued in the order they are injected, they must be injected by
+ascending reception time. The queue is not protected against concurrent
+access: packets must be injected from the thread which fetches the packets.
+*/
+int lgw_mock_rx_inject(const struct lgw_mock_rx_s * pkt);
+
+/**
+@brief Get the packets emitted by the software device of the current instance
+@param max_tx maximum number of packets to be returned
+@param tx array of packets emitted, oldest first
+@return the number of packets returned, -1 if the current instance does not use a software device
+*/
+int lgw_mock_tx_get(int max_tx, struct lgw_mock_tx_s * tx);
+
+/**
+@brief Set the channel state sensed by the SX1261 of the software device of the current instance
+@param busy true for the emissions checked by Listen-Before-Talk to be blocked
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+
+The channel is checked when the emission starts, for all frequencies. A
+blocked emission is not captured and the TX modem gets back to free.
+*/
+int lgw_mock_lbt_busy(bool busy);
+
+/**
+@brief Set the speed of the virtual time of the software device of the current instance
+@param scale device microseconds per host microsecond (1.0 at device opening)
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+
+The internal counter, the PPS counter, the RX packets release and the TX
+emissions all follow the virtual time, which stays continuous when the speed
+is changed. With a scale of 1000, the 2^32us wrap of count_us happens every
+4.3 seconds instead of 71 minutes.
+*/
+int lgw_mock_time_scale(double scale);
+
+/**
+@brief Fast-forward the virtual time of the software device of the current instance
+@param delta_us time jump, in microseconds (LGW_MOCK_WARP_MAX_US max)
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+
+The HAL samples the 32MHz counter to count its wraps: warps longer than one
+counter period (2^27us, about 134s) without any HAL access in between are
+seen as a missing wrap, as with a real concentrator left unpolled.
+*/
+int lgw_mock_time_warp(uint32_t delta_us);
+
+/**
+@brief Get the virtual time of the software device of the current instance
+@param time_us microseconds elapsed on the device since its opening (not wrapped)
+@return status of register operation (LGW_MOCK_SUCCESS/LGW_MOCK_ERROR)
+
+The count_us reported by the HAL is the lower 32 bits of this value, as long
+as the HAL samples the counter at least once per counter period.
+*/
+int lgw_mock_time_get(uint64_t * time_us);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -43,6 +43,9 @@ struct lgw_reg_s {
     int32_t  dflt;        /*!< register default value */
 };
 
+/* register map of the SX1302, also used by the software device (loragw_mock.c) */
+extern const struct lgw_reg_s loregs[];
+
 /* -------------------------------------------------------------------------- */
 /* --- INTERNAL SHARED FUNCTIONS -------------------------------------------- */
 
@@ -39,6 +39,16 @@ static const char sx1261_pram_version_string[] = "2D06";
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
+/**
+@enum sx1261_rx_state_t
+@brief State of the RX parameters set by sx1261_set_rx_params()
+*/
+typedef enum {
+    SX1261_RX_UNKNOWN,  /*!> RX parameters not set, or changed by a spectral scan */
+    SX1261_RX_FS,       /*!> RX parameters set, radio in FS mode (LBT stopped) */
+    SX1261_RX_ON        /*!> RX parameters set, radio in RX mode */
+} sx1261_rx_state_t;
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
@@ -29,6 +29,11 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define SX1302_AGC_RADIO_GAIN_AUTO  0xFF
 #define TX_START_DELAY_DEFAULT      1500    /* Calibrated value for 500KHz BW */
 
+/* Range of requested RF powers covered by the TX power table */
+#define TX_POWER_TABLE_MIN          -10     /* dBm */
+#define TX_POWER_TABLE_MAX          30      /* dBm */
+#define TX_POWER_TABLE_SIZE         (TX_POWER_TABLE_MAX - TX_POWER_TABLE_MIN + 1)
+
 /* type of if_chain + modem */
 #define IF_UNDEFINED                0
 #define IF_LORA_STD                 0x10    /* if + standard single-SF LoRa modem */
@@ -86,6 +91,18 @@ typedef enum {
     RX_DFT_PEAK_MODE_AUTO        = 0x03
 } sx1302_rx_dft_peak_mode_t;
 
+/**
+@struct sx1302_tx_power_s
+@brief TX gain LUT entry selected for a requested RF power, with its register values
+*/
+struct sx1302_tx_power_s {
+    uint8_t lut_index;  /*!> index of the selected TX gain LUT entry */
+    int8_t  rf_power;   /*!> RF power of the selected entry, in dBm */
+    uint8_t tx_pwr;     /*!> AGC TX power register value (radio dependant) */
+    uint8_t iq_gain;    /*!> SX1302 digital gain register value */
+    int8_t  offset_i;   /*!> calibrated I offset */
+    int8_t  offset_q;   /*!> calibrated Q offset */
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
@@ -368,6 +385,7 @@ uint16_t sx1302_lora_payload_crc(const uint8_t * data, uint8_t size);
 /**
 @brief Get the number of packets available in rx_buffer and fetch data from ...
 @brief ... the SX1302 if rx_buffer is empty.
+@brief The timestamp counters are then read once (see sx1302_update()), and reused to parse all the packets fetched.
 @param  nb_pkt A pointer to allocated memory to hold the number of packet fetched
 @return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
 */
@@ -381,6 +399,36 @@ int sx1302_fetch(uint8_t * nb_pkt);
 */
 int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p);
 
+/**
+@brief Compute the delay to be applied by the SX1302 for TX to start
+@param radio_type    Type of radio for the RF chain
+@param modulation    Modulation used for the TX
+@param bandwidth     Bandwidth used for the TX
+@param chirp_lowpass Chirp Low Pass filtering configuration
+@param delay         TX start delay calculated (0 if not LoRa)
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
+*/
+int sx1302_tx_get_start_delay(lgw_radio_type_t radio_type, uint8_t modulation, uint8_t bandwidth, uint8_t chirp_lowpass, uint16_t * delay);
+
+/**
+@brief Select the TX gain LUT entry for a requested RF power, and compute its register values
+@param radio_type   Type of radio for the RF chain
+@param tx_lut       TX gain LUT of the RF chain
+@param rf_power     requested RF power, in dBm
+@param tx_pow       selected entry: the highest power lower or equal to the requested one, or the first entry if there is none
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
+*/
+int sx1302_tx_power_get(lgw_radio_type_t radio_type, const struct lgw_tx_gain_lut_s * tx_lut, int8_t rf_power, struct sx1302_tx_power_s * tx_pow);
+
+/**
+@brief Build the table of selected TX gain LUT entries, for each requested RF power in [TX_POWER_TABLE_MIN..TX_POWER_TABLE_MAX]
+@param radio_type   Type of radio for the RF chain
+@param tx_lut       TX gain LUT of the RF chain
+@param table        table to be filled, indexed by (rf_power - TX_POWER_TABLE_MIN)
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise (eg. radio type not supported yet)
+*/
+int sx1302_tx_power_table_build(lgw_radio_type_t radio_type, const struct lgw_tx_gain_lut_s * tx_lut, struct sx1302_tx_power_s table[TX_POWER_TABLE_SIZE]);
+
 /**
 @brief Configure the delay to be applied by the SX1302 for TX to start
 @param rf_chain      RF chain index to be configured
@@ -437,6 +485,25 @@ int sx1302_tx_configure(lgw_radio_type_t radio_type);
 */
 int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut, bool lwan_public, struct lgw_conf_rxif_s * context_fsk, struct lgw_pkt_tx_s * pkt_data);
 
+/**
+@brief Encode all the register and memory writes needed to send a packet, without bus access
+@param radio_type   Type of radio for the RF chain
+@param tx_pow       TX gain LUT entry selected for the packet RF power (see sx1302_tx_power_get)
+@param lwan_public  LoRaWAN public network syncword
+@param context_fsk  FSK configuration (syncword)
+@param pkt_data     packet to be sent (preamble may be adjusted)
+@param prep         prepared TX request to be filled (operations and data only)
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
+*/
+int sx1302_send_prepare(lgw_radio_type_t radio_type, const struct sx1302_tx_power_s * tx_pow, bool lwan_public, struct lgw_conf_rxif_s * context_fsk, struct lgw_pkt_tx_s * pkt_data, struct lgw_tx_prep_s * prep);
+
+/**
+@brief Write a prepared TX request to the SX1302, in a single USB bulk request
+@param prep         prepared TX request
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
+*/
+int sx1302_send_commit(const struct lgw_tx_prep_s * prep);
+
 /**
 @brief TODO
 @param TODO
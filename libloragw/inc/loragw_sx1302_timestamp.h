@@ -35,6 +35,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
+#define MAX_TIMESTAMP_PPS_HISTORY 16
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC MACROS -------------------------------------------------------- */
 
@@ -52,8 +54,19 @@ struct timestamp_info_s {
 typedef struct timestamp_counter_s {
     struct timestamp_info_s inst; /* holds current reference of the instantaneous counter */
     struct timestamp_info_s pps;  /* holds current reference of the pps-trigged counter */
+    uint32_t pps_reg;             /* raw 32MHz PPS counter register at last read, reused for the fine timestamp of the packets fetched */
 } timestamp_counter_t;
 
+/**
+@struct timestamp_pps_history_s
+@brief history of the last PPS timestamps, used for fine timestamp xtal correction
+*/
+struct timestamp_pps_history_s {
+    uint32_t history[MAX_TIMESTAMP_PPS_HISTORY];
+    uint8_t idx; /* next slot to be written */
+    uint8_t size; /* current size */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS ----------------------------------------------------- */
 
@@ -136,12 +149,13 @@ int timestamp_counter_mode(bool ftime_enable);
 @param ts_metrics_nb The number of timestamp metrics given in ts_metrics array
 @param ts_metrics An array containing timestamp metrics to compute fine timestamp
 @param pkt_coarse_tmst The packet coarse timestamp
+@param pps_reg The raw 32MHz PPS counter register, as read after the packet has been fetched
 @param sf packet spreading factor, used to shift timestamp from end of header to end of preamble
 @param if_freq_hz the IF frequency, to take into account DC noth delay
 @param result_ftime A pointer to store the resulting fine timestamp
 @return 0 if success, -1 otherwise
 */
-int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics, uint32_t pkt_coarse_tmst, uint8_t sf, int32_t if_freq_hz, double pkt_freq_error, uint32_t * result_ftime);
+int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics, uint32_t pkt_coarse_tmst, uint32_t pps_reg, uint8_t sf, int32_t if_freq_hz, double pkt_freq_error, uint32_t * result_ftime);
 
 #endif
 
@@ -83,6 +83,11 @@ int lgw_usb_set_write_mode(lgw_com_write_mode_t write_mode);
  **/
 int lgw_usb_flush(void *com_target);
 
+/**
+@brief Drop the pending bulk requests without sending them, and restore single write mode
+*/
+void lgw_usb_discard(void);
+
 /**
  *
  **/
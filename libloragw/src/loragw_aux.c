@@ -24,8 +24,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #endif
 
 #include <stdio.h>  /* printf fprintf */
-#include <time.h>   /* clock_nanosleep */
-#include <math.h>   /* pow, ceil */
+#include <time.h>   /* clock_nanosleep, clock_gettime */
 
 #include "loragw_aux.h"
 #include "loragw_hal.h"
@@ -41,6 +40,86 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
     #define DEBUG_PRINTF(fmt, args...)
 #endif
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define TOA_SF_NB           8   /* SF5 to SF12 */
+#define TOA_PAYLOAD_NB      256
+
+#define PERF_ATOMIC_ADD(p, v)   __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define PERF_ATOMIC_GET(p, r)   ((r) ? __atomic_exchange_n((p), 0, __ATOMIC_RELAXED) : __atomic_load_n((p), __ATOMIC_RELAXED))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* Number of payload blocks of a LoRa packet (number of payload symbols divided
+   by (CR + 4)), for each SF, CRC on/off, header on/off and payload size.
+   Filled once at library load, see lora_toa_table_init() */
+static uint8_t lora_payload_blocks[TOA_SF_NB][2][2][TOA_PAYLOAD_NB];
+
+/* Performance counters of the instrumented call sites, shared by all instances,
+   updated with atomic operations */
+static bool perf_enabled = true;
+static struct lgw_perf_s perf_stat[LGW_PERF_NB];
+
+static const char * perf_name[LGW_PERF_NB] = {
+    [LGW_PERF_RECEIVE]              = "receive",
+    [LGW_PERF_RECEIVE_COMPACT]      = "receive_compact",
+    [LGW_PERF_SEND]                 = "send",
+    [LGW_PERF_SEND_PREPARE]         = "send_prepare",
+    [LGW_PERF_SX1302_UPDATE]        = "sx1302_update",
+    [LGW_PERF_SX1302_FETCH]         = "sx1302_fetch",
+    [LGW_PERF_SX1302_PARSE]         = "sx1302_parse",
+    [LGW_PERF_SX1302_SEND]          = "sx1302_send",
+    [LGW_PERF_COM_W]                = "com_w",
+    [LGW_PERF_COM_R]                = "com_r",
+    [LGW_PERF_COM_RMW]              = "com_rmw",
+    [LGW_PERF_COM_WB]               = "com_wb",
+    [LGW_PERF_COM_RB]               = "com_rb",
+    [LGW_PERF_MCU_WRITE_REQ]        = "write_req",
+    [LGW_PERF_MCU_READ_ACK_HDR]     = "read_ack_hdr",
+    [LGW_PERF_MCU_READ_ACK_PAYLOAD] = "read_ack_payload",
+    [LGW_PERF_LBT_START]            = "lbt_start",
+    [LGW_PERF_LBT_TX_STATUS]        = "lbt_tx_status",
+    [LGW_PERF_LBT_STOP]             = "lbt_stop",
+    [LGW_PERF_SX1261_SET_RX_PARAMS] = "sx1261_set_rx_params",
+    [LGW_PERF_SX1261_LBT_START]     = "sx1261_lbt_start",
+    [LGW_PERF_SX1261_LBT_STOP]      = "sx1261_lbt_stop",
+    [LGW_PERF_SX1261_SCAN_START]    = "sx1261_scan_start",
+    [LGW_PERF_SX1261_SCAN_RESULTS]  = "sx1261_scan_results",
+    [LGW_PERF_SX1261_SCAN_STATUS]   = "sx1261_scan_status",
+    [LGW_PERF_SX1261_SCAN_ABORT]    = "sx1261_scan_abort"
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void lora_toa_table_init(void) __attribute__((constructor));
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void lora_toa_table_init(void) {
+    int sf, crc, hdr, size;
+    int n_bit, n_bit_per_block;
+
+    for (sf = 5; sf <= 12; sf++) {
+        /* Low datarate optimization enabled for SF11 and SF12 */
+        n_bit_per_block = 4 * (sf - ((sf >= 11) ? 2 : 0));
+        for (crc = 0; crc < 2; crc++) {
+            for (hdr = 0; hdr < 2; hdr++) {
+                for (size = 0; size < TOA_PAYLOAD_NB; size++) {
+                    n_bit = 8 * size + 16 * crc - 4 * sf + ((sf >= 7) ? 8 : 0) + 20 * hdr;
+                    if (n_bit < 0) {
+                        n_bit = 0;
+                    }
+                    lora_payload_blocks[sf - 5][crc][hdr][size] = (uint8_t)((n_bit + n_bit_per_block - 1) / n_bit_per_block);
+                }
+            }
+        }
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
@@ -91,11 +170,9 @@ void wait_ms(unsigned long delay_ms) {
 uint32_t lora_packet_time_on_air(const uint8_t bw, const uint8_t sf, const uint8_t cr, const uint16_t n_symbol_preamble,
                                  const bool no_header, const bool no_crc, const uint8_t size,
                                  double * out_nb_symbols, uint32_t * out_nb_symbols_payload, uint16_t * out_t_symbol_us) {
-    uint8_t H, DE, n_bit_crc;
     uint8_t bw_pow;
     uint16_t t_symbol_us;
-    double n_symbol;
-    uint32_t toa_us, n_symbol_payload;
+    uint32_t toa_us, n_symbol_payload, n_symbol_x4;
 
     /* Check input parameters */
     if (IS_LORA_DR(sf) == false) {
@@ -130,27 +207,20 @@ uint32_t lora_packet_time_on_air(const uint8_t bw, const uint8_t sf, const uint8
     /* Duration of 1 symbol */
     t_symbol_us = (1 << sf) * 8 / bw_pow; /* 2^SF / BW , in microseconds */
 
-    /* Packet parameters */
-    H = (no_header == false) ? 1 : 0; /* header is always enabled, except for beacons */
-    DE = (sf >= 11) ? 1 : 0; /* Low datarate optimization enabled for SF11 and SF12 */
-    n_bit_crc = (no_crc == false) ? 16 : 0;
+    /* Number of symbols in the payload (header is always enabled, except for beacons) */
+    n_symbol_payload = lora_payload_blocks[sf - 5][(no_crc == false) ? 1 : 0][(no_header == false) ? 1 : 0][size] * (cr + 4);
 
-    /* Number of symbols in the payload */
-    n_symbol_payload = ceil( MAX( (double)( 8 * size + n_bit_crc - 4*sf + ((sf >= 7) ? 8 : 0) + 20*H ), 0.0) /
-                                  (double)( 4 * (sf - 2*DE)) )
-                       * ( cr + 4 ); /* Explicitely cast to double to keep precision of the division */
-
-    /* number of symbols in packet */
-    n_symbol = (double)n_symbol_preamble + ((sf >= 7) ? 4.25 : 6.25) + 8.0 + (double)n_symbol_payload;
+    /* Number of quarters of symbols in packet: preamble + 4.25 (6.25 for SF5/SF6) sync + 8 header */
+    n_symbol_x4 = (4 * (uint32_t)n_symbol_preamble) + ((sf >= 7) ? 17 : 25) + 32 + (4 * n_symbol_payload);
 
     /* Duration of packet in microseconds */
-    toa_us = (uint32_t)( (double)n_symbol * (double)t_symbol_us );
+    toa_us = (uint32_t)(((uint64_t)n_symbol_x4 * t_symbol_us) / 4);
 
-    DEBUG_PRINTF("INFO: LoRa packet ToA: %u us (n_symbol:%f, t_symbol_us:%u)\n", toa_us, n_symbol, t_symbol_us);
+    DEBUG_PRINTF("INFO: LoRa packet ToA: %u us (n_symbol:%f, t_symbol_us:%u)\n", toa_us, n_symbol_x4 / 4.0, t_symbol_us);
 
     /* Return details if required */
     if (out_nb_symbols != NULL) {
-        *out_nb_symbols = n_symbol;
+        *out_nb_symbols = (double)n_symbol_x4 / 4.0;
     }
     if (out_nb_symbols_payload != NULL) {
         *out_nb_symbols_payload = n_symbol_payload;
@@ -164,27 +234,54 @@ uint32_t lora_packet_time_on_air(const uint8_t bw, const uint8_t sf, const uint8
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+void _meas_time_start(uint64_t *tm) {
+    struct timespec now;
+
+    if (__atomic_load_n(&perf_enabled, __ATOMIC_RELAXED) == true) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        *tm = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    } else {
+        *tm = 0;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
-void _meas_time_start(struct timeval *tm)
-{
-#if (DEBUG_PERF > 0) && (DEBUG_PERF <= 5)
-    gettimeofday(tm, NULL);
-#endif
-}
+void _meas_time_stop(lgw_perf_id_t id, int debug_level, uint64_t start_time) {
+    struct timespec tm;
+    struct lgw_perf_s * perf;
+    uint32_t time_us, max_us;
+    int bucket;
+
+    /* Not measured (counters disabled when the measure started) */
+    if ((start_time == 0) || (id >= LGW_PERF_NB)) {
+        return;
+    }
 
-void _meas_time_stop(int debug_level, struct timeval start_time, const char *str)
-{
-#if (DEBUG_PERF > 0) && (DEBUG_PERF <= 5)
-    struct timeval tm;
-    double time_ms;
-    char *indent[] = { "", " ..", " ....", " ......", " ........" };
+    clock_gettime(CLOCK_MONOTONIC, &tm);
+    time_us = (uint32_t)(((uint64_t)tm.tv_sec * 1000000000 + tm.tv_nsec - start_time) / 1000);
 
-    gettimeofday(&tm, NULL);
+    /* log2 bucket: 0 for < 1us, k for [2^(k-1), 2^k[ */
+    bucket = (time_us == 0) ? 0 : (32 - __builtin_clz(time_us));
+    if (bucket >= LGW_PERF_HIST_NB) {
+        bucket = LGW_PERF_HIST_NB - 1;
+    }
 
-    time_ms = (tm.tv_sec - start_time.tv_sec) * 1000.0 + (tm.tv_usec - start_time.tv_usec) / 1000.0;
+    perf = &perf_stat[id];
+    PERF_ATOMIC_ADD(&perf->count, 1);
+    PERF_ATOMIC_ADD(&perf->total_us, time_us);
+    PERF_ATOMIC_ADD(&perf->hist[bucket], 1);
+    max_us = __atomic_load_n(&perf->max_us, __ATOMIC_RELAXED);
+    while ((time_us > max_us) && !__atomic_compare_exchange_n(&perf->max_us, &max_us, time_us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        /* max_us updated by the failed exchange, try again */
+    }
+
+#if (DEBUG_PERF > 0) && (DEBUG_PERF <= 5)
+    char *indent[] = { "", " ..", " ....", " ......", " ........" };
     if ((debug_level > 0) && (debug_level <= DEBUG_PERF)) {
-        printf("PERF:%s %s %f ms\n", indent[debug_level - 1], str, time_ms);
+        printf("PERF:%s %s %f ms\n", indent[debug_level - 1], perf_name[id], time_us / 1000.0);
     }
 #endif
 }
@@ -192,6 +289,39 @@ void _meas_time_stop(int debug_level, struct timeval start_time, const char *str
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+void lgw_perf_enable(bool enable) {
+    __atomic_store_n(&perf_enabled, enable, __ATOMIC_RELAXED);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_perf_get(struct lgw_perf_s perf[LGW_PERF_NB], bool reset) {
+    int i, j;
+
+    if (perf == NULL) {
+        return LGW_HAL_ERROR;
+    }
+
+    for (i = 0; i < LGW_PERF_NB; i++) {
+        perf[i].count = PERF_ATOMIC_GET(&perf_stat[i].count, reset);
+        perf[i].total_us = PERF_ATOMIC_GET(&perf_stat[i].total_us, reset);
+        perf[i].max_us = PERF_ATOMIC_GET(&perf_stat[i].max_us, reset);
+        for (j = 0; j < LGW_PERF_HIST_NB; j++) {
+            perf[i].hist[j] = PERF_ATOMIC_GET(&perf_stat[i].hist[j], reset);
+        }
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+const char * lgw_perf_name(lgw_perf_id_t id) {
+    return ((unsigned int)id < LGW_PERF_NB) ? perf_name[id] : "";
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 void timeout_start(struct timeval * start) {
     gettimeofday(start, NULL);
 }
@@ -26,6 +26,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_sx1302.h"
 #include "loragw_sx125x.h"
 #include "loragw_cal.h"
+#include "loragw_handle.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- DEBUG FLAGS ---------------------------------------------------------- */
@@ -56,9 +57,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES -------------------------------------------- */
 
-/* Record Rx IQ mismatch corrections from calibration */
-static int8_t rf_rx_image_amp[LGW_RF_CHAIN_NB] = {0, 0};
-static int8_t rf_rx_image_phi[LGW_RF_CHAIN_NB] = {0, 0};
+/* Rx IQ mismatch corrections from calibration are recorded in the current
+   instance handle (lgw_inst->rf_rx_image_amp, lgw_inst->rf_rx_image_phi) */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
@@ -148,21 +148,21 @@ int sx1302_cal_start(uint8_t version, struct lgw_conf_rxrf_s * rf_chain_cfg, str
                     x_max_idx = j;
                 }
             }
-            rf_rx_image_amp[i] = cal_rx[x_max_idx].amp;
-            rf_rx_image_phi[i] = cal_rx[x_max_idx].phi;
+            lgw_inst->rf_rx_image_amp[i] = cal_rx[x_max_idx].amp;
+            lgw_inst->rf_rx_image_phi[i] = cal_rx[x_max_idx].phi;
 
             DEBUG_PRINTF("INFO: Rx image calibration of radio %d succeeded. Improved image rejection from %2d to %2d dB (Amp:%3d Phi:%3d)\n", i, cal_rx[x_max_idx].rej_init, cal_rx[x_max_idx].rej, cal_rx[x_max_idx].amp, cal_rx[x_max_idx].phi);
         } else {
-            rf_rx_image_amp[i] = 0;
-            rf_rx_image_phi[i] = 0;
+            lgw_inst->rf_rx_image_amp[i] = 0;
+            lgw_inst->rf_rx_image_phi[i] = 0;
         }
     }
 
     /* Apply calibrated IQ mismatch compensation */
-    lgw_reg_w(SX1302_REG_RADIO_FE_IQ_COMP_AMP_COEFF_RADIO_A_AMP_COEFF, (int32_t)rf_rx_image_amp[0]);
-    lgw_reg_w(SX1302_REG_RADIO_FE_IQ_COMP_PHI_COEFF_RADIO_A_PHI_COEFF, (int32_t)rf_rx_image_phi[0]);
-    lgw_reg_w(SX1302_REG_RADIO_FE_IQ_COMP_AMP_COEFF_RADIO_B_AMP_COEFF, (int32_t)rf_rx_image_amp[1]);
-    lgw_reg_w(SX1302_REG_RADIO_FE_IQ_COMP_PHI_COEFF_RADIO_B_PHI_COEFF, (int32_t)rf_rx_image_phi[1]);
+    lgw_reg_w(SX1302_REG_RADIO_FE_IQ_COMP_AMP_COEFF_RADIO_A_AMP_COEFF, (int32_t)lgw_inst->rf_rx_image_amp[0]);
+    lgw_reg_w(SX1302_REG_RADIO_FE_IQ_COMP_PHI_COEFF_RADIO_A_PHI_COEFF, (int32_t)lgw_inst->rf_rx_image_phi[0]);
+    lgw_reg_w(SX1302_REG_RADIO_FE_IQ_COMP_AMP_COEFF_RADIO_B_AMP_COEFF, (int32_t)lgw_inst->rf_rx_image_amp[1]);
+    lgw_reg_w(SX1302_REG_RADIO_FE_IQ_COMP_PHI_COEFF_RADIO_B_PHI_COEFF, (int32_t)lgw_inst->rf_rx_image_phi[1]);
 
     /* Get List of unique combinations of DAC and mixer gains */
     for (k = 0; k < LGW_RF_CHAIN_NB; k++) {
@@ -232,8 +232,8 @@ int sx1302_cal_start(uint8_t version, struct lgw_conf_rxrf_s * rf_chain_cfg, str
 
     printf("-------------------------------------------------------------------\n");
     printf("Radio calibration completed:\n");
-    printf("  RadioA: amp:%d phi:%d\n", rf_rx_image_amp[0], rf_rx_image_phi[0]);
-    printf("  RadioB: amp:%d phi:%d\n", rf_rx_image_amp[1], rf_rx_image_phi[1]);
+    printf("  RadioA: amp:%d phi:%d\n", lgw_inst->rf_rx_image_amp[0], lgw_inst->rf_rx_image_phi[0]);
+    printf("  RadioB: amp:%d phi:%d\n", lgw_inst->rf_rx_image_amp[1], lgw_inst->rf_rx_image_phi[1]);
     for (k = 0; k < LGW_RF_CHAIN_NB; k++) {
         printf("  TX calibration params for rf_chain %d:\n", k);
         for (i = 0; i < txgain_lut[k].size; i++) {
@@ -485,7 +485,7 @@ int sx125x_cal_tx_dc_offset(uint8_t rf_chain, uint32_t freq_hz, uint8_t dac_gain
 #if TX_CALIB_DONE_BY_HAL /* For debug */
 
     lgw_reg_w(SX1302_REG_RADIO_FE_SIG_ANA_CFG_FORCE_HAL_CTRL, 1);
-    agc_cal_tx_dc_offset(rf_chain, CAL_TX_TONE_FREQ_HZ * 64e-6, rf_rx_image_amp[rf_chain], rf_rx_image_phi[rf_chain], tx_threshold, 0, &(res->offset_i), &(res->offset_q), &(res->rej));
+    agc_cal_tx_dc_offset(rf_chain, CAL_TX_TONE_FREQ_HZ * 64e-6, lgw_inst->rf_rx_image_amp[rf_chain], lgw_inst->rf_rx_image_phi[rf_chain], tx_threshold, 0, &(res->offset_i), &(res->offset_q), &(res->rej));
     lgw_reg_w(SX1302_REG_RADIO_FE_SIG_ANA_CFG_FORCE_HAL_CTRL, 0);
 
 #else
@@ -499,8 +499,8 @@ int sx125x_cal_tx_dc_offset(uint8_t rf_chain, uint32_t freq_hz, uint8_t dac_gain
     sx1302_agc_mailbox_write(3, 0x01); /* sync */
     sx1302_agc_wait_status(0x01);
 
-    sx1302_agc_mailbox_write(2, rf_rx_image_amp[rf_chain]); /* amp */
-    sx1302_agc_mailbox_write(1, rf_rx_image_phi[rf_chain]); /* phi */
+    sx1302_agc_mailbox_write(2, lgw_inst->rf_rx_image_amp[rf_chain]); /* amp */
+    sx1302_agc_mailbox_write(1, lgw_inst->rf_rx_image_phi[rf_chain]); /* phi */
 
     sx1302_agc_mailbox_write(3, 0x02); /* sync */
     sx1302_agc_wait_status(0x02);
@@ -24,7 +24,9 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_com.h"
 #include "loragw_usb.h"
 #include "loragw_spi.h"
+#include "loragw_mock.h"
 #include "loragw_aux.h"
+#include "loragw_handle.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -40,21 +42,30 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
     #define CHECK_NULL(a)                if(a==NULL){return LGW_COM_ERROR;}
 #endif
 
+/* counters are updated by the RX/TX/stat threads of the same instance */
+#define STAT_ADD(p, v)      __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define STAT_GET(p, r)      ((r) ? __atomic_exchange_n((p), 0, __ATOMIC_RELAXED) : __atomic_load_n((p), __ATOMIC_RELAXED))
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-/**
-@brief The current communication type in use (SPI, USB)
-*/
-static lgw_com_type_t _lgw_com_type = LGW_COM_UNKNOWN;
+/* The communication type and target in use are held by the current instance
+   handle (lgw_inst->com_type, lgw_inst->com_target) */
 
-/**
-@brief A generic pointer to the COM device (file descriptor)
-*/
-static void* _lgw_com_target = NULL;
+/* subsystem the bus transactions of the calling thread are accounted to */
+static __thread lgw_com_sub_t com_sub = LGW_COM_SUB_CONFIG;
+
+static const char * com_sub_name[LGW_COM_SUB_NB] = {
+    "cfg",
+    "rx",
+    "tx",
+    "cnt",
+    "scan",
+    "gps"
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
@@ -64,27 +75,31 @@ int lgw_com_open(lgw_com_type_t com_type, const char * com_path) {
 
     /* Check input parameters */
     CHECK_NULL(com_path);
-    if ((com_type != LGW_COM_SPI) && (com_type != LGW_COM_USB)) {
+    if ((com_type != LGW_COM_SPI) && (com_type != LGW_COM_USB) && (com_type != LGW_COM_MOCK)) {
         DEBUG_MSG("ERROR: COMMUNICATION INTERFACE TYPE IS NOT SUPPORTED\n");
         return LGW_COM_ERROR;
     }
 
-    if (_lgw_com_target != NULL) {
+    if (lgw_inst->com_target != NULL) {
         DEBUG_MSG("WARNING: CONCENTRATOR WAS ALREADY CONNECTED\n");
         lgw_com_close();
     }
 
     /* set current com type */
-    _lgw_com_type = com_type;
+    lgw_inst->com_type = com_type;
 
     switch (com_type) {
         case LGW_COM_SPI:
             printf("Opening SPI communication interface\n");
-            com_stat = lgw_spi_open(com_path, &_lgw_com_target);
+            com_stat = lgw_spi_open(com_path, &lgw_inst->com_target);
             break;
         case LGW_COM_USB:
             printf("Opening USB communication interface\n");
-            com_stat = lgw_usb_open(com_path, &_lgw_com_target);
+            com_stat = lgw_usb_open(com_path, &lgw_inst->com_target);
+            break;
+        case LGW_COM_MOCK:
+            printf("Opening software device (mock) communication interface\n");
+            com_stat = lgw_mock_open(com_path, &lgw_inst->com_target);
             break;
         default:
             com_stat = LGW_COM_ERROR;
@@ -100,19 +115,23 @@ int lgw_com_open(lgw_com_type_t com_type, const char * com_path) {
 int lgw_com_close(void) {
     int com_stat;
 
-    if (_lgw_com_target == NULL) {
+    if (lgw_inst->com_target == NULL) {
         printf("ERROR: concentrator is not connected\n");
         return -1;
     }
 
-    switch (_lgw_com_type) {
+    switch (lgw_inst->com_type) {
         case LGW_COM_SPI:
             printf("Closing SPI communication interface\n");
-            com_stat = lgw_spi_close(_lgw_com_target);
+            com_stat = lgw_spi_close(lgw_inst->com_target);
             break;
         case LGW_COM_USB:
             printf("Closing USB communication interface\n");
-            com_stat = lgw_usb_close(_lgw_com_target);
+            com_stat = lgw_usb_close(lgw_inst->com_target);
+            break;
+        case LGW_COM_MOCK:
+            printf("Closing software device (mock) communication interface\n");
+            com_stat = lgw_mock_close(lgw_inst->com_target);
             break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
@@ -120,7 +139,7 @@ int lgw_com_close(void) {
             break;
     }
 
-    _lgw_com_target = NULL;
+    lgw_inst->com_target = NULL;
 
     return com_stat;
 }
@@ -131,20 +150,23 @@ int lgw_com_close(void) {
 int lgw_com_w(uint8_t spi_mux_target, uint16_t address, uint8_t data) {
     int com_stat;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
 
     /* Check input parameters */
-    CHECK_NULL(_lgw_com_target);
+    CHECK_NULL(lgw_inst->com_target);
 
-    switch (_lgw_com_type) {
+    switch (lgw_inst->com_type) {
         case LGW_COM_SPI:
-            com_stat = lgw_spi_w(_lgw_com_target, spi_mux_target, address, data);
+            com_stat = lgw_spi_w(lgw_inst->com_target, spi_mux_target, address, data);
             break;
         case LGW_COM_USB:
-            com_stat = lgw_usb_w(_lgw_com_target, spi_mux_target, address, data);
+            com_stat = lgw_usb_w(lgw_inst->com_target, spi_mux_target, address, data);
+            break;
+        case LGW_COM_MOCK:
+            com_stat = lgw_mock_w(lgw_inst->com_target, spi_mux_target, address, data);
             break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
@@ -152,8 +174,10 @@ int lgw_com_w(uint8_t spi_mux_target, uint16_t address, uint8_t data) {
             break;
     }
 
+    lgw_com_stat_account(1, 1, 0, com_stat);
+
     /* Compute time spent in this function */
-    _meas_time_stop(5, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_COM_W, 5, tm);
 
     return com_stat;
 }
@@ -164,21 +188,24 @@ int lgw_com_w(uint8_t spi_mux_target, uint16_t address, uint8_t data) {
 int lgw_com_r(uint8_t spi_mux_target, uint16_t address, uint8_t *data) {
     int com_stat;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
 
     /* Check input parameters */
-    CHECK_NULL(_lgw_com_target);
+    CHECK_NULL(lgw_inst->com_target);
     CHECK_NULL(data);
 
-    switch (_lgw_com_type) {
+    switch (lgw_inst->com_type) {
         case LGW_COM_SPI:
-            com_stat = lgw_spi_r(_lgw_com_target, spi_mux_target, address, data);
+            com_stat = lgw_spi_r(lgw_inst->com_target, spi_mux_target, address, data);
             break;
         case LGW_COM_USB:
-            com_stat = lgw_usb_r(_lgw_com_target, spi_mux_target, address, data);
+            com_stat = lgw_usb_r(lgw_inst->com_target, spi_mux_target, address, data);
+            break;
+        case LGW_COM_MOCK:
+            com_stat = lgw_mock_r(lgw_inst->com_target, spi_mux_target, address, data);
             break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
@@ -186,8 +213,10 @@ int lgw_com_r(uint8_t spi_mux_target, uint16_t address, uint8_t *data) {
             break;
     }
 
+    lgw_com_stat_account(1, 0, 1, com_stat);
+
     /* Compute time spent in this function */
-    _meas_time_stop(5, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_COM_R, 5, tm);
 
     return com_stat;
 }
@@ -197,20 +226,23 @@ int lgw_com_r(uint8_t spi_mux_target, uint16_t address, uint8_t *data) {
 int lgw_com_rmw(uint8_t spi_mux_target, uint16_t address, uint8_t offs, uint8_t leng, uint8_t data) {
     int com_stat;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
 
     /* Check input parameters */
-    CHECK_NULL(_lgw_com_target);
+    CHECK_NULL(lgw_inst->com_target);
 
-    switch (_lgw_com_type) {
+    switch (lgw_inst->com_type) {
         case LGW_COM_SPI:
-            com_stat = lgw_spi_rmw(_lgw_com_target, spi_mux_target, address, offs, leng, data);
+            com_stat = lgw_spi_rmw(lgw_inst->com_target, spi_mux_target, address, offs, leng, data);
             break;
         case LGW_COM_USB:
-            com_stat = lgw_usb_rmw(_lgw_com_target, address, offs, leng, data);
+            com_stat = lgw_usb_rmw(lgw_inst->com_target, address, offs, leng, data);
+            break;
+        case LGW_COM_MOCK:
+            com_stat = lgw_mock_rmw(lgw_inst->com_target, spi_mux_target, address, offs, leng, data);
             break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
@@ -218,8 +250,10 @@ int lgw_com_rmw(uint8_t spi_mux_target, uint16_t address, uint8_t offs, uint8_t
             break;
     }
 
+    lgw_com_stat_account(1, 1, 1, com_stat);
+
     /* Compute time spent in this function */
-    _meas_time_stop(5, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_COM_RMW, 5, tm);
 
     return com_stat;
 }
@@ -230,21 +264,24 @@ int lgw_com_rmw(uint8_t spi_mux_target, uint16_t address, uint8_t offs, uint8_t
 int lgw_com_wb(uint8_t spi_mux_target, uint16_t address, const uint8_t *data, uint16_t size) {
     int com_stat;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
 
     /* Check input parameters */
-    CHECK_NULL(_lgw_com_target);
+    CHECK_NULL(lgw_inst->com_target);
     CHECK_NULL(data);
 
-    switch (_lgw_com_type) {
+    switch (lgw_inst->com_type) {
         case LGW_COM_SPI:
-            com_stat = lgw_spi_wb(_lgw_com_target, spi_mux_target, address, data, size);
+            com_stat = lgw_spi_wb(lgw_inst->com_target, spi_mux_target, address, data, size);
             break;
         case LGW_COM_USB:
-            com_stat = lgw_usb_wb(_lgw_com_target, spi_mux_target, address, data, size);
+            com_stat = lgw_usb_wb(lgw_inst->com_target, spi_mux_target, address, data, size);
+            break;
+        case LGW_COM_MOCK:
+            com_stat = lgw_mock_wb(lgw_inst->com_target, spi_mux_target, address, data, size);
             break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
@@ -252,8 +289,10 @@ int lgw_com_wb(uint8_t spi_mux_target, uint16_t address, const uint8_t *data, ui
             break;
     }
 
+    lgw_com_stat_account(1, size, 0, com_stat);
+
     /* Compute time spent in this function */
-    _meas_time_stop(5, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_COM_WB, 5, tm);
 
     return com_stat;
 }
@@ -264,21 +303,24 @@ int lgw_com_wb(uint8_t spi_mux_target, uint16_t address, const uint8_t *data, ui
 int lgw_com_rb(uint8_t spi_mux_target, uint16_t address, uint8_t *data, uint16_t size) {
     int com_stat;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
 
     /* Check input parameters */
-    CHECK_NULL(_lgw_com_target);
+    CHECK_NULL(lgw_inst->com_target);
     CHECK_NULL(data);
 
-    switch (_lgw_com_type) {
+    switch (lgw_inst->com_type) {
         case LGW_COM_SPI:
-            com_stat = lgw_spi_rb(_lgw_com_target, spi_mux_target, address, data, size);
+            com_stat = lgw_spi_rb(lgw_inst->com_target, spi_mux_target, address, data, size);
             break;
         case LGW_COM_USB:
-            com_stat = lgw_usb_rb(_lgw_com_target, spi_mux_target, address, data, size);
+            com_stat = lgw_usb_rb(lgw_inst->com_target, spi_mux_target, address, data, size);
+            break;
+        case LGW_COM_MOCK:
+            com_stat = lgw_mock_rb(lgw_inst->com_target, spi_mux_target, address, data, size);
             break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
@@ -286,8 +328,10 @@ int lgw_com_rb(uint8_t spi_mux_target, uint16_t address, uint8_t *data, uint16_t
             break;
     }
 
+    lgw_com_stat_account(1, 0, size, com_stat);
+
     /* Compute time spent in this function */
-    _meas_time_stop(5, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_COM_RB, 5, tm);
 
     return com_stat;
 }
@@ -297,8 +341,9 @@ int lgw_com_rb(uint8_t spi_mux_target, uint16_t address, uint8_t *data, uint16_t
 int lgw_com_set_write_mode(lgw_com_write_mode_t write_mode) {
     int com_stat = LGW_COM_SUCCESS;
 
-    switch (_lgw_com_type) {
+    switch (lgw_inst->com_type) {
         case LGW_COM_SPI:
+        case LGW_COM_MOCK:
             /* Do nothing: only single mode is supported on SPI */
             break;
         case LGW_COM_USB:
@@ -318,12 +363,16 @@ int lgw_com_set_write_mode(lgw_com_write_mode_t write_mode) {
 int lgw_com_flush(void) {
     int com_stat = LGW_COM_SUCCESS;
 
-    switch (_lgw_com_type) {
+    switch (lgw_inst->com_type) {
         case LGW_COM_SPI:
+        case LGW_COM_MOCK:
             /* Do nothing: only single mode is supported on SPI */
             break;
         case LGW_COM_USB:
-            com_stat = lgw_usb_flush(_lgw_com_target);
+            com_stat = lgw_usb_flush(lgw_inst->com_target);
+            if (com_stat != LGW_COM_SUCCESS) {
+                lgw_com_stat_account(0, 0, 0, com_stat);
+            }
             break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
@@ -336,13 +385,32 @@ int lgw_com_flush(void) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+void lgw_com_discard(void) {
+    switch (lgw_inst->com_type) {
+        case LGW_COM_SPI:
+        case LGW_COM_MOCK:
+            /* Do nothing: only single mode is supported on SPI */
+            break;
+        case LGW_COM_USB:
+            lgw_usb_discard();
+            break;
+        default:
+            printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
+            break;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 uint16_t lgw_com_chunk_size(void) {
-    switch (_lgw_com_type) {
+    switch (lgw_inst->com_type) {
         case LGW_COM_SPI:
             return lgw_spi_chunk_size();
         case LGW_COM_USB:
             return lgw_usb_chunk_size();
             break;
+        case LGW_COM_MOCK:
+            return lgw_mock_chunk_size();
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             return 0;
@@ -353,15 +421,17 @@ uint16_t lgw_com_chunk_size(void) {
 
 int lgw_com_get_temperature(float * temperature) {
     /* Check input parameters */
-    CHECK_NULL(_lgw_com_target);
+    CHECK_NULL(lgw_inst->com_target);
     CHECK_NULL(temperature);
 
-    switch (_lgw_com_type) {
+    switch (lgw_inst->com_type) {
         case LGW_COM_SPI:
             printf("ERROR(%s:%d): not supported for SPI com\n", __FUNCTION__, __LINE__);
             return -1;
         case LGW_COM_USB:
-            return lgw_usb_get_temperature(_lgw_com_target, temperature);
+            return lgw_usb_get_temperature(lgw_inst->com_target, temperature);
+        case LGW_COM_MOCK:
+            return lgw_mock_get_temperature(lgw_inst->com_target, temperature);
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
             return LGW_COM_ERROR;
@@ -371,13 +441,82 @@ int lgw_com_get_temperature(float * temperature) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void* lgw_com_target(void) {
-    return _lgw_com_target;
+    return lgw_inst->com_target;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 lgw_com_type_t lgw_com_type(void) {
-    return _lgw_com_type;
+    return lgw_inst->com_type;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+lgw_com_sub_t lgw_com_set_subsystem(lgw_com_sub_t sub) {
+    lgw_com_sub_t prev = com_sub;
+
+    com_sub = (sub < LGW_COM_SUB_NB) ? sub : LGW_COM_SUB_CONFIG;
+
+    return prev;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_com_stat_account(uint32_t nb_access, uint32_t size_w, uint32_t size_r, int status) {
+    struct lgw_com_stat_s * stat = &lgw_inst->com_stat[com_sub];
+
+    STAT_ADD(&stat->nb_access, nb_access);
+    STAT_ADD(&stat->data_w, size_w);
+    STAT_ADD(&stat->data_r, size_r);
+    if (status != LGW_COM_SUCCESS) {
+        STAT_ADD(&stat->nb_error, 1);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_com_stat_account_usb(uint32_t nb_req, uint32_t nb_ack, uint32_t nb_flush, uint32_t size_w, uint32_t size_r) {
+    struct lgw_com_stat_s * stat = &lgw_inst->com_stat[com_sub];
+
+    STAT_ADD(&stat->usb_nb_req, nb_req);
+    STAT_ADD(&stat->usb_nb_ack, nb_ack);
+    STAT_ADD(&stat->usb_nb_flush, nb_flush);
+    STAT_ADD(&stat->usb_wire_w, size_w);
+    STAT_ADD(&stat->usb_wire_r, size_r);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_com_stat_get(struct lgw_com_stat_s stat[LGW_COM_SUB_NB], bool reset) {
+    struct lgw_com_stat_s * s;
+    int i;
+
+    CHECK_NULL(stat);
+
+    for (i = 0; i < LGW_COM_SUB_NB; i++) {
+        s = &lgw_inst->com_stat[i];
+        stat[i].nb_access = STAT_GET(&s->nb_access, reset);
+        stat[i].nb_error = STAT_GET(&s->nb_error, reset);
+        stat[i].data_w = STAT_GET(&s->data_w, reset);
+        stat[i].data_r = STAT_GET(&s->data_r, reset);
+        stat[i].usb_nb_req = STAT_GET(&s->usb_nb_req, reset);
+        stat[i].usb_nb_ack = STAT_GET(&s->usb_nb_ack, reset);
+        stat[i].usb_nb_flush = STAT_GET(&s->usb_nb_flush, reset);
+        stat[i].usb_wire_w = STAT_GET(&s->usb_wire_w, reset);
+        stat[i].usb_wire_r = STAT_GET(&s->usb_wire_r, reset);
+    }
+
+    return LGW_COM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+const char * lgw_com_subsystem_name(lgw_com_sub_t sub) {
+    if (sub >= LGW_COM_SUB_NB) {
+        return "";
+    }
+
+    return com_sub_name[sub];
 }
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -55,6 +55,9 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define TS_CPS              1E6 /* count-per-second of the timestamp counter */
 #define PLUS_10PPM          1.00001
 #define MINUS_10PPM         0.99999
+#define FIT_OUTLIER_US      20      /* PPS samples further from the time model prediction are aberrant */
+#define FIT_XERR_SD         1E-6    /* clock error uncertainty assumed when it is not fitted on enough samples */
+#define HOLDOVER_WANDER     1E-9    /* assumed random walk of the XTAL frequency, per second */
 #define DEFAULT_BAUDRATE    B9600
 
 #define UBX_MSG_NAVTIMEGPS_LEN  16
@@ -90,162 +93,387 @@ static short gps_sat = 0; /* number of satellites used for fix */
 
 static struct termios ttyopt_restore;
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* states of the incremental stream parser, see lgw_gps_parse_stream() */
+enum gps_stream_state {
+    GPS_WAIT_SYNC,      /* looking for '$' or the first UBX sync char */
+    GPS_NMEA_BODY,      /* between '$' and '*', fields are checksummed and stored on the fly */
+    GPS_NMEA_CK1,       /* first hex char of the NMEA checksum */
+    GPS_NMEA_CK2,       /* second hex char of the NMEA checksum, end of frame */
+    GPS_UBX_SYNC2,      /* second UBX sync char */
+    GPS_UBX_CLASS,
+    GPS_UBX_ID,
+    GPS_UBX_LEN1,
+    GPS_UBX_LEN2,
+    GPS_UBX_PAYLOAD,
+    GPS_UBX_CKA,
+    GPS_UBX_CKB         /* second byte of the UBX checksum, end of frame */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
-static int nmea_checksum(const char *nmea_string, int buff_size, char *checksum);
+static void ubx_timegps_update(const uint8_t *payload);
+
+static void nmea_rmc_update(const struct lgw_gps_parser_s *p);
+
+static void nmea_gga_update(const struct lgw_gps_parser_s *p);
+
+static int nmea_field_slot(enum gps_msg msg, int field);
 
-static char nibble_to_hexchar(uint8_t a);
+static bool parse_digits(const char *s, int n, short *value);
 
-static bool validate_nmea_checksum(const char *serial_buff, int buff_size);
+static int parse_decimal(const char *s, int max_len, double *value);
 
-static bool match_label(const char *s, char *label, int size, char wildcard);
+static int hexchar_to_nibble(uint8_t c);
 
-static int str_chop(char *s, int buff_size, char separator, int *idx_ary, int max_idx);
+static enum gps_stream_state stream_sync(struct lgw_gps_parser_s *p, uint8_t c);
+
+static void timespec_shift(struct timespec *t, struct timespec ref, double delta_sec);
+
+static void gps_fit_add(struct tref *ref, uint32_t count_us, struct timespec utc, struct timespec gps_time);
+
+static void gps_fit_solve(struct tref *ref);
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
 /*
-Calculate the checksum for a NMEA string
-Skip the first '$' if necessary and calculate checksum until '*' character is
-reached (or buff_size exceeded).
-Checksum must point to a 2-byte (or more) char array.
-Return position of the checksum in the string
+Update the GPS time variables from a checksummed UBX NAV-TIMEGPS payload
+(16 bytes, little endian)
 */
-static int nmea_checksum(const char *nmea_string, int buff_size, char *checksum) {
-    int i = 0;
-    uint8_t check_num = 0;
-
-    /* check input parameters */
-    if ((nmea_string == NULL) ||  (checksum == NULL) || (buff_size <= 1)) {
-        DEBUG_MSG("Invalid parameters for nmea_checksum\n");
-        return -1;
+static void ubx_timegps_update(const uint8_t *payload) {
+    /* Check validity of information */
+    if ((payload[11] & 0x3) == 0) { /* towValid, weekValid */
+        gps_time_ok = false;
+        return;
     }
 
-    /* skip the first '$' if necessary */
-    if (nmea_string[i] == '$') {
-        i += 1;
-    }
+    gps_iTOW =  (uint32_t)payload[0];
+    gps_iTOW |= (uint32_t)payload[1] << 8;
+    gps_iTOW |= (uint32_t)payload[2] << 16;
+    gps_iTOW |= (uint32_t)payload[3] << 24; /* GPS time of week, in ms */
 
-    /* xor until '*' or max length is reached */
-    while (nmea_string[i] != '*') {
-        check_num ^= nmea_string[i];
-        i += 1;
-        if (i >= buff_size) {
-            DEBUG_MSG("Maximum length reached for nmea_checksum\n");
-            return -1;
-        }
-    }
+    gps_fTOW =  (uint32_t)payload[4];
+    gps_fTOW |= (uint32_t)payload[5] << 8;
+    gps_fTOW |= (uint32_t)payload[6] << 16;
+    gps_fTOW |= (uint32_t)payload[7] << 24; /* Fractional part of iTOW, in ns */
 
-    /* Convert checksum value to 2 hexadecimal characters */
-    checksum[0] = nibble_to_hexchar(check_num / 16); /* upper nibble */
-    checksum[1] = nibble_to_hexchar(check_num % 16); /* lower nibble */
+    gps_week =  (uint16_t)payload[8];
+    gps_week |= (uint16_t)payload[9] << 8; /* GPS week number */
 
-    return i + 1;
+    gps_time_ok = true;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static char nibble_to_hexchar(uint8_t a) {
-    if (a < 10) {
-        return '0' + a;
-    } else if (a < 16) {
-        return 'A' + (a-10);
+/*
+Update the date/time variables from the fields of a checksummed RMC sentence
+NMEA sentence format: $xxRMC,time,status,lat,NS,long,EW,spd,cog,date,mv,mvEW,posMode*cs<CR><LF>
+Valid fix: $GPRMC,083559.34,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A*00
+No fix: $GPRMC,,V,,,,,,,,,,N*00
+*/
+static void nmea_rmc_update(const struct lgw_gps_parser_s *p) {
+    const char *time = p->field[0];
+    const char *date = p->field[1];
+    double fra;
+    bool time_ok;
+
+    /* parse GPS status, first character of the field */
+    gps_mod = p->field[2][0];
+    if ((gps_mod != 'N') && (gps_mod != 'A') && (gps_mod != 'D')) {
+        gps_mod = 'N';
+    }
+
+    /* parse complete time, hhmmss.ss + ddmmyy */
+    time_ok = parse_digits(time, 2, &gps_hou) && parse_digits(time + 2, 2, &gps_min) && parse_digits(time + 4, 2, &gps_sec);
+    time_ok = time_ok && (parse_decimal(time + 6, 4, &fra) > 0);
+    if (time_ok) {
+        gps_fra = (float)fra;
+    }
+    time_ok = time_ok && parse_digits(date, 2, &gps_day) && parse_digits(date + 2, 2, &gps_mon) && parse_digits(date + 4, 2, &gps_yea);
+    if (time_ok) {
+        if ((gps_mod == 'A') || (gps_mod == 'D')) {
+            gps_time_ok = true;
+            DEBUG_MSG("Note: Valid RMC sentence, GPS locked, date: 20%02d-%02d-%02dT%02d:%02d:%06.3fZ\n", gps_yea, gps_mon, gps_day, gps_hou, gps_min, gps_fra + (float)gps_sec);
+        } else {
+            gps_time_ok = false;
+            DEBUG_MSG("Note: Valid RMC sentence, no satellite fix, estimated date: 20%02d-%02d-%02dT%02d:%02d:%06.3fZ\n", gps_yea, gps_mon, gps_day, gps_hou, gps_min, gps_fra + (float)gps_sec);
+        }
     } else {
-        return '?';
+        /* could not get a valid hour AND date */
+        gps_time_ok = false;
+        DEBUG_MSG("Note: Valid RMC sentence, mode %c, no date\n", gps_mod);
     }
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /*
-Calculate the checksum of a NMEA frame and compare it to the checksum that is
-present at the end of it.
-Return true if it matches
+Update the position variables from the fields of a checksummed GGA sentence
+NMEA sentence format: $xxGGA,time,lat,NS,long,EW,quality,numSV,HDOP,alt,M,sep,M,diffAge,diffStation*cs<CR><LF>
+Valid fix: $GPGGA,092725.00,4717.11399,N,00833.91590,E,1,08,1.01,499.6,M,48.0,M,,*5B
 */
-static bool validate_nmea_checksum(const char *serial_buff, int buff_size) {
-    int checksum_index;
-    char checksum[2]; /* 2 characters to calculate NMEA checksum */
-
-    checksum_index = nmea_checksum(serial_buff, buff_size, checksum);
+static void nmea_gga_update(const struct lgw_gps_parser_s *p) {
+    double value;
+    bool lat_ok, lon_ok, alt_ok;
 
-    /* could we calculate a verification checksum ? */
-    if (checksum_index < 0) {
-        DEBUG_MSG("ERROR: IMPOSSIBLE TO PARSE NMEA SENTENCE\n");
-        return false;
+    /* parse number of satellites used for fix */
+    if (parse_decimal(p->field[4], LGW_GPS_FIELD_SIZE, &value) > 0) {
+        gps_sat = (short)value;
     }
 
-    /* check if there are enough char in the serial buffer to read checksum */
-    if (checksum_index >= (buff_size - 2)) {
-        DEBUG_MSG("ERROR: IMPOSSIBLE TO READ NMEA SENTENCE CHECKSUM\n");
-        return false;
+    /* parse 3D coordinates, ddmm.mmmmm and dddmm.mmmmm */
+    lat_ok = parse_digits(p->field[0], 2, &gps_dla) && (parse_decimal(p->field[0] + 2, 10, &gps_mla) > 0);
+    gps_ola = p->field[1][0];
+    lon_ok = parse_digits(p->field[2], 3, &gps_dlo) && (parse_decimal(p->field[2] + 3, 10, &gps_mlo) > 0);
+    gps_olo = p->field[3][0];
+    if (p->field[5][0] == '-') {
+        alt_ok = (parse_decimal(p->field[5] + 1, LGW_GPS_FIELD_SIZE, &value) > 0);
+        value = -value;
+    } else {
+        alt_ok = (parse_decimal(p->field[5], LGW_GPS_FIELD_SIZE, &value) > 0);
+    }
+    if (alt_ok) {
+        gps_alt = (short)value; /* truncated to the meter, like "%hd" */
     }
 
-    /* check the checksum per se */
-    if ((serial_buff[checksum_index] == checksum[0]) && (serial_buff[checksum_index+1] == checksum[1])) {
-        return true;
+    if (lat_ok && lon_ok && alt_ok && ((gps_ola=='N')||(gps_ola=='S')) && ((gps_olo=='E')||(gps_olo=='W'))) {
+        gps_pos_ok = true;
+        DEBUG_MSG("Note: Valid GGA sentence, %d sat, lat %02ddeg %06.3fmin %c, lon %03ddeg%06.3fmin %c, alt %d\n", gps_sat, gps_dla, gps_mla, gps_ola, gps_dlo, gps_mlo, gps_olo, gps_alt);
     } else {
-        DEBUG_MSG("ERROR: NMEA CHECKSUM %c%c DOESN'T MATCH VERIFICATION CHECKSUM %c%c\n", serial_buff[checksum_index], serial_buff[checksum_index+1], checksum[0], checksum[1]);
-        return false;
+        /* could not get a valid latitude, longitude AND altitude */
+        gps_pos_ok = false;
+        DEBUG_MSG("Note: Valid GGA sentence, %d sat, no coordinates\n", gps_sat);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Return the storage slot of a NMEA field that is needed to update the global
+variables, or -1 if the field can be skipped.
+*/
+static int nmea_field_slot(enum gps_msg msg, int field) {
+    if (msg == NMEA_RMC) {
+        switch (field) {
+            case 1: return 0;   /* time */
+            case 9: return 1;   /* date */
+            case 12: return 2;  /* posMode */
+            default: return -1;
+        }
+    } else if (msg == NMEA_GGA) {
+        switch (field) {
+            case 2: return 0;   /* lat */
+            case 3: return 1;   /* NS */
+            case 4: return 2;   /* long */
+            case 5: return 3;   /* EW */
+            case 7: return 4;   /* numSV */
+            case 9: return 5;   /* alt */
+            default: return -1;
+        }
     }
+    return -1;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /*
-Return true if the "label" string (can contain wildcard characters) matches
-the begining of the "s" string
+Parse exactly n decimal digits.
+Return false if any of them is not a digit (incl. string terminator).
 */
-static bool match_label(const char *s, char *label, int size, char wildcard) {
+static bool parse_digits(const char *s, int n, short *value) {
     int i;
+    short v = 0;
 
-    for (i=0; i < size; i++) {
-        if (label[i] == wildcard) continue;
-        if (label[i] != s[i]) return false;
+    for (i = 0; i < n; i++) {
+        if ((s[i] < '0') || (s[i] > '9')) {
+            return false;
+        }
+        v = (v * 10) + (s[i] - '0');
     }
+    *value = v;
     return true;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /*
-Chop a string into smaller strings
-Replace every separator in the input character buffer by a null character so
-that all s[index] are valid strings.
-Populate an array of integer 'idx_ary' representing indexes of token in the
-string.
-buff_size and max_idx are there to prevent segfaults.
-Return the number of token found (number of idx_ary filled).
+Parse an unsigned decimal number (digits with an optional fractional part) of
+at most max_len characters, without relying on locale or sscanf.
+Return the number of digits parsed, 0 if no number was found.
 */
-int str_chop(char *s, int buff_size, char separator, int *idx_ary, int max_idx) {
-    int i = 0; /* index in the string */
-    int j = 0; /* index in the result array */
+static int parse_decimal(const char *s, int max_len, double *value) {
+    int i;
+    int nb_digits = 0;
+    double v = 0.0;
+    double scale = 0.0; /* 0 while in the integer part */
+
+    for (i = 0; i < max_len; i++) {
+        if ((s[i] >= '0') && (s[i] <= '9')) {
+            if (scale == 0.0) {
+                v = (v * 10.0) + (s[i] - '0');
+            } else {
+                v += scale * (s[i] - '0');
+                scale /= 10.0;
+            }
+            nb_digits += 1;
+        } else if ((s[i] == '.') && (scale == 0.0)) {
+            scale = 0.1;
+        } else {
+            break;
+        }
+    }
+    if (nb_digits > 0) {
+        *value = v;
+    }
+    return nb_digits;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    if ((s == NULL) || (buff_size < 0) || (separator == 0) || (idx_ary == NULL) || (max_idx < 0)) {
-        /* unsafe to do anything */
+static int hexchar_to_nibble(uint8_t c) {
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    } else if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    } else if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    } else {
         return -1;
     }
-    if ((buff_size == 0) || (max_idx == 0)) {
-        /* nothing to do */
-        return 0;
-    }
-    s[buff_size - 1] = 0; /* add string terminator at the end of the buffer, just to be sure */
-    idx_ary[j] = 0;
-    j += 1;
-    /* loop until string terminator is reached */
-    while (s[i] != 0) {
-        if (s[i] == separator) {
-            s[i] = 0; /* replace separator by string terminator */
-            if (j >= max_idx) { /* no more room in the index array */
-                return j;
-            }
-            idx_ary[j] = i+1; /* next token start after replaced separator */
-            ++j;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Start a new frame if c is a sync character, return the next parser state
+*/
+static enum gps_stream_state stream_sync(struct lgw_gps_parser_s *p, uint8_t c) {
+    int i;
+
+    if (c == LGW_GPS_NMEA_SYNC_CHAR) {
+        p->msg = UNKNOWN;
+        p->size = 1;
+        p->field_idx = 0;
+        p->char_idx = 0;
+        p->ck_a = 0;
+        for (i = 0; i < LGW_GPS_NB_FIELDS; i++) {
+            p->field[i][0] = '\0';
+        }
+        return GPS_NMEA_BODY;
+    } else if (c == LGW_GPS_UBX_SYNC_CHAR) {
+        return GPS_UBX_SYNC2;
+    } else {
+        return GPS_WAIT_SYNC;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Set t to ref + delta_sec (positive or negative), with ns resolution
+*/
+static void timespec_shift(struct timespec *t, struct timespec ref, double delta_sec) {
+    double intpart, fractpart;
+    long tmp;
+
+    fractpart = modf(delta_sec, &intpart);
+    tmp = ref.tv_nsec + (long)(fractpart * 1E9);
+    t->tv_sec = ref.tv_sec + (time_t)intpart;
+    if (tmp >= (long)1E9) { /* must carry one second */
+        t->tv_sec += 1;
+        tmp -= (long)1E9;
+    } else if (tmp < 0) { /* must borrow one second */
+        t->tv_sec -= 1;
+        tmp += (long)1E9;
+    }
+    t->tv_nsec = tmp;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Add a PPS sample to the time model window of ref, replacing the oldest one if full
+*/
+static void gps_fit_add(struct tref *ref, uint32_t count_us, struct timespec utc, struct timespec gps_time) {
+    ref->fit[ref->fit_head].count_us = count_us;
+    ref->fit[ref->fit_head].utc = utc;
+    ref->fit[ref->fit_head].gps = gps_time;
+    ref->fit_head = (ref->fit_head + 1) % LGW_GPS_FIT_SIZE;
+    if (ref->fit_nb < LGW_GPS_FIT_SIZE) {
+        ref->fit_nb += 1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Fit the concentrator counter against UTC time on the samples held, by least
+squares, and update the time reference accordingly. With less than 3 samples
+in the last LGW_GPS_FIT_SPAN seconds (eg. GPS back after a holdover), the clock
+error of ref is kept if it was fitted, or else computed from 2 samples.
+*/
+static void gps_fit_solve(struct tref *ref) {
+    const struct lgw_gps_sample_s *fit = ref->fit;
+    int last = (ref->fit_head + LGW_GPS_FIT_SIZE - 1) % LGW_GPS_FIT_SIZE;
+    double x[LGW_GPS_FIT_SIZE], y[LGW_GPS_FIT_SIZE];
+    double mx = 0.0, my = 0.0, sxx = 0.0, sxy = 0.0, sr = 0.0;
+    double a, b, r;
+    int i, j, n = 0;
+
+    /* samples relative to the latest one: x in seconds of UTC, y in us of counter */
+    for (i = 0; i < ref->fit_nb; i++) {
+        j = (last + LGW_GPS_FIT_SIZE - i) % LGW_GPS_FIT_SIZE;
+        x[n] = (double)(fit[j].utc.tv_sec - fit[last].utc.tv_sec) + (1E-9 * (double)(fit[j].utc.tv_nsec - fit[last].utc.tv_nsec));
+        if (x[n] < -LGW_GPS_FIT_SPAN) {
+            break; /* the older samples are not fitted either */
         }
-        ++i;
+        y[n] = (double)(int32_t)(fit[j].count_us - fit[last].count_us);
+        mx += x[n];
+        my += y[n];
+        n += 1;
+    }
+    mx /= n;
+    my /= n;
+    for (i = 0; i < n; i++) {
+        sxx += (x[i] - mx) * (x[i] - mx);
+        sxy += (x[i] - mx) * (y[i] - my);
+    }
+
+    /* counter value at the latest sample time: y = a + b.x */
+    if ((n <= 2) && (ref->xtal_err_sd < FIT_XERR_SD)) {
+        b = ref->xtal_err * TS_CPS;
+    } else {
+        b = (sxx > 0.0) ? (sxy / sxx) : (ref->xtal_err * TS_CPS);
+    }
+    /* the fit of a clock at the edge of the range can be just out of it */
+    if (b > (PLUS_10PPM * TS_CPS)) {
+        b = PLUS_10PPM * TS_CPS;
+    } else if (b < (MINUS_10PPM * TS_CPS)) {
+        b = MINUS_10PPM * TS_CPS;
+    }
+    a = my - (b * mx);
+    for (i = 0; i < n; i++) {
+        r = y[i] - a - (b * x[i]);
+        sr += r * r;
+    }
+
+    /* reference on the fitted line, at the counter value of the latest sample */
+    ref->count_us = fit[last].count_us;
+    timespec_shift(&ref->utc, fit[last].utc, -a / b);
+    timespec_shift(&ref->gps, fit[last].gps, -a / b);
+    ref->xtal_err = b / TS_CPS;
+    ref->nb_sync = (uint8_t)n;
+    if (n > 2) {
+        ref->jitter_us = sqrt(sr / (n - 2));
+        ref->xtal_err_sd = (ref->jitter_us / sqrt(sxx)) / TS_CPS;
+    } else if (ref->xtal_err_sd >= FIT_XERR_SD) {
+        ref->jitter_us = 0.0;
+        ref->xtal_err_sd = FIT_XERR_SD;
     }
-    return j;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -336,9 +564,10 @@ int lgw_gps_enable(char *tty_path, char *gps_family, speed_t target_brate, int *
     ttyopt.c_lflag &= ~ECHOK;  /* do not echo NL after KILL character */
 
     /* settings for non-canonical mode
-       read will block for until the lesser of VMIN or requested chars have been received */
-    ttyopt.c_cc[VMIN]  = LGW_GPS_MIN_MSG_SIZE;
-    ttyopt.c_cc[VTIME] = 0;
+       read will block until at least VMIN char is received, and return all the chars
+       available up to the requested number (no waiting for the end of a burst) */
+    ttyopt.c_cc[VMIN]  = LGW_GPS_READ_VMIN;
+    ttyopt.c_cc[VTIME] = LGW_GPS_READ_VTIME;
 
     /* set new serial ports parameters */
     i = tcsetattr(gps_tty_dev, TCSANOW, &ttyopt);
@@ -391,7 +620,6 @@ int lgw_gps_disable(int fd) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 enum gps_msg lgw_parse_ubx(const char *serial_buff, size_t buff_size, size_t *msg_size) {
-    bool valid = 0;    /* iTOW, fTOW and week validity */
     unsigned int payload_length;
     uint8_t ck_a, ck_b;
     uint8_t ck_a_rcv, ck_b_rcv;
@@ -439,42 +667,7 @@ enum gps_msg lgw_parse_ubx(const char *serial_buff, size_t buff_size, size_t *ms
             if ((ck_a == ck_a_rcv) && (ck_b == ck_b_rcv)) {
                 /* Check for Class 0x01 (NAV) and ID 0x20 (NAV-TIMEGPS) */
                 if ((serial_buff[2] == 0x01) && (serial_buff[3] == 0x20)) {
-                    /* Check validity of information */
-                    valid = serial_buff[17] & 0x3; /* towValid, weekValid */
-                    if (valid) {
-                        /* Parse buffer to extract GPS time */
-                        /* Warning: payload byte ordering is Little Endian */
-                        gps_iTOW =  (uint8_t)serial_buff[6];
-                        gps_iTOW |= (uint8_t)serial_buff[7] << 8;
-                        gps_iTOW |= (uint8_t)serial_buff[8] << 16;
-                        gps_iTOW |= (uint8_t)serial_buff[9] << 24; /* GPS time of week, in ms */
-
-                        gps_fTOW =  (uint8_t)serial_buff[10];
-                        gps_fTOW |= (uint8_t)serial_buff[11] << 8;
-                        gps_fTOW |= (uint8_t)serial_buff[12] << 16;
-                        gps_fTOW |= (uint8_t)serial_buff[13] << 24; /* Fractional part of iTOW, in ns */
-
-                        gps_week =  (uint8_t)serial_buff[14];
-                        gps_week |= (uint8_t)serial_buff[15] << 8; /* GPS week number */
-
-                        gps_time_ok = true;
-#if 0
-                        /* For debug */
-                        {
-                            short ubx_gps_hou = 0; /* hours (0-23) */
-                            short ubx_gps_min = 0; /* minutes (0-59) */
-                            short ubx_gps_sec = 0; /* seconds (0-59) */
-
-                            /* Format GPS time in hh:mm:ss based on iTOW */
-                            ubx_gps_sec = (gps_iTOW / 1000) % 60;
-                            ubx_gps_min = (gps_iTOW / 1000 / 60) % 60;
-                            ubx_gps_hou = (gps_iTOW / 1000 / 60 / 60) % 24;
-                            printf("  GPS time = %02d:%02d:%02d\n", ubx_gps_hou, ubx_gps_min, ubx_gps_sec);
-                        }
-#endif
-                    } else { /* valid */
-                        gps_time_ok = false;
-                    }
+                    ubx_timegps_update((const uint8_t *)&serial_buff[6]);
 
                     return UBX_NAV_TIMEGPS;
                 } else if ((serial_buff[2] == 0x05) && (serial_buff[3] == 0x00)) {
@@ -504,96 +697,227 @@ enum gps_msg lgw_parse_ubx(const char *serial_buff, size_t buff_size, size_t *ms
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 enum gps_msg lgw_parse_nmea(const char *serial_buff, int buff_size) {
-    int i, j, k;
-    int str_index[30]; /* string index from the string chopping */
-    int nb_fields; /* number of strings detected by string chopping */
-    char parser_buf[256]; /* parsing modifies buffer so need a local copy */
+    struct lgw_gps_parser_s parser;
+    enum gps_msg msg;
+    size_t nb_read;
 
     /* check input parameters */
     if (serial_buff == NULL) {
         return UNKNOWN;
     }
 
-    if(buff_size > (int)(sizeof(parser_buf) - 1)) {
-        DEBUG_MSG("Note: input string to big for parsing\n");
-        return INVALID;
-    }
-
     /* look for some NMEA sentences in particular */
     if (buff_size < 8) {
         DEBUG_MSG("ERROR: TOO SHORT TO BE A VALID NMEA SENTENCE\n");
         return UNKNOWN;
-    } else if (!validate_nmea_checksum(serial_buff, buff_size)) {
-        DEBUG_MSG("Warning: invalid NMEA sentence (bad checksum)\n");
+    } else if (serial_buff[0] != LGW_GPS_NMEA_SYNC_CHAR) {
+        DEBUG_MSG("Warning: invalid NMEA sentence (no sync char)\n");
         return INVALID;
-    } else if (match_label(serial_buff, "$G?RMC", 6, '?')) {
-        /*
-        NMEA sentence format: $xxRMC,time,status,lat,NS,long,EW,spd,cog,date,mv,mvEW,posMode*cs<CR><LF>
-        Valid fix: $GPRMC,083559.34,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A*00
-        No fix: $GPRMC,,V,,,,,,,,,,N*00
-        */
-        memcpy(parser_buf, serial_buff, buff_size);
-        parser_buf[buff_size] = '\0';
-        nb_fields = str_chop(parser_buf, buff_size, ',', str_index, ARRAY_SIZE(str_index));
-        if (nb_fields != 13) {
-            DEBUG_MSG("Warning: invalid RMC sentence (number of fields)\n");
-            return IGNORED;
-        }
-        /* parse GPS status */
-        gps_mod = *(parser_buf + str_index[12]); /* get first character, no need to bother with sscanf */
-        if ((gps_mod != 'N') && (gps_mod != 'A') && (gps_mod != 'D')) {
-            gps_mod = 'N';
-        }
-        /* parse complete time */
-        i = sscanf(parser_buf + str_index[1], "%2hd%2hd%2hd%4f", &gps_hou, &gps_min, &gps_sec, &gps_fra);
-        j = sscanf(parser_buf + str_index[9], "%2hd%2hd%2hd", &gps_day, &gps_mon, &gps_yea);
-        if ((i == 4) && (j == 3)) {
-            if ((gps_mod == 'A') || (gps_mod == 'D')) {
-                gps_time_ok = true;
-                DEBUG_MSG("Note: Valid RMC sentence, GPS locked, date: 20%02d-%02d-%02dT%02d:%02d:%06.3fZ\n", gps_yea, gps_mon, gps_day, gps_hou, gps_min, gps_fra + (float)gps_sec);
-            } else {
-                gps_time_ok = false;
-                DEBUG_MSG("Note: Valid RMC sentence, no satellite fix, estimated date: 20%02d-%02d-%02dT%02d:%02d:%06.3fZ\n", gps_yea, gps_mon, gps_day, gps_hou, gps_min, gps_fra + (float)gps_sec);
-            }
-        } else {
-            /* could not get a valid hour AND date */
-            gps_time_ok = false;
-            DEBUG_MSG("Note: Valid RMC sentence, mode %c, no date\n", gps_mod);
-        }
-        return NMEA_RMC;
-    } else if (match_label(serial_buff, "$G?GGA", 6, '?')) {
-        /*
-        NMEA sentence format: $xxGGA,time,lat,NS,long,EW,quality,numSV,HDOP,alt,M,sep,M,diffAge,diffStation*cs<CR><LF>
-        Valid fix: $GPGGA,092725.00,4717.11399,N,00833.91590,E,1,08,1.01,499.6,M,48.0,M,,*5B
-        */
-        memcpy(parser_buf, serial_buff, buff_size);
-        parser_buf[buff_size] = '\0';
-        nb_fields = str_chop(parser_buf, buff_size, ',', str_index, ARRAY_SIZE(str_index));
-        if (nb_fields != 15) {
-            DEBUG_MSG("Warning: invalid GGA sentence (number of fields)\n");
-            return IGNORED;
+    }
+
+    lgw_gps_parser_init(&parser);
+    msg = lgw_gps_parse_stream(&parser, (const uint8_t *)serial_buff, buff_size, &nb_read);
+    if (msg == INCOMPLETE) {
+        DEBUG_MSG("Warning: invalid NMEA sentence (no checksum)\n");
+        return INVALID;
+    }
+    return msg;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_gps_parser_init(struct lgw_gps_parser_s *parser) {
+    if (parser == NULL) {
+        return;
+    }
+    memset(parser, 0, sizeof *parser);
+    parser->state = GPS_WAIT_SYNC;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+enum gps_msg lgw_gps_parse_stream(struct lgw_gps_parser_s *p, const uint8_t *buff, size_t buff_size, size_t *nb_read) {
+    size_t i;
+    uint8_t c;
+    int slot, nibble;
+    enum gps_msg msg;
+
+    if ((p == NULL) || (buff == NULL) || (nb_read == NULL)) {
+        if (nb_read != NULL) {
+            *nb_read = 0;
         }
-        /* parse number of satellites used for fix */
-        sscanf(parser_buf + str_index[7], "%hd", &gps_sat);
-        /* parse 3D coordinates */
-        i = sscanf(parser_buf + str_index[2], "%2hd%10lf", &gps_dla, &gps_mla);
-        gps_ola = *(parser_buf + str_index[3]);
-        j = sscanf(parser_buf + str_index[4], "%3hd%10lf", &gps_dlo, &gps_mlo);
-        gps_olo = *(parser_buf + str_index[5]);
-        k = sscanf(parser_buf + str_index[9], "%hd", &gps_alt);
-        if ((i == 2) && (j == 2) && (k == 1) && ((gps_ola=='N')||(gps_ola=='S')) && ((gps_olo=='E')||(gps_olo=='W'))) {
-            gps_pos_ok = true;
-            DEBUG_MSG("Note: Valid GGA sentence, %d sat, lat %02ddeg %06.3fmin %c, lon %03ddeg%06.3fmin %c, alt %d\n", gps_sat, gps_dla, gps_mla, gps_ola, gps_dlo, gps_mlo, gps_olo, gps_alt);
-        } else {
-            /* could not get a valid latitude, longitude AND altitude */
-            gps_pos_ok = false;
-            DEBUG_MSG("Note: Valid GGA sentence, %d sat, no coordinates\n", gps_sat);
+        return UNKNOWN;
+    }
+
+    for (i = 0; i < buff_size; i++) {
+        c = buff[i];
+        switch (p->state) {
+            case GPS_WAIT_SYNC:
+                p->state = stream_sync(p, c);
+                break;
+
+            case GPS_NMEA_BODY:
+                p->size += 1;
+                if (c == ',') {
+                    if (p->field_idx == 0) {
+                        /* end of the address field, only $G?RMC and $G?GGA are parsed */
+                        if ((p->char_idx == 5) && (p->addr[0] == 'G') && (memcmp(&p->addr[2], "RMC", 3) == 0)) {
+                            p->msg = NMEA_RMC;
+                        } else if ((p->char_idx == 5) && (p->addr[0] == 'G') && (memcmp(&p->addr[2], "GGA", 3) == 0)) {
+                            p->msg = NMEA_GGA;
+                        } else {
+                            p->msg = IGNORED;
+                        }
+                    }
+                    p->ck_a ^= c;
+                    p->field_idx += 1;
+                    p->char_idx = 0;
+                } else if (c == '*') {
+                    p->state = GPS_NMEA_CK1;
+                } else if (c == LGW_GPS_NMEA_SYNC_CHAR) {
+                    DEBUG_MSG("Warning: truncated NMEA sentence\n");
+                    p->state = GPS_WAIT_SYNC;
+                    *nb_read = i; /* the new sentence will be parsed on next call */
+                    return INVALID;
+                } else if ((c < 0x20) || (c > 0x7E) || (p->size > LGW_GPS_NMEA_MAX_SIZE)) {
+                    DEBUG_MSG("Warning: invalid NMEA sentence (garbage or too long)\n");
+                    p->state = GPS_WAIT_SYNC;
+                    *nb_read = i + 1;
+                    return INVALID;
+                } else {
+                    p->ck_a ^= c;
+                    if (p->field_idx == 0) {
+                        if (p->char_idx < sizeof p->addr) {
+                            p->addr[p->char_idx] = c;
+                        }
+                        p->char_idx += 1;
+                    } else {
+                        slot = nmea_field_slot(p->msg, p->field_idx);
+                        if ((slot >= 0) && (p->char_idx < (LGW_GPS_FIELD_SIZE - 1))) {
+                            p->field[slot][p->char_idx] = c;
+                            p->field[slot][p->char_idx + 1] = '\0';
+                            p->char_idx += 1;
+                        }
+                    }
+                }
+                break;
+
+            case GPS_NMEA_CK1:
+            case GPS_NMEA_CK2:
+                nibble = hexchar_to_nibble(c);
+                if (nibble < 0) {
+                    DEBUG_MSG("Warning: invalid NMEA sentence (checksum format)\n");
+                    p->state = GPS_WAIT_SYNC;
+                    /* a sync char will be parsed again on next call */
+                    *nb_read = ((c == LGW_GPS_NMEA_SYNC_CHAR) || (c == LGW_GPS_UBX_SYNC_CHAR)) ? i : i + 1;
+                    return INVALID;
+                }
+                if (p->state == GPS_NMEA_CK1) {
+                    p->ck_b = nibble << 4;
+                    p->state = GPS_NMEA_CK2;
+                    break;
+                }
+                /* end of frame, no need to wait for <CR><LF> */
+                p->state = GPS_WAIT_SYNC;
+                *nb_read = i + 1;
+                if ((p->ck_b | nibble) != p->ck_a) {
+                    DEBUG_MSG("Warning: invalid NMEA sentence (bad checksum)\n");
+                    return INVALID;
+                }
+                if ((p->msg == NMEA_RMC) && (p->field_idx + 1 == 13)) {
+                    nmea_rmc_update(p);
+                    return NMEA_RMC;
+                } else if ((p->msg == NMEA_GGA) && (p->field_idx + 1 == 15)) {
+                    nmea_gga_update(p);
+                    return NMEA_GGA;
+                } else {
+                    DEBUG_MSG("Note: ignored NMEA sentence\n"); /* quite verbose */
+                    return IGNORED;
+                }
+
+            case GPS_UBX_SYNC2:
+                if (c == 0x62) {
+                    p->ck_a = 0;
+                    p->ck_b = 0;
+                    p->state = GPS_UBX_CLASS;
+                } else {
+                    p->state = stream_sync(p, c);
+                }
+                break;
+
+            case GPS_UBX_CLASS:
+            case GPS_UBX_ID:
+            case GPS_UBX_LEN1:
+            case GPS_UBX_LEN2:
+            case GPS_UBX_PAYLOAD:
+                /* 8-bit Fletcher checksum over class, id, length and payload */
+                p->ck_a += c;
+                p->ck_b += p->ck_a;
+                if (p->state == GPS_UBX_CLASS) {
+                    p->addr[0] = c;
+                    p->state = GPS_UBX_ID;
+                } else if (p->state == GPS_UBX_ID) {
+                    p->addr[1] = c;
+                    p->state = GPS_UBX_LEN1;
+                } else if (p->state == GPS_UBX_LEN1) {
+                    p->size = c;
+                    p->state = GPS_UBX_LEN2;
+                } else if (p->state == GPS_UBX_LEN2) {
+                    p->size |= (uint16_t)c << 8;
+                    p->char_idx = 0;
+                    if (p->size > LGW_GPS_UBX_MAX_SIZE) {
+                        DEBUG_MSG("Warning: invalid UBX message (length %u)\n", p->size);
+                        p->state = GPS_WAIT_SYNC;
+                        *nb_read = i + 1;
+                        return INVALID;
+                    }
+                    p->state = (p->size > 0) ? GPS_UBX_PAYLOAD : GPS_UBX_CKA;
+                } else {
+                    /* only the NAV-TIMEGPS payload is stored */
+                    if (p->char_idx < sizeof p->payload) {
+                        p->payload[p->char_idx] = c;
+                    }
+                    p->char_idx += 1;
+                    if (p->char_idx == p->size) {
+                        p->state = GPS_UBX_CKA;
+                    }
+                }
+                break;
+
+            case GPS_UBX_CKA:
+                p->state = (c == p->ck_a) ? GPS_UBX_CKB : GPS_WAIT_SYNC;
+                if (p->state == GPS_WAIT_SYNC) {
+                    DEBUG_MSG("ERROR: UBX message is corrupted, checksum failed\n");
+                    *nb_read = i + 1;
+                    return INVALID;
+                }
+                break;
+
+            case GPS_UBX_CKB:
+                p->state = GPS_WAIT_SYNC;
+                *nb_read = i + 1;
+                if (c != p->ck_b) {
+                    DEBUG_MSG("ERROR: UBX message is corrupted, checksum failed\n");
+                    return INVALID;
+                }
+                /* Check for Class 0x01 (NAV) and ID 0x20 (NAV-TIMEGPS) */
+                if ((p->addr[0] == 0x01) && (p->addr[1] == 0x20) && (p->size == sizeof p->payload)) {
+                    ubx_timegps_update(p->payload);
+                    msg = UBX_NAV_TIMEGPS;
+                } else {
+                    DEBUG_MSG("NOTE: UBX message ignored (%02x %02x)\n", p->addr[0], p->addr[1]);
+                    msg = IGNORED;
+                }
+                return msg;
+
+            default:
+                p->state = GPS_WAIT_SYNC;
+                break;
         }
-        return NMEA_GGA;
-    } else {
-        DEBUG_MSG("Note: ignored NMEA sentence\n"); /* quite verbose */
-        return IGNORED;
     }
+
+    *nb_read = buff_size;
+    return INCOMPLETE;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -665,6 +989,7 @@ int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struc
     double cnt_diff; /* internal concentrator time difference (in seconds) */
     double utc_diff; /* UTC time difference (in seconds) */
     double slope; /* time slope between new reference and old reference (for sanity check) */
+    double residual_us; /* distance of the new sample from the time model prediction */
 
     bool aber_n0; /* is the update value for synchronization aberrant or not ? */
     static bool aber_min1 = false; /* keep track of whether value at sync N-1 was aberrant or not  */
@@ -678,9 +1003,25 @@ int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struc
     utc_diff = (double)(utc.tv_sec - (ref->utc).tv_sec) + (1E-9 * (double)(utc.tv_nsec - (ref->utc).tv_nsec));
 
     /* detect aberrant points by measuring if slope limits are exceeded */
-    if (utc_diff != 0) { // prevent divide by zero
+    if (ref->systime == 0) {
+        /* initial synchronization, nothing to compare with */
+        ref->fit_nb = 0;
+        ref->fit_head = 0;
+        ref->xtal_err = 1.0;
+        aber_n0 = true;
+        aber_min1 = true;
+        aber_min2 = true;
+    } else if (utc_diff != 0) { // prevent divide by zero
         slope = cnt_diff/utc_diff;
-        if ((slope > PLUS_10PPM) || (slope < MINUS_10PPM)) {
+        if ((ref->nb_sync >= 2) || (ref->xtal_err_sd < FIT_XERR_SD)) {
+            /* the clock error is fitted, check the sample against the model prediction
+             * (the slope from a single PPS interval is too noisy near the limits) */
+            residual_us = (cnt_diff - (utc_diff * ref->xtal_err)) * TS_CPS;
+            aber_n0 = (fabs(residual_us) > (FIT_OUTLIER_US + (3 * lgw_gps_holdover_us(*ref, utc_diff))));
+            if (aber_n0 == true) {
+                DEBUG_PRINTF("Warning: PPS sample %.1fus away from the time model\n", residual_us);
+            }
+        } else if ((slope > PLUS_10PPM) || (slope < MINUS_10PPM)) {
             DEBUG_MSG("Warning: correction range exceeded\n");
             aber_n0 = true;
         } else {
@@ -693,29 +1034,24 @@ int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struc
 
     /* watch if the 3 latest sync point were aberrant or not */
     if (aber_n0 == false) {
-        /* value no aberrant -> sync with smoothed slope */
+        /* value no aberrant -> sync with the clock error fitted on the latest samples */
+        gps_fit_add(ref, count_us, utc, gps_time);
         ref->systime = time(NULL);
-        ref->count_us = count_us;
-        ref->utc.tv_sec = utc.tv_sec;
-        ref->utc.tv_nsec = utc.tv_nsec;
-        ref->gps.tv_sec = gps_time.tv_sec;
-        ref->gps.tv_nsec = gps_time.tv_nsec;
-        ref->xtal_err = slope;
+        gps_fit_solve(ref);
         aber_min2 = aber_min1;
         aber_min1 = aber_n0;
         return LGW_GPS_SUCCESS;
     } else if (aber_n0 && aber_min1 && aber_min2) {
-        /* 3 successive aberrant values -> sync reset (keep xtal_err) */
+        /* 3 successive aberrant values -> sync reset (keep xtal_err, but check the next samples against it no more) */
+        ref->fit_nb = 0;
+        gps_fit_add(ref, count_us, utc, gps_time);
         ref->systime = time(NULL);
-        ref->count_us = count_us;
-        ref->utc.tv_sec = utc.tv_sec;
-        ref->utc.tv_nsec = utc.tv_nsec;
-        ref->gps.tv_sec = gps_time.tv_sec;
-        ref->gps.tv_nsec = gps_time.tv_nsec;
+        ref->xtal_err_sd = FIT_XERR_SD;
         /* reset xtal_err only if the present value is out of range */
         if ((ref->xtal_err > PLUS_10PPM) || (ref->xtal_err < MINUS_10PPM)) {
             ref->xtal_err = 1.0;
         }
+        gps_fit_solve(ref);
         DEBUG_MSG("Warning: 3 successive aberrant sync attempts, sync reset\n");
         aber_min2 = aber_min1;
         aber_min1 = aber_n0;
@@ -732,10 +1068,24 @@ int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struc
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+double lgw_gps_holdover_us(struct tref ref, double age_s) {
+    double err_us;
+
+    age_s = fabs(age_s);
+
+    /* uncertainty of the fitted line at the reference point */
+    err_us = (ref.nb_sync > 0) ? (ref.jitter_us / sqrt((double)ref.nb_sync)) : 0.0;
+    /* uncertainty of the clock error, and XTAL frequency wander since the reference */
+    err_us += age_s * ref.xtal_err_sd * TS_CPS;
+    err_us += 0.5 * HOLDOVER_WANDER * age_s * age_s * TS_CPS;
+
+    return err_us;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_cnt2utc(struct tref ref, uint32_t count_us, struct timespec *utc) {
     double delta_sec;
-    double intpart, fractpart;
-    long tmp;
 
     CHECK_NULL(utc);
     if ((ref.systime == 0) || (ref.xtal_err > PLUS_10PPM) || (ref.xtal_err < MINUS_10PPM)) {
@@ -743,19 +1093,11 @@ int lgw_cnt2utc(struct tref ref, uint32_t count_us, struct timespec *utc) {
         return LGW_GPS_ERROR;
     }
 
-    /* calculate delta in seconds between reference count_us and target count_us */
-    delta_sec = (double)(count_us - ref.count_us) / (TS_CPS * ref.xtal_err);
+    /* calculate delta in seconds between reference count_us and target count_us (before or after) */
+    delta_sec = (double)(int32_t)(count_us - ref.count_us) / (TS_CPS * ref.xtal_err);
 
     /* now add that delta to reference UTC time */
-    fractpart = modf (delta_sec , &intpart);
-    tmp = ref.utc.tv_nsec + (long)(fractpart * 1E9);
-    if (tmp < (long)1E9) { /* the nanosecond part doesn't overflow */
-        utc->tv_sec = ref.utc.tv_sec + (time_t)intpart;
-        utc->tv_nsec = tmp;
-    } else { /* must carry one second */
-        utc->tv_sec = ref.utc.tv_sec + (time_t)intpart + 1;
-        utc->tv_nsec = tmp - (long)1E9;
-    }
+    timespec_shift(utc, ref.utc, delta_sec);
 
     return LGW_GPS_SUCCESS;
 }
@@ -776,7 +1118,7 @@ int lgw_utc2cnt(struct tref ref, struct timespec utc, uint32_t *count_us) {
     delta_sec += 1E-9 * (double)(utc.tv_nsec - ref.utc.tv_nsec);
 
     /* now convert that to internal counter tics and add that to reference counter value */
-    *count_us = ref.count_us + (uint32_t)(delta_sec * TS_CPS * ref.xtal_err);
+    *count_us = ref.count_us + (uint32_t)(int64_t)(delta_sec * TS_CPS * ref.xtal_err);
 
     return LGW_GPS_SUCCESS;
 }
@@ -785,8 +1127,6 @@ int lgw_utc2cnt(struct tref ref, struct timespec utc, uint32_t *count_us) {
 
 int lgw_cnt2gps(struct tref ref, uint32_t count_us, struct timespec *gps_time) {
     double delta_sec;
-    double intpart, fractpart;
-    long tmp;
 
     CHECK_NULL(gps_time);
     if ((ref.systime == 0) || (ref.xtal_err > PLUS_10PPM) || (ref.xtal_err < MINUS_10PPM)) {
@@ -794,19 +1134,11 @@ int lgw_cnt2gps(struct tref ref, uint32_t count_us, struct timespec *gps_time) {
         return LGW_GPS_ERROR;
     }
 
-    /* calculate delta in milliseconds between reference count_us and target count_us */
-    delta_sec = (double)(count_us - ref.count_us) / (TS_CPS * ref.xtal_err);
+    /* calculate delta in seconds between reference count_us and target count_us (before or after) */
+    delta_sec = (double)(int32_t)(count_us - ref.count_us) / (TS_CPS * ref.xtal_err);
 
     /* now add that delta to reference GPS time */
-    fractpart = modf (delta_sec , &intpart);
-    tmp = ref.gps.tv_nsec + (long)(fractpart * 1E9);
-    if (tmp < (long)1E9) { /* the nanosecond part doesn't overflow */
-        gps_time->tv_sec = ref.gps.tv_sec + (time_t)intpart;
-        gps_time->tv_nsec = tmp;
-    } else { /* must carry one second */
-        gps_time->tv_sec = ref.gps.tv_sec + (time_t)intpart + 1;
-        gps_time->tv_nsec = tmp - (long)1E9;
-    }
+    timespec_shift(gps_time, ref.gps, delta_sec);
 
     return LGW_GPS_SUCCESS;
 }
@@ -827,7 +1159,7 @@ int lgw_gps2cnt(struct tref ref, struct timespec gps_time, uint32_t *count_us) {
     delta_sec += 1E-9 * (double)(gps_time.tv_nsec - ref.gps.tv_nsec);
 
     /* now convert that to internal counter tics and add that to reference counter value */
-    *count_us = ref.count_us + (uint32_t)(delta_sec * TS_CPS * ref.xtal_err);
+    *count_us = ref.count_us + (uint32_t)(int64_t)(delta_sec * TS_CPS * ref.xtal_err);
 
     return LGW_GPS_SUCCESS;
 }
@@ -23,13 +23,13 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
     #define _XOPEN_SOURCE 500
 #endif
 
-#define _GNU_SOURCE     /* needed for qsort_r to be defined */
-#include <stdlib.h>     /* qsort_r */
+#include <stdlib.h>     /* qsort */
 
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
 #include <stdio.h>      /* printf fprintf */
 #include <string.h>     /* memcpy */
+#include <time.h>       /* clock_gettime */
 #include <unistd.h>     /* symlink, unlink */
 #include <inttypes.h>
 
@@ -47,6 +47,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_stts751.h"
 #include "loragw_ad5338r.h"
 #include "loragw_debug.h"
+#include "loragw_handle.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- DEBUG CONSTANTS ------------------------------------------------------ */
@@ -71,20 +72,20 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #define TRACE()             fprintf(stderr, "@ %s %d\n", __FUNCTION__, __LINE__);
 
-#define CONTEXT_STARTED         lgw_context.is_started
-#define CONTEXT_COM_TYPE        lgw_context.board_cfg.com_type
-#define CONTEXT_COM_PATH        lgw_context.board_cfg.com_path
-#define CONTEXT_LWAN_PUBLIC     lgw_context.board_cfg.lorawan_public
-#define CONTEXT_BOARD           lgw_context.board_cfg
-#define CONTEXT_RF_CHAIN        lgw_context.rf_chain_cfg
-#define CONTEXT_IF_CHAIN        lgw_context.if_chain_cfg
-#define CONTEXT_DEMOD           lgw_context.demod_cfg
-#define CONTEXT_LORA_SERVICE    lgw_context.lora_service_cfg
-#define CONTEXT_FSK             lgw_context.fsk_cfg
-#define CONTEXT_TX_GAIN_LUT     lgw_context.tx_gain_lut
-#define CONTEXT_FINE_TIMESTAMP  lgw_context.ftime_cfg
-#define CONTEXT_SX1261          lgw_context.sx1261_cfg
-#define CONTEXT_DEBUG           lgw_context.debug_cfg
+#define CONTEXT_STARTED         lgw_inst->context.is_started
+#define CONTEXT_COM_TYPE        lgw_inst->context.board_cfg.com_type
+#define CONTEXT_COM_PATH        lgw_inst->context.board_cfg.com_path
+#define CONTEXT_LWAN_PUBLIC     lgw_inst->context.board_cfg.lorawan_public
+#define CONTEXT_BOARD           lgw_inst->context.board_cfg
+#define CONTEXT_RF_CHAIN        lgw_inst->context.rf_chain_cfg
+#define CONTEXT_IF_CHAIN        lgw_inst->context.if_chain_cfg
+#define CONTEXT_DEMOD           lgw_inst->context.demod_cfg
+#define CONTEXT_LORA_SERVICE    lgw_inst->context.lora_service_cfg
+#define CONTEXT_FSK             lgw_inst->context.fsk_cfg
+#define CONTEXT_TX_GAIN_LUT     lgw_inst->context.tx_gain_lut
+#define CONTEXT_FINE_TIMESTAMP  lgw_inst->context.ftime_cfg
+#define CONTEXT_SX1261          lgw_inst->context.sx1261_cfg
+#define CONTEXT_DEBUG           lgw_inst->context.debug_cfg
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
@@ -103,6 +104,30 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define LGW_RF_RX_FREQ_MIN          100E6
 #define LGW_RF_RX_FREQ_MAX          1E9
 
+#define TX_TRACK_RETRY_US           1000    /* min delay between 2 TX status reads while an expected transition is late */
+#define TX_TRACK_RETRY_MAX_US       10000   /* max delay between 2 TX status reads while an expected transition is late */
+#define TX_TRACK_RETRY_TOA_DIV      32      /* delay between 2 TX status reads while late: time on air / TX_TRACK_RETRY_TOA_DIV */
+#define TX_TRACK_GPS_POLL_US        100000  /* delay between 2 TX status reads while waiting for a PPS-triggered TX */
+#define TX_TRACK_REF_MAX_US         100000  /* max age of the counter reference used to predict the TX start */
+
+#if (LGW_TX_STAGE_ADVANCE_MIN < (TX_START_DELAY_DEFAULT + 500))
+    #error "LGW_TX_STAGE_ADVANCE_MIN does not cover the TX start delay"
+#endif
+
+#define MERGE_TMST_DIFF_MAX         24  /* max count_us difference between duplicated packets (3 samples) */
+
+/* Sort key of a received packet, used to merge packets without moving them around */
+struct pkt_key_s {
+    int32_t         tmst;           /* count_us relative to first packet, handles counter wrap-around */
+    uint32_t        datarate;
+    const uint8_t * payload;
+    uint16_t        size;
+    uint8_t         idx;            /* index of the packet in the array */
+    uint8_t         if_chain;
+    uint8_t         status;
+    bool            ftime_received;
+};
+
 /* Version string, used to identify the library version/options once compiled */
 const char lgw_version_string[] = "Version: " LIBLORAGW_VERSION ";";
 
@@ -114,100 +139,113 @@ const char lgw_version_string[] = "Version: " LIBLORAGW_VERSION ";";
 #include "agc_fw_sx1257.var"    /* text_agc_sx1257_19_Nov_1 */
 
 /*
-The following static variable holds the gateway configuration provided by the
-user that need to be propagated in the drivers.
+The following static variable holds the default state of a concentrator
+instance, including the gateway configuration provided by the user that need
+to be propagated in the drivers.
 
 Parameters validity and coherency is verified by the _setconf functions and
 the _start and _send functions assume they are valid.
 */
-static lgw_context_t lgw_context = {
-    .is_started = false,
-    .board_cfg.com_type = LGW_COM_SPI,
-    .board_cfg.com_path = "/dev/spidev0.0",
-    .board_cfg.lorawan_public = true,
-    .board_cfg.clksrc = 0,
-    .board_cfg.full_duplex = false,
-    .rf_chain_cfg = {{0}},
-    .if_chain_cfg = {{0}},
-    .demod_cfg = {
-        .multisf_datarate = LGW_MULTI_SF_EN
-    },
-    .lora_service_cfg = {
-        .enable = 0,    /* not used, handled by if_chain_cfg */
-        .rf_chain = 0,  /* not used, handled by if_chain_cfg */
-        .freq_hz = 0,   /* not used, handled by if_chain_cfg */
-        .bandwidth = BW_250KHZ,
-        .datarate = DR_LORA_SF7,
-        .implicit_hdr = false,
-        .implicit_payload_length = 0,
-        .implicit_crc_en = 0,
-        .implicit_coderate = 0
-    },
-    .fsk_cfg = {
-        .enable = 0,    /* not used, handled by if_chain_cfg */
-        .rf_chain = 0,  /* not used, handled by if_chain_cfg */
-        .freq_hz = 0,   /* not used, handled by if_chain_cfg */
-        .bandwidth = BW_125KHZ,
-        .datarate = 50000,
-        .sync_word_size = 3,
-        .sync_word = 0xC194C1
-    },
-    .tx_gain_lut = {
-        {
-            .size = 1,
-            .lut[0] = {
-                .rf_power = 14,
-                .dig_gain = 0,
-                .pa_gain = 2,
-                .dac_gain = 3,
-                .mix_gain = 10,
-                .offset_i = 0,
-                .offset_q = 0,
-                .pwr_idx = 0
+static const struct lgw_handle_s lgw_handle_template = {
+    .context = {
+        .is_started = false,
+        .board_cfg.com_type = LGW_COM_SPI,
+        .board_cfg.com_path = "/dev/spidev0.0",
+        .board_cfg.lorawan_public = true,
+        .board_cfg.clksrc = 0,
+        .board_cfg.full_duplex = false,
+        .rf_chain_cfg = {{0}},
+        .if_chain_cfg = {{0}},
+        .demod_cfg = {
+            .multisf_datarate = LGW_MULTI_SF_EN
+        },
+        .lora_service_cfg = {
+            .enable = 0,    /* not used, handled by if_chain_cfg */
+            .rf_chain = 0,  /* not used, handled by if_chain_cfg */
+            .freq_hz = 0,   /* not used, handled by if_chain_cfg */
+            .bandwidth = BW_250KHZ,
+            .datarate = DR_LORA_SF7,
+            .implicit_hdr = false,
+            .implicit_payload_length = 0,
+            .implicit_crc_en = 0,
+            .implicit_coderate = 0
+        },
+        .fsk_cfg = {
+            .enable = 0,    /* not used, handled by if_chain_cfg */
+            .rf_chain = 0,  /* not used, handled by if_chain_cfg */
+            .freq_hz = 0,   /* not used, handled by if_chain_cfg */
+            .bandwidth = BW_125KHZ,
+            .datarate = 50000,
+            .sync_word_size = 3,
+            .sync_word = 0xC194C1
+        },
+        .tx_gain_lut = {
+            {
+                .size = 1,
+                .lut[0] = {
+                    .rf_power = 14,
+                    .dig_gain = 0,
+                    .pa_gain = 2,
+                    .dac_gain = 3,
+                    .mix_gain = 10,
+                    .offset_i = 0,
+                    .offset_q = 0,
+                    .pwr_idx = 0
+                }
+            },{
+                .size = 1,
+                .lut[0] = {
+                    .rf_power = 14,
+                    .dig_gain = 0,
+                    .pa_gain = 2,
+                    .dac_gain = 3,
+                    .mix_gain = 10,
+                    .offset_i = 0,
+                    .offset_q = 0,
+                    .pwr_idx = 0
+                }
             }
-        },{
-            .size = 1,
-            .lut[0] = {
-                .rf_power = 14,
-                .dig_gain = 0,
-                .pa_gain = 2,
-                .dac_gain = 3,
-                .mix_gain = 10,
-                .offset_i = 0,
-                .offset_q = 0,
-                .pwr_idx = 0
+        },
+        .ftime_cfg = {
+            .enable = false,
+            .mode = LGW_FTIME_MODE_ALL_SF
+        },
+        .sx1261_cfg = {
+            .enable = false,
+            .spi_path = "/dev/spidev0.1",
+            .rssi_offset = 0,
+            .lbt_conf = {
+                .rssi_target = 0,
+                .nb_channel = 0,
+                .channels = {{ 0 }}
             }
+        },
+        .debug_cfg = {
+            .nb_ref_payload = 0,
+            .log_file_name = "loragw_hal.log"
         }
     },
-    .ftime_cfg = {
-        .enable = false,
-        .mode = LGW_FTIME_MODE_ALL_SF
-    },
-    .sx1261_cfg = {
-        .enable = false,
-        .spi_path = "/dev/spidev0.1",
-        .rssi_offset = 0,
-        .lbt_conf = {
-            .rssi_target = 0,
-            .nb_channel = 0,
-            .channels = {{ 0 }}
-        }
-    },
-    .debug_cfg = {
-        .nb_ref_payload = 0,
-        .log_file_name = "loragw_hal.log"
-    }
+    .log_file = NULL,                                   /* File handle to write debug logs */
+    .ts_fd = -1,                                        /* I2C temperature sensor handles */
+    .ts_addr = 0xFF,
+    .ad_fd = -1,                                        /* I2C AD5338 handles */
+    .com_type = LGW_COM_UNKNOWN,
+    .com_target = NULL,
+    .usb_write_mode = LGW_COM_WRITE_MODE_SINGLE,
+    .usb_spi_req_nb = 0,
+    .sx1261_com_type = LGW_COM_UNKNOWN,
+    .sx1261_com_target = NULL,
+    .sx1261_write_mode = LGW_COM_WRITE_MODE_SINGLE,
+    .sx1261_spi_req_nb = 0,
+    .rf_rx_image_amp = {0, 0},
+    .rf_rx_image_phi = {0, 0}
 };
 
-/* File handle to write debug logs */
-FILE * log_file = NULL;
+/* Instance used when the application does not select one */
+static struct lgw_handle_s lgw_handle_default;
 
-/* I2C temperature sensor handles */
-static int     ts_fd = -1;
-static uint8_t ts_addr = 0xFF;
-
-/* I2C AD5338 handles */
-static int     ad_fd = -1;
+/* Instance currently selected by the calling thread */
+__thread struct lgw_handle_s * lgw_inst = &lgw_handle_default;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
@@ -215,13 +253,39 @@ static int     ad_fd = -1;
 int32_t lgw_sf_getval(int x);
 int32_t lgw_bw_getval(int x);
 
-static bool is_same_pkt(struct lgw_pkt_rx_s *p1, struct lgw_pkt_rx_s *p2);
-static int remove_pkt(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt, uint8_t pkt_index);
-static int merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt);
+static bool is_same_pkt(const struct pkt_key_s *p1, const struct pkt_key_s *p2);
+static bool is_better_dup(const struct pkt_key_s *p1, const struct pkt_key_s *p2);
+static int compare_pkt_key(const void *a, const void *b);
+static int merge_keys(struct pkt_key_s * key, int nb_pkt, uint8_t * order);
+static void merge_compact(void * array, size_t elem_size, int nb_pkt, const uint8_t * order, int nb_keep);
+static int merge_packets_meta(struct lgw_pkt_rx_meta_s * meta, const uint8_t * payload, uint8_t * nb_pkt);
+
+static int receive_fetch(uint8_t max_pkt, uint8_t * nb_pkt, float * temperature);
+static int send_prepare(struct lgw_pkt_tx_s * pkt_data, struct lgw_tx_prep_s * prep);
+static int send_commit(struct lgw_tx_prep_s * prep);
+static int tx_dispatch(uint8_t rf_chain, uint8_t * code);
+static void tx_power_update(uint8_t rf_chain);
+static uint64_t host_time_us(void);
+static uint32_t counter_estimate(uint64_t now_us);
+static uint32_t tx_track_retry(uint32_t toa_us);
+static void tx_track_set(uint8_t rf_chain, uint8_t status);
+static void tx_track_read(uint8_t rf_chain, uint8_t status, uint64_t now_us);
+static void tx_track_sent(const struct lgw_pkt_tx_s * pkt_data, uint64_t commit_us, int result);
+static int tx_power_select(uint8_t rf_chain, int8_t rf_power, struct sx1302_tx_power_s * tx_pow);
+static int receive_parse(struct lgw_pkt_rx_s * pkt, float temperature);
+
+static void lgw_handle_default_init(void) __attribute__((constructor));
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+static void lgw_handle_default_init(void) {
+    /* Called once at library load, before any instance can be selected */
+    memcpy(&lgw_handle_default, &lgw_handle_template, sizeof lgw_handle_default);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int32_t lgw_bw_getval(int x) {
     switch (x) {
         case BW_500KHZ: return 500000;
@@ -249,205 +313,278 @@ int32_t lgw_sf_getval(int x) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static bool is_same_pkt(struct lgw_pkt_rx_s *p1, struct lgw_pkt_rx_s *p2) {
-    if ((p1 != NULL) && (p2 != NULL)) {
-        /* Criterias to determine if packets are identical:
-            -- count_us should be equal or can have up to 24µs of difference (3 samples)
-            -- channel should be same
-            -- datarate should be same
-            -- payload should be same
-        */
-        if ((abs(p1->count_us - p2->count_us) <= 24) &&
-            (p1->if_chain == p2->if_chain) &&
+static bool is_same_pkt(const struct pkt_key_s *p1, const struct pkt_key_s *p2) {
+    /* Criterias to determine if packets are identical (count_us already checked by caller):
+        -- channel should be same
+        -- datarate should be same
+        -- payload should be same
+    */
+    return ((p1->if_chain == p2->if_chain) &&
             (p1->datarate == p2->datarate) &&
             (p1->size == p2->size) &&
-            (memcmp(p1->payload, p2->payload, p1->size) == 0)) {
-
-            return true;
-        }
-    }
-
-    return false;
+            (memcmp(p1->payload, p2->payload, p1->size) == 0));
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static int remove_pkt(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt, uint8_t pkt_index) {
-    /* Check input parameters */
-    CHECK_NULL(p);
-    CHECK_NULL(nb_pkt);
-    if (pkt_index > ((*nb_pkt) - 1)) {
-        printf("ERROR: failed to remove packet index %u\n", pkt_index);
-        return -1;
+static bool is_better_dup(const struct pkt_key_s *p1, const struct pkt_key_s *p2) {
+    /* We keep the packet which has CRC checked */
+    if ((p1->status == STAT_CRC_OK) && (p2->status == STAT_CRC_BAD)) {
+        return true;
+    } else if ((p1->status == STAT_CRC_BAD) && (p2->status == STAT_CRC_OK)) {
+        return false;
     }
 
-    /* Remove pkt from array, by replacing it with last packet of array */
-    if (pkt_index == ((*nb_pkt) - 1)) {
-        /* If we remove last element, just decrement nb packet counter */
-        /* Do nothing */
-    } else {
-        /* Copy last packet onto the packet to be removed */
-        memcpy(p + pkt_index, p + (*nb_pkt) - 1, sizeof(struct lgw_pkt_rx_s));
+    /* sanity check */
+    if (p1->ftime_received == p2->ftime_received) {
+        DEBUG_MSG("WARNING: both duplicates have fine timestamps, or none has ? TBC\n");
     }
 
-    *nb_pkt -= 1;
-
-    return 0;
+    /* we keep the packet which has a fine timestamp */
+    return (p1->ftime_received == true);
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int compare_pkt_tmst(const void *a, const void *b, void *arg)
-{
-    struct lgw_pkt_rx_s *p = (struct lgw_pkt_rx_s *)a;
-    struct lgw_pkt_rx_s *q = (struct lgw_pkt_rx_s *)b;
-    int *counter = (int *)arg;
-    int p_count, q_count;
+static int compare_pkt_key(const void *a, const void *b) {
+    const struct pkt_key_s *p = (const struct pkt_key_s *)a;
+    const struct pkt_key_s *q = (const struct pkt_key_s *)b;
 
-    p_count = p->count_us;
-    q_count = q->count_us;
-
-    if (p_count > q_count) {
-        *counter = *counter + 1;
+    if (p->tmst != q->tmst) {
+        return (p->tmst < q->tmst) ? -1 : 1;
     }
 
-    return (p_count - q_count);
+    /* keep reception order for packets with same timestamp */
+    return (int)p->idx - (int)q->idx;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static int merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt) {
-    uint8_t cpt;
-    int j, k, pkt_dup_idx, x;
-#if DEBUG_HAL == 1
-    int pkt_idx;
-#endif
-    bool dup_restart = false;
-    int counter_qsort_swap = 0;
+static int merge_keys(struct pkt_key_s * key, int nb_pkt, uint8_t * order) {
+    uint8_t keep[256]; /* position in key[] of the packets kept, ascending */
+    int nb_keep = 0;
+    int i, j;
+    uint8_t tmp;
 
-    /* Check input parameters */
-    CHECK_NULL(p);
-    CHECK_NULL(nb_pkt);
+    DEBUG_MSG("<----- Searching for DUPLICATEs ------\n");
+    for (i = 0; i < nb_pkt; i++) {
+        DEBUG_PRINTF("  %d: tmst=%d SF=%u CRC_status=%d chan=%u ftime=%d\n", key[i].idx, key[i].tmst, key[i].datarate, key[i].status, key[i].if_chain, key[i].ftime_received);
+    }
 
-    /* Init number of packets in array before merge */
-    cpt = *nb_pkt;
+    /* Sort the packets by ascending counter_us value (only the keys are moved) */
+    qsort(key, nb_pkt, sizeof key[0], compare_pkt_key);
 
-    /* --------------------------------------------- */
-    /* ---------- For Debug only - START ----------- */
-    if (cpt > 0) {
-        DEBUG_MSG("<----- Searching for DUPLICATEs ------\n");
-    }
-    for (j = 0; j < cpt; j++) {
-        DEBUG_PRINTF("  %d: tmst=%u SF=%u CRC_status=%d freq=%u chan=%u", j, p[j].count_us, p[j].datarate, p[j].status, p[j].freq_hz, p[j].if_chain);
-        if (p[j].ftime_received == true) {
-            DEBUG_PRINTF(" ftime=%u\n", p[j].ftime);
-        } else {
-            DEBUG_MSG   (" ftime=NONE\n");
-        }
-    }
-    /* ---------- For Debug only - END ------------- */
-    /* --------------------------------------------- */
-
-    /* Remove duplicates */
-    j = 0;
-    while (j < cpt) {
-        for (k = (j+1); k < cpt; k++) {
-            /* Searching for duplicated packets:
-                -- count_us should be equal or can have up to 24µs of difference (3 samples)
-                -- channel should be same
-                -- datarate should be same
-                -- payload should be same
-            */
-            if (is_same_pkt( &p[j], &p[k])) {
-                /* We keep the packet which has CRC checked */
-                if ((p[j].status == STAT_CRC_OK) && (p[k].status == STAT_CRC_BAD)) {
-                    pkt_dup_idx = k;
-#if DEBUG_HAL == 1
-                    pkt_idx = j;
-#endif
-                } else if ((p[j].status == STAT_CRC_BAD) && (p[k].status == STAT_CRC_OK)) {
-                    pkt_dup_idx = j;
-#if DEBUG_HAL == 1
-                    pkt_idx = k;
-#endif
-                } else {
-                    /* we keep the packet which has a fine timestamp */
-                    if (p[j].ftime_received == true) {
-                        pkt_dup_idx = k;
-#if DEBUG_HAL == 1
-                        pkt_idx = j;
-#endif
-                    } else {
-                        pkt_dup_idx = j;
-#if DEBUG_HAL == 1
-                        pkt_idx = k;
-#endif
-                    }
-                    /* sanity check */
-                    if (((p[j].ftime_received == true) && (p[k].ftime_received == true)) ||
-                        ((p[j].ftime_received == false) && (p[k].ftime_received == false))) {
-                        DEBUG_MSG("WARNING: both duplicates have fine timestamps, or none has ? TBC\n");
-                    }
-                }
-                /* pkt_dup_idx contains the index to be deleted */
-                DEBUG_PRINTF("duplicate found %d:%d, deleting %d\n", pkt_idx, pkt_dup_idx, pkt_dup_idx);
-                /* Remove duplicated packet from packet array */
-                x = remove_pkt(p, &cpt, pkt_dup_idx);
-                if (x != 0) {
-                    printf("ERROR: failed to remove packet from array (%d)\n", x);
-                }
-                dup_restart = true;
+    /* Remove duplicates in a single pass: a packet is compared with the packets
+       already kept within MERGE_TMST_DIFF_MAX before it */
+    for (i = 0; i < nb_pkt; i++) {
+        for (j = nb_keep - 1; j >= 0; j--) {
+            if ((key[i].tmst - key[keep[j]].tmst) > MERGE_TMST_DIFF_MAX) {
+                j = -1;
+                break;
+            }
+            if (is_same_pkt(&key[keep[j]], &key[i]) == true) {
                 break;
             }
         }
-        if (dup_restart == true) {
-            /* Duplicate found, restart searching for duplicate from first element */
-            j = 0;
-            dup_restart = false;
-#if 0
-            printf( "restarting search for duplicate\n" ); /* Too verbose */
-#endif
+        if (j < 0) {
+            keep[nb_keep++] = (uint8_t)i;
+            continue;
+        }
+
+        /* duplicate of keep[j], replace it if this one is better */
+        if (is_better_dup(&key[i], &key[keep[j]]) == true) {
+            DEBUG_PRINTF("duplicate found %u:%u, deleting %u\n", key[i].idx, key[keep[j]].idx, key[keep[j]].idx);
+            keep[j] = (uint8_t)i;
+            /* keep the list ordered by timestamp */
+            while ((j < (nb_keep - 1)) && (keep[j] > keep[j + 1])) {
+                tmp = keep[j];
+                keep[j] = keep[j + 1];
+                keep[j + 1] = tmp;
+                j++;
+            }
         } else {
-            /* No duplicate found, continue... */
-            j += 1;
-#if 0
-            printf( "no duplicate found\n" ); /* Too verbose */
-#endif
+            DEBUG_PRINTF("duplicate found %u:%u, deleting %u\n", key[keep[j]].idx, key[i].idx, key[i].idx);
         }
     }
 
-    /* Sort the packet array by ascending counter_us value */
-    qsort_r(p, cpt, sizeof(p[0]), compare_pkt_tmst, &counter_qsort_swap);
-    DEBUG_PRINTF("%d elements swapped during sorting...\n", counter_qsort_swap);
-
-    /* --------------------------------------------- */
-    /* ---------- For Debug only - START ----------- */
-    if (cpt > 0) {
-        DEBUG_MSG("--\n");
+    for (i = 0; i < nb_keep; i++) {
+        order[i] = key[keep[i]].idx;
     }
-    for (j = 0; j < cpt; j++) {
-        DEBUG_PRINTF("  %d: tmst=%u SF=%d CRC_status=%d freq=%u chan=%u", j, p[j].count_us, p[j].datarate, p[j].status, p[j].freq_hz, p[j].if_chain);
-        if (p[j].ftime_received == true) {
-            DEBUG_PRINTF(" ftime=%u\n", p[j].ftime);
-        } else {
-            DEBUG_MSG   (" ftime=NONE\n");
+    DEBUG_PRINTF(" %d packets kept ------------------------>\n\n", nb_keep);
+
+    return nb_keep;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void merge_compact(void * array, size_t elem_size, int nb_pkt, const uint8_t * order, int nb_keep) {
+    uint8_t * p = (uint8_t *)array;
+    uint8_t buff[sizeof(struct lgw_pkt_rx_s)];
+    uint8_t pos[256]; /* current position in array of each packet */
+    uint8_t at[256]; /* packet currently at each position of array */
+    int i, j;
+
+    /* Move each kept packet once to its final position */
+    for (i = 0; i < nb_pkt; i++) {
+        pos[i] = (uint8_t)i;
+        at[i] = (uint8_t)i;
+    }
+    for (i = 0; i < nb_keep; i++) {
+        j = pos[order[i]];
+        if (j != i) {
+            memcpy(buff, p + (i * elem_size), elem_size);
+            memcpy(p + (i * elem_size), p + (j * elem_size), elem_size);
+            memcpy(p + (j * elem_size), buff, elem_size);
+            at[j] = at[i];
+            pos[at[j]] = (uint8_t)j;
+            at[i] = order[i];
+            pos[order[i]] = (uint8_t)i;
         }
     }
-    if (cpt > 0) {
-        DEBUG_MSG( " ------------------------------------>\n\n" );
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int merge_packets_meta(struct lgw_pkt_rx_meta_s * meta, const uint8_t * payload, uint8_t * nb_pkt) {
+    struct pkt_key_s key[256];
+    uint8_t order[256];
+    int i, nb_keep;
+
+    for (i = 0; i < *nb_pkt; i++) {
+        key[i].tmst = (int32_t)(meta[i].count_us - meta[0].count_us);
+        key[i].datarate = meta[i].datarate;
+        key[i].payload = payload + meta[i].payload_offset;
+        key[i].size = meta[i].size;
+        key[i].idx = (uint8_t)i;
+        key[i].if_chain = meta[i].if_chain;
+        key[i].status = meta[i].status;
+        key[i].ftime_received = meta[i].ftime_received;
+    }
+
+    nb_keep = merge_keys(key, *nb_pkt, order);
+    merge_compact(meta, sizeof meta[0], *nb_pkt, order, nb_keep);
+    *nb_pkt = (uint8_t)nb_keep;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int receive_fetch(uint8_t max_pkt, uint8_t * nb_pkt, float * temperature) {
+    int res;
+    uint8_t nb_pkt_fetched = 0;
+
+    *nb_pkt = 0;
+
+    /* Get packets from SX1302, if any, and update internal counter */
+    /* WARNING: this needs to be called regularly by the upper layer */
+    res = sx1302_fetch(&nb_pkt_fetched);
+    if (res != LGW_REG_SUCCESS) {
+        printf("ERROR: failed to fetch packets from SX1302\n");
+        return LGW_HAL_ERROR;
+    }
+
+    /* Exit now if no packet fetched */
+    if (nb_pkt_fetched == 0) {
+        return LGW_HAL_SUCCESS;
+    }
+    if (nb_pkt_fetched > max_pkt) {
+        printf("WARNING: not enough space allocated, fetched %d packet(s), %d will be left in RX buffer\n", nb_pkt_fetched, nb_pkt_fetched - max_pkt);
+        nb_pkt_fetched = max_pkt;
     }
-    /* ---------- For Debug only - END ------------- */
-    /* --------------------------------------------- */
 
-    /* Update number of packets contained in packet array */
-    *nb_pkt = cpt;
+    /* Get temperature for RSSI compensation */
+    res = lgw_get_temperature(temperature);
+    if (res != LGW_I2C_SUCCESS) {
+        printf("ERROR: failed to get current temperature\n");
+        return LGW_HAL_ERROR;
+    }
 
-    return 0;
+    *nb_pkt = nb_pkt_fetched;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int receive_parse(struct lgw_pkt_rx_s * pkt, float temperature) {
+    int res;
+    float rssi_temperature_offset;
+
+    /* Get packet and move to next one */
+    res = sx1302_parse(&lgw_inst->context, pkt);
+    if (res != LGW_REG_SUCCESS) {
+        return res;
+    }
+
+    /* Appli RSSI offset calibrated for the board */
+    pkt->rssic += CONTEXT_RF_CHAIN[pkt->rf_chain].rssi_offset;
+    pkt->rssis += CONTEXT_RF_CHAIN[pkt->rf_chain].rssi_offset;
+
+    /* Apply RSSI temperature compensation */
+    rssi_temperature_offset = sx1302_rssi_get_temperature_offset(&CONTEXT_RF_CHAIN[pkt->rf_chain].rssi_tcomp, temperature);
+    pkt->rssic += rssi_temperature_offset;
+    pkt->rssis += rssi_temperature_offset;
+    DEBUG_PRINTF("INFO: RSSI temperature offset applied: %.3f dB (current temperature %.1f C)\n", rssi_temperature_offset, temperature);
+
+    return LGW_REG_SUCCESS;
 }
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
+lgw_handle_t * lgw_handle_new(void) {
+    struct lgw_handle_s * handle;
+
+    handle = malloc(sizeof *handle);
+    if (handle == NULL) {
+        printf("ERROR: failed to allocate concentrator instance\n");
+        return NULL;
+    }
+    memcpy(handle, &lgw_handle_template, sizeof *handle);
+
+    return handle;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_handle_delete(lgw_handle_t * handle) {
+    CHECK_NULL(handle);
+
+    if (handle == &lgw_handle_default) {
+        printf("ERROR: the default concentrator instance cannot be deleted\n");
+        return LGW_HAL_ERROR;
+    }
+    if (handle->context.is_started == true) {
+        printf("ERROR: concentrator instance must be stopped before being deleted\n");
+        return LGW_HAL_ERROR;
+    }
+
+    /* Do not leave the calling thread with a dangling instance */
+    if (lgw_inst == handle) {
+        lgw_inst = &lgw_handle_default;
+    }
+    free(handle);
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_handle_select(lgw_handle_t * handle) {
+    lgw_inst = (handle != NULL) ? handle : &lgw_handle_default;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+lgw_handle_t * lgw_handle_get(void) {
+    return lgw_inst;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_board_setconf(struct lgw_conf_board_s * conf) {
     CHECK_NULL(conf);
 
@@ -458,7 +595,7 @@ int lgw_board_setconf(struct lgw_conf_board_s * conf) {
     }
 
     /* Check input parameters */
-    if ((conf->com_type != LGW_COM_SPI) && (conf->com_type != LGW_COM_USB)) {
+    if ((conf->com_type != LGW_COM_SPI) && (conf->com_type != LGW_COM_USB) && (conf->com_type != LGW_COM_MOCK)) {
         DEBUG_MSG("ERROR: WRONG COM TYPE\n");
         return LGW_HAL_ERROR;
     }
@@ -471,7 +608,7 @@ int lgw_board_setconf(struct lgw_conf_board_s * conf) {
     strncpy(CONTEXT_COM_PATH, conf->com_path, sizeof CONTEXT_COM_PATH);
     CONTEXT_COM_PATH[sizeof CONTEXT_COM_PATH - 1] = '\0'; /* ensure string termination */
 
-    DEBUG_PRINTF("Note: board configuration: com_type: %s, com_path: %s, lorawan_public:%d, clksrc:%d, full_duplex:%d\n",   (CONTEXT_COM_TYPE == LGW_COM_SPI) ? "SPI" : "USB",
+    DEBUG_PRINTF("Note: board configuration: com_type: %s, com_path: %s, lorawan_public:%d, clksrc:%d, full_duplex:%d\n",   (CONTEXT_COM_TYPE == LGW_COM_SPI) ? "SPI" : ((CONTEXT_COM_TYPE == LGW_COM_USB) ? "USB" : "MOCK"),
                                                                                                                             CONTEXT_COM_PATH,
                                                                                                                             CONTEXT_LWAN_PUBLIC,
                                                                                                                             CONTEXT_BOARD.clksrc,
@@ -723,6 +860,10 @@ int lgw_txgain_setconf(uint8_t rf_chain, struct lgw_tx_gain_lut_s * conf) {
     int i;
 
     CHECK_NULL(conf);
+    if (rf_chain >= LGW_RF_CHAIN_NB) {
+        DEBUG_MSG("ERROR: NOT A VALID RF_CHAIN NUMBER\n");
+        return LGW_HAL_ERROR;
+    }
 
     /* Check LUT size */
     if ((conf->size < 1) || (conf->size > TX_GAIN_LUT_SIZE_MAX)) {
@@ -769,6 +910,33 @@ int lgw_txgain_setconf(uint8_t rf_chain, struct lgw_tx_gain_lut_s * conf) {
         CONTEXT_TX_GAIN_LUT[rf_chain].lut[i].pwr_idx = conf->lut[i].pwr_idx;
     }
 
+    /* Precompute the LUT entry and register values for each RF power */
+    tx_power_update(rf_chain);
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txgain_getpower(uint8_t rf_chain, int8_t rf_power, int8_t * rf_power_used) {
+    struct sx1302_tx_power_s tx_pow;
+
+    CHECK_NULL(rf_power_used);
+    if (rf_chain >= LGW_RF_CHAIN_NB) {
+        DEBUG_MSG("ERROR: NOT A VALID RF_CHAIN NUMBER\n");
+        return LGW_HAL_ERROR;
+    }
+
+    if (tx_power_select(rf_chain, rf_power, &tx_pow) != LGW_HAL_SUCCESS) {
+        return LGW_HAL_ERROR;
+    }
+    *rf_power_used = tx_pow.rf_power;
+
+    /* No entry with a lower or equal power, the first one is used */
+    if (tx_pow.rf_power > rf_power) {
+        return LGW_HAL_ERROR;
+    }
+
     return LGW_HAL_SUCCESS;
 }
 
@@ -875,6 +1043,11 @@ int lgw_start(void) {
         return LGW_HAL_ERROR;
     }
 
+    /* Radio types are now known and TX offsets calibrated: refresh the TX power tables */
+    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+        tx_power_update(i);
+    }
+
     /* Setup radios for RX */
     for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
         if (CONTEXT_RF_CHAIN[i].enable == true) {
@@ -1073,8 +1246,8 @@ int lgw_start(void) {
     strncat(CONTEXT_DEBUG.log_file_name, timestamp_str, sizeof CONTEXT_DEBUG.log_file_name);
 
     /* Open the file for writting */
-    log_file = fopen(CONTEXT_DEBUG.log_file_name, "w+"); /* create log file, overwrite if file already exist */
-    if (log_file == NULL) {
+    lgw_inst->log_file = fopen(CONTEXT_DEBUG.log_file_name, "w+"); /* create log file, overwrite if file already exist */
+    if (lgw_inst->log_file == NULL) {
         printf("ERROR: impossible to create log file %s\n", CONTEXT_DEBUG.log_file_name);
         return LGW_HAL_ERROR;
     } else {
@@ -1095,20 +1268,20 @@ int lgw_start(void) {
     if (CONTEXT_COM_TYPE == LGW_COM_SPI) {
         /* Find the temperature sensor on the known supported ports */
         for (i = 0; i < (int)(sizeof I2C_PORT_TEMP_SENSOR); i++) {
-            ts_addr = I2C_PORT_TEMP_SENSOR[i];
-            err = i2c_linuxdev_open(I2C_DEVICE, ts_addr, &ts_fd);
+            lgw_inst->ts_addr = I2C_PORT_TEMP_SENSOR[i];
+            err = i2c_linuxdev_open(I2C_DEVICE, lgw_inst->ts_addr, &lgw_inst->ts_fd);
             if (err != LGW_I2C_SUCCESS) {
-                printf("ERROR: failed to open I2C for temperature sensor on port 0x%02X\n", ts_addr);
+                printf("ERROR: failed to open I2C for temperature sensor on port 0x%02X\n", lgw_inst->ts_addr);
                 return LGW_HAL_ERROR;
             }
 
-            err = stts751_configure(ts_fd, ts_addr);
+            err = stts751_configure(lgw_inst->ts_fd, lgw_inst->ts_addr);
             if (err != LGW_I2C_SUCCESS) {
-                printf("INFO: no temperature sensor found on port 0x%02X\n", ts_addr);
-                i2c_linuxdev_close(ts_fd);
-                ts_fd = -1;
+                printf("INFO: no temperature sensor found on port 0x%02X\n", lgw_inst->ts_addr);
+                i2c_linuxdev_close(lgw_inst->ts_fd);
+                lgw_inst->ts_fd = -1;
             } else {
-                printf("INFO: found temperature sensor on port 0x%02X\n", ts_addr);
+                printf("INFO: found temperature sensor on port 0x%02X\n", lgw_inst->ts_addr);
                 break;
             }
         }
@@ -1119,23 +1292,23 @@ int lgw_start(void) {
 
         /* Configure ADC AD338R for full duplex (CN490 reference design) */
         if (CONTEXT_BOARD.full_duplex == true) {
-            err = i2c_linuxdev_open(I2C_DEVICE, I2C_PORT_DAC_AD5338R, &ad_fd);
+            err = i2c_linuxdev_open(I2C_DEVICE, I2C_PORT_DAC_AD5338R, &lgw_inst->ad_fd);
             if (err != LGW_I2C_SUCCESS) {
                 printf("ERROR: failed to open I2C for ad5338r\n");
                 return LGW_HAL_ERROR;
             }
 
-            err = ad5338r_configure(ad_fd, I2C_PORT_DAC_AD5338R);
+            err = ad5338r_configure(lgw_inst->ad_fd, I2C_PORT_DAC_AD5338R);
             if (err != LGW_I2C_SUCCESS) {
                 printf("ERROR: failed to configure ad5338r\n");
-                i2c_linuxdev_close(ad_fd);
-                ad_fd = -1;
+                i2c_linuxdev_close(lgw_inst->ad_fd);
+                lgw_inst->ad_fd = -1;
                 return LGW_HAL_ERROR;
             }
 
             /* Turn off the PA: set DAC output to 0V */
             uint8_t volt_val[AD5338R_CMD_SIZE] = { 0x39, (uint8_t)VOLTAGE2HEX_H(0), (uint8_t)VOLTAGE2HEX_L(0) };
-            err = ad5338r_write(ad_fd, I2C_PORT_DAC_AD5338R, volt_val);
+            err = ad5338r_write(lgw_inst->ad_fd, I2C_PORT_DAC_AD5338R, volt_val);
             if (err != LGW_I2C_SUCCESS) {
                 printf("ERROR: AD5338R: failed to set DAC output to 0V\n");
                 return LGW_HAL_ERROR;
@@ -1178,6 +1351,13 @@ int lgw_start(void) {
         return LGW_HAL_ERROR;
     }
 
+    /* TX modems are now free, no counter reference yet */
+    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+        memset(&(lgw_inst->tx_track[i]), 0, sizeof lgw_inst->tx_track[i]);
+        tx_track_set(i, TX_FREE);
+    }
+    lgw_inst->cnt_ref_host = 0;
+
     /* set hal state */
     CONTEXT_STARTED = true;
 
@@ -1209,9 +1389,9 @@ int lgw_stop(void) {
     }
 
     /* Close log file */
-    if (log_file != NULL) {
-        fclose(log_file);
-        log_file = NULL;
+    if (lgw_inst->log_file != NULL) {
+        fclose(lgw_inst->log_file);
+        lgw_inst->log_file = NULL;
     }
 
     DEBUG_MSG("INFO: Disconnecting\n");
@@ -1223,7 +1403,7 @@ int lgw_stop(void) {
 
     if (CONTEXT_COM_TYPE == LGW_COM_SPI) {
         DEBUG_MSG("INFO: Closing I2C for temperature sensor\n");
-        x = i2c_linuxdev_close(ts_fd);
+        x = i2c_linuxdev_close(lgw_inst->ts_fd);
         if (x != 0) {
             printf("ERROR: failed to close I2C temperature sensor device (err=%i)\n", x);
             err = LGW_HAL_ERROR;
@@ -1231,7 +1411,7 @@ int lgw_stop(void) {
 
         if (CONTEXT_BOARD.full_duplex == true) {
             DEBUG_MSG("INFO: Closing I2C for AD5338R\n");
-            x = i2c_linuxdev_close(ad_fd);
+            x = i2c_linuxdev_close(lgw_inst->ad_fd);
             if (x != 0) {
                 printf("ERROR: failed to close I2C AD5338R device (err=%i)\n", x);
                 err = LGW_HAL_ERROR;
@@ -1241,6 +1421,11 @@ int lgw_stop(void) {
 
     CONTEXT_STARTED = false;
 
+    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+        lgw_inst->tx_track[i].check = false;
+        tx_track_set(i, TX_OFF);
+    }
+
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
     return err;
@@ -1252,10 +1437,10 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
     int res;
     uint8_t nb_pkt_fetched = 0;
     uint8_t nb_pkt_found = 0;
-    uint8_t nb_pkt_left = 0;
-    float current_temperature = 0.0, rssi_temperature_offset = 0.0;
+    float current_temperature = 0.0;
+    lgw_com_sub_t sub;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     DEBUG_PRINTF(" --- %s\n", "IN");
 
@@ -1263,40 +1448,16 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
     _meas_time_start(&tm);
 
     /* Get packets from SX1302, if any */
-    res = sx1302_fetch(&nb_pkt_fetched);
-    if (res != LGW_REG_SUCCESS) {
-        printf("ERROR: failed to fetch packets from SX1302\n");
-        return LGW_HAL_ERROR;
-    }
-
-    /* Update internal counter */
-    /* WARNING: this needs to be called regularly by the upper layer */
-    res = sx1302_update();
-    if (res != LGW_REG_SUCCESS) {
-        return LGW_HAL_ERROR;
-    }
-
-    /* Exit now if no packet fetched */
-    if (nb_pkt_fetched == 0) {
-        _meas_time_stop(1, tm, __FUNCTION__);
-        return 0;
-    }
-    if (nb_pkt_fetched > max_pkt) {
-        nb_pkt_left = nb_pkt_fetched - max_pkt;
-        printf("WARNING: not enough space allocated, fetched %d packet(s), %d will be left in RX buffer\n", nb_pkt_fetched, nb_pkt_left);
-    }
-
-    /* Apply RSSI temperature compensation */
-    res = lgw_get_temperature(&current_temperature);
-    if (res != LGW_I2C_SUCCESS) {
-        printf("ERROR: failed to get current temperature\n");
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_RX);
+    res = receive_fetch(max_pkt, &nb_pkt_fetched, &current_temperature);
+    lgw_com_set_subsystem(sub);
+    if (res != LGW_HAL_SUCCESS) {
         return LGW_HAL_ERROR;
     }
 
     /* Iterate on the RX buffer to get parsed packets */
-    for (nb_pkt_found = 0; nb_pkt_found < ((nb_pkt_fetched <= max_pkt) ? nb_pkt_fetched : max_pkt); nb_pkt_found++) {
-        /* Get packet and move to next one */
-        res = sx1302_parse(&lgw_context, &pkt_data[nb_pkt_found]);
+    for (nb_pkt_found = 0; nb_pkt_found < nb_pkt_fetched; nb_pkt_found++) {
+        res = receive_parse(&pkt_data[nb_pkt_found], current_temperature);
         if (res == LGW_REG_WARNING) {
             printf("WARNING: parsing error on packet %d, discarding fetched packets\n", nb_pkt_found);
             return LGW_HAL_SUCCESS;
@@ -1304,22 +1465,13 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
             printf("ERROR: fatal parsing error on packet %d, aborting...\n", nb_pkt_found);
             return LGW_HAL_ERROR;
         }
-
-        /* Appli RSSI offset calibrated for the board */
-        pkt_data[nb_pkt_found].rssic += CONTEXT_RF_CHAIN[pkt_data[nb_pkt_found].rf_chain].rssi_offset;
-        pkt_data[nb_pkt_found].rssis += CONTEXT_RF_CHAIN[pkt_data[nb_pkt_found].rf_chain].rssi_offset;
-
-        rssi_temperature_offset = sx1302_rssi_get_temperature_offset(&CONTEXT_RF_CHAIN[pkt_data[nb_pkt_found].rf_chain].rssi_tcomp, current_temperature);
-        pkt_data[nb_pkt_found].rssic += rssi_temperature_offset;
-        pkt_data[nb_pkt_found].rssis += rssi_temperature_offset;
-        DEBUG_PRINTF("INFO: RSSI temperature offset applied: %.3f dB (current temperature %.1f C)\n", rssi_temperature_offset, current_temperature);
     }
 
-    DEBUG_PRINTF("INFO: nb pkt found:%u left:%u\n", nb_pkt_found, nb_pkt_left);
+    DEBUG_PRINTF("INFO: nb pkt found:%u\n", nb_pkt_found);
 
     /* Remove duplicated packets generated by double demod when precision timestamp is enabled */
     if ((nb_pkt_found > 0) && (CONTEXT_FINE_TIMESTAMP.enable == true)) {
-        res = merge_packets(pkt_data, &nb_pkt_found);
+        res = lgw_merge_packets(pkt_data, &nb_pkt_found);
         if (res != 0) {
             printf("WARNING: failed to remove duplicated packets\n");
         }
@@ -1327,7 +1479,7 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
         DEBUG_PRINTF("INFO: nb pkt found:%u (after de-duplicating)\n", nb_pkt_found);
     }
 
-    _meas_time_stop(1, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_RECEIVE, 1, tm);
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
@@ -1336,52 +1488,334 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_send(struct lgw_pkt_tx_s * pkt_data) {
-    int err;
-    bool lbt_tx_allowed;
+int lgw_receive_compact(uint8_t max_pkt, struct lgw_pkt_rx_meta_s * meta, uint8_t * payload, uint32_t payload_size) {
+    int res;
+    uint8_t nb_pkt_fetched = 0;
+    uint8_t nb_pkt_found = 0;
+    uint16_t offset = 0;
+    float current_temperature = 0.0;
+    lgw_com_sub_t sub;
+    struct lgw_pkt_rx_s pkt;
+    struct lgw_pkt_rx_meta_s * m;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     DEBUG_PRINTF(" --- %s\n", "IN");
 
+    /* check input parameters */
+    CHECK_NULL(meta);
+    CHECK_NULL(payload);
+    if (payload_size < LGW_RX_PAYLOAD_ARENA_SIZE(max_pkt)) {
+        printf("ERROR: payload arena too small for %u packets (%u bytes)\n", max_pkt, payload_size);
+        return LGW_HAL_ERROR;
+    }
+
     /* Record function start time */
     _meas_time_start(&tm);
 
-    /* check if the concentrator is running */
-    if (CONTEXT_STARTED == false) {
-        printf("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE SENDING\n");
+    /* Get packets from SX1302, if any */
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_RX);
+    res = receive_fetch(max_pkt, &nb_pkt_fetched, &current_temperature);
+    lgw_com_set_subsystem(sub);
+    if (res != LGW_HAL_SUCCESS) {
         return LGW_HAL_ERROR;
     }
 
-    CHECK_NULL(pkt_data);
+    /* Iterate on the RX buffer to get parsed packets, payloads stored back to back */
+    for (nb_pkt_found = 0; nb_pkt_found < nb_pkt_fetched; nb_pkt_found++) {
+        res = receive_parse(&pkt, current_temperature);
+        if (res == LGW_REG_WARNING) {
+            printf("WARNING: parsing error on packet %d, discarding fetched packets\n", nb_pkt_found);
+            return LGW_HAL_SUCCESS;
+        } else if (res == LGW_REG_ERROR) {
+            printf("ERROR: fatal parsing error on packet %d, aborting...\n", nb_pkt_found);
+            return LGW_HAL_ERROR;
+        }
 
-    /* check input range (segfault prevention) */
-    if (pkt_data->rf_chain >= LGW_RF_CHAIN_NB) {
-        printf("ERROR: INVALID RF_CHAIN TO SEND PACKETS\n");
-        return LGW_HAL_ERROR;
-    }
+        m = &meta[nb_pkt_found];
+        m->count_us = pkt.count_us;
+        m->freq_hz = pkt.freq_hz;
+        m->freq_offset = pkt.freq_offset;
+        m->datarate = pkt.datarate;
+        m->ftime = pkt.ftime;
+        m->rssic = pkt.rssic;
+        m->rssis = pkt.rssis;
+        m->snr = pkt.snr;
+        m->snr_min = pkt.snr_min;
+        m->snr_max = pkt.snr_max;
+        m->payload_offset = offset;
+        m->crc = pkt.crc;
+        m->size = pkt.size;
+        m->if_chain = pkt.if_chain;
+        m->status = pkt.status;
+        m->rf_chain = pkt.rf_chain;
+        m->modem_id = pkt.modem_id;
+        m->modulation = pkt.modulation;
+        m->bandwidth = pkt.bandwidth;
+        m->coderate = pkt.coderate;
+        m->ftime_received = pkt.ftime_received;
+        memcpy(payload + offset, pkt.payload, pkt.size);
+        offset += pkt.size;
+    }
+
+    DEBUG_PRINTF("INFO: nb pkt found:%u\n", nb_pkt_found);
 
-    /* check input variables */
-    if (CONTEXT_RF_CHAIN[pkt_data->rf_chain].tx_enable == false) {
-        printf("ERROR: SELECTED RF_CHAIN IS DISABLED FOR TX ON SELECTED BOARD\n");
-        return LGW_HAL_ERROR;
+    /* Remove duplicated packets generated by double demod when precision timestamp is enabled */
+    if ((nb_pkt_found > 0) && (CONTEXT_FINE_TIMESTAMP.enable == true)) {
+        merge_packets_meta(meta, payload, &nb_pkt_found);
+        DEBUG_PRINTF("INFO: nb pkt found:%u (after de-duplicating)\n", nb_pkt_found);
     }
-    if (CONTEXT_RF_CHAIN[pkt_data->rf_chain].enable == false) {
-        printf("ERROR: SELECTED RF_CHAIN IS DISABLED\n");
-        return LGW_HAL_ERROR;
+
+    _meas_time_stop(LGW_PERF_RECEIVE_COMPACT, 1, tm);
+
+    DEBUG_PRINTF(" --- %s\n", "OUT");
+
+    return nb_pkt_found;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_merge_packets(struct lgw_pkt_rx_s * pkt_data, uint8_t * nb_pkt) {
+    struct pkt_key_s key[256];
+    uint8_t order[256];
+    int i, nb_keep;
+
+    /* Check input parameters */
+    CHECK_NULL(pkt_data);
+    CHECK_NULL(nb_pkt);
+
+    if (*nb_pkt == 0) {
+        return LGW_HAL_SUCCESS;
     }
-    if (!IS_TX_MODE(pkt_data->tx_mode)) {
-        printf("ERROR: TX_MODE NOT SUPPORTED\n");
-        return LGW_HAL_ERROR;
+
+    for (i = 0; i < *nb_pkt; i++) {
+        key[i].tmst = (int32_t)(pkt_data[i].count_us - pkt_data[0].count_us);
+        key[i].datarate = pkt_data[i].datarate;
+        key[i].payload = pkt_data[i].payload;
+        key[i].size = pkt_data[i].size;
+        key[i].idx = (uint8_t)i;
+        key[i].if_chain = pkt_data[i].if_chain;
+        key[i].status = pkt_data[i].status;
+        key[i].ftime_received = pkt_data[i].ftime_received;
     }
-    if (pkt_data->modulation == MOD_LORA) {
-        if (!IS_LORA_BW(pkt_data->bandwidth)) {
-            printf("ERROR: BANDWIDTH NOT SUPPORTED BY LORA TX\n");
-            return LGW_HAL_ERROR;
-        }
-        if (!IS_LORA_DR(pkt_data->datarate)) {
-            printf("ERROR: DATARATE NOT SUPPORTED BY LORA TX\n");
-            return LGW_HAL_ERROR;
+
+    /* Sort and remove duplicates on keys, then compact the packet array once */
+    nb_keep = merge_keys(key, *nb_pkt, order);
+    merge_compact(pkt_data, sizeof pkt_data[0], *nb_pkt, order, nb_keep);
+
+    /* Update number of packets contained in packet array */
+    *nb_pkt = (uint8_t)nb_keep;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint64_t host_time_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * 1000000) + ((uint64_t)now.tv_nsec / 1000);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Counter value at host time now_us, extrapolated from a recent read if possible */
+static uint32_t counter_estimate(uint64_t now_us) {
+    if ((lgw_inst->cnt_ref_host == 0) || ((now_us - lgw_inst->cnt_ref_host) > TX_TRACK_REF_MAX_US)) {
+        lgw_inst->cnt_ref_us = sx1302_timestamp_counter(false);
+        lgw_inst->cnt_ref_host = host_time_us();
+    }
+
+    return lgw_inst->cnt_ref_us + (uint32_t)(now_us - lgw_inst->cnt_ref_host);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Late transitions are read again at a pace following the emission duration */
+static uint32_t tx_track_retry(uint32_t toa_us) {
+    uint32_t retry_us = toa_us / TX_TRACK_RETRY_TOA_DIV;
+
+    if (retry_us < TX_TRACK_RETRY_US) {
+        return TX_TRACK_RETRY_US;
+    }
+    return (retry_us > TX_TRACK_RETRY_MAX_US) ? TX_TRACK_RETRY_MAX_US : retry_us;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void tx_track_set(uint8_t rf_chain, uint8_t status) {
+    struct lgw_tx_track_s * t = &(lgw_inst->tx_track[rf_chain]);
+
+    if (status == t->status) {
+        return;
+    }
+    t->status = status;
+    if (lgw_inst->tx_event_cb != NULL) {
+        lgw_inst->tx_event_cb(rf_chain, status, lgw_inst->tx_event_arg);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void tx_track_read(uint8_t rf_chain, uint8_t status, uint64_t now_us) {
+    struct lgw_tx_track_s * t = &(lgw_inst->tx_track[rf_chain]);
+
+    /* PPS-triggered emission: its end is only known once it has started */
+    if ((status == TX_EMITTING) && (t->status != TX_EMITTING) && (t->end_us <= now_us)) {
+        t->end_us = now_us + t->toa_us;
+        t->retry_us = tx_track_retry(t->toa_us);
+    }
+    tx_track_set(rf_chain, status);
+
+    /* Next read: at the predicted start or end, or a bit later if it is already passed */
+    switch (status) {
+        case TX_FREE:
+            t->check = false;
+            break;
+        case TX_SCHEDULED:
+            if ((t->check == false) || (t->check_us <= now_us)) {
+                t->check_us = now_us + t->retry_us;
+            }
+            t->check = true;
+            break;
+        case TX_EMITTING:
+            t->check_us = (t->end_us > now_us) ? t->end_us : (now_us + t->retry_us);
+            t->check = true;
+            break;
+        default:
+            t->check_us = now_us + TX_TRACK_RETRY_US;
+            t->check = true;
+            break;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void tx_track_sent(const struct lgw_pkt_tx_s * pkt_data, uint64_t commit_us, int result) {
+    struct lgw_tx_track_s * t = &(lgw_inst->tx_track[pkt_data->rf_chain]);
+    uint64_t now_us, start_us;
+    uint32_t count_us;
+    int32_t delay_us;
+
+    if (result == LGW_LBT_NOT_ALLOWED) {
+        /* blocked by LBT: the TX modem never left the free state */
+        t->check = false;
+        tx_track_set(pkt_data->rf_chain, TX_FREE);
+        return;
+    }
+    if (result != LGW_HAL_SUCCESS) {
+        /* unknown state, to be read on next update */
+        t->check = true;
+        t->check_us = host_time_us();
+        return;
+    }
+    now_us = commit_us; /* the emission timing is computed from the commit */
+
+    if (pkt_data->modulation == MOD_LORA) {
+        t->toa_us = lora_packet_time_on_air(pkt_data->bandwidth, pkt_data->datarate, pkt_data->coderate, pkt_data->preamble, pkt_data->no_header, pkt_data->no_crc, pkt_data->size, NULL, NULL, NULL);
+    } else if (pkt_data->modulation == MOD_FSK) {
+        t->toa_us = lgw_time_on_air(pkt_data) * 1000;
+    } else {
+        t->toa_us = 0; /* CW: until aborted */
+    }
+
+    t->retry_us = tx_track_retry(t->toa_us);
+    switch (pkt_data->tx_mode) {
+        case TIMESTAMPED:
+            count_us = counter_estimate(now_us);
+            delay_us = (int32_t)(pkt_data->count_us - count_us);
+            start_us = now_us + ((delay_us > 0) ? (uint64_t)delay_us : 0);
+            break;
+        case ON_GPS:
+            start_us = now_us + TX_TRACK_GPS_POLL_US;
+            t->retry_us = TX_TRACK_GPS_POLL_US;
+            break;
+        default:
+            start_us = now_us + TX_START_DELAY_DEFAULT;
+            break;
+    }
+    t->end_us = start_us + t->toa_us;
+    t->check_us = start_us + TX_TRACK_RETRY_US;
+    t->check = true;
+
+    tx_track_set(pkt_data->rf_chain, TX_SCHEDULED);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void tx_power_update(uint8_t rf_chain) {
+    int err;
+
+    /* The radio type may not be configured yet, the table is then built again by lgw_start */
+    err = sx1302_tx_power_table_build(CONTEXT_RF_CHAIN[rf_chain].type, &CONTEXT_TX_GAIN_LUT[rf_chain], lgw_inst->tx_power[rf_chain]);
+    lgw_inst->tx_power_valid[rf_chain] = (err == LGW_REG_SUCCESS);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int tx_power_select(uint8_t rf_chain, int8_t rf_power, struct sx1302_tx_power_s * tx_pow) {
+    int err;
+
+    if ((lgw_inst->tx_power_valid[rf_chain] == true) && (rf_power >= TX_POWER_TABLE_MIN) && (rf_power <= TX_POWER_TABLE_MAX)) {
+        *tx_pow = lgw_inst->tx_power[rf_chain][rf_power - TX_POWER_TABLE_MIN];
+        return LGW_HAL_SUCCESS;
+    }
+
+    /* Out of the table range: search the LUT */
+    err = sx1302_tx_power_get(CONTEXT_RF_CHAIN[rf_chain].type, &CONTEXT_TX_GAIN_LUT[rf_chain], rf_power, tx_pow);
+
+    return (err == LGW_REG_SUCCESS) ? LGW_HAL_SUCCESS : LGW_HAL_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int send_prepare(struct lgw_pkt_tx_s * pkt_data, struct lgw_tx_prep_s * prep) {
+    int err;
+    struct sx1302_tx_power_s tx_pow;
+    /* performances variables */
+    uint64_t tm;
+
+    /* Record function start time */
+    _meas_time_start(&tm);
+
+    /* check if the concentrator is running */
+    if (CONTEXT_STARTED == false) {
+        printf("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE SENDING\n");
+        return LGW_HAL_ERROR;
+    }
+
+    CHECK_NULL(pkt_data);
+    CHECK_NULL(prep);
+
+    /* check input range (segfault prevention) */
+    if (pkt_data->rf_chain >= LGW_RF_CHAIN_NB) {
+        printf("ERROR: INVALID RF_CHAIN TO SEND PACKETS\n");
+        return LGW_HAL_ERROR;
+    }
+
+    /* check input variables */
+    if (CONTEXT_RF_CHAIN[pkt_data->rf_chain].tx_enable == false) {
+        printf("ERROR: SELECTED RF_CHAIN IS DISABLED FOR TX ON SELECTED BOARD\n");
+        return LGW_HAL_ERROR;
+    }
+    if (CONTEXT_RF_CHAIN[pkt_data->rf_chain].enable == false) {
+        printf("ERROR: SELECTED RF_CHAIN IS DISABLED\n");
+        return LGW_HAL_ERROR;
+    }
+    if (!IS_TX_MODE(pkt_data->tx_mode)) {
+        printf("ERROR: TX_MODE NOT SUPPORTED\n");
+        return LGW_HAL_ERROR;
+    }
+    if (pkt_data->modulation == MOD_LORA) {
+        if (!IS_LORA_BW(pkt_data->bandwidth)) {
+            printf("ERROR: BANDWIDTH NOT SUPPORTED BY LORA TX\n");
+            return LGW_HAL_ERROR;
+        }
+        if (!IS_LORA_DR(pkt_data->datarate)) {
+            printf("ERROR: DATARATE NOT SUPPORTED BY LORA TX\n");
+            return LGW_HAL_ERROR;
         }
         if (!IS_LORA_CR(pkt_data->coderate)) {
             printf("ERROR: CODERATE NOT SUPPORTED BY LORA TX\n");
@@ -1411,10 +1845,60 @@ int lgw_send(struct lgw_pkt_tx_s * pkt_data) {
         return LGW_HAL_ERROR;
     }
 
+    /* Select the TX gain LUT entry */
+    err = tx_power_select(pkt_data->rf_chain, pkt_data->rf_power, &tx_pow);
+    if (err != LGW_HAL_SUCCESS) {
+        printf("ERROR: %s: Failed to select TX gain LUT entry\n", __FUNCTION__);
+        return LGW_HAL_ERROR;
+    }
+
+    /* Encode the TX request, the packet is kept for LBT */
+    memcpy(&(prep->pkt), pkt_data, sizeof prep->pkt);
+    err = sx1302_send_prepare(CONTEXT_RF_CHAIN[pkt_data->rf_chain].type, &tx_pow, CONTEXT_LWAN_PUBLIC, &CONTEXT_FSK, &(prep->pkt), prep);
+    if (err != LGW_REG_SUCCESS) {
+        printf("ERROR: %s: Failed to prepare packet\n", __FUNCTION__);
+        return LGW_HAL_ERROR;
+    }
+
+    _meas_time_stop(LGW_PERF_SEND_PREPARE, 1, tm);
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int send_commit(struct lgw_tx_prep_s * prep) {
+    int err;
+    bool lbt_tx_allowed = true;
+    uint64_t commit_us;
+    int32_t delay_us;
+    uint32_t tx_delay_us;
+    struct lgw_pkt_tx_s * pkt_data;
+    /* performances variables */
+    uint64_t tm;
+
+    DEBUG_PRINTF(" --- %s\n", "IN");
+
+    /* Record function start time */
+    _meas_time_start(&tm);
+
+    /* check if the concentrator is running */
+    if (CONTEXT_STARTED == false) {
+        printf("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE SENDING\n");
+        return LGW_HAL_ERROR;
+    }
+
+    CHECK_NULL(prep);
+    pkt_data = &(prep->pkt);
+    if ((prep->nb_op == 0) || (pkt_data->rf_chain >= LGW_RF_CHAIN_NB)) {
+        printf("ERROR: TX REQUEST WAS NOT PREPARED\n");
+        return LGW_HAL_ERROR;
+    }
+
     /* Set PA gain with AD5338R when using full duplex CN490 ref design */
     if (CONTEXT_BOARD.full_duplex == true) {
         uint8_t volt_val[AD5338R_CMD_SIZE] = {0x39, VOLTAGE2HEX_H(2.51), VOLTAGE2HEX_L(2.51)}; /* set to 2.51V */
-        err = ad5338r_write(ad_fd, I2C_PORT_DAC_AD5338R, volt_val);
+        err = ad5338r_write(lgw_inst->ad_fd, I2C_PORT_DAC_AD5338R, volt_val);
         if (err != LGW_I2C_SUCCESS) {
             printf("ERROR: failed to set voltage by ad5338r\n");
             return LGW_HAL_ERROR;
@@ -1422,9 +1906,14 @@ int lgw_send(struct lgw_pkt_tx_s * pkt_data) {
         printf("INFO: AD5338R: Set DAC output to 0x%02X 0x%02X\n", (uint8_t)VOLTAGE2HEX_H(2.51), (uint8_t)VOLTAGE2HEX_L(2.51));
     }
 
-    /* Start Listen-Before-Talk */
+    /* Start Listen-Before-Talk, only waiting for the scan time if the TX is closer than that */
     if (CONTEXT_SX1261.lbt_conf.enable == true) {
-        err = lgw_lbt_start(&CONTEXT_SX1261, pkt_data);
+        tx_delay_us = 0;
+        if (pkt_data->tx_mode == TIMESTAMPED) {
+            delay_us = (int32_t)(pkt_data->count_us - counter_estimate(host_time_us()));
+            tx_delay_us = (delay_us > 0) ? (uint32_t)delay_us : 0;
+        }
+        err = lgw_lbt_start(&CONTEXT_SX1261, pkt_data, tx_delay_us);
         if (err != 0) {
             printf("ERROR: failed to start LBT\n");
             return LGW_HAL_ERROR;
@@ -1432,9 +1921,11 @@ int lgw_send(struct lgw_pkt_tx_s * pkt_data) {
     }
 
     /* Send the TX request to the concentrator */
-    err = sx1302_send(CONTEXT_RF_CHAIN[pkt_data->rf_chain].type, &CONTEXT_TX_GAIN_LUT[pkt_data->rf_chain], CONTEXT_LWAN_PUBLIC, &CONTEXT_FSK, pkt_data);
+    commit_us = host_time_us();
+    err = sx1302_send_commit(prep);
     if (err != LGW_REG_SUCCESS) {
         printf("ERROR: %s: Failed to send packet\n", __FUNCTION__);
+        tx_track_sent(pkt_data, commit_us, LGW_HAL_ERROR);
 
         if (CONTEXT_SX1261.lbt_conf.enable == true) {
             err = lgw_lbt_stop();
@@ -1446,7 +1937,7 @@ int lgw_send(struct lgw_pkt_tx_s * pkt_data) {
         return LGW_HAL_ERROR;
     }
 
-    _meas_time_stop(1, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_SEND, 1, tm);
 
     /* Stop Listen-Before-Talk */
     if (CONTEXT_SX1261.lbt_conf.enable == true) {
@@ -1461,6 +1952,7 @@ int lgw_send(struct lgw_pkt_tx_s * pkt_data) {
             if (err != 0) {
                 printf("ERROR: %s: Failed to stop LBT\n", __FUNCTION__);
             }
+            tx_track_sent(pkt_data, commit_us, LGW_HAL_ERROR);
             return LGW_HAL_ERROR;
         }
         if (lbt_tx_allowed == true) {
@@ -1472,22 +1964,258 @@ int lgw_send(struct lgw_pkt_tx_s * pkt_data) {
         err = lgw_lbt_stop();
         if (err != 0) {
             printf("ERROR: %s: Failed to stop LBT\n", __FUNCTION__);
+            tx_track_sent(pkt_data, commit_us, (lbt_tx_allowed == true) ? LGW_HAL_SUCCESS : LGW_LBT_NOT_ALLOWED);
             return LGW_HAL_ERROR;
         }
     }
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
+    /* The TX is only tracked once the LBT result is known, a blocked TX is never scheduled */
     if (CONTEXT_SX1261.lbt_conf.enable == true && lbt_tx_allowed == false) {
+        tx_track_sent(pkt_data, commit_us, LGW_LBT_NOT_ALLOWED);
         return LGW_LBT_NOT_ALLOWED;
     } else {
+        tx_track_sent(pkt_data, commit_us, LGW_HAL_SUCCESS);
+        return LGW_HAL_SUCCESS;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int tx_dispatch(uint8_t rf_chain, uint8_t * code) {
+    int err = LGW_HAL_SUCCESS;
+    struct lgw_tx_prep_s * prep = &(lgw_inst->tx_staged[rf_chain]);
+    uint32_t count_us;
+
+    *code = sx1302_tx_status(rf_chain);
+    tx_track_read(rf_chain, *code, host_time_us());
+    if ((lgw_inst->tx_staged_valid[rf_chain] == false) || (*code != TX_FREE)) {
+        return LGW_HAL_SUCCESS;
+    }
+    lgw_inst->tx_staged_valid[rf_chain] = false;
+
+    /* A late timestamped request would only be triggered after a counter wrap */
+    if (prep->pkt.tx_mode == TIMESTAMPED) {
+        count_us = sx1302_timestamp_counter(false);
+        lgw_inst->cnt_ref_us = count_us;
+        lgw_inst->cnt_ref_host = host_time_us();
+        if ((int32_t)(prep->pkt.count_us - count_us) < LGW_TX_STAGE_ADVANCE_MIN) {
+            printf("ERROR: %s: staged TX request on rf_chain %u is too late (%d us left), dropped\n", __FUNCTION__, rf_chain, (int32_t)(prep->pkt.count_us - count_us));
+            return LGW_HAL_ERROR;
+        }
+    }
+
+    err = send_commit(prep);
+    if (err == LGW_HAL_ERROR) {
+        return LGW_HAL_ERROR;
+    }
+    *code = sx1302_tx_status(rf_chain);
+    tx_track_read(rf_chain, *code, host_time_us());
+
+    return err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_send(struct lgw_pkt_tx_s * pkt_data) {
+    int err;
+    lgw_com_sub_t sub;
+    struct lgw_tx_prep_s prep;
+
+    err = send_prepare(pkt_data, &prep);
+    if (err != LGW_HAL_SUCCESS) {
+        return err;
+    }
+    pkt_data->preamble = prep.pkt.preamble; /* default or minimum preamble applied */
+
+    /* Bus transactions of the TX request and LBT are accounted to TX */
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_TX);
+    err = send_commit(&prep);
+    lgw_com_set_subsystem(sub);
+
+    return err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_send_prepare(struct lgw_pkt_tx_s * pkt_data, struct lgw_tx_prep_s * prep) {
+    int err;
+
+    err = send_prepare(pkt_data, prep);
+    if (err == LGW_HAL_SUCCESS) {
+        pkt_data->preamble = prep->pkt.preamble; /* default or minimum preamble applied */
+    }
+
+    return err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_send_commit(struct lgw_tx_prep_s * prep) {
+    int err;
+    lgw_com_sub_t sub;
+
+    /* Bus transactions of the TX request and LBT are accounted to TX */
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_TX);
+    err = send_commit(prep);
+    lgw_com_set_subsystem(sub);
+
+    return err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_send_arm(const struct lgw_tx_prep_s * prep) {
+    int err;
+    lgw_com_sub_t sub;
+
+    /* check if the concentrator is running */
+    if (CONTEXT_STARTED == false) {
+        printf("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE SENDING\n");
+        return LGW_HAL_ERROR;
+    }
+
+    CHECK_NULL(prep);
+    if (prep->nb_op == 0) {
+        printf("ERROR: TX REQUEST WAS NOT PREPARED\n");
+        return LGW_HAL_ERROR;
+    }
+
+    if (CONTEXT_SX1261.lbt_conf.enable == false) {
+        return LGW_HAL_SUCCESS;
+    }
+
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_TX);
+    err = lgw_lbt_tune(&CONTEXT_SX1261, &(prep->pkt));
+    lgw_com_set_subsystem(sub);
+    if (err < 0) {
+        printf("ERROR: failed to pre-arm LBT\n");
+        return LGW_HAL_ERROR;
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_send_stage(struct lgw_tx_prep_s * prep) {
+    uint8_t rf_chain;
+
+    DEBUG_PRINTF(" --- %s\n", "IN");
+
+    /* check if the concentrator is running */
+    if (CONTEXT_STARTED == false) {
+        printf("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE SENDING\n");
+        return LGW_HAL_ERROR;
+    }
+
+    CHECK_NULL(prep);
+    rf_chain = prep->pkt.rf_chain;
+    if ((prep->nb_op == 0) || (rf_chain >= LGW_RF_CHAIN_NB)) {
+        printf("ERROR: TX REQUEST WAS NOT PREPARED\n");
+        return LGW_HAL_ERROR;
+    }
+    if (lgw_inst->tx_staged_valid[rf_chain] == true) {
+        printf("ERROR: a TX request is already staged on rf_chain %u\n", rf_chain);
+        return LGW_HAL_ERROR;
+    }
+
+    memcpy(&(lgw_inst->tx_staged[rf_chain]), prep, sizeof *prep);
+    lgw_inst->tx_staged_valid[rf_chain] = true;
+
+    DEBUG_PRINTF(" --- %s\n", "OUT");
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_tx_dispatch(uint8_t rf_chain, uint8_t * code, bool * staged) {
+    int err;
+    lgw_com_sub_t sub;
+
+    /* check input variables */
+    CHECK_NULL(code);
+    if (rf_chain >= LGW_RF_CHAIN_NB) {
+        DEBUG_MSG("ERROR: NOT A VALID RF_CHAIN NUMBER\n");
+        return LGW_HAL_ERROR;
+    }
+
+    if (CONTEXT_STARTED == false) {
+        *code = TX_OFF;
+        err = LGW_HAL_SUCCESS;
+    } else {
+        sub = lgw_com_set_subsystem(LGW_COM_SUB_TX);
+        err = tx_dispatch(rf_chain, code);
+        lgw_com_set_subsystem(sub);
+    }
+
+    if (staged != NULL) {
+        *staged = lgw_inst->tx_staged_valid[rf_chain];
+    }
+
+    return err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_tx_event_setcb(lgw_tx_event_cb_t cb, void * arg) {
+    lgw_inst->tx_event_cb = cb;
+    lgw_inst->tx_event_arg = arg;
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_tx_track(uint8_t status[LGW_RF_CHAIN_NB], uint32_t * next_us) {
+    struct lgw_tx_track_s * t;
+    lgw_com_sub_t sub;
+    uint64_t now_us, delta, next = UINT32_MAX;
+    uint8_t code;
+    int i;
+
+    if (CONTEXT_STARTED == false) {
+        for (i = 0; (i < LGW_RF_CHAIN_NB) && (status != NULL); i++) {
+            status[i] = TX_OFF;
+        }
+        if (next_us != NULL) {
+            *next_us = UINT32_MAX;
+        }
         return LGW_HAL_SUCCESS;
     }
+
+    now_us = host_time_us();
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_TX);
+    for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+        t = &(lgw_inst->tx_track[i]);
+        if ((t->check == true) && (t->check_us <= now_us)) {
+            code = sx1302_tx_status(i);
+            tx_track_read(i, code, now_us);
+        }
+        if (t->check == true) {
+            delta = (t->check_us > now_us) ? (t->check_us - now_us) : 0;
+            next = (delta < next) ? delta : next;
+        }
+        if (status != NULL) {
+            status[i] = t->status;
+        }
+    }
+    lgw_com_set_subsystem(sub);
+
+    if (next_us != NULL) {
+        *next_us = (uint32_t)((next < UINT32_MAX) ? next : UINT32_MAX);
+    }
+
+    return LGW_HAL_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_status(uint8_t rf_chain, uint8_t select, uint8_t *code) {
+    lgw_com_sub_t sub;
+
     DEBUG_PRINTF(" --- %s\n", "IN");
 
     /* check input variables */
@@ -1502,7 +2230,10 @@ int lgw_status(uint8_t rf_chain, uint8_t select, uint8_t *code) {
         if (CONTEXT_STARTED == false) {
             *code = TX_OFF;
         } else {
+            sub = lgw_com_set_subsystem(LGW_COM_SUB_TX);
             *code = sx1302_tx_status(rf_chain);
+            tx_track_read(rf_chain, *code, host_time_us());
+            lgw_com_set_subsystem(sub);
         }
     } else if (select == RX_STATUS) {
         if (CONTEXT_STARTED == false) {
@@ -1525,6 +2256,7 @@ int lgw_status(uint8_t rf_chain, uint8_t select, uint8_t *code) {
 
 int lgw_abort_tx(uint8_t rf_chain) {
     int err;
+    lgw_com_sub_t sub;
 
     DEBUG_PRINTF(" --- %s\n", "IN");
 
@@ -1534,8 +2266,16 @@ int lgw_abort_tx(uint8_t rf_chain) {
         return LGW_HAL_ERROR;
     }
 
+    /* Drop the staged request, it would be committed once the RF chain is free */
+    lgw_inst->tx_staged_valid[rf_chain] = false;
+
     /* Abort current TX */
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_TX);
     err = sx1302_tx_abort(rf_chain);
+    lgw_com_set_subsystem(sub);
+    if (err == LGW_REG_SUCCESS) {
+        tx_track_read(rf_chain, TX_FREE, host_time_us());
+    }
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
@@ -1545,11 +2285,15 @@ int lgw_abort_tx(uint8_t rf_chain) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_get_trigcnt(uint32_t* trig_cnt_us) {
+    lgw_com_sub_t sub;
+
     DEBUG_PRINTF(" --- %s\n", "IN");
 
     CHECK_NULL(trig_cnt_us);
 
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_GPS);
     *trig_cnt_us = sx1302_timestamp_counter(true);
+    lgw_com_set_subsystem(sub);
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
@@ -1559,11 +2303,19 @@ int lgw_get_trigcnt(uint32_t* trig_cnt_us) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_get_instcnt(uint32_t* inst_cnt_us) {
+    lgw_com_sub_t sub;
+
     DEBUG_PRINTF(" --- %s\n", "IN");
 
     CHECK_NULL(inst_cnt_us);
 
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_COUNTER);
     *inst_cnt_us = sx1302_timestamp_counter(false);
+    lgw_com_set_subsystem(sub);
+
+    /* Reference for the TX status tracker */
+    lgw_inst->cnt_ref_us = *inst_cnt_us;
+    lgw_inst->cnt_ref_host = host_time_us();
 
     DEBUG_PRINTF(" --- %s\n", "OUT");
 
@@ -1597,9 +2349,10 @@ int lgw_get_temperature(float* temperature) {
 
     switch (CONTEXT_COM_TYPE) {
         case LGW_COM_SPI:
-            err = stts751_get_temperature(ts_fd, ts_addr, temperature);
+            err = stts751_get_temperature(lgw_inst->ts_fd, lgw_inst->ts_addr, temperature);
             break;
         case LGW_COM_USB:
+        case LGW_COM_MOCK:
             err = lgw_com_get_temperature(temperature);
             break;
         default:
@@ -1633,7 +2386,7 @@ uint32_t lgw_time_on_air(const struct lgw_pkt_tx_s *packet) {
 
     if (packet->modulation == MOD_LORA) {
         toa_us = lora_packet_time_on_air(packet->bandwidth, packet->datarate, packet->coderate, packet->preamble, packet->no_header, packet->no_crc, packet->size, NULL, NULL, NULL);
-        toa_ms = (uint32_t)( (double)toa_us / 1000.0 + 0.5 );
+        toa_ms = (toa_us + 500) / 1000; /* rounded to nearest ms */
         DEBUG_PRINTF("INFO: LoRa packet ToA: %u ms\n", toa_ms);
     } else if (packet->modulation == MOD_FSK) {
         /* PREAMBLE + SYNC_WORD + PKT_LEN + PKT_PAYLOAD + CRC
@@ -1661,19 +2414,23 @@ uint32_t lgw_time_on_air(const struct lgw_pkt_tx_s *packet) {
 
 int lgw_spectral_scan_start(uint32_t freq_hz, uint16_t nb_scan) {
     int err;
+    lgw_com_sub_t sub;
 
     if (CONTEXT_SX1261.enable != true) {
         printf("ERROR: sx1261 is not enabled, no spectral scan\n");
         return LGW_HAL_ERROR;
     }
 
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_SCAN);
     err = sx1261_set_rx_params(freq_hz, BW_125KHZ);
     if (err != LGW_REG_SUCCESS) {
         printf("ERROR: Failed to set RX params for Spectral Scan\n");
+        lgw_com_set_subsystem(sub);
         return LGW_HAL_ERROR;
     }
 
     err = sx1261_spectral_scan_start(nb_scan);
+    lgw_com_set_subsystem(sub);
     if (err != LGW_REG_SUCCESS) {
         printf("ERROR: start spectral scan failed\n");
         return LGW_HAL_ERROR;
@@ -1685,19 +2442,57 @@ int lgw_spectral_scan_start(uint32_t freq_hz, uint16_t nb_scan) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_spectral_scan_get_status(lgw_spectral_scan_status_t * status) {
-    return sx1261_spectral_scan_status(status);
+    int err;
+    lgw_com_sub_t sub;
+
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_SCAN);
+    err = sx1261_spectral_scan_status(status);
+    lgw_com_set_subsystem(sub);
+
+    return err;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_spectral_scan_get_results(int16_t levels_dbm[static LGW_SPECTRAL_SCAN_RESULT_SIZE], uint16_t results[static LGW_SPECTRAL_SCAN_RESULT_SIZE]) {
-    return sx1261_spectral_scan_get_results(CONTEXT_SX1261.rssi_offset, levels_dbm, results);
+    int err;
+    lgw_com_sub_t sub;
+
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_SCAN);
+    err = sx1261_spectral_scan_get_results(CONTEXT_SX1261.rssi_offset, levels_dbm, results);
+    lgw_com_set_subsystem(sub);
+
+    return err;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_spectral_scan_abort() {
-    return sx1261_spectral_scan_abort();
+    int err;
+    lgw_com_sub_t sub;
+
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_SCAN);
+    err = sx1261_spectral_scan_abort();
+    lgw_com_set_subsystem(sub);
+
+    return err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_bus_stat_get(lgw_com_type_t * com_type, struct lgw_com_stat_s stat[LGW_COM_SUB_NB], bool reset) {
+    CHECK_NULL(com_type);
+    CHECK_NULL(stat);
+
+    *com_type = CONTEXT_COM_TYPE;
+
+    return (lgw_com_stat_get(stat, reset) == LGW_COM_SUCCESS) ? LGW_HAL_SUCCESS : LGW_HAL_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+const char * lgw_bus_subsystem_name(lgw_com_sub_t sub) {
+    return lgw_com_subsystem_name(sub);
 }
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -82,15 +82,10 @@ static int is_lbt_channel(const struct lgw_conf_lbt_s * lbt_context, uint32_t fr
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
-int lgw_lbt_start(const struct lgw_conf_sx1261_s * sx1261_context, const struct lgw_pkt_tx_s * pkt) {
+int lgw_lbt_tune(const struct lgw_conf_sx1261_s * sx1261_context, const struct lgw_pkt_tx_s * pkt) {
     int err;
     int lbt_channel_selected;
     uint32_t toa_ms;
-    /* performances variables */
-    struct timeval tm;
-
-    /* Record function start time */
-    _meas_time_start(&tm);
 
     /* Check if we have a LBT channel for this transmit frequency */
     lbt_channel_selected = is_lbt_channel(&(sx1261_context->lbt_conf), pkt->freq_hz, pkt->bandwidth);
@@ -111,21 +106,47 @@ int lgw_lbt_start(const struct lgw_conf_sx1261_s * sx1261_context, const struct
         return -1;
     }
 
-    /* Set LBT scan frequency */
+    /* Set LBT scan frequency (no bus access if already set) */
     err = sx1261_set_rx_params(pkt->freq_hz, pkt->bandwidth);
     if (err != 0) {
         printf("ERROR: Cannot start LBT - unable to set sx1261 RX parameters\n");
         return -1;
     }
 
+    return lbt_channel_selected;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_lbt_start(const struct lgw_conf_sx1261_s * sx1261_context, const struct lgw_pkt_tx_s * pkt, uint32_t tx_delay_us) {
+    int err;
+    int lbt_channel_selected;
+    uint32_t scan_time_us;
+    /* performances variables */
+    uint64_t tm;
+
+    /* Record function start time */
+    _meas_time_start(&tm);
+
+    lbt_channel_selected = lgw_lbt_tune(sx1261_context, pkt);
+    if (lbt_channel_selected == -1) {
+        return -1;
+    }
+
     /* Start LBT */
+    scan_time_us = (uint32_t)sx1261_context->lbt_conf.channels[lbt_channel_selected].scan_time_us;
     err = sx1261_lbt_start(sx1261_context->lbt_conf.channels[lbt_channel_selected].scan_time_us, sx1261_context->lbt_conf.rssi_target + sx1261_context->rssi_offset);
     if (err != 0) {
         printf("ERROR: Cannot start LBT - sx1261 LBT start\n");
         return -1;
     }
 
-    _meas_time_stop(3, tm, __FUNCTION__);
+    /* Wait for Scan Time before TX trigger request, if the TX is closer than that */
+    if (tx_delay_us < scan_time_us) {
+        wait_us(scan_time_us - tx_delay_us);
+    }
+
+    _meas_time_stop(LGW_PERF_LBT_START, 3, tm);
 
     return 0;
 }
@@ -138,7 +159,7 @@ int lgw_lbt_tx_status(uint8_t rf_chain, bool * tx_ok) {
     bool tx_timeout = false;
     struct timeval tm_start;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
@@ -201,7 +222,7 @@ int lgw_lbt_tx_status(uint8_t rf_chain, bool * tx_ok) {
     /* Acknoledge */
     sx1302_agc_mailbox_write(0, 0x00);
 
-    _meas_time_stop(3, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_LBT_TX_STATUS, 3, tm);
 
     if (tx_timeout == true) {
         return -1;
@@ -216,7 +237,7 @@ int lgw_lbt_stop(void) {
     int err;
 
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
@@ -227,7 +248,7 @@ int lgw_lbt_stop(void) {
         return -1;
     }
 
-    _meas_time_stop(3, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_LBT_STOP, 3, tm);
 
     return 0;
 }
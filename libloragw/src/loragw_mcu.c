@@ -29,6 +29,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include "loragw_mcu.h"
 #include "loragw_aux.h"
+#include "loragw_handle.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -53,26 +54,6 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #define HEADER_CMD_SIZE 4
 
-/* -------------------------------------------------------------------------- */
-/* --- PRIVATE TYPES -------------------------------------------------------- */
-
-typedef struct spi_req_bulk_s {
-    uint16_t size;
-    uint8_t nb_req;
-    uint8_t buffer[LGW_USB_BURST_CHUNK];
-} spi_req_bulk_t;
-
-/* -------------------------------------------------------------------------- */
-/* --- PRIVATE VARIABLES  --------------------------------------------------- */
-
-static uint8_t buf_hdr[HEADER_CMD_SIZE];
-
-static spi_req_bulk_t spi_bulk_buffer = {
-    .size = 0,
-    .nb_req = 0,
-    .buffer = { 0 }
-};
-
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -194,7 +175,7 @@ int write_req(int fd, order_id_t cmd, const uint8_t * payload, uint16_t payload_
     uint8_t buf_w[HEADER_CMD_SIZE];
     int n;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
     /* debug variables */
 #if DEBUG_MCU == 1
     struct timeval write_tv;
@@ -249,8 +230,10 @@ int write_req(int fd, order_id_t cmd, const uint8_t * payload, uint16_t payload_
     printf("\n");
 #endif
 
+    lgw_com_stat_account_usb(1, 0, 0, HEADER_CMD_SIZE + payload_size, 0);
+
     /* Compute time spent in this function */
-    _meas_time_stop(5, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_MCU_WRITE_REQ, 5, tm);
 
     return 0;
 }
@@ -265,7 +248,7 @@ int read_ack(int fd, uint8_t * hdr, uint8_t * buf, size_t buf_size) {
     size_t size;
     int nb_read = 0;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
     /* debug variables */
 #if DEBUG_MCU == 1
     struct timeval read_tv;
@@ -290,7 +273,7 @@ int read_ack(int fd, uint8_t * hdr, uint8_t * buf, size_t buf_size) {
     }
 
     /* Compute time spent in this function */
-    _meas_time_stop(5, tm, "read_ack(hdr)");
+    _meas_time_stop(LGW_PERF_MCU_READ_ACK_HDR, 5, tm);
 
 #if DEBUG_VERBOSE
     printf("read_ack(hdr):");
@@ -347,8 +330,10 @@ int read_ack(int fd, uint8_t * hdr, uint8_t * buf, size_t buf_size) {
 #endif
     }
 
+    lgw_com_stat_account_usb(0, 1, 0, 0, HEADER_CMD_SIZE + nb_read);
+
     /* Compute time spent in this function */
-    _meas_time_stop(5, tm, "read_ack(payload)");
+    _meas_time_stop(LGW_PERF_MCU_READ_ACK_PAYLOAD, 5, tm);
 
     return nb_read;
 }
@@ -551,12 +536,12 @@ int mcu_ping(int fd, s_ping_info * info) {
         return -1;
     }
 
-    if (read_ack(fd, buf_hdr, buf_ack, sizeof buf_ack) < 0) {
+    if (read_ack(fd, lgw_inst->mcu_buf_hdr, buf_ack, sizeof buf_ack) < 0) {
         printf("ERROR: failed to read PING ack\n");
         return -1;
     }
 
-    if (decode_ack_ping(buf_hdr, buf_ack, info) != 0) {
+    if (decode_ack_ping(lgw_inst->mcu_buf_hdr, buf_ack, info) != 0) {
         printf("ERROR: invalid PING ack\n");
         return -1;
     }
@@ -572,12 +557,12 @@ int mcu_boot(int fd) {
         return -1;
     }
 
-    if (read_ack(fd, buf_hdr, NULL, 0) < 0) {
+    if (read_ack(fd, lgw_inst->mcu_buf_hdr, NULL, 0) < 0) {
         printf("ERROR: failed to read BOOTLOADER_MODE ack\n");
         return -1;
     }
 
-    if (decode_ack_bootloader_mode(buf_hdr) != 0) {
+    if (decode_ack_bootloader_mode(lgw_inst->mcu_buf_hdr) != 0) {
         printf("ERROR: invalid BOOTLOADER_MODE ack\n");
         return -1;
     }
@@ -597,12 +582,12 @@ int mcu_get_status(int fd, s_status * status) {
         return -1;
     }
 
-    if (read_ack(fd, buf_hdr, buf_ack, sizeof buf_ack) < 0) {
+    if (read_ack(fd, lgw_inst->mcu_buf_hdr, buf_ack, sizeof buf_ack) < 0) {
         printf("ERROR: failed to read GET_STATUS ack\n");
         return -1;
     }
 
-    if (decode_ack_get_status(buf_hdr, buf_ack, status) != 0) {
+    if (decode_ack_get_status(lgw_inst->mcu_buf_hdr, buf_ack, status) != 0) {
         printf("ERROR: invalid GET_STATUS ack\n");
         return -1;
     }
@@ -625,12 +610,12 @@ int mcu_gpio_write(int fd, uint8_t gpio_port, uint8_t gpio_id, uint8_t gpio_valu
         return -1;
     }
 
-    if (read_ack(fd, buf_hdr, buf_ack, sizeof buf_ack) < 0) {
+    if (read_ack(fd, lgw_inst->mcu_buf_hdr, buf_ack, sizeof buf_ack) < 0) {
         printf("ERROR: failed to read PING ack\n");
         return -1;
     }
 
-    if (decode_ack_gpio_access(buf_hdr, buf_ack, &status) != 0) {
+    if (decode_ack_gpio_access(lgw_inst->mcu_buf_hdr, buf_ack, &status) != 0) {
         printf("ERROR: invalid REQ_WRITE_GPIO ack\n");
         return -1;
     }
@@ -654,12 +639,12 @@ int mcu_spi_write(int fd, uint8_t * in_out_buf, size_t buf_size) {
         return -1;
     }
 
-    if (read_ack(fd, buf_hdr, in_out_buf, buf_size) < 0) {
+    if (read_ack(fd, lgw_inst->mcu_buf_hdr, in_out_buf, buf_size) < 0) {
         printf("ERROR: failed to read REQ_MULTIPLE_SPI ack\n");
         return -1;
     }
 
-    if (decode_ack_spi_bulk(buf_hdr, in_out_buf) != 0) {
+    if (decode_ack_spi_bulk(lgw_inst->mcu_buf_hdr, in_out_buf) != 0) {
         printf("ERROR: invalid REQ_MULTIPLE_SPI ack\n");
         return -1;
     }
@@ -672,23 +657,33 @@ int mcu_spi_write(int fd, uint8_t * in_out_buf, size_t buf_size) {
 int mcu_spi_store(uint8_t * in_out_buf, size_t buf_size) {
     CHECK_NULL(in_out_buf);
 
-    return spi_req_bulk_insert(&spi_bulk_buffer, in_out_buf, buf_size);
+    return spi_req_bulk_insert(&lgw_inst->mcu_bulk_buffer, in_out_buf, buf_size);
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int mcu_spi_flush(int fd) {
     /* Write pending SPI requests to MCU */
-    if (mcu_spi_write(fd, spi_bulk_buffer.buffer, spi_bulk_buffer.size) != 0) {
+    if (mcu_spi_write(fd, lgw_inst->mcu_bulk_buffer.buffer, lgw_inst->mcu_bulk_buffer.size) != 0) {
         printf("ERROR: %s: failed to write SPI requests to MCU\n", __FUNCTION__);
         return -1;
     }
 
+    lgw_com_stat_account_usb(0, 0, 1, 0, 0);
+
     /* Reset bulk storage buffer */
-    spi_bulk_buffer.nb_req = 0;
-    spi_bulk_buffer.size = 0;
+    lgw_inst->mcu_bulk_buffer.nb_req = 0;
+    lgw_inst->mcu_bulk_buffer.size = 0;
 
     return 0;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void mcu_spi_discard(void) {
+    /* Reset bulk storage buffer, the pending SPI requests are never sent */
+    lgw_inst->mcu_bulk_buffer.nb_req = 0;
+    lgw_inst->mcu_bulk_buffer.size = 0;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,1072 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Software model of the SX1302 and its SX1250 radios, used as a
+    communication interface to run the HAL without hardware.
+    Single-byte read/write and burst read/write, RX packets injection and
+    TX packets capture, SX1261 Listen-Before-Talk.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf fopen fgets */
+#include <stdlib.h>     /* malloc free */
+#include <string.h>     /* memset memcpy strcmp */
+#include <time.h>       /* clock_gettime */
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_mock.h"
+#include "loragw_sx1302.h"
+#include "loragw_sx1261.h"
+#include "loragw_handle.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_COM == 1
+    #define DEBUG_MSG(str)                fprintf(stdout, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stdout,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_MOCK_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                if(a==NULL){return LGW_MOCK_ERROR;}
+#endif
+
+#define REG_ADDR(id)        (loregs[id].addr)
+#define REG_MASK(id)        ((uint8_t)(((1 << loregs[id].leng) - 1) << loregs[id].offs))
+#define REG_FIELD(id, b)    (((b) & REG_MASK(id)) >> loregs[id].offs)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define MOCK_MEM_SIZE           0x10000 /* SX1302 address space */
+#define MOCK_BURST_CHUNK        1024
+
+#define MOCK_RX_BUFFER_ADDR     0x4000  /* reading this address pops the RX FIFO */
+#define MOCK_RX_FIFO_SIZE       4096    /* size of the SX1302 RX buffer */
+#define MOCK_RX_QUEUE_SIZE      256     /* packets injected, waiting for their reception time */
+#define MOCK_TX_BUFFER_A        0x5300
+#define MOCK_TX_BUFFER_B        0x5500
+#define MOCK_TX_QUEUE_SIZE      64      /* packets emitted, waiting to be read by lgw_mock_tx_get() */
+#define MOCK_TX_DURATION_US     10000   /* emission duration (not derived from the time on air) */
+
+#define MOCK_CHIP_VERSION       0x10
+#define MOCK_CHIP_MODEL_ID      CHIP_MODEL_ID_SX1303    /* SX1302 with fine timestamping, so that it can be enabled */
+#define MOCK_EUI                0x0016C00100000001ULL
+#define MOCK_AGC_FW_VERSION     10      /* AGC firmware version for SX1250 radios */
+#define MOCK_ARB_FW_VERSION     2
+#define MOCK_TEMPERATURE        25.0
+
+#define MOCK_SX1261_REG_SIZE    0x1000  /* SX1261 registers modelled (PRAM excluded) */
+#define MOCK_SX1261_REG_VERSION 0x0320  /* PRAM version string */
+#define MOCK_SX1261_REG_LBT     0x089B  /* LBT enable, cleared by sx1261_lbt_stop */
+#define MOCK_SX1261_LBT_START   0x9A    /* LBT scan command of the PRAM patch */
+
+#define MOCK_AGC_CMD_LBT        0x0B    /* AGC configuration command enabling LBT (mailbox 0) */
+#define MOCK_AGC_CMD_DONE       0x0F    /* end of the AGC configuration */
+#define MOCK_AGC_LBT_CLEAR      0xFF    /* TX status clear request, in mailbox 0 */
+
+#define MOCK_TX_STATUS_FREE         0x80
+#define MOCK_TX_STATUS_EMITTING     0x30
+#define MOCK_TX_STATUS_SCHEDULED    0x91
+
+#define MOCK_PKT_HEAD_METADATA  9
+#define MOCK_PKT_TAIL_METADATA  14
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef enum {
+    MOCK_TX_FREE,
+    MOCK_TX_SCHEDULED,
+    MOCK_TX_EMITTING
+} mock_tx_state_t;
+
+struct mock_tx_chain_s {
+    mock_tx_state_t state;
+    uint8_t trig;           /* trigger of the scheduled/emitted packet */
+    uint32_t start_cnt;     /* 32MHz counter value of the emission start */
+    uint16_t buffer_size;   /* number of bytes written in the TX buffer */
+    bool lbt;               /* the channel is sensed by the SX1261 before the emission */
+};
+
+struct mock_dev_s {
+    uint8_t mem[MOCK_MEM_SIZE];     /* registers and memories */
+    struct timespec time_start;     /* host time of the device opening */
+    struct timespec time_ref;       /* host time of the latest time scale change or warp */
+    uint64_t time_ref_us;           /* virtual time at time_ref, in microseconds since the device opening */
+    double time_scale;              /* virtual microseconds per host microsecond */
+
+    /* RX */
+    uint8_t fifo[MOCK_RX_FIFO_SIZE];
+    uint16_t fifo_size;
+    struct lgw_mock_rx_s rx_queue[MOCK_RX_QUEUE_SIZE];
+    int rx_queue_first;
+    int rx_queue_nb;
+    FILE * trace;
+    unsigned int trace_line;
+    uint32_t trace_offset;          /* added to the trace times, set by the @origin directive */
+    bool trace_pkt_valid;
+    struct lgw_mock_rx_s trace_pkt; /* next packet of the trace file */
+
+    /* TX */
+    struct mock_tx_chain_s tx_chain[2];
+    struct lgw_mock_tx_s tx_queue[MOCK_TX_QUEUE_SIZE];
+    int tx_queue_first;
+    int tx_queue_nb;
+    FILE * tx_log;                  /* triggered packets log, set by the @txlog directive */
+
+    /* radios */
+    uint8_t radio_mode[2];          /* SX1250 chip mode, as reported by GET_STATUS */
+
+    /* Listen-Before-Talk */
+    uint8_t sx1261_mode;            /* SX1261 chip mode, as reported by GET_STATUS */
+    uint8_t sx1261_reg[MOCK_SX1261_REG_SIZE];
+    bool agc_lbt;                   /* LBT enabled in the AGC firmware */
+    bool sx1261_lbt;                /* LBT scan started on the SX1261 */
+    bool lbt_busy;                  /* channel sensed busy, set by lgw_mock_lbt_busy() */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static uint64_t mock_time_us64(struct mock_dev_s * dev);
+static uint32_t mock_time_us(struct mock_dev_s * dev);
+static void mock_time_rebase(struct mock_dev_s * dev, double scale, uint64_t warp_us);
+static uint64_t host_time_us(void);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* Virtual time of the device, runs at time_scale times the host time */
+static uint64_t mock_time_us64(struct mock_dev_s * dev) {
+    struct timespec now;
+    int64_t elapsed_us;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed_us = ((int64_t)(now.tv_sec - dev->time_ref.tv_sec) * 1000000) + ((now.tv_nsec - dev->time_ref.tv_nsec) / 1000);
+    if (dev->time_scale == 1.0) {
+        return dev->time_ref_us + (uint64_t)elapsed_us;
+    }
+
+    return dev->time_ref_us + (uint64_t)(dev->time_scale * (double)elapsed_us);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* 32-bit microseconds counter, as the SX1302 32MHz counter divided by 32 */
+static uint32_t mock_time_us(struct mock_dev_s * dev) {
+    return (uint32_t)mock_time_us64(dev);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Change the virtual time speed, without discontinuity */
+static void mock_time_rebase(struct mock_dev_s * dev, double scale, uint64_t warp_us) {
+    dev->time_ref_us = mock_time_us64(dev) + warp_us;
+    clock_gettime(CLOCK_MONOTONIC, &dev->time_ref);
+    dev->time_scale = scale;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* CLOCK_MONOTONIC time, shared with the other processes of the host */
+static uint64_t host_time_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * 1000000) + (uint64_t)(now.tv_nsec / 1000);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void mem_reg_set(struct mock_dev_s * dev, uint16_t reg_id, uint8_t value) {
+    uint16_t addr = REG_ADDR(reg_id);
+
+    dev->mem[addr] = (dev->mem[addr] & ~REG_MASK(reg_id)) | ((uint8_t)(value << loregs[reg_id].offs) & REG_MASK(reg_id));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t mem_reg_get(struct mock_dev_s * dev, uint16_t reg_id) {
+    return REG_FIELD(reg_id, dev->mem[REG_ADDR(reg_id)]);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void mem_write_u32_msb(struct mock_dev_s * dev, uint16_t reg_id_msb, uint32_t value) {
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        dev->mem[REG_ADDR(reg_id_msb + i)] = (uint8_t)(value >> (24 - (8 * i)));
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Push a packet in the RX FIFO, in the format of the SX1302 RX buffer */
+static int rx_fifo_push(struct mock_dev_s * dev, const struct lgw_mock_rx_s * pkt) {
+    int size;
+
+    size = lgw_mock_rx_format(pkt, &dev->fifo[dev->fifo_size], MOCK_RX_FIFO_SIZE - dev->fifo_size);
+    if (size < 0) {
+        return LGW_MOCK_ERROR;
+    }
+    dev->fifo_size += (uint16_t)size;
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Apply a '@' line of the RX trace file */
+static void trace_directive(struct mock_dev_s * dev, const char * line) {
+    unsigned long long origin_us;
+    uint64_t start_us;
+    double scale;
+    char path[256];
+
+    if (sscanf(line, "@origin %llu", &origin_us) == 1) {
+        /* trace times are relative to a CLOCK_MONOTONIC instant instead of the device opening */
+        start_us = ((uint64_t)dev->time_start.tv_sec * 1000000) + (uint64_t)(dev->time_start.tv_nsec / 1000);
+        dev->trace_offset = (uint32_t)((uint64_t)origin_us - start_us);
+    } else if (sscanf(line, "@timescale %lf", &scale) == 1) {
+        if (scale > 0.0) {
+            mock_time_rebase(dev, scale, 0);
+        } else {
+            printf("WARNING: mock RX trace line %u, invalid time scale\n", dev->trace_line);
+        }
+    } else if (sscanf(line, "@txlog %255s", path) == 1) {
+        if (dev->tx_log != NULL) {
+            fclose(dev->tx_log);
+        }
+        dev->tx_log = fopen(path, "w");
+        if (dev->tx_log == NULL) {
+            printf("WARNING: failed to open mock TX log %s\n", path);
+        }
+    } else {
+        printf("WARNING: mock RX trace line %u ignored\n", dev->trace_line);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Parse the next packet of the RX trace file, returns false at end of file */
+static bool trace_next(struct mock_dev_s * dev) {
+    char line[640];
+    char crc[8];
+    char hex[520];
+    unsigned int time_us, if_chain, sf, cr, rssi, byte;
+    float snr;
+    int i, n;
+
+    while (fgets(line, sizeof line, dev->trace) != NULL) {
+        dev->trace_line += 1;
+        if ((line[0] == '#') || (line[0] == '\n') || (line[0] == '\r')) {
+            continue;
+        }
+        if (line[0] == '@') {
+            trace_directive(dev, line);
+            continue;
+        }
+        hex[0] = '\0';
+        n = sscanf(line, "%u %u %u %u %7s %f %u %519s", &time_us, &if_chain, &sf, &cr, crc, &snr, &rssi, hex);
+        if ((n < 7) || (if_chain > 9) || (rssi > 255)) {
+            printf("WARNING: mock RX trace line %u ignored\n", dev->trace_line);
+            continue;
+        }
+        memset(&dev->trace_pkt, 0, sizeof dev->trace_pkt);
+        dev->trace_pkt.time_us = time_us + dev->trace_offset;
+        dev->trace_pkt.if_chain = (uint8_t)if_chain;
+        dev->trace_pkt.datarate = (uint8_t)sf;
+        dev->trace_pkt.coderate = (uint8_t)cr;
+        dev->trace_pkt.crc_en = (strcmp(crc, "none") != 0);
+        dev->trace_pkt.crc_error = (strcmp(crc, "bad") == 0);
+        dev->trace_pkt.snr = snr;
+        dev->trace_pkt.rssi = (uint8_t)rssi;
+        for (i = 0; (i < 255) && (sscanf(&hex[2 * i], "%2x", &byte) == 1); i++) {
+            dev->trace_pkt.payload[i] = (uint8_t)byte;
+        }
+        dev->trace_pkt.size = (uint16_t)i;
+        return true;
+    }
+
+    return false;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Move the packets whose reception time is reached to the RX FIFO */
+static void rx_release(struct mock_dev_s * dev) {
+    uint32_t now = mock_time_us(dev);
+    struct lgw_mock_rx_s * pkt;
+
+    while (dev->rx_queue_nb > 0) {
+        pkt = &dev->rx_queue[dev->rx_queue_first];
+        if ((int32_t)(now - pkt->time_us) < 0) {
+            break;
+        }
+        if (rx_fifo_push(dev, pkt) != LGW_MOCK_SUCCESS) {
+            DEBUG_MSG("WARNING: mock RX FIFO full, packet dropped\n");
+        }
+        dev->rx_queue_first = (dev->rx_queue_first + 1) % MOCK_RX_QUEUE_SIZE;
+        dev->rx_queue_nb -= 1;
+    }
+
+    while ((dev->trace_pkt_valid == true) && ((int32_t)(now - dev->trace_pkt.time_us) >= 0)) {
+        if (rx_fifo_push(dev, &dev->trace_pkt) != LGW_MOCK_SUCCESS) {
+            DEBUG_MSG("WARNING: mock RX FIFO full, packet dropped\n");
+        }
+        dev->trace_pkt_valid = trace_next(dev);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Update the TX state machines and capture the packets whose emission has started */
+static void tx_update(struct mock_dev_s * dev) {
+    uint32_t cnt = mock_time_us(dev) * 32;
+    struct mock_tx_chain_s * c;
+    struct lgw_mock_tx_s * tx;
+    int rf, idx;
+
+    for (rf = 0; rf < 2; rf++) {
+        c = &dev->tx_chain[rf];
+        if ((c->state == MOCK_TX_SCHEDULED) && ((int32_t)(cnt - c->start_cnt) >= 0) && (c->lbt == true)) {
+            /* AGC: TX initiated (bit rf), not allowed if the channel is busy (bit 6+rf) */
+            mem_reg_set(dev, SX1302_REG_AGC_MCU_MCU_AGC_STATUS_MCU_AGC_STATUS, (uint8_t)((1 << rf) | ((dev->lbt_busy == true) ? (1 << (6 + rf)) : 0)));
+            c->lbt = false;
+            if (dev->lbt_busy == true) {
+                c->state = MOCK_TX_FREE;
+                continue;
+            }
+        }
+        if ((c->state == MOCK_TX_SCHEDULED) && ((int32_t)(cnt - c->start_cnt) >= 0)) {
+            c->state = MOCK_TX_EMITTING;
+            if (dev->tx_queue_nb == MOCK_TX_QUEUE_SIZE) {
+                /* drop the oldest one */
+                dev->tx_queue_first = (dev->tx_queue_first + 1) % MOCK_TX_QUEUE_SIZE;
+                dev->tx_queue_nb -= 1;
+            }
+            idx = (dev->tx_queue_first + dev->tx_queue_nb) % MOCK_TX_QUEUE_SIZE;
+            tx = &dev->tx_queue[idx];
+            tx->rf_chain = (uint8_t)rf;
+            tx->trig = c->trig;
+            tx->count_us = c->start_cnt / 32;
+            tx->size = c->buffer_size;
+            memcpy(tx->payload, &dev->mem[(rf == 0) ? MOCK_TX_BUFFER_A : MOCK_TX_BUFFER_B], c->buffer_size);
+            dev->tx_queue_nb += 1;
+        }
+        if ((c->state == MOCK_TX_EMITTING) && ((int32_t)(cnt - c->start_cnt) >= (MOCK_TX_DURATION_US * 32))) {
+            c->state = MOCK_TX_FREE;
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void tx_trigger(struct mock_dev_s * dev, int rf, uint8_t trig) {
+    struct mock_tx_chain_s * c = &dev->tx_chain[rf];
+    uint32_t cnt = mock_time_us(dev) * 32;
+    uint32_t trig_cnt = 0;
+    int i;
+
+    switch (trig) {
+        case LGW_MOCK_TRIG_DELAYED:
+            for (i = 0; i < 4; i++) {
+                trig_cnt |= (uint32_t)dev->mem[REG_ADDR(SX1302_REG_TX_TOP_TIMER_TRIG_BYTE0_TIMER_DELAYED_TRIG(rf) - i)] << (8 * i);
+            }
+            break;
+        case LGW_MOCK_TRIG_GPS:
+            trig_cnt = ((cnt / 32000000) + 1) * 32000000; /* next PPS */
+            break;
+        default:
+            trig_cnt = cnt;
+            break;
+    }
+
+    c->state = MOCK_TX_SCHEDULED;
+    c->trig = trig;
+    c->start_cnt = trig_cnt;
+    c->lbt = (dev->agc_lbt == true) && (dev->sx1261_lbt == true);
+
+    if (dev->tx_log != NULL) {
+        fprintf(dev->tx_log, "%llu %d %u %u %u ", (unsigned long long)host_time_us(), rf, trig, trig_cnt / 32, c->buffer_size);
+        for (i = 0; i < c->buffer_size; i++) {
+            fprintf(dev->tx_log, "%02X", dev->mem[((rf == 0) ? MOCK_TX_BUFFER_A : MOCK_TX_BUFFER_B) + i]);
+        }
+        fputc('\n', dev->tx_log);
+        fflush(dev->tx_log);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Emulate the firmwares and state machines reacting to a register write */
+static void write_hook(struct mock_dev_s * dev, uint16_t addr, uint8_t prev) {
+    uint8_t cur = dev->mem[addr];
+    uint8_t cmd, status;
+    int rf, i;
+
+    if ((addr == REG_ADDR(SX1302_REG_AGC_MCU_CTRL_MCU_CLEAR)) &&
+        (REG_FIELD(SX1302_REG_AGC_MCU_CTRL_MCU_CLEAR, cur) == 0) && (REG_FIELD(SX1302_REG_AGC_MCU_CTRL_HOST_PROG, cur) == 0) &&
+        ((REG_FIELD(SX1302_REG_AGC_MCU_CTRL_MCU_CLEAR, prev) != 0) || (REG_FIELD(SX1302_REG_AGC_MCU_CTRL_HOST_PROG, prev) != 0))) {
+        /* AGC firmware started: version in mailbox */
+        mem_reg_set(dev, SX1302_REG_AGC_MCU_MCU_AGC_STATUS_MCU_AGC_STATUS, 0x01);
+        mem_reg_set(dev, SX1302_REG_AGC_MCU_MCU_MAIL_BOX_RD_DATA_BYTE0_MCU_MAIL_BOX_RD_DATA, MOCK_AGC_FW_VERSION);
+    } else if (addr == REG_ADDR(SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE3_MCU_MAIL_BOX_WR_DATA)) {
+        /* AGC command: echo the parameters and acknowledge */
+        cmd = cur;
+        for (i = 0; i < 3; i++) {
+            mem_reg_set(dev, SX1302_REG_AGC_MCU_MCU_MAIL_BOX_RD_DATA_BYTE0_MCU_MAIL_BOX_RD_DATA - i, mem_reg_get(dev, SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE0_MCU_MAIL_BOX_WR_DATA - i));
+        }
+        if (cmd == 0x80) {          /* radio A init done */
+            status = 0x02;
+        } else if (cmd == 0x20) {   /* radio B init done */
+            status = 0x03;
+        } else if ((cmd >= 0x03) && (cmd <= 0x0A)) {
+            status = cmd + 1;
+        } else if (cmd == MOCK_AGC_CMD_DONE) {
+            status = 0x00; /* running, TX status reported from now on */
+        } else {
+            if (cmd == MOCK_AGC_CMD_LBT) {
+                dev->agc_lbt = (mem_reg_get(dev, SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE0_MCU_MAIL_BOX_WR_DATA) != 0);
+            }
+            status = 0x0F;
+        }
+        mem_reg_set(dev, SX1302_REG_AGC_MCU_MCU_AGC_STATUS_MCU_AGC_STATUS, status);
+    } else if ((addr == REG_ADDR(SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE0_MCU_MAIL_BOX_WR_DATA)) && (cur == MOCK_AGC_LBT_CLEAR) && (dev->agc_lbt == true)) {
+        /* AGC: TX status cleared by the host after a LBT check */
+        mem_reg_set(dev, SX1302_REG_AGC_MCU_MCU_AGC_STATUS_MCU_AGC_STATUS, 0x00);
+    } else if ((addr == REG_ADDR(SX1302_REG_ARB_MCU_CTRL_MCU_CLEAR)) &&
+        (REG_FIELD(SX1302_REG_ARB_MCU_CTRL_MCU_CLEAR, cur) == 0) && (REG_FIELD(SX1302_REG_ARB_MCU_CTRL_HOST_PROG, cur) == 0) &&
+        ((REG_FIELD(SX1302_REG_ARB_MCU_CTRL_MCU_CLEAR, prev) != 0) || (REG_FIELD(SX1302_REG_ARB_MCU_CTRL_HOST_PROG, prev) != 0))) {
+        /* ARB firmware started: version in debug register */
+        mem_reg_set(dev, SX1302_REG_ARB_MCU_MCU_ARB_STATUS_MCU_ARB_STATUS, 0x01);
+        mem_reg_set(dev, SX1302_REG_ARB_MCU_ARB_DEBUG_STS_0_ARB_DEBUG_STS_0, MOCK_ARB_FW_VERSION);
+    } else if ((addr == REG_ADDR(SX1302_REG_ARB_MCU_ARB_DEBUG_CFG_1_ARB_DEBUG_CFG_1)) && (cur == 1)) {
+        /* ARB configuration done */
+        mem_reg_set(dev, SX1302_REG_ARB_MCU_MCU_ARB_STATUS_MCU_ARB_STATUS, 0x00);
+    } else if (addr == REG_ADDR(SX1302_REG_OTP_BYTE_ADDR_ADDR)) {
+        cmd = mem_reg_get(dev, SX1302_REG_OTP_BYTE_ADDR_ADDR);
+        if (cmd < 8) {
+            status = (uint8_t)(MOCK_EUI >> (56 - (8 * cmd)));
+        } else if (cmd == 0xD0) {
+            status = MOCK_CHIP_MODEL_ID;
+        } else {
+            status = 0;
+        }
+        mem_reg_set(dev, SX1302_REG_OTP_RD_DATA_RD_DATA, status);
+    }
+
+    for (rf = 0; rf < 2; rf++) {
+        if ((addr == REG_ADDR(SX1302_REG_TX_TOP_TX_CTRL_WRITE_BUFFER(rf))) && (REG_FIELD(SX1302_REG_TX_TOP_TX_CTRL_WRITE_BUFFER(rf), cur) == 1)) {
+            dev->tx_chain[rf].buffer_size = 0;
+        } else if (addr == REG_ADDR(SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_IMMEDIATE(rf))) {
+            static const uint8_t trig_mode[3] = {LGW_MOCK_TRIG_IMMEDIATE, LGW_MOCK_TRIG_DELAYED, LGW_MOCK_TRIG_GPS};
+            uint16_t trig_reg[3];
+            bool any = false;
+
+            trig_reg[0] = SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_IMMEDIATE(rf);
+            trig_reg[1] = SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_DELAYED(rf);
+            trig_reg[2] = SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_GPS(rf);
+            tx_update(dev);
+            for (i = 0; i < 3; i++) {
+                if (REG_FIELD(trig_reg[i], cur) != 0) {
+                    any = true;
+                    if (REG_FIELD(trig_reg[i], prev) == 0) {
+                        tx_trigger(dev, rf, trig_mode[i]);
+                    }
+                }
+            }
+            if (any == false) {
+                /* all triggers cleared: abort */
+                dev->tx_chain[rf].state = MOCK_TX_FREE;
+            }
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Refresh the registers which depend on time before they are read */
+static void read_hook(struct mock_dev_s * dev, uint16_t addr, uint16_t size) {
+    uint32_t now, pps;
+    uint16_t a;
+    int rf;
+
+    a = REG_ADDR(SX1302_REG_RX_TOP_RX_BUFFER_NB_BYTES_MSB_RX_BUFFER_NB_BYTES);
+    if ((a >= addr) && (a < (addr + size))) {
+        rx_release(dev);
+        dev->mem[a] = (uint8_t)(dev->fifo_size >> 8);
+        dev->mem[REG_ADDR(SX1302_REG_RX_TOP_RX_BUFFER_NB_BYTES_LSB_RX_BUFFER_NB_BYTES)] = (uint8_t)(dev->fifo_size >> 0);
+    }
+
+    a = REG_ADDR(SX1302_REG_TIMESTAMP_TIMESTAMP_PPS_MSB2_TIMESTAMP_PPS);
+    if ((a < (addr + size)) && ((a + 8) > addr)) {
+        now = mock_time_us(dev);
+        pps = (now / 1000000) * 1000000;
+        mem_write_u32_msb(dev, SX1302_REG_TIMESTAMP_TIMESTAMP_PPS_MSB2_TIMESTAMP_PPS, pps * 32);
+        mem_write_u32_msb(dev, SX1302_REG_TIMESTAMP_TIMESTAMP_MSB2_TIMESTAMP, now * 32);
+    }
+
+    a = REG_ADDR(SX1302_REG_AGC_MCU_MCU_AGC_STATUS_MCU_AGC_STATUS);
+    if ((a >= addr) && (a < (addr + size))) {
+        tx_update(dev); /* LBT check of the emissions started */
+    }
+
+    for (rf = 0; rf < 2; rf++) {
+        a = REG_ADDR(SX1302_REG_TX_TOP_TX_FSM_STATUS_TX_STATUS(rf));
+        if ((a >= addr) && (a < (addr + size))) {
+            tx_update(dev);
+            switch (dev->tx_chain[rf].state) {
+                case MOCK_TX_SCHEDULED:
+                    dev->mem[a] = MOCK_TX_STATUS_SCHEDULED;
+                    break;
+                case MOCK_TX_EMITTING:
+                    dev->mem[a] = MOCK_TX_STATUS_EMITTING;
+                    break;
+                default:
+                    dev->mem[a] = MOCK_TX_STATUS_FREE;
+                    break;
+            }
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static struct mock_dev_s * current_dev(void) {
+    if ((lgw_inst->com_type != LGW_COM_MOCK) || (lgw_inst->com_target == NULL)) {
+        printf("ERROR: %s: the concentrator is not a software device\n", __FUNCTION__);
+        return NULL;
+    }
+
+    return (struct mock_dev_s *)lgw_inst->com_target;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_mock_open(const char * com_path, void **com_target_ptr) {
+    struct mock_dev_s * dev;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(com_path);
+    CHECK_NULL(com_target_ptr);
+
+    dev = malloc(sizeof *dev);
+    if (dev == NULL) {
+        printf("ERROR: MALLOC FAIL\n");
+        return LGW_MOCK_ERROR;
+    }
+    memset(dev, 0, sizeof *dev);
+
+    /* registers reset values */
+    for (i = 0; i < LGW_TOTALREGS; i++) {
+        mem_reg_set(dev, (uint16_t)i, (uint8_t)loregs[i].dflt);
+    }
+    dev->mem[REG_ADDR(SX1302_REG_COMMON_VERSION_VERSION)] = MOCK_CHIP_VERSION;
+    dev->radio_mode[0] = 0x02; /* STDBY_RC */
+    dev->radio_mode[1] = 0x02;
+    dev->sx1261_mode = 0x02;
+    snprintf((char *)&dev->sx1261_reg[MOCK_SX1261_REG_VERSION], 16, "SX1261 mock%s", sx1261_pram_version_string);
+
+    clock_gettime(CLOCK_MONOTONIC, &dev->time_start);
+    dev->time_ref = dev->time_start;
+    dev->time_ref_us = 0;
+    dev->time_scale = 1.0;
+
+    /* RX trace to be replayed */
+    if ((com_path[0] != '\0') && (strcmp(com_path, LGW_MOCK_PATH_NONE) != 0)) {
+        dev->trace = fopen(com_path, "r");
+        if (dev->trace == NULL) {
+            printf("ERROR: failed to open mock RX trace %s\n", com_path);
+            free(dev);
+            return LGW_MOCK_ERROR;
+        }
+        dev->trace_pkt_valid = trace_next(dev);
+        printf("INFO: replaying RX trace %s\n", com_path);
+    }
+
+    *com_target_ptr = (void *)dev;
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_close(void *com_target) {
+    struct mock_dev_s * dev = (struct mock_dev_s *)com_target;
+
+    /* check input variables */
+    CHECK_NULL(com_target);
+
+    if (dev->trace != NULL) {
+        fclose(dev->trace);
+    }
+    if (dev->tx_log != NULL) {
+        fclose(dev->tx_log);
+    }
+    free(dev);
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_w(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t data) {
+    return lgw_mock_wb(com_target, spi_mux_target, address, &data, 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_r(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t *data) {
+    return lgw_mock_rb(com_target, spi_mux_target, address, data, 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_rmw(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t offs, uint8_t leng, uint8_t data) {
+    struct mock_dev_s * dev = (struct mock_dev_s *)com_target;
+    uint8_t mask, prev;
+
+    /* check input variables */
+    CHECK_NULL(com_target);
+    if (spi_mux_target != LGW_SPI_MUX_TARGET_SX1302) {
+        return LGW_MOCK_ERROR;
+    }
+
+    mask = (uint8_t)(((1 << leng) - 1) << offs);
+    prev = dev->mem[address];
+    dev->mem[address] = (prev & ~mask) | ((uint8_t)(data << offs) & mask);
+    write_hook(dev, address, prev);
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_wb(void *com_target, uint8_t spi_mux_target, uint16_t address, const uint8_t *data, uint16_t size) {
+    struct mock_dev_s * dev = (struct mock_dev_s *)com_target;
+    uint32_t end = (uint32_t)address + size;
+    uint16_t base;
+    uint8_t prev;
+    int i, rf;
+
+    /* check input variables */
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+    if ((spi_mux_target != LGW_SPI_MUX_TARGET_SX1302) || (end > MOCK_MEM_SIZE)) {
+        return LGW_MOCK_ERROR;
+    }
+
+    for (i = 0; i < size; i++) {
+        prev = dev->mem[address + i];
+        dev->mem[address + i] = data[i];
+        write_hook(dev, address + i, prev);
+    }
+
+    /* keep track of the TX buffers filling */
+    for (rf = 0; rf < 2; rf++) {
+        base = (rf == 0) ? MOCK_TX_BUFFER_A : MOCK_TX_BUFFER_B;
+        if ((address >= base) && (end <= (uint32_t)(base + LGW_MOCK_TX_SIZE_MAX)) && ((end - base) > dev->tx_chain[rf].buffer_size)) {
+            dev->tx_chain[rf].buffer_size = (uint16_t)(end - base);
+        }
+    }
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_rb(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8_t *data, uint16_t size) {
+    struct mock_dev_s * dev = (struct mock_dev_s *)com_target;
+    uint16_t n;
+
+    /* check input variables */
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+    if ((spi_mux_target != LGW_SPI_MUX_TARGET_SX1302) || (((uint32_t)address + size) > MOCK_MEM_SIZE)) {
+        return LGW_MOCK_ERROR;
+    }
+
+    if (address == MOCK_RX_BUFFER_ADDR) {
+        /* RX FIFO read */
+        n = (size < dev->fifo_size) ? size : dev->fifo_size;
+        memcpy(data, dev->fifo, n);
+        memset(data + n, 0, size - n);
+        dev->fifo_size -= n;
+        memmove(dev->fifo, dev->fifo + n, dev->fifo_size);
+        return LGW_MOCK_SUCCESS;
+    }
+
+    read_hook(dev, address, size);
+    memcpy(data, &dev->mem[address], size);
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint16_t lgw_mock_chunk_size(void) {
+    return (uint16_t)MOCK_BURST_CHUNK;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_get_temperature(void *com_target, float * temperature) {
+    /* check input variables */
+    CHECK_NULL(com_target);
+    CHECK_NULL(temperature);
+
+    *temperature = MOCK_TEMPERATURE;
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int sx1250_mock_w(void *com_target, uint8_t spi_mux_target, sx1250_op_code_t op_code, uint8_t *data, uint16_t size) {
+    struct mock_dev_s * dev = (struct mock_dev_s *)com_target;
+    uint8_t * mode;
+
+    /* check input variables */
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+    if ((spi_mux_target != LGW_SPI_MUX_TARGET_RADIOA) && (spi_mux_target != LGW_SPI_MUX_TARGET_RADIOB)) {
+        return LGW_MOCK_ERROR;
+    }
+    mode = &dev->radio_mode[spi_mux_target - LGW_SPI_MUX_TARGET_RADIOA];
+
+    switch (op_code) {
+        case SET_SLEEP:
+            *mode = 0x00;
+            break;
+        case SET_STANDBY:
+            *mode = ((size > 0) && (data[0] == STDBY_XOSC)) ? 0x03 : 0x02;
+            break;
+        case SET_FS:
+            *mode = 0x04;
+            break;
+        case SET_RX:
+            *mode = 0x05;
+            break;
+        case SET_TX:
+        case SET_TXCONTINUOUSWAVE:
+        case SET_TXCONTINUOUSPREAMBLE:
+            *mode = 0x06;
+            break;
+        default:
+            /* configuration commands have no visible effect */
+            break;
+    }
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int sx1250_mock_r(void *com_target, uint8_t spi_mux_target, sx1250_op_code_t op_code, uint8_t *data, uint16_t size) {
+    struct mock_dev_s * dev = (struct mock_dev_s *)com_target;
+
+    /* check input variables */
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+    if ((spi_mux_target != LGW_SPI_MUX_TARGET_RADIOA) && (spi_mux_target != LGW_SPI_MUX_TARGET_RADIOB)) {
+        return LGW_MOCK_ERROR;
+    }
+
+    memset(data, 0, size);
+    if ((op_code == GET_STATUS) && (size > 0)) {
+        data[0] = (uint8_t)(dev->radio_mode[spi_mux_target - LGW_SPI_MUX_TARGET_RADIOA] << 4);
+    }
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int sx1261_mock_w(void *com_target, sx1261_op_code_t op_code, uint8_t *data, uint16_t size) {
+    struct mock_dev_s * dev = (struct mock_dev_s *)com_target;
+    uint16_t addr;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+
+    switch ((int)op_code) {
+        case SX1261_SET_STANDBY:
+            dev->sx1261_mode = ((size > 0) && (data[0] == SX1261_STDBY_XOSC)) ? 0x03 : 0x02;
+            break;
+        case SX1261_SET_FS:
+            dev->sx1261_mode = 0x04;
+            break;
+        case SX1261_SET_RX:
+            dev->sx1261_mode = 0x05;
+            break;
+        case SX1261_WRITE_REGISTER:
+            if (size < 2) {
+                return LGW_MOCK_ERROR;
+            }
+            addr = (uint16_t)((data[0] << 8) | data[1]);
+            for (i = 2; (i < size) && ((addr + i - 2) < MOCK_SX1261_REG_SIZE); i++) {
+                dev->sx1261_reg[addr + i - 2] = data[i]; /* PRAM patch not stored */
+            }
+            if ((addr == MOCK_SX1261_REG_LBT) && (size > 2) && (data[2] == 0)) {
+                dev->sx1261_lbt = false;
+            }
+            break;
+        case MOCK_SX1261_LBT_START:
+            dev->sx1261_lbt = true;
+            break;
+        default:
+            /* configuration commands have no visible effect */
+            break;
+    }
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int sx1261_mock_r(void *com_target, sx1261_op_code_t op_code, uint8_t *data, uint16_t size) {
+    struct mock_dev_s * dev = (struct mock_dev_s *)com_target;
+    uint16_t addr;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(com_target);
+    CHECK_NULL(data);
+
+    if ((op_code == SX1261_READ_REGISTER) && (size >= 3)) {
+        addr = (uint16_t)((data[0] << 8) | data[1]);
+        for (i = 3; i < size; i++) {
+            data[i] = ((addr + i - 3) < MOCK_SX1261_REG_SIZE) ? dev->sx1261_reg[addr + i - 3] : 0;
+        }
+        return LGW_MOCK_SUCCESS;
+    }
+
+    memset(data, 0, size);
+    if ((op_code == SX1261_GET_STATUS) && (size > 0)) {
+        data[0] = (uint8_t)((dev->sx1261_mode << 4) | SX1261_STATUS_READY);
+    }
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_rx_format(const struct lgw_mock_rx_s * pkt, uint8_t * buf, uint16_t buf_size) {
+    uint8_t * t;
+    uint16_t size;
+    uint32_t freq_offset = 0;
+    uint32_t cnt;
+    uint16_t crc;
+    uint8_t checksum = 0;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(pkt);
+    CHECK_NULL(buf);
+    if ((pkt->size > 255) || (pkt->nb_ts_metrics > LGW_MOCK_TS_METRICS_MAX)) {
+        return LGW_MOCK_ERROR;
+    }
+
+    size = MOCK_PKT_HEAD_METADATA + pkt->size + MOCK_PKT_TAIL_METADATA + (2 * pkt->nb_ts_metrics);
+    if (size > buf_size) {
+        return LGW_MOCK_ERROR;
+    }
+
+    cnt = pkt->time_us * 32;
+    buf[0] = 0xA5;
+    buf[1] = 0xC0;
+    buf[2] = (uint8_t)pkt->size;
+    buf[3] = pkt->if_chain;
+    buf[4] = (pkt->crc_en ? 0x01 : 0x00) | ((pkt->coderate & 0x07) << 1) | ((pkt->datarate & 0x0F) << 4);
+    buf[5] = (pkt->if_chain < 8) ? pkt->if_chain : (uint8_t)(pkt->if_chain + 8); /* 16: LoRa service, 17: FSK */
+    buf[6] = (uint8_t)(freq_offset >> 0);
+    buf[7] = (uint8_t)(freq_offset >> 8);
+    buf[8] = (uint8_t)(freq_offset >> 16) & 0x0F;
+    memcpy(&buf[MOCK_PKT_HEAD_METADATA], pkt->payload, pkt->size);
+
+    t = &buf[pkt->size];
+    t[9] = ((pkt->crc_en && pkt->crc_error) ? 0x01 : 0x00);
+    t[10] = (uint8_t)(int8_t)(pkt->snr * 4);
+    t[11] = pkt->rssi;
+    t[12] = pkt->rssi;
+    t[13] = 0;
+    t[14] = 0;
+    t[15] = (uint8_t)(cnt >> 0);
+    t[16] = (uint8_t)(cnt >> 8);
+    t[17] = (uint8_t)(cnt >> 16);
+    t[18] = (uint8_t)(cnt >> 24);
+    crc = (pkt->size > 0) ? sx1302_lora_payload_crc(pkt->payload, (uint8_t)pkt->size) : 0;
+    t[19] = (uint8_t)(crc >> 0);
+    t[20] = (uint8_t)(crc >> 8);
+    t[21] = pkt->nb_ts_metrics;
+    for (i = 0; i < (2 * pkt->nb_ts_metrics); i++) {
+        t[22 + i] = (uint8_t)(int8_t)((i % 7) - 3); /* small symbol timing offsets around 0 */
+    }
+    for (i = 0; i < (size - 1); i++) {
+        checksum += buf[i];
+    }
+    buf[size - 1] = checksum;
+
+    return (int)size;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_rx_raw(const uint8_t * data, uint16_t size) {
+    struct mock_dev_s * dev;
+
+    /* check input variables */
+    CHECK_NULL(data);
+    dev = current_dev();
+    CHECK_NULL(dev);
+
+    if ((dev->fifo_size + size) > MOCK_RX_FIFO_SIZE) {
+        printf("ERROR: %s: RX buffer is full\n", __FUNCTION__);
+        return LGW_MOCK_ERROR;
+    }
+    memcpy(&dev->fifo[dev->fifo_size], data, size);
+    dev->fifo_size += size;
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_rx_inject(const struct lgw_mock_rx_s * pkt) {
+    struct mock_dev_s * dev;
+
+    /* check input variables */
+    CHECK_NULL(pkt);
+    dev = current_dev();
+    CHECK_NULL(dev);
+    if ((pkt->if_chain > 9) || (pkt->size > 255) || (pkt->nb_ts_metrics > LGW_MOCK_TS_METRICS_MAX)) {
+        printf("ERROR: %s: invalid packet\n", __FUNCTION__);
+        return LGW_MOCK_ERROR;
+    }
+
+    if (dev->rx_queue_nb == MOCK_RX_QUEUE_SIZE) {
+        printf("ERROR: %s: RX queue is full\n", __FUNCTION__);
+        return LGW_MOCK_ERROR;
+    }
+    memcpy(&dev->rx_queue[(dev->rx_queue_first + dev->rx_queue_nb) % MOCK_RX_QUEUE_SIZE], pkt, sizeof *pkt);
+    dev->rx_queue_nb += 1;
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_tx_get(int max_tx, struct lgw_mock_tx_s * tx) {
+    struct mock_dev_s * dev;
+    int n = 0;
+
+    /* check input variables */
+    CHECK_NULL(tx);
+    dev = current_dev();
+    CHECK_NULL(dev);
+
+    tx_update(dev);
+    while ((n < max_tx) && (dev->tx_queue_nb > 0)) {
+        memcpy(&tx[n], &dev->tx_queue[dev->tx_queue_first], sizeof tx[n]);
+        dev->tx_queue_first = (dev->tx_queue_first + 1) % MOCK_TX_QUEUE_SIZE;
+        dev->tx_queue_nb -= 1;
+        n += 1;
+    }
+
+    return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_lbt_busy(bool busy) {
+    struct mock_dev_s * dev;
+
+    dev = current_dev();
+    CHECK_NULL(dev);
+
+    dev->lbt_busy = busy;
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_time_scale(double scale) {
+    struct mock_dev_s * dev;
+
+    /* check input variables */
+    if (scale <= 0.0) {
+        return LGW_MOCK_ERROR;
+    }
+    dev = current_dev();
+    CHECK_NULL(dev);
+
+    mock_time_rebase(dev, scale, 0);
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_time_warp(uint32_t delta_us) {
+    struct mock_dev_s * dev;
+
+    /* check input variables */
+    if (delta_us > LGW_MOCK_WARP_MAX_US) {
+        return LGW_MOCK_ERROR;
+    }
+    dev = current_dev();
+    CHECK_NULL(dev);
+
+    mock_time_rebase(dev, dev->time_scale, delta_us);
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_mock_time_get(uint64_t * time_us) {
+    struct mock_dev_s * dev;
+
+    /* check input variables */
+    CHECK_NULL(time_us);
+    dev = current_dev();
+    CHECK_NULL(dev);
+
+    *time_us = mock_time_us64(dev);
+
+    return LGW_MOCK_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
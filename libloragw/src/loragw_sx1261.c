@@ -27,6 +27,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_aux.h"
 #include "loragw_reg.h"
 #include "loragw_hal.h"
+#include "loragw_handle.h"
 
 #include "sx1261_com.h"
 
@@ -146,6 +147,7 @@ int sx1261_connect(lgw_com_type_t com_type, const char *com_path) {
         printf("ERROR: %s: unspecified COM path to connect to sx1261 radio\n", __FUNCTION__);
         return LGW_REG_ERROR;
     }
+    lgw_inst->sx1261_rx_state = SX1261_RX_UNKNOWN;
     return sx1261_com_open(com_type, com_path);
 }
 
@@ -320,6 +322,8 @@ int sx1261_setup(void) {
     int err;
     uint8_t buff[32];
 
+    lgw_inst->sx1261_rx_state = SX1261_RX_UNKNOWN;
+
     /* Set Radio in Standby mode */
     buff[0] = (uint8_t)SX1261_STDBY_RC;
     err = sx1261_reg_w(SX1261_SET_STANDBY, buff, 1);
@@ -355,11 +359,40 @@ int sx1261_set_rx_params(uint32_t freq_hz, uint8_t bandwidth) {
     int32_t freq_reg;
     uint8_t fsk_bw_reg;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
 
+    /* Same parameters as the last call: nothing to do if the radio is still in
+    RX, only re-enable RSSI averaging and RX if LBT stopped it */
+    if ((lgw_inst->sx1261_rx_state != SX1261_RX_UNKNOWN) && (freq_hz == lgw_inst->sx1261_rx_freq_hz) && (bandwidth == lgw_inst->sx1261_rx_bw)) {
+        if (lgw_inst->sx1261_rx_state == SX1261_RX_FS) {
+            lgw_inst->sx1261_rx_state = SX1261_RX_UNKNOWN; /* until it is done */
+            err = sx1261_com_set_write_mode(LGW_COM_WRITE_MODE_BULK);
+            CHECK_ERR(err);
+            buff[0] = 0x08;
+            buff[1] = 0x9B;
+            buff[2] = 0x05 << 2;
+            err = sx1261_reg_w(SX1261_WRITE_REGISTER, buff, 3);
+            CHECK_ERR(err);
+            buff[0] = 0xFF;
+            buff[1] = 0xFF;
+            buff[2] = 0xFF;
+            err = sx1261_reg_w(SX1261_SET_RX, buff, 3);
+            CHECK_ERR(err);
+            err = sx1261_com_flush();
+            CHECK_ERR(err);
+            err = sx1261_com_set_write_mode(LGW_COM_WRITE_MODE_SINGLE);
+            CHECK_ERR(err);
+            lgw_inst->sx1261_rx_state = SX1261_RX_ON;
+        }
+        DEBUG_PRINTF("SX1261: RX params already set to %u Hz (bw:0x%02X)\n", freq_hz, bandwidth);
+        _meas_time_stop(LGW_PERF_SX1261_SET_RX_PARAMS, 4, tm);
+        return LGW_REG_SUCCESS;
+    }
+    lgw_inst->sx1261_rx_state = SX1261_RX_UNKNOWN;
+
     /* Set SPI write bulk mode to optimize speed on USB */
     err = sx1261_com_set_write_mode(LGW_COM_WRITE_MODE_BULK);
     CHECK_ERR(err);
@@ -461,9 +494,13 @@ int sx1261_set_rx_params(uint32_t freq_hz, uint8_t bandwidth) {
     CHECK_ERR(err);
 #endif
 
+    lgw_inst->sx1261_rx_state = SX1261_RX_ON;
+    lgw_inst->sx1261_rx_freq_hz = freq_hz;
+    lgw_inst->sx1261_rx_bw = bandwidth;
+
     DEBUG_PRINTF("SX1261: RX params set to %u Hz (bw:0x%02X)\n", freq_hz, bandwidth);
 
-    _meas_time_stop(4, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_SX1261_SET_RX_PARAMS, 4, tm);
 
     return LGW_REG_SUCCESS;
 }
@@ -476,7 +513,7 @@ int sx1261_lbt_start(lgw_lbt_scan_time_t scan_time_us, int8_t threshold_dbm) {
     uint16_t nb_scan;
     uint8_t threshold_reg = -2 * threshold_dbm;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
@@ -508,12 +545,9 @@ int sx1261_lbt_start(lgw_lbt_scan_time_t scan_time_us, int8_t threshold_dbm) {
     err = sx1261_reg_w(0x9a, buff, 5);
     CHECK_ERR(err);
 
-    /* Wait for Scan Time before TX trigger request */
-    wait_us((uint16_t)scan_time_us);
-
     DEBUG_PRINTF("SX1261: LBT started: scan time = %uus, threshold = %ddBm\n", (uint16_t)scan_time_us, threshold_dbm);
 
-    _meas_time_stop(4, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_SX1261_LBT_START, 4, tm);
 
     return LGW_REG_SUCCESS;
 
@@ -525,7 +559,7 @@ int sx1261_lbt_stop(void) {
     int err;
     uint8_t buff[16];
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
@@ -541,9 +575,14 @@ int sx1261_lbt_stop(void) {
     err = sx1261_reg_w(SX1261_SET_FS, buff, 0);
     CHECK_ERR(err);
 
+    /* RX parameters kept, for the next LBT on the same channel */
+    if (lgw_inst->sx1261_rx_state == SX1261_RX_ON) {
+        lgw_inst->sx1261_rx_state = SX1261_RX_FS;
+    }
+
     DEBUG_MSG("SX1261: LBT stopped\n");
 
-    _meas_time_stop(4, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_SX1261_LBT_STOP, 4, tm);
 
     return LGW_REG_SUCCESS;
 }
@@ -554,7 +593,7 @@ int sx1261_spectral_scan_start(uint16_t nb_scan) {
     int err;
     uint8_t buff[4]; /* 66 bytes for spectral scan results + 2 bytes register address + 1 dummy byte for reading */
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
@@ -563,12 +602,13 @@ int sx1261_spectral_scan_start(uint16_t nb_scan) {
     buff[0] = (nb_scan >> 8) & 0xFF; /* nb_scan MSB */
     buff[1] = (nb_scan >> 0) & 0xFF; /* nb_scan LSB */
     buff[2] = 11; /* interval between scans - 8.2 us */
+    lgw_inst->sx1261_rx_state = SX1261_RX_UNKNOWN; /* RSSI averaging reconfigured by the scan */
     err = sx1261_reg_w(0x9b, buff, 9);
     CHECK_ERR(err);
 
     DEBUG_MSG("INFO: Spectral Scan started...\n");
 
-    _meas_time_stop(4, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_SX1261_SCAN_START, 4, tm);
 
     return LGW_REG_SUCCESS;
 }
@@ -579,7 +619,7 @@ int sx1261_spectral_scan_get_results(int8_t rssi_offset, int16_t * levels_dbm, u
     int err, i;
     uint8_t buff[69]; /* 66 bytes for spectral scan results + 2 bytes register address + 1 dummy byte for reading */
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
@@ -608,7 +648,7 @@ int sx1261_spectral_scan_get_results(int8_t rssi_offset, int16_t * levels_dbm, u
     levels_dbm[32] = -31*4 + rssi_offset;
     results[32] = (uint16_t)((buff[3 + 32*2] << 8) + buff[3 + 32*2 + 1]);
 
-    _meas_time_stop(4, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_SX1261_SCAN_RESULTS, 4, tm);
 
     return LGW_REG_SUCCESS;
 }
@@ -619,7 +659,7 @@ int sx1261_spectral_scan_status(lgw_spectral_scan_status_t * status) {
     int err;
     uint8_t buff[16];
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     CHECK_NULL(status);
 
@@ -654,7 +694,7 @@ int sx1261_spectral_scan_status(lgw_spectral_scan_status_t * status) {
 
     DEBUG_PRINTF("INFO: %s: %s\n", __FUNCTION__, get_scan_status_str(*status));
 
-    _meas_time_stop(4, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_SX1261_SCAN_STATUS, 4, tm);
 
     return LGW_REG_SUCCESS;
 }
@@ -665,7 +705,7 @@ int sx1261_spectral_scan_abort(void) {
     int err;
     uint8_t buff[16];
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
@@ -679,7 +719,7 @@ int sx1261_spectral_scan_abort(void) {
 
     DEBUG_MSG("SX1261: spectral scan aborted\n");
 
-    _meas_time_stop(4, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_SX1261_SCAN_ABORT, 4, tm);
 
     return LGW_REG_SUCCESS;
 }
@@ -33,6 +33,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_agc_params.h"
 #include "loragw_cal.h"
 #include "loragw_debug.h"
+#include "loragw_handle.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -115,17 +116,20 @@ const uint8_t ifmod_config[LGW_IF_CHAIN_NB] = LGW_IFMODEM_CONFIG;
 #define GPIO_CFG_MBIST                  0x0A
 #define GPIO_CFG_OTP                    0x0B
 
+/* register operations of a prepared TX request (struct lgw_tx_op_s type) */
+#define TX_OP_WRITE                     0x00 /* direct write of a whole register byte */
+#define TX_OP_RMW                       0x01 /* read-modify-write of the masked bits */
+#define TX_OP_REG_BURST                 0x02 /* burst write of consecutive registers */
+#define TX_OP_MEM_BURST                 0x03 /* burst write in memory, split in com chunks */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
 /* Radio calibration firmware */
 #include "cal_fw.var" /* text_cal_sx1257_16_Nov_1 */
 
-/* Buffer to hold RX data */
-rx_buffer_t rx_buffer;
-
-/* Internal timestamp counter */
-timestamp_counter_t counter_us;
+/* RX data buffer and internal timestamp counter are held by the current
+   instance handle (lgw_inst->rx_buffer, lgw_inst->counter_us) */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
@@ -151,11 +155,35 @@ extern int32_t lgw_bw_getval(int x);
 */
 void lora_crc16(const char data, int *crc);
 
-/* -------------------------------------------------------------------------- */
-/* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
+/**
+@brief Append a register write to a prepared TX request, merged with the previous operation when possible
+@param prep prepared TX request
+@param register_id register to be written
+@param reg_value value to be written
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
+*/
+static int tx_prep_reg(struct lgw_tx_prep_s * prep, uint16_t register_id, int32_t reg_value);
 
-/* Log file */
-extern FILE * log_file;
+/**
+@brief Append a burst write, starting at a register, to a prepared TX request
+@param prep prepared TX request
+@param register_id first register to be written
+@param data bytes to be written
+@param size number of bytes to be written
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
+*/
+static int tx_prep_regb(struct lgw_tx_prep_s * prep, uint16_t register_id, const uint8_t * data, uint16_t size);
+
+/**
+@brief Append a burst write to a prepared TX request, appended to the previous burst when contiguous
+@param prep prepared TX request
+@param type TX_OP_REG_BURST or TX_OP_MEM_BURST
+@param addr first address to be written
+@param data bytes to be written
+@param size number of bytes to be written
+@return LGW_REG_SUCCESS if success, LGW_REG_ERROR otherwise
+*/
+static int tx_prep_burst(struct lgw_tx_prep_s * prep, uint8_t type, uint16_t addr, const uint8_t * data, uint16_t size);
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
@@ -237,6 +265,138 @@ int sx1302_config_gpio(void) {
     return LGW_REG_SUCCESS;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int tx_prep_reg(struct lgw_tx_prep_s * prep, uint16_t register_id, int32_t reg_value) {
+    struct lgw_reg_s r;
+    struct lgw_tx_op_s * last;
+    uint8_t mask, value;
+
+    /* check input parameters */
+    if (register_id >= LGW_TOTALREGS) {
+        DEBUG_MSG("ERROR: REGISTER NUMBER OUT OF DEFINED RANGE\n");
+        return LGW_REG_ERROR;
+    }
+    r = loregs[register_id];
+    if ((r.rdon == 1) || ((r.offs + r.leng) > 8)) {
+        DEBUG_MSG("ERROR: REGISTER CANNOT BE PART OF A TX REQUEST\n");
+        return LGW_REG_ERROR;
+    }
+
+    mask = (uint8_t)(((1 << r.leng) - 1) << r.offs);
+    value = (uint8_t)(reg_value << r.offs) & mask;
+    last = (prep->nb_op > 0) ? &(prep->op[prep->nb_op - 1]) : NULL;
+
+    if (mask == 0xFF) {
+        /* whole byte, can extend a burst of consecutive registers */
+        return tx_prep_burst(prep, TX_OP_REG_BURST, r.addr, &value, 1);
+    }
+
+    /* other bits of the register just written: one access for both */
+    if ((last != NULL) && (last->type == TX_OP_RMW) && (last->addr == r.addr) && ((last->mask & mask) == 0)) {
+        last->mask |= mask;
+        last->value |= value;
+        if (last->mask == 0xFF) {
+            last->type = TX_OP_WRITE;
+        }
+        return LGW_REG_SUCCESS;
+    }
+
+    if (prep->nb_op >= LGW_TX_PREP_OP_NB) {
+        printf("ERROR: too many register operations for a TX request\n");
+        return LGW_REG_ERROR;
+    }
+    last = &(prep->op[prep->nb_op]);
+    last->addr = r.addr;
+    last->type = TX_OP_RMW;
+    last->mask = mask;
+    last->value = value;
+    last->size = 1;
+    prep->nb_op += 1;
+
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int tx_prep_regb(struct lgw_tx_prep_s * prep, uint16_t register_id, const uint8_t * data, uint16_t size) {
+    /* check input parameters */
+    if (register_id >= LGW_TOTALREGS) {
+        DEBUG_MSG("ERROR: REGISTER NUMBER OUT OF DEFINED RANGE\n");
+        return LGW_REG_ERROR;
+    }
+    if (loregs[register_id].rdon == 1) {
+        DEBUG_MSG("ERROR: TRYING TO BURST WRITE A READ-ONLY REGISTER\n");
+        return LGW_REG_ERROR;
+    }
+
+    return tx_prep_burst(prep, TX_OP_REG_BURST, loregs[register_id].addr, data, size);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int tx_prep_burst(struct lgw_tx_prep_s * prep, uint8_t type, uint16_t addr, const uint8_t * data, uint16_t size) {
+    struct lgw_tx_op_s * last;
+
+    /* check input parameters */
+    CHECK_NULL(data);
+    if (size == 0) {
+        DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+        return LGW_REG_ERROR;
+    }
+    if ((prep->data_size + size) > LGW_TX_PREP_DATA_SIZE) {
+        printf("ERROR: too much data for a TX request\n");
+        return LGW_REG_ERROR;
+    }
+    last = (prep->nb_op > 0) ? &(prep->op[prep->nb_op - 1]) : NULL;
+
+    /* a single byte written just before at the previous address becomes a burst */
+    if ((last != NULL) && (type == TX_OP_REG_BURST) && (last->type == TX_OP_WRITE) && ((last->addr + 1) == addr)) {
+        prep->data[prep->data_size] = (uint8_t)last->value;
+        last->type = TX_OP_REG_BURST;
+        last->value = prep->data_size;
+        last->size = 1;
+        prep->data_size += 1;
+        if ((prep->data_size + size) > LGW_TX_PREP_DATA_SIZE) {
+            printf("ERROR: too much data for a TX request\n");
+            return LGW_REG_ERROR;
+        }
+    }
+
+    /* contiguous with the previous burst (in address and in the data buffer): extend it */
+    if ((last != NULL) && (last->type == type) && ((last->type == TX_OP_REG_BURST) || (last->type == TX_OP_MEM_BURST))
+        && ((last->addr + last->size) == addr) && ((last->value + last->size) == prep->data_size)) {
+        memcpy(&(prep->data[prep->data_size]), data, size);
+        prep->data_size += size;
+        last->size += size;
+        return LGW_REG_SUCCESS;
+    }
+
+    if (prep->nb_op >= LGW_TX_PREP_OP_NB) {
+        printf("ERROR: too many register operations for a TX request\n");
+        return LGW_REG_ERROR;
+    }
+    last = &(prep->op[prep->nb_op]);
+    last->addr = addr;
+    if ((type == TX_OP_REG_BURST) && (size == 1)) {
+        /* single register, kept as a direct write until a burst is possible */
+        last->type = TX_OP_WRITE;
+        last->mask = 0xFF;
+        last->value = data[0];
+        last->size = 1;
+    } else {
+        last->type = type;
+        last->mask = 0xFF;
+        last->value = prep->data_size;
+        last->size = size;
+        memcpy(&(prep->data[prep->data_size]), data, size);
+        prep->data_size += size;
+    }
+    prep->nb_op += 1;
+
+    return LGW_REG_SUCCESS;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
@@ -248,10 +408,10 @@ int sx1302_init(const struct lgw_conf_ftime_s * ftime_context) {
     CHECK_NULL(ftime_context);
 
     /* Initialize internal counter */
-    timestamp_counter_new(&counter_us);
+    timestamp_counter_new(&lgw_inst->counter_us);
 
     /* Initialize RX buffer */
-    rx_buffer_new(&rx_buffer);
+    rx_buffer_new(&lgw_inst->rx_buffer);
 
     /* Configure timestamping mode */
     if (ftime_context->enable == true) {
@@ -329,9 +489,11 @@ int sx1302_get_model_id(sx1302_model_id_t * model_id) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int sx1302_update(void) {
+    int err;
     uint32_t inst, pps;
+    lgw_com_sub_t sub;
     /* performances variables */
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
@@ -353,9 +515,14 @@ int sx1302_update(void) {
 #endif
 
     /* Update internal timestamp counter wrapping status */
-    timestamp_counter_get(&counter_us, &inst, &pps);
+    sub = lgw_com_set_subsystem(LGW_COM_SUB_COUNTER);
+    err = timestamp_counter_get(&lgw_inst->counter_us, &inst, &pps);
+    lgw_com_set_subsystem(sub);
+    if (err != 0) {
+        return LGW_REG_ERROR;
+    }
 
-    _meas_time_stop(2, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_SX1302_UPDATE, 2, tm);
 
     return LGW_REG_SUCCESS;
 }
@@ -1145,7 +1312,7 @@ int sx1302_lora_syncword(bool public, uint8_t lora_service_sf) {
 
 uint32_t sx1302_timestamp_counter(bool pps) {
     uint32_t inst_cnt, pps_cnt;
-    timestamp_counter_get(&counter_us, &inst_cnt, &pps_cnt);
+    timestamp_counter_get(&lgw_inst->counter_us, &inst_cnt, &pps_cnt);
     return ((pps == true) ? pps_cnt : inst_cnt);
 }
 
@@ -1860,34 +2027,41 @@ int sx1302_arb_start(uint8_t version, const struct lgw_conf_ftime_s * ftime_cont
 
 int sx1302_fetch(uint8_t * nb_pkt) {
     int err;
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
 
     /* Fetch packets from sx1302 if no more left in RX buffer */
-    if (rx_buffer.buffer_pkt_nb == 0) {
+    if (lgw_inst->rx_buffer.buffer_pkt_nb == 0) {
         /* Initialize RX buffer */
-        err = rx_buffer_new(&rx_buffer);
+        err = rx_buffer_new(&lgw_inst->rx_buffer);
         if (err != LGW_REG_SUCCESS) {
             printf("ERROR: Failed to initialize RX buffer\n");
             return LGW_REG_ERROR;
         }
 
         /* Fetch RX buffer if any data available */
-        err = rx_buffer_fetch(&rx_buffer);
+        err = rx_buffer_fetch(&lgw_inst->rx_buffer);
         if (err != LGW_REG_SUCCESS) {
             printf("ERROR: Failed to fetch RX buffer\n");
             return LGW_REG_ERROR;
         }
     } else {
-        printf("Note: remaining %u packets in RX buffer, do not fetch sx1302 yet...\n", rx_buffer.buffer_pkt_nb);
+        printf("Note: remaining %u packets in RX buffer, do not fetch sx1302 yet...\n", lgw_inst->rx_buffer.buffer_pkt_nb);
+    }
+
+    /* Take the timing snapshot used to parse the packets fetched (counters wrapping status, PPS counter for fine timestamp),
+        read after the RX buffer so that all packets fetched are older than the snapshot */
+    err = sx1302_update();
+    if (err != LGW_REG_SUCCESS) {
+        return LGW_REG_ERROR;
     }
 
     /* Return the number of packet fetched */
-    *nb_pkt = rx_buffer.buffer_pkt_nb;
+    *nb_pkt = lgw_inst->rx_buffer.buffer_pkt_nb;
 
-    _meas_time_stop(2, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_SX1302_FETCH, 2, tm);
 
     return LGW_REG_SUCCESS;
 }
@@ -1904,7 +2078,7 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
     uint8_t cr;
     int32_t timestamp_correction;
     rx_packet_t pkt;
-    struct timeval tm;
+    uint64_t tm;
 
     /* Record function start time */
     _meas_time_start(&tm);
@@ -1921,9 +2095,9 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
 #endif
 
     /* get packet from RX buffer */
-    err = rx_buffer_pop(&rx_buffer, &pkt);
+    err = rx_buffer_pop(&lgw_inst->rx_buffer, &pkt);
     if (err == LGW_REG_WARNING) {
-        rx_buffer_del(&rx_buffer); /* clear the buffer */
+        rx_buffer_del(&lgw_inst->rx_buffer); /* clear the buffer */
         return err;
     } else if (err == LGW_REG_ERROR) {
         return err;
@@ -1970,9 +2144,9 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
                     payload_crc16_calc = sx1302_lora_payload_crc(p->payload, p->size);
                     if (payload_crc16_calc != pkt.rx_crc16_value) {
                         printf("ERROR: Payload CRC16 check failed (got:0x%04X calc:0x%04X)\n", pkt.rx_crc16_value, payload_crc16_calc);
-                        if (log_file != NULL) {
-                            fprintf(log_file, "ERROR: Payload CRC16 check failed (got:0x%04X calc:0x%04X)\n", pkt.rx_crc16_value, payload_crc16_calc);
-                            dbg_log_buffer_to_file(log_file, rx_buffer.buffer, rx_buffer.buffer_size);
+                        if (lgw_inst->log_file != NULL) {
+                            fprintf(lgw_inst->log_file, "ERROR: Payload CRC16 check failed (got:0x%04X calc:0x%04X)\n", pkt.rx_crc16_value, payload_crc16_calc);
+                            dbg_log_buffer_to_file(lgw_inst->log_file, lgw_inst->rx_buffer.buffer, lgw_inst->rx_buffer.buffer_size);
                         }
                         return LGW_REG_ERROR;
                     } else {
@@ -1996,13 +2170,13 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
             */
             int res;
             for (i = 0; i < context->debug_cfg.nb_ref_payload; i++) {
-                res = dbg_check_payload(&(context->debug_cfg), log_file, p->payload, p->size, i, pkt.rx_rate_sf);
+                res = dbg_check_payload(&(context->debug_cfg), lgw_inst->log_file, p->payload, p->size, i, pkt.rx_rate_sf);
                 if (res == -1) {
                     printf("ERROR: 0x%08X payload error\n", context->debug_cfg.ref_payload[i].id);
-                    if (log_file != NULL) {
-                        fprintf(log_file, "ERROR: 0x%08X payload error\n", context->debug_cfg.ref_payload[i].id);
-                        dbg_log_buffer_to_file(log_file, rx_buffer.buffer, rx_buffer.buffer_size);
-                        dbg_log_payload_diff_to_file(log_file, p->payload, context->debug_cfg.ref_payload[i].payload, p->size);
+                    if (lgw_inst->log_file != NULL) {
+                        fprintf(lgw_inst->log_file, "ERROR: 0x%08X payload error\n", context->debug_cfg.ref_payload[i].id);
+                        dbg_log_buffer_to_file(lgw_inst->log_file, lgw_inst->rx_buffer.buffer, lgw_inst->rx_buffer.buffer_size);
+                        dbg_log_payload_diff_to_file(lgw_inst->log_file, p->payload, context->debug_cfg.ref_payload[i].payload, p->size);
                     }
                     return LGW_REG_ERROR;
                 } else if (res == 1) {
@@ -2093,7 +2267,7 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
             pkt_freq_error = ((double)(p->freq_hz + p->freq_offset) / (double)(p->freq_hz)) - 1.0;
 
             /* Compute the fine timestamp */
-            err = precise_timestamp_calculate(pkt.num_ts_metrics_stored, &pkt.timestamp_avg[0], pkt.timestamp_cnt, pkt.rx_rate_sf, context->if_chain_cfg[p->if_chain].freq_hz, pkt_freq_error, &(p->ftime));
+            err = precise_timestamp_calculate(pkt.num_ts_metrics_stored, &pkt.timestamp_avg[0], pkt.timestamp_cnt, lgw_inst->counter_us.pps_reg, pkt.rx_rate_sf, context->if_chain_cfg[p->if_chain].freq_hz, pkt_freq_error, &(p->ftime));
             if (err == 0) {
                 p->ftime_received = true;
             }
@@ -2150,7 +2324,7 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
     p->count_us = pkt.timestamp_cnt / 32;
 
     /* Expand 27-bits counter to 32-bits counter, based on current wrapping status (updated after fetch) */
-    p->count_us = timestamp_pkt_expand(&counter_us, p->count_us);
+    p->count_us = timestamp_pkt_expand(&lgw_inst->counter_us, p->count_us);
 
 
 #if 0 // debug code to check for failed submicros/micros handling
@@ -2161,8 +2335,8 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
         int32_t diff = p->count_us - last_us32;
         uint32_t pkt_num = (p->payload[4] << 24) | (p->payload[5] << 16) | (p->payload[6] << 8) | (p->payload[7] << 0);
 
-        printf("XXXXXXXXXXXXXXXX inst - ref=%u wrap=%u\n", counter_us.inst.counter_us_27bits_ref, counter_us.inst.counter_us_27bits_wrap);
-        printf("XXXXXXXXXXXXXXXX pps  - ref=%u wrap=%u\n", counter_us.pps.counter_us_27bits_ref, counter_us.pps.counter_us_27bits_wrap);
+        printf("XXXXXXXXXXXXXXXX inst - ref=%u wrap=%u\n", lgw_inst->counter_us.inst.counter_us_27bits_ref, lgw_inst->counter_us.inst.counter_us_27bits_wrap);
+        printf("XXXXXXXXXXXXXXXX pps  - ref=%u wrap=%u\n", lgw_inst->counter_us.pps.counter_us_27bits_ref, lgw_inst->counter_us.pps.counter_us_27bits_wrap);
         printf("XXXXXXXXXXXXXXXX pkt=%u (%u) last=%u diff=%d\n", p->count_us, pkt.timestamp_cnt / 32, last_us32, diff);
         printf("XXXXXXXXXXXXXXXX pkt num=%u\n", pkt_num);
         if (last_valid && (diff > 30000000) && (pkt_num == (last_pkt_num + 1))) {
@@ -2181,7 +2355,7 @@ int sx1302_parse(lgw_context_t * context, struct lgw_pkt_rx_s * p) {
     /* Packet CRC status */
     p->crc = pkt.rx_crc16_value;
 
-    _meas_time_stop(2, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_SX1302_PARSE, 2, tm);
 
     return LGW_REG_SUCCESS;
 }
@@ -2202,14 +2376,12 @@ uint16_t sx1302_lora_payload_crc(const uint8_t * data, uint8_t size) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int sx1302_tx_set_start_delay(uint8_t rf_chain, lgw_radio_type_t radio_type, uint8_t modulation, uint8_t bandwidth, uint8_t chirp_lowpass, uint16_t * delay) {
-    int err;
+int sx1302_tx_get_start_delay(lgw_radio_type_t radio_type, uint8_t modulation, uint8_t bandwidth, uint8_t chirp_lowpass, uint16_t * delay) {
     uint16_t tx_start_delay = TX_START_DELAY_DEFAULT * 32;
     uint16_t radio_bw_delay = 0;
     uint16_t filter_delay = 0;
     uint16_t modem_delay = 0;
     int32_t bw_hz = lgw_bw_getval(bandwidth);
-    uint8_t buff[2]; /* for 16 bits register write operation */
 
     CHECK_NULL(delay);
 
@@ -2261,11 +2433,6 @@ int sx1302_tx_set_start_delay(uint8_t rf_chain, lgw_radio_type_t radio_type, uin
 
     DEBUG_PRINTF("INFO: tx_start_delay=%u (%u, radio_bw_delay=%u, filter_delay=%u, modem_delay=%u)\n", (uint16_t)tx_start_delay, TX_START_DELAY_DEFAULT*32, radio_bw_delay, filter_delay, modem_delay);
 
-    buff[0] = (uint8_t)(tx_start_delay >> 8);
-    buff[1] = (uint8_t)(tx_start_delay >> 0);
-    err = lgw_reg_wb(SX1302_REG_TX_TOP_TX_START_DELAY_MSB_TX_START_DELAY(rf_chain), buff, 2);
-    CHECK_ERR(err);
-
     /* return tx_start_delay */
     *delay = tx_start_delay;
 
@@ -2274,6 +2441,96 @@ int sx1302_tx_set_start_delay(uint8_t rf_chain, lgw_radio_type_t radio_type, uin
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int sx1302_tx_power_get(lgw_radio_type_t radio_type, const struct lgw_tx_gain_lut_s * tx_lut, int8_t rf_power, struct sx1302_tx_power_s * tx_pow) {
+    const struct lgw_tx_gain_s * g;
+    int i, best = -1;
+    uint8_t pa_en;
+
+    /* Check input parameters */
+    CHECK_NULL(tx_lut);
+    CHECK_NULL(tx_pow);
+    if ((tx_lut->size < 1) || (tx_lut->size > TX_GAIN_LUT_SIZE_MAX)) {
+        DEBUG_MSG("ERROR: TX gain LUT is empty\n");
+        return LGW_REG_ERROR;
+    }
+
+    /* Find the highest power lower or equal to the requested one, the first entry if none */
+    for (i = 0; i < tx_lut->size; i++) {
+        if ((tx_lut->lut[i].rf_power <= rf_power) && ((best < 0) || (tx_lut->lut[i].rf_power >= tx_lut->lut[best].rf_power))) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        best = 0;
+    }
+    g = &(tx_lut->lut[best]);
+
+    /* Power register value, depending on the radio */
+    switch (radio_type) {
+        case LGW_RADIO_TYPE_SX1250:
+            pa_en = (g->pa_gain > 0) ? 1 : 0; /* only 1 bit used to control the external PA */
+            tx_pow->tx_pwr = (pa_en << 6) | g->pwr_idx;
+            break;
+        case LGW_RADIO_TYPE_SX1255:
+        case LGW_RADIO_TYPE_SX1257:
+            tx_pow->tx_pwr = (g->pa_gain << 6) | (g->dac_gain << 4) | g->mix_gain;
+            break;
+        default:
+            DEBUG_MSG("ERROR: radio type not supported\n");
+            return LGW_REG_ERROR;
+    }
+
+    tx_pow->lut_index = (uint8_t)best;
+    tx_pow->rf_power = g->rf_power;
+    tx_pow->iq_gain = g->dig_gain;
+    tx_pow->offset_i = g->offset_i;
+    tx_pow->offset_q = g->offset_q;
+
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int sx1302_tx_power_table_build(lgw_radio_type_t radio_type, const struct lgw_tx_gain_lut_s * tx_lut, struct sx1302_tx_power_s table[TX_POWER_TABLE_SIZE]) {
+    int err;
+    int i;
+
+    CHECK_NULL(table);
+
+    for (i = 0; i < TX_POWER_TABLE_SIZE; i++) {
+        err = sx1302_tx_power_get(radio_type, tx_lut, (int8_t)(TX_POWER_TABLE_MIN + i), &table[i]);
+        if (err != LGW_REG_SUCCESS) {
+            return LGW_REG_ERROR;
+        }
+    }
+
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int sx1302_tx_set_start_delay(uint8_t rf_chain, lgw_radio_type_t radio_type, uint8_t modulation, uint8_t bandwidth, uint8_t chirp_lowpass, uint16_t * delay) {
+    int err;
+    uint8_t buff[2]; /* for 16 bits register write operation */
+
+    err = sx1302_tx_get_start_delay(radio_type, modulation, bandwidth, chirp_lowpass, delay);
+    CHECK_ERR(err);
+
+    /* tx start delay only necessary for beaconing (LoRa) */
+    if (modulation != MOD_LORA) {
+        return LGW_REG_SUCCESS;
+    }
+
+    buff[0] = (uint8_t)(*delay >> 8);
+    buff[1] = (uint8_t)(*delay >> 0);
+    err = lgw_reg_wb(SX1302_REG_TX_TOP_TX_START_DELAY_MSB_TX_START_DELAY(rf_chain), buff, 2);
+    CHECK_ERR(err);
+
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 float sx1302_rssi_get_temperature_offset(struct lgw_rssi_tcomp_s * context, float temperature) {
     /* Chekc params */
     CHECK_NULL(context);
@@ -2395,7 +2652,7 @@ int sx1302_tx_configure(lgw_radio_type_t radio_type) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut, bool lwan_public, struct lgw_conf_rxif_s * context_fsk, struct lgw_pkt_tx_s * pkt_data) {
+int sx1302_send_prepare(lgw_radio_type_t radio_type, const struct sx1302_tx_power_s * tx_pow, bool lwan_public, struct lgw_conf_rxif_s * context_fsk, struct lgw_pkt_tx_s * pkt_data, struct lgw_tx_prep_s * prep) {
     int err;
     uint32_t freq_reg, fdev_reg;
     uint32_t freq_dev;
@@ -2403,45 +2660,37 @@ int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut,
     uint64_t fsk_sync_word_reg;
     uint16_t mem_addr;
     uint32_t count_us;
-    uint8_t power;
-    uint8_t pow_index;
     uint8_t mod_bw;
-    uint8_t pa_en;
     uint16_t tx_start_delay;
     uint8_t chirp_lowpass = 0;
     uint8_t buff[2]; /* for 16-bits register write operation */
-    /* performances variables */
-    struct timeval tm;
-
-    /* Record function start time */
-    _meas_time_start(&tm);
 
     /* Check input parameters */
-    CHECK_NULL(tx_lut);
+    CHECK_NULL(tx_pow);
     CHECK_NULL(pkt_data);
+    CHECK_NULL(prep);
 
-    /* Setting BULK write mode (to speed up configuration on USB) */
-    err = lgw_com_set_write_mode(LGW_COM_WRITE_MODE_BULK);
-    CHECK_ERR(err);
+    prep->nb_op = 0;
+    prep->data_size = 0;
 
     /* Select the proper modem */
     switch (pkt_data->modulation) {
         case MOD_CW:
-            err = lgw_reg_w(SX1302_REG_TX_TOP_GEN_CFG_0_MODULATION_TYPE(pkt_data->rf_chain), 0x00);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_GEN_CFG_0_MODULATION_TYPE(pkt_data->rf_chain), 0x00);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_CTRL_TX_IF_SRC(pkt_data->rf_chain), 0x00);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_CTRL_TX_IF_SRC(pkt_data->rf_chain), 0x00);
             CHECK_ERR(err);
             break;
         case MOD_LORA:
-            err = lgw_reg_w(SX1302_REG_TX_TOP_GEN_CFG_0_MODULATION_TYPE(pkt_data->rf_chain), 0x00);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_GEN_CFG_0_MODULATION_TYPE(pkt_data->rf_chain), 0x00);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_CTRL_TX_IF_SRC(pkt_data->rf_chain), 0x01);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_CTRL_TX_IF_SRC(pkt_data->rf_chain), 0x01);
             CHECK_ERR(err);
             break;
         case MOD_FSK:
-            err = lgw_reg_w(SX1302_REG_TX_TOP_GEN_CFG_0_MODULATION_TYPE(pkt_data->rf_chain), 0x01);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_GEN_CFG_0_MODULATION_TYPE(pkt_data->rf_chain), 0x01);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_CTRL_TX_IF_SRC(pkt_data->rf_chain), 0x02);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_CTRL_TX_IF_SRC(pkt_data->rf_chain), 0x02);
             CHECK_ERR(err);
             break;
         default:
@@ -2449,41 +2698,22 @@ int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut,
             return LGW_REG_ERROR;
     }
 
-    /* Find the proper index in the TX gain LUT according to requested rf_power */
-    for (pow_index = tx_lut->size-1; pow_index > 0; pow_index--) {
-        if (tx_lut->lut[pow_index].rf_power <= pkt_data->rf_power) {
-            break;
-        }
-    }
-    DEBUG_PRINTF("INFO: selecting TX Gain LUT index %u\n", pow_index);
+    DEBUG_PRINTF("INFO: selecting TX Gain LUT index %u\n", tx_pow->lut_index);
 
     /* loading calibrated Tx DC offsets */
-    err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_I_OFFSET_I_OFFSET(pkt_data->rf_chain), tx_lut->lut[pow_index].offset_i);
+    err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_I_OFFSET_I_OFFSET(pkt_data->rf_chain), tx_pow->offset_i);
     CHECK_ERR(err);
-    err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_Q_OFFSET_Q_OFFSET(pkt_data->rf_chain), tx_lut->lut[pow_index].offset_q);
+    err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_Q_OFFSET_Q_OFFSET(pkt_data->rf_chain), tx_pow->offset_q);
     CHECK_ERR(err);
 
-    DEBUG_PRINTF("INFO: Applying IQ offset (i:%d, q:%d)\n", tx_lut->lut[pow_index].offset_i, tx_lut->lut[pow_index].offset_q);
+    DEBUG_PRINTF("INFO: Applying IQ offset (i:%d, q:%d)\n", tx_pow->offset_i, tx_pow->offset_q);
 
     /* Set the power parameters to be used for TX */
-    switch (radio_type) {
-        case LGW_RADIO_TYPE_SX1250:
-            pa_en = (tx_lut->lut[pow_index].pa_gain > 0) ? 1 : 0; /* only 1 bit used to control the external PA */
-            power = (pa_en << 6) | tx_lut->lut[pow_index].pwr_idx;
-            break;
-        case LGW_RADIO_TYPE_SX1255:
-        case LGW_RADIO_TYPE_SX1257:
-            power = (tx_lut->lut[pow_index].pa_gain << 6) | (tx_lut->lut[pow_index].dac_gain << 4) | tx_lut->lut[pow_index].mix_gain;
-            break;
-        default:
-            DEBUG_MSG("ERROR: radio type not supported\n");
-            return LGW_REG_ERROR;
-    }
-    err = lgw_reg_w(SX1302_REG_TX_TOP_AGC_TX_PWR_AGC_TX_PWR(pkt_data->rf_chain), power);
+    err = tx_prep_reg(prep, SX1302_REG_TX_TOP_AGC_TX_PWR_AGC_TX_PWR(pkt_data->rf_chain), tx_pow->tx_pwr);
     CHECK_ERR(err);
 
     /* Set digital gain */
-    err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_IQ_GAIN_IQ_GAIN(pkt_data->rf_chain), tx_lut->lut[pow_index].dig_gain);
+    err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_IQ_GAIN_IQ_GAIN(pkt_data->rf_chain), tx_pow->iq_gain);
     CHECK_ERR(err);
 
     /* Set Tx frequency */
@@ -2492,11 +2722,11 @@ int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut,
     } else {
         freq_reg = SX1302_FREQ_TO_REG(pkt_data->freq_hz);
     }
-    err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_RF_H_FREQ_RF(pkt_data->rf_chain), (freq_reg >> 16) & 0xFF);
+    err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_RF_H_FREQ_RF(pkt_data->rf_chain), (freq_reg >> 16) & 0xFF);
     CHECK_ERR(err);
-    err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_RF_M_FREQ_RF(pkt_data->rf_chain), (freq_reg >> 8) & 0xFF);
+    err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_RF_M_FREQ_RF(pkt_data->rf_chain), (freq_reg >> 8) & 0xFF);
     CHECK_ERR(err);
-    err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_RF_L_FREQ_RF(pkt_data->rf_chain), (freq_reg >> 0) & 0xFF);
+    err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_RF_L_FREQ_RF(pkt_data->rf_chain), (freq_reg >> 0) & 0xFF);
     CHECK_ERR(err);
 
     /* Set AGC bandwidth and modulation type*/
@@ -2512,7 +2742,7 @@ int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut,
             printf("ERROR: Modulation not supported\n");
             return LGW_REG_ERROR;
     }
-    err = lgw_reg_w(SX1302_REG_TX_TOP_AGC_TX_BW_AGC_TX_BW(pkt_data->rf_chain), mod_bw);
+    err = tx_prep_reg(prep, SX1302_REG_TX_TOP_AGC_TX_BW_AGC_TX_BW(pkt_data->rf_chain), mod_bw);
     CHECK_ERR(err);
 
     /* Configure modem */
@@ -2522,34 +2752,34 @@ int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut,
             freq_dev = ceil(fabs( (float)pkt_data->freq_offset / 10) ) * 10e3;
             printf("CW: f_dev %d Hz\n", (int)(freq_dev));
             fdev_reg = SX1302_FREQ_TO_REG(freq_dev);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_DEV_H_FREQ_DEV(pkt_data->rf_chain), (fdev_reg >>  8) & 0xFF);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_DEV_H_FREQ_DEV(pkt_data->rf_chain), (fdev_reg >>  8) & 0xFF);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_DEV_L_FREQ_DEV(pkt_data->rf_chain), (fdev_reg >>  0) & 0xFF);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_DEV_L_FREQ_DEV(pkt_data->rf_chain), (fdev_reg >>  0) & 0xFF);
             CHECK_ERR(err);
 
             /* Send frequency deviation to AGC fw for radio config */
             fdev_reg = SX1250_FREQ_TO_REG(freq_dev);
-            err = lgw_reg_w(SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE2_MCU_MAIL_BOX_WR_DATA, (fdev_reg >> 16) & 0xFF); /* Needed by AGC to configure the sx1250 */
+            err = tx_prep_reg(prep, SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE2_MCU_MAIL_BOX_WR_DATA, (fdev_reg >> 16) & 0xFF); /* Needed by AGC to configure the sx1250 */
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE1_MCU_MAIL_BOX_WR_DATA, (fdev_reg >>  8) & 0xFF); /* Needed by AGC to configure the sx1250 */
+            err = tx_prep_reg(prep, SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE1_MCU_MAIL_BOX_WR_DATA, (fdev_reg >>  8) & 0xFF); /* Needed by AGC to configure the sx1250 */
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE0_MCU_MAIL_BOX_WR_DATA, (fdev_reg >>  0) & 0xFF); /* Needed by AGC to configure the sx1250 */
+            err = tx_prep_reg(prep, SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE0_MCU_MAIL_BOX_WR_DATA, (fdev_reg >>  0) & 0xFF); /* Needed by AGC to configure the sx1250 */
             CHECK_ERR(err);
 
             /* Set the frequency offset (ratio of the frequency deviation)*/
             printf("CW: IF test mod freq %d\n", (int)(((float)pkt_data->freq_offset*1e3*64/(float)freq_dev)));
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_TEST_MOD_FREQ(pkt_data->rf_chain), (int)(((float)pkt_data->freq_offset*1e3*64/(float)freq_dev)));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_TEST_MOD_FREQ(pkt_data->rf_chain), (int)(((float)pkt_data->freq_offset*1e3*64/(float)freq_dev)));
             CHECK_ERR(err);
             break;
         case MOD_LORA:
             /* Set bandwidth */
             freq_dev = lgw_bw_getval(pkt_data->bandwidth) / 2;
             fdev_reg = SX1302_FREQ_TO_REG(freq_dev);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_DEV_H_FREQ_DEV(pkt_data->rf_chain), (fdev_reg >>  8) & 0xFF);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_DEV_H_FREQ_DEV(pkt_data->rf_chain), (fdev_reg >>  8) & 0xFF);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_DEV_L_FREQ_DEV(pkt_data->rf_chain), (fdev_reg >>  0) & 0xFF);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_DEV_L_FREQ_DEV(pkt_data->rf_chain), (fdev_reg >>  0) & 0xFF);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_0_MODEM_BW(pkt_data->rf_chain), pkt_data->bandwidth);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_0_MODEM_BW(pkt_data->rf_chain), pkt_data->bandwidth);
             CHECK_ERR(err);
 
             /* Preamble length */
@@ -2559,82 +2789,82 @@ int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut,
                 pkt_data->preamble = MIN_LORA_PREAMBLE;
                 DEBUG_MSG("Note: preamble length adjusted to respect minimum LoRa preamble size\n");
             }
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG1_3_PREAMBLE_SYMB_NB(pkt_data->rf_chain), (pkt_data->preamble >> 8) & 0xFF); /* MSB */
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG1_3_PREAMBLE_SYMB_NB(pkt_data->rf_chain), (pkt_data->preamble >> 8) & 0xFF); /* MSB */
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG1_2_PREAMBLE_SYMB_NB(pkt_data->rf_chain), (pkt_data->preamble >> 0) & 0xFF); /* LSB */
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG1_2_PREAMBLE_SYMB_NB(pkt_data->rf_chain), (pkt_data->preamble >> 0) & 0xFF); /* LSB */
             CHECK_ERR(err);
 
             /* LoRa datarate */
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_0_MODEM_SF(pkt_data->rf_chain), pkt_data->datarate);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_0_MODEM_SF(pkt_data->rf_chain), pkt_data->datarate);
             CHECK_ERR(err);
 
             /* Chirp filtering */
             chirp_lowpass = (pkt_data->datarate < 10) ? 6 : 7;
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_CFG0_0_CHIRP_LOWPASS(pkt_data->rf_chain), (int32_t)chirp_lowpass);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_CFG0_0_CHIRP_LOWPASS(pkt_data->rf_chain), (int32_t)chirp_lowpass);
             CHECK_ERR(err);
 
             /* Coding Rate */
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_1_CODING_RATE(pkt_data->rf_chain), pkt_data->coderate);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_1_CODING_RATE(pkt_data->rf_chain), pkt_data->coderate);
             CHECK_ERR(err);
 
             /* Start LoRa modem */
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_2_MODEM_EN(pkt_data->rf_chain), 1);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_2_MODEM_EN(pkt_data->rf_chain), 1);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_2_CADRXTX(pkt_data->rf_chain), 2);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_2_CADRXTX(pkt_data->rf_chain), 2);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG1_1_MODEM_START(pkt_data->rf_chain), 1);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG1_1_MODEM_START(pkt_data->rf_chain), 1);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_CFG0_0_CONTINUOUS(pkt_data->rf_chain), 0);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_CFG0_0_CONTINUOUS(pkt_data->rf_chain), 0);
             CHECK_ERR(err);
 
             /* Modulation options */
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_CFG0_0_CHIRP_INVERT(pkt_data->rf_chain), (pkt_data->invert_pol) ? 1 : 0);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_CFG0_0_CHIRP_INVERT(pkt_data->rf_chain), (pkt_data->invert_pol) ? 1 : 0);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_2_IMPLICIT_HEADER(pkt_data->rf_chain), (pkt_data->no_header) ? 1 : 0);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_2_IMPLICIT_HEADER(pkt_data->rf_chain), (pkt_data->no_header) ? 1 : 0);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_2_CRC_EN(pkt_data->rf_chain), (pkt_data->no_crc) ? 0 : 1);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_2_CRC_EN(pkt_data->rf_chain), (pkt_data->no_crc) ? 0 : 1);
             CHECK_ERR(err);
 
             /* Syncword */
             if ((lwan_public == false) || (pkt_data->datarate == DR_LORA_SF5) || (pkt_data->datarate == DR_LORA_SF6)) {
                 DEBUG_MSG("Setting LoRa syncword 0x12\n");
-                err = lgw_reg_w(SX1302_REG_TX_TOP_FRAME_SYNCH_0_PEAK1_POS(pkt_data->rf_chain), 2);
+                err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FRAME_SYNCH_0_PEAK1_POS(pkt_data->rf_chain), 2);
                 CHECK_ERR(err);
-                err = lgw_reg_w(SX1302_REG_TX_TOP_FRAME_SYNCH_1_PEAK2_POS(pkt_data->rf_chain), 4);
+                err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FRAME_SYNCH_1_PEAK2_POS(pkt_data->rf_chain), 4);
                 CHECK_ERR(err);
             } else {
                 DEBUG_MSG("Setting LoRa syncword 0x34\n");
-                err = lgw_reg_w(SX1302_REG_TX_TOP_FRAME_SYNCH_0_PEAK1_POS(pkt_data->rf_chain), 6);
+                err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FRAME_SYNCH_0_PEAK1_POS(pkt_data->rf_chain), 6);
                 CHECK_ERR(err);
-                err = lgw_reg_w(SX1302_REG_TX_TOP_FRAME_SYNCH_1_PEAK2_POS(pkt_data->rf_chain), 8);
+                err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FRAME_SYNCH_1_PEAK2_POS(pkt_data->rf_chain), 8);
                 CHECK_ERR(err);
             }
 
             /* Set Fine Sync for SF5/SF6 */
             if ((pkt_data->datarate == DR_LORA_SF5) || (pkt_data->datarate == DR_LORA_SF6)) {
                 DEBUG_MSG("Enable Fine Sync\n");
-                err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_2_FINE_SYNCH_EN(pkt_data->rf_chain), 1);
+                err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_2_FINE_SYNCH_EN(pkt_data->rf_chain), 1);
                 CHECK_ERR(err);
             } else {
                 DEBUG_MSG("Disable Fine Sync\n");
-                err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_2_FINE_SYNCH_EN(pkt_data->rf_chain), 0);
+                err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_2_FINE_SYNCH_EN(pkt_data->rf_chain), 0);
                 CHECK_ERR(err);
             }
 
             /* Set Payload length */
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_3_PAYLOAD_LENGTH(pkt_data->rf_chain), pkt_data->size);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_3_PAYLOAD_LENGTH(pkt_data->rf_chain), pkt_data->size);
             CHECK_ERR(err);
 
             /* Set PPM offset (low datarate optimization) */
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_1_PPM_OFFSET_HDR_CTRL(pkt_data->rf_chain), 0);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_1_PPM_OFFSET_HDR_CTRL(pkt_data->rf_chain), 0);
             CHECK_ERR(err);
             if (SET_PPM_ON(pkt_data->bandwidth, pkt_data->datarate)) {
                 DEBUG_MSG("Low datarate optimization ENABLED\n");
-                err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_1_PPM_OFFSET(pkt_data->rf_chain), 1);
+                err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_1_PPM_OFFSET(pkt_data->rf_chain), 1);
                 CHECK_ERR(err);
             } else {
                 DEBUG_MSG("Low datarate optimization DISABLED\n");
-                err = lgw_reg_w(SX1302_REG_TX_TOP_TXRX_CFG0_1_PPM_OFFSET(pkt_data->rf_chain), 0);
+                err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TXRX_CFG0_1_PPM_OFFSET(pkt_data->rf_chain), 0);
                 CHECK_ERR(err);
             }
             break;
@@ -2644,64 +2874,64 @@ int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut,
             /* Set frequency deviation */
             freq_dev = pkt_data->f_dev * 1e3;
             fdev_reg = SX1302_FREQ_TO_REG(freq_dev);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_DEV_H_FREQ_DEV(pkt_data->rf_chain), (fdev_reg >>  8) & 0xFF);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_DEV_H_FREQ_DEV(pkt_data->rf_chain), (fdev_reg >>  8) & 0xFF);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_DEV_L_FREQ_DEV(pkt_data->rf_chain), (fdev_reg >>  0) & 0xFF);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_RFFE_IF_FREQ_DEV_L_FREQ_DEV(pkt_data->rf_chain), (fdev_reg >>  0) & 0xFF);
             CHECK_ERR(err);
 
             /* Send frequency deviation to AGC fw for radio config */
             fdev_reg = SX1250_FREQ_TO_REG(freq_dev);
-            err = lgw_reg_w(SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE2_MCU_MAIL_BOX_WR_DATA, (fdev_reg >> 16) & 0xFF); /* Needed by AGC to configure the sx1250 */
+            err = tx_prep_reg(prep, SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE2_MCU_MAIL_BOX_WR_DATA, (fdev_reg >> 16) & 0xFF); /* Needed by AGC to configure the sx1250 */
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE1_MCU_MAIL_BOX_WR_DATA, (fdev_reg >>  8) & 0xFF); /* Needed by AGC to configure the sx1250 */
+            err = tx_prep_reg(prep, SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE1_MCU_MAIL_BOX_WR_DATA, (fdev_reg >>  8) & 0xFF); /* Needed by AGC to configure the sx1250 */
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE0_MCU_MAIL_BOX_WR_DATA, (fdev_reg >>  0) & 0xFF); /* Needed by AGC to configure the sx1250 */
+            err = tx_prep_reg(prep, SX1302_REG_AGC_MCU_MCU_MAIL_BOX_WR_DATA_BYTE0_MCU_MAIL_BOX_WR_DATA, (fdev_reg >>  0) & 0xFF); /* Needed by AGC to configure the sx1250 */
             CHECK_ERR(err);
 
             /* Modulation parameters */
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_CFG_0_PKT_MODE(pkt_data->rf_chain), 1); /* Variable length */
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_CFG_0_PKT_MODE(pkt_data->rf_chain), 1); /* Variable length */
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_CFG_0_CRC_EN(pkt_data->rf_chain), (pkt_data->no_crc) ? 0 : 1);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_CFG_0_CRC_EN(pkt_data->rf_chain), (pkt_data->no_crc) ? 0 : 1);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_CFG_0_CRC_IBM(pkt_data->rf_chain), 0); /* CCITT CRC */
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_CFG_0_CRC_IBM(pkt_data->rf_chain), 0); /* CCITT CRC */
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_CFG_0_DCFREE_ENC(pkt_data->rf_chain), 2); /* Whitening Encoding */
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_CFG_0_DCFREE_ENC(pkt_data->rf_chain), 2); /* Whitening Encoding */
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_MOD_FSK_GAUSSIAN_EN(pkt_data->rf_chain), 1);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_MOD_FSK_GAUSSIAN_EN(pkt_data->rf_chain), 1);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_MOD_FSK_GAUSSIAN_SELECT_BT(pkt_data->rf_chain), 2);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_MOD_FSK_GAUSSIAN_SELECT_BT(pkt_data->rf_chain), 2);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_MOD_FSK_REF_PATTERN_EN(pkt_data->rf_chain), 1);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_MOD_FSK_REF_PATTERN_EN(pkt_data->rf_chain), 1);
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_MOD_FSK_REF_PATTERN_SIZE(pkt_data->rf_chain), context_fsk->sync_word_size - 1);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_MOD_FSK_REF_PATTERN_SIZE(pkt_data->rf_chain), context_fsk->sync_word_size - 1);
             CHECK_ERR(err);
 
             /* Syncword */
             fsk_sync_word_reg = context_fsk->sync_word << (8 * (8 - context_fsk->sync_word_size));
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE0_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 0));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE0_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 0));
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE1_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 8));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE1_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 8));
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE2_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 16));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE2_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 16));
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE3_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 24));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE3_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 24));
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE4_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 32));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE4_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 32));
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE5_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 40));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE5_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 40));
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE6_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 48));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE6_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 48));
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE7_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 56));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_REF_PATTERN_BYTE7_FSK_REF_PATTERN(pkt_data->rf_chain), (uint8_t)(fsk_sync_word_reg >> 56));
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_MOD_FSK_PREAMBLE_SEQ(pkt_data->rf_chain), 0);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_MOD_FSK_PREAMBLE_SEQ(pkt_data->rf_chain), 0);
             CHECK_ERR(err);
 
             /* Set datarate */
             fsk_br_reg = 32000000 / pkt_data->datarate;
             buff[0] = (uint8_t)(fsk_br_reg >> 8);
             buff[1] = (uint8_t)(fsk_br_reg >> 0);
-            err = lgw_reg_wb(SX1302_REG_TX_TOP_FSK_BIT_RATE_MSB_BIT_RATE(pkt_data->rf_chain), buff, 2);
+            err = tx_prep_regb(prep, SX1302_REG_TX_TOP_FSK_BIT_RATE_MSB_BIT_RATE(pkt_data->rf_chain), buff, 2);
             CHECK_ERR(err);
 
             /* Preamble length */
@@ -2713,11 +2943,11 @@ int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut,
             }
             buff[0] = (uint8_t)(pkt_data->preamble >> 8);
             buff[1] = (uint8_t)(pkt_data->preamble >> 0);
-            err = lgw_reg_wb(SX1302_REG_TX_TOP_FSK_PREAMBLE_SIZE_MSB_PREAMBLE_SIZE(pkt_data->rf_chain), buff, 2);
+            err = tx_prep_regb(prep, SX1302_REG_TX_TOP_FSK_PREAMBLE_SIZE_MSB_PREAMBLE_SIZE(pkt_data->rf_chain), buff, 2);
             CHECK_ERR(err);
 
             /* Set Payload length */
-            err = lgw_reg_w(SX1302_REG_TX_TOP_FSK_PKT_LEN_PKT_LENGTH(pkt_data->rf_chain), pkt_data->size);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_FSK_PKT_LEN_PKT_LENGTH(pkt_data->rf_chain), pkt_data->size);
             CHECK_ERR(err);
             break;
         default:
@@ -2726,56 +2956,63 @@ int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut,
     }
 
     /* Set TX start delay */
-    err = sx1302_tx_set_start_delay(pkt_data->rf_chain, radio_type, pkt_data->modulation, pkt_data->bandwidth, chirp_lowpass, &tx_start_delay);
+    err = sx1302_tx_get_start_delay(radio_type, pkt_data->modulation, pkt_data->bandwidth, chirp_lowpass, &tx_start_delay);
     CHECK_ERR(err);
+    if (pkt_data->modulation == MOD_LORA) {
+        buff[0] = (uint8_t)(tx_start_delay >> 8);
+        buff[1] = (uint8_t)(tx_start_delay >> 0);
+        err = tx_prep_regb(prep, SX1302_REG_TX_TOP_TX_START_DELAY_MSB_TX_START_DELAY(pkt_data->rf_chain), buff, 2);
+        CHECK_ERR(err);
+    }
 
     /* Write payload in transmit buffer */
-    err = lgw_reg_w(SX1302_REG_TX_TOP_TX_CTRL_WRITE_BUFFER(pkt_data->rf_chain), 0x01);
+    err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_CTRL_WRITE_BUFFER(pkt_data->rf_chain), 0x01);
     CHECK_ERR(err);
     mem_addr = REG_SELECT(pkt_data->rf_chain, 0x5300, 0x5500);
     if (pkt_data->modulation == MOD_FSK) {
-        err = lgw_mem_wb(mem_addr, (uint8_t *)(&(pkt_data->size)), 1); /* insert payload size in the packet for FSK variable mode (1 byte) */
+        /* insert payload size in the packet for FSK variable mode (1 byte) */
+        err = tx_prep_burst(prep, TX_OP_MEM_BURST, mem_addr, (uint8_t *)(&(pkt_data->size)), 1);
         CHECK_ERR(err);
-        err = lgw_mem_wb(mem_addr+1, &(pkt_data->payload[0]), pkt_data->size);
+        err = tx_prep_burst(prep, TX_OP_MEM_BURST, mem_addr+1, &(pkt_data->payload[0]), pkt_data->size);
         CHECK_ERR(err);
     } else {
-        err = lgw_mem_wb(mem_addr, &(pkt_data->payload[0]), pkt_data->size);
+        err = tx_prep_burst(prep, TX_OP_MEM_BURST, mem_addr, &(pkt_data->payload[0]), pkt_data->size);
         CHECK_ERR(err);
     }
-    err = lgw_reg_w(SX1302_REG_TX_TOP_TX_CTRL_WRITE_BUFFER(pkt_data->rf_chain), 0x00);
+    err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_CTRL_WRITE_BUFFER(pkt_data->rf_chain), 0x00);
     CHECK_ERR(err);
 
     /* Trigger transmit */
     DEBUG_PRINTF("Start Tx: Freq:%u %s%u size:%u preamb:%u\n", pkt_data->freq_hz, (pkt_data->modulation == MOD_LORA) ? "SF" : "DR:", pkt_data->datarate, pkt_data->size, pkt_data->preamble);
     switch (pkt_data->tx_mode) {
         case IMMEDIATE:
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_IMMEDIATE(pkt_data->rf_chain), 0x00); /* reset state machine */
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_IMMEDIATE(pkt_data->rf_chain), 0x00); /* reset state machine */
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_IMMEDIATE(pkt_data->rf_chain), 0x01);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_IMMEDIATE(pkt_data->rf_chain), 0x01);
             CHECK_ERR(err);
             break;
         case TIMESTAMPED:
             count_us = pkt_data->count_us * 32 - tx_start_delay;
             DEBUG_PRINTF("--> programming trig delay at %u (%u)\n", pkt_data->count_us - (tx_start_delay / 32), count_us);
 
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TIMER_TRIG_BYTE0_TIMER_DELAYED_TRIG(pkt_data->rf_chain), (uint8_t)((count_us >>  0) & 0x000000FF));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TIMER_TRIG_BYTE0_TIMER_DELAYED_TRIG(pkt_data->rf_chain), (uint8_t)((count_us >>  0) & 0x000000FF));
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TIMER_TRIG_BYTE1_TIMER_DELAYED_TRIG(pkt_data->rf_chain), (uint8_t)((count_us >>  8) & 0x000000FF));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TIMER_TRIG_BYTE1_TIMER_DELAYED_TRIG(pkt_data->rf_chain), (uint8_t)((count_us >>  8) & 0x000000FF));
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TIMER_TRIG_BYTE2_TIMER_DELAYED_TRIG(pkt_data->rf_chain), (uint8_t)((count_us >> 16) & 0x000000FF));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TIMER_TRIG_BYTE2_TIMER_DELAYED_TRIG(pkt_data->rf_chain), (uint8_t)((count_us >> 16) & 0x000000FF));
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TIMER_TRIG_BYTE3_TIMER_DELAYED_TRIG(pkt_data->rf_chain), (uint8_t)((count_us >> 24) & 0x000000FF));
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TIMER_TRIG_BYTE3_TIMER_DELAYED_TRIG(pkt_data->rf_chain), (uint8_t)((count_us >> 24) & 0x000000FF));
             CHECK_ERR(err);
 
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_DELAYED(pkt_data->rf_chain), 0x00); /* reset state machine */
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_DELAYED(pkt_data->rf_chain), 0x00); /* reset state machine */
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_DELAYED(pkt_data->rf_chain), 0x01);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_DELAYED(pkt_data->rf_chain), 0x01);
             CHECK_ERR(err);
             break;
         case ON_GPS:
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_GPS(pkt_data->rf_chain), 0x00); /* reset state machine */
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_GPS(pkt_data->rf_chain), 0x00); /* reset state machine */
             CHECK_ERR(err);
-            err = lgw_reg_w(SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_GPS(pkt_data->rf_chain), 0x01);
+            err = tx_prep_reg(prep, SX1302_REG_TX_TOP_TX_TRIG_TX_TRIG_GPS(pkt_data->rf_chain), 0x01);
             CHECK_ERR(err);
             break;
         default:
@@ -2783,6 +3020,72 @@ int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut,
             return LGW_REG_ERROR;
     }
 
+    DEBUG_PRINTF("INFO: TX request prepared, %u register operations, %u data bytes\n", prep->nb_op, prep->data_size);
+
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int sx1302_send_commit(const struct lgw_tx_prep_s * prep) {
+    int err = LGW_COM_SUCCESS;
+    const struct lgw_tx_op_s * op;
+    uint8_t offs, leng;
+    int i;
+    /* performances variables */
+    uint64_t tm;
+
+    /* Record function start time */
+    _meas_time_start(&tm);
+
+    /* Check input parameters */
+    CHECK_NULL(prep);
+
+    /* Setting BULK write mode (to speed up configuration on USB) */
+    err = lgw_com_set_write_mode(LGW_COM_WRITE_MODE_BULK);
+    CHECK_ERR(err);
+
+    for (i = 0; i < prep->nb_op; i++) {
+        op = &(prep->op[i]);
+        switch (op->type) {
+            case TX_OP_WRITE:
+                err = lgw_com_w(LGW_SPI_MUX_TARGET_SX1302, op->addr, (uint8_t)op->value);
+                break;
+            case TX_OP_RMW:
+                /* one read-modify-write per contiguous group of bits */
+                for (offs = 0; (offs < 8) && (err == LGW_COM_SUCCESS); offs += leng) {
+                    leng = 1;
+                    if ((op->mask & (1 << offs)) == 0) {
+                        continue;
+                    }
+                    while (((offs + leng) < 8) && (op->mask & (1 << (offs + leng)))) {
+                        leng += 1;
+                    }
+                    err = lgw_com_rmw(LGW_SPI_MUX_TARGET_SX1302, op->addr, offs, leng, (uint8_t)((op->value >> offs) & ((1 << leng) - 1)));
+                }
+                break;
+            case TX_OP_REG_BURST:
+                err = lgw_com_wb(LGW_SPI_MUX_TARGET_SX1302, op->addr, &(prep->data[op->value]), op->size);
+                break;
+            case TX_OP_MEM_BURST:
+                err = lgw_mem_wb(op->addr, &(prep->data[op->value]), op->size);
+                break;
+            default:
+                printf("ERROR: invalid TX request operation %u\n", op->type);
+                err = LGW_COM_ERROR;
+                break;
+        }
+        if (err != LGW_COM_SUCCESS) {
+            break;
+        }
+    }
+    if (err != LGW_COM_SUCCESS) {
+        printf("ERROR: failed to write TX request (operation %d/%u)\n", i + 1, prep->nb_op);
+        /* drop the pending bulk requests, the TX is not triggered */
+        lgw_com_discard();
+        return LGW_REG_ERROR;
+    }
+
     /* Flush write (USB BULK mode) */
     err = lgw_com_flush();
     CHECK_ERR(err);
@@ -2792,13 +3095,29 @@ int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut,
     CHECK_ERR(err);
 
     /* Compute time spent in this function */
-    _meas_time_stop(2, tm, __FUNCTION__);
+    _meas_time_stop(LGW_PERF_SX1302_SEND, 2, tm);
 
     return LGW_REG_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int sx1302_send(lgw_radio_type_t radio_type, struct lgw_tx_gain_lut_s * tx_lut, bool lwan_public, struct lgw_conf_rxif_s * context_fsk, struct lgw_pkt_tx_s * pkt_data) {
+    struct lgw_tx_prep_s prep;
+    struct sx1302_tx_power_s tx_pow;
+    int err;
+
+    err = sx1302_tx_power_get(radio_type, tx_lut, pkt_data->rf_power, &tx_pow);
+    CHECK_ERR(err);
+
+    err = sx1302_send_prepare(radio_type, &tx_pow, lwan_public, context_fsk, pkt_data, &prep);
+    CHECK_ERR(err);
+
+    return sx1302_send_commit(&prep);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int sx1302_set_gpio(uint8_t gpio_reg_val) {
     int err;
 
@@ -2816,7 +3135,8 @@ double sx1302_dc_notch_delay(double if_freq_khz) {
     if ((if_freq_khz < -75.0) || (if_freq_khz > 75.0)) {
         delay = 0.0;
     } else {
-        delay = 1.7e-6 * pow(if_freq_khz, 4) + 2.4e-6 * pow(if_freq_khz, 3) - 0.0101 * pow(if_freq_khz, 2) - 0.01275 * if_freq_khz + 10.2922;
+        /* 1.7e-6 * f^4 + 2.4e-6 * f^3 - 0.0101 * f^2 - 0.01275 * f + 10.2922, Horner form */
+        delay = (((1.7e-6 * if_freq_khz + 2.4e-6) * if_freq_khz - 0.0101) * if_freq_khz - 0.01275) * if_freq_khz + 10.2922;
     }
 
     /* Number of 32MHz clock cycles */
@@ -31,6 +31,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_sx1302_timestamp.h"
 #include "loragw_reg.h"
 #include "loragw_aux.h"
+#include "loragw_handle.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -46,35 +47,34 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
     #define CHECK_NULL(a)                if(a==NULL){return LGW_REG_ERROR;}
 #endif
 
-/* -------------------------------------------------------------------------- */
-/* --- PRIVATE TYPES -------------------------------------------------------- */
-
-#define MAX_TIMESTAMP_PPS_HISTORY 16
-struct timestamp_pps_history_s {
-    uint32_t history[MAX_TIMESTAMP_PPS_HISTORY];
-    uint8_t idx; /* next slot to be written */
-    uint8_t size; /* current size */
-};
-
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
 #define PRECISION_TIMESTAMP_TS_METRICS_MAX  32 /* reduce number of metrics to better match GW v2 fine timestamp (max is 255) */
 #define PRECISION_TIMESTAMP_NB_SYMBOLS      0
 
+#define TS_BW_NB                            3       /* 125, 250 and 500KHz */
+#define TS_PAYLOAD_NB                       256
+#define TS_FITS_IN_HEADER                   0x80    /* flag in ts_legacy_last_block: payload fits entirely in the header */
+
+#define FTIME_FRAC_BITS                     9       /* fixed-point precision of the fine timestamp, in 32MHz clock cycles */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-/* history of the last PPS timestamps */
-static struct timestamp_pps_history_s timestamp_pps_history = {
-    .history = { 0 },
-    .idx = 0,
-    .size = 0
-};
+/* Timestamp correction tables, the input domain is small (BW x SF x CRC x payload length) */
+static uint64_t ts_legacy_base_delay[TS_BW_NB][8][2][2];    /* [bw][sf][dft peak enabled][payload fits in header], in 1e-6 us */
+static uint8_t ts_legacy_last_block[TS_BW_NB][8][2][TS_PAYLOAD_NB]; /* [bw][sf][crc][length], nb of nibbles in last block | TS_FITS_IN_HEADER */
+static int32_t ts_filtering_delay_x32[TS_BW_NB];            /* [bw], in 1/32 us */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
+/**
+@brief Fill the timestamp correction tables, called once at library load
+*/
+static void timestamp_correction_table_init(void) __attribute__((constructor));
+
 /**
 @brief TODO
 @param TODO
@@ -97,117 +97,112 @@ int32_t precision_timestamp_correction(uint8_t bandwidth, uint8_t datarate, uint
 */
 void timestamp_pps_history_save(uint32_t timestamp_pps_reg);
 
+/**
+@brief Sum of the cumulative sum of the fine timestamp metrics, without intermediate array
+@param ts_metrics   metrics given by the SX1302
+@param nb           number of metrics to be used
+@return sum(k=0..nb-1) sum(i=0..k) ts_metrics[i]
+*/
+static int32_t ts_metrics_reduce(const int8_t * ts_metrics, int nb);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
-int32_t legacy_timestamp_correction(uint8_t bandwidth, uint8_t sf, uint8_t cr, bool crc_en, uint8_t payload_length, sx1302_rx_dft_peak_mode_t dft_peak_mode) {
-    uint64_t clk_period, filtering_delay, demap_delay, fft_delay_state3, fft_delay, decode_delay, total_delay;
-    uint32_t nb_nibble, nb_nibble_in_hdr, nb_nibble_in_last_block;
-    uint8_t nb_iter, bw_pow, dft_peak_en = (dft_peak_mode == RX_DFT_PEAK_MODE_DISABLED) ? 0 : 1;
-    uint8_t ppm = SET_PPM_ON(bandwidth, sf) ? 1 : 0;
-    int32_t timestamp_correction;
-    bool payload_fits_in_header = false;
-    uint8_t cr_local = cr;
-
-    switch (bandwidth)
-    {
-        case BW_125KHZ:
-            bw_pow = 1;
-            break;
-        case BW_250KHZ:
-            bw_pow = 2;
-            break;
-        case BW_500KHZ:
-            bw_pow = 4;
-            break;
-        default:
-            printf("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT - %s\n", bandwidth, __FUNCTION__);
-            return 0;
-    }
-
-    /* Prepare variables for delay computing */
-    clk_period = 250E3 / bw_pow;
-
-    nb_nibble = (payload_length + 2 * crc_en) * 2 + 5;
+static int32_t ts_metrics_reduce(const int8_t * ts_metrics, int nb) {
+    int32_t sum = 0;
+    int32_t sum_weighted = 0;
+    int i;
 
-    if ((sf == 5) || (sf == 6)) {
-        nb_nibble_in_hdr = sf;
-    } else {
-        nb_nibble_in_hdr = sf - 2;
-    }
-
-    nb_nibble_in_last_block = nb_nibble - nb_nibble_in_hdr - (sf - 2 * ppm) * ((nb_nibble - nb_nibble_in_hdr) / (sf - 2 * ppm));
-    if (nb_nibble_in_last_block == 0) {
-        nb_nibble_in_last_block = sf - 2 * ppm;
+    /* metric i is counted (nb - i) times in the sum of the cumulative sum.
+        Simple multiply-accumulate loop, which the compiler vectorizes */
+    for (i = 0; i < nb; i++) {
+        sum += ts_metrics[i];
+        sum_weighted += i * ts_metrics[i];
     }
 
-    nb_iter = (sf + 1) / 2; /* intended to be truncated */
-
-    /* Update some variables if payload fits entirely in the header */
-    if (((int)(2 * (payload_length + 2 * crc_en) - (sf - 7)) <= 0) || ((payload_length == 0) && (crc_en == false))) {
-        /* Payload fits entirely in first 8 symbols (header):
-            - not possible for SF5/SF6, unless payload length is 0 and no CRC
-        */
-        payload_fits_in_header = true;
+    return (nb * sum) - sum_weighted;
+}
 
-        /* overwrite some variables accordingly */
-        dft_peak_en = 0;
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-        cr_local = 4; /* header coding rate is 4 */
+static void timestamp_correction_table_init(void) {
+    int bw, sf, crc, len, dft, fits;
+    uint64_t bw_pow, clk_period, filtering_delay, demap_delay, fft_delay_state3, fft_delay;
+    uint32_t nb_nibble, nb_nibble_in_hdr, nb_nibble_in_last_block;
+    uint8_t nb_iter, ppm;
+
+    for (bw = 0; bw < TS_BW_NB; bw++) {
+        bw_pow = 1 << bw; /* 125KHz divider */
+        clk_period = 250000 / bw_pow;
+        filtering_delay = 16000000 / bw_pow + 2031250; /* Filtering delay : I/Q 32Mhz -> 4Mhz */
+
+        /* Precision mode: filtering delay to be compensated, in 1/32 us (exact) */
+        ts_filtering_delay_x32[bw] = (int32_t)(((filtering_delay + 500000) * 32) / 1000000);
+
+        for (sf = 5; sf <= 12; sf++) {
+            ppm = SET_PPM_ON(BW_125KHZ + bw, sf) ? 1 : 0;
+            nb_iter = (sf + 1) / 2; /* intended to be truncated */
+            fft_delay_state3 = clk_period * (((1 << sf) - 6) + 2 * ((1 << sf) * (nb_iter - 1) + 6)) + 4 * clk_period;
+
+            /* Legacy mode: all delays but the last block decoding, for each DFT peak / payload in header combination */
+            for (fits = 0; fits < 2; fits++) {
+                if (fits == 1) {
+                    demap_delay = clk_period + (1 << sf) * clk_period * 3 / 4 + 3 * clk_period + (sf - 2) * clk_period;
+                } else {
+                    demap_delay = clk_period + (1 << sf) * clk_period + 3 * clk_period + (sf - 2 * ppm) * clk_period;
+                }
+                for (dft = 0; dft < 2; dft++) {
+                    if ((dft == 1) && (fits == 0)) {
+                        fft_delay = (5 - 2 * ppm) * ((1 << sf) * clk_period + 7 * clk_period) + 2 * clk_period;
+                    } else {
+                        fft_delay = (1 << sf) * 2 * clk_period + 3 * clk_period;
+                    }
+                    ts_legacy_base_delay[bw][sf - 5][dft][fits] = filtering_delay + fft_delay_state3 + fft_delay + demap_delay + 8 * clk_period + 500000;
+                }
+            }
 
-        if (sf > 6) {
-            nb_nibble_in_last_block = sf - 2;
-        } else {
-            nb_nibble_in_last_block = sf;
+            /* Legacy mode: number of nibbles in the last block, and payload in header flag */
+            for (crc = 0; crc < 2; crc++) {
+                for (len = 0; len < TS_PAYLOAD_NB; len++) {
+                    nb_nibble = (len + 2 * crc) * 2 + 5;
+                    nb_nibble_in_hdr = ((sf == 5) || (sf == 6)) ? sf : (sf - 2);
+                    nb_nibble_in_last_block = nb_nibble - nb_nibble_in_hdr - (sf - 2 * ppm) * ((nb_nibble - nb_nibble_in_hdr) / (sf - 2 * ppm));
+                    if (nb_nibble_in_last_block == 0) {
+                        nb_nibble_in_last_block = sf - 2 * ppm;
+                    }
+                    /* Payload fits entirely in first 8 symbols (header):
+                        - not possible for SF5/SF6, unless payload length is 0 and no CRC
+                    */
+                    if (((int)(2 * (len + 2 * crc) - (sf - 7)) <= 0) || ((len == 0) && (crc == 0))) {
+                        nb_nibble_in_last_block = (sf > 6) ? (sf - 2) : sf;
+                        nb_nibble_in_last_block |= TS_FITS_IN_HEADER;
+                    }
+                    ts_legacy_last_block[bw][sf - 5][crc][len] = (uint8_t)nb_nibble_in_last_block;
+                }
+            }
         }
     }
+}
 
-    /* Filtering delay : I/Q 32Mhz -> 4Mhz */
-    filtering_delay = 16000E3 / bw_pow + 2031250;
-
-    /* demap delay */
-    if (payload_fits_in_header == true) {
-        demap_delay = clk_period + (1 << sf) * clk_period * 3 / 4 + 3 * clk_period + (sf - 2) * clk_period;
-    } else {
-        demap_delay = clk_period + (1 << sf) * clk_period * (1 - ppm / 4) + 3 * clk_period + (sf - 2 * ppm) * clk_period;
-    }
-
-    /* FFT delays */
-    fft_delay_state3 = clk_period * (((1 << sf) - 6) + 2 * ((1 << sf) * (nb_iter - 1) + 6)) + 4 * clk_period;
-
-    if (dft_peak_en) {
-        fft_delay = (5 - 2 * ppm) * ((1 << sf) * clk_period + 7 * clk_period) + 2 * clk_period;
-    } else {
-        fft_delay = (1 << sf) * 2 * clk_period + 3 * clk_period;
-    }
-
-    /* Decode delay */
-    decode_delay = 5 * clk_period + (9 * clk_period + clk_period * cr_local) * nb_nibble_in_last_block + 3 * clk_period;
-
-    /* Cumulated delays */
-    total_delay = (filtering_delay + fft_delay_state3 + fft_delay + demap_delay + decode_delay + 500E3) / 1E6;
-
-    if (total_delay > INT32_MAX) {
-        printf("ERROR: overflow error for timestamp correction (SHOULD NOT HAPPEN)\n");
-        printf("=> filtering_delay %" PRIu64 "\n", filtering_delay);
-        printf("=> fft_delay_state3 %" PRIu64 "\n", fft_delay_state3);
-        printf("=> fft_delay %" PRIu64 "\n", fft_delay);
-        printf("=> demap_delay %" PRIu64 "\n", demap_delay);
-        printf("=> decode_delay %" PRIu64 "\n", decode_delay);
-        printf("=> total_delay %" PRIu64 "\n", total_delay);
-        assert(0);
-    }
-
-    timestamp_correction = -((int32_t)total_delay); /* compensate all decoding processing delays */
-
-    DEBUG_PRINTF("FTIME OFF : filtering_delay %llu \n", filtering_delay);
-    DEBUG_PRINTF("FTIME OFF : fft_delay_state3 %llu \n", fft_delay_state3);
-    DEBUG_PRINTF("FTIME OFF : fft_delay %llu \n", fft_delay);
-    DEBUG_PRINTF("FTIME OFF : demap_delay %llu \n", demap_delay);
-    DEBUG_PRINTF("FTIME OFF : decode_delay %llu \n", decode_delay);
-    DEBUG_PRINTF("FTIME OFF : timestamp correction %d \n", timestamp_correction);
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    return timestamp_correction;
+int32_t legacy_timestamp_correction(uint8_t bandwidth, uint8_t sf, uint8_t cr, bool crc_en, uint8_t payload_length, sx1302_rx_dft_peak_mode_t dft_peak_mode) {
+    uint8_t bw = bandwidth - BW_125KHZ;
+    uint8_t last_block = ts_legacy_last_block[bw][sf - 5][crc_en ? 1 : 0][payload_length];
+    uint8_t fits = (last_block & TS_FITS_IN_HEADER) ? 1 : 0;
+    uint8_t dft_peak_en = (dft_peak_mode == RX_DFT_PEAK_MODE_DISABLED) ? 0 : 1;
+    uint8_t cr_local = (fits == 1) ? 4 : cr; /* header coding rate is 4 */
+    uint64_t clk_period = 250000 >> bw;
+    uint64_t total_delay;
+
+    /* Cumulated delays, only the last block decoding delay depends on the coding rate */
+    total_delay = ts_legacy_base_delay[bw][sf - 5][dft_peak_en][fits];
+    total_delay += (9 * clk_period + clk_period * cr_local) * (last_block & ~TS_FITS_IN_HEADER);
+    total_delay /= 1000000;
+
+    DEBUG_PRINTF("FTIME OFF : timestamp correction %d \n", -((int32_t)total_delay));
+
+    return -((int32_t)total_delay); /* compensate all decoding processing delays */
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -216,26 +211,6 @@ int32_t precision_timestamp_correction(uint8_t bandwidth, uint8_t datarate, uint
     uint32_t nb_symbols_payload;
     uint16_t t_symbol_us;
     int32_t timestamp_correction;
-    uint8_t bw_pow;
-    uint32_t filtering_delay;
-
-    switch (bandwidth)
-    {
-        case BW_125KHZ:
-            bw_pow = 1;
-            break;
-        case BW_250KHZ:
-            bw_pow = 2;
-            break;
-        case BW_500KHZ:
-            bw_pow = 4;
-            break;
-        default:
-            printf("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT - %s\n", bandwidth, __FUNCTION__);
-            return 0;
-    }
-
-    filtering_delay = 16000000 / bw_pow + 2031250;
 
     /* NOTE: no need of the preamble size, only the payload duration is needed */
     /* WARNING: implicit header not supported */
@@ -244,9 +219,8 @@ int32_t precision_timestamp_correction(uint8_t bandwidth, uint8_t datarate, uint
         return 0;
     }
 
-    timestamp_correction = 0;
-    timestamp_correction += (nb_symbols_payload * t_symbol_us); /* shift from end of header to end of packet */
-    timestamp_correction -= (filtering_delay + 500E3) / 1E6; /* compensate the filtering delay */
+    /* shift from end of header to end of packet, and compensate the filtering delay (rounded toward 0) */
+    timestamp_correction = ((int32_t)(nb_symbols_payload * t_symbol_us) * 32 - ts_filtering_delay_x32[bandwidth - BW_125KHZ]) / 32;
 
     DEBUG_PRINTF("FTIME ON : timestamp correction %d \n", timestamp_correction);
 
@@ -257,27 +231,27 @@ int32_t precision_timestamp_correction(uint8_t bandwidth, uint8_t datarate, uint
 
 void timestamp_pps_history_save(uint32_t timestamp_pps_reg) {
     /* Store it only if different from the previous one */
-    if ((timestamp_pps_reg != timestamp_pps_history.history[timestamp_pps_history.idx] || (timestamp_pps_history.size == 0))) {
+    if ((timestamp_pps_reg != lgw_inst->pps_history.history[lgw_inst->pps_history.idx] || (lgw_inst->pps_history.size == 0))) {
         /* Select next index */
-        if (timestamp_pps_history.size > 0) {
-            timestamp_pps_history.idx += 1;
+        if (lgw_inst->pps_history.size > 0) {
+            lgw_inst->pps_history.idx += 1;
         }
-        if (timestamp_pps_history.idx == MAX_TIMESTAMP_PPS_HISTORY) {
-            timestamp_pps_history.idx = 0;
+        if (lgw_inst->pps_history.idx == MAX_TIMESTAMP_PPS_HISTORY) {
+            lgw_inst->pps_history.idx = 0;
         }
 
         /* Set PPS counter value */
-        timestamp_pps_history.history[timestamp_pps_history.idx] = timestamp_pps_reg;
+        lgw_inst->pps_history.history[lgw_inst->pps_history.idx] = timestamp_pps_reg;
 
         /* Add one entry to the history */
-        if (timestamp_pps_history.size < MAX_TIMESTAMP_PPS_HISTORY) {
-            timestamp_pps_history.size += 1;
+        if (lgw_inst->pps_history.size < MAX_TIMESTAMP_PPS_HISTORY) {
+            lgw_inst->pps_history.size += 1;
         }
 
 #if 0
-        printf("---- timestamp PPS history (idx:%u size:%u) ----\n",  timestamp_pps_history.idx,  timestamp_pps_history.size);
-        for (int i = 0; i < timestamp_pps_history.size; i++) {
-            printf("  %u\n", timestamp_pps_history.history[i]);
+        printf("---- timestamp PPS history (idx:%u size:%u) ----\n",  lgw_inst->pps_history.idx,  lgw_inst->pps_history.size);
+        for (int i = 0; i < lgw_inst->pps_history.size; i++) {
+            printf("  %u\n", lgw_inst->pps_history.history[i]);
         }
         printf("--------------------------------\n");
 #endif
@@ -359,6 +333,7 @@ int timestamp_counter_get(timestamp_counter_t * self, uint32_t * inst, uint32_t
 
     /* Store PPS counter to history, for fine timestamp calculation */
     timestamp_pps_history_save(counter_pps_us_raw_27bits_now);
+    self->pps_reg = counter_pps_us_raw_27bits_now;
 
     /* Scale to 1MHz */
     counter_pps_us_raw_27bits_now /= 32;
@@ -475,27 +450,29 @@ int32_t timestamp_counter_correction(lgw_context_t * context, uint8_t bandwidth,
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics, uint32_t timestamp_cnt, uint8_t sf, int32_t if_freq_hz, double pkt_freq_error, uint32_t * result_ftime) {
-    int i, x, timestamp_pps_idx, timestamp_pps_idx_next, timestamp_pps_idx_prev;
+int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics, uint32_t timestamp_cnt, uint32_t timestamp_pps_reg, uint8_t sf, int32_t if_freq_hz, double pkt_freq_error, uint32_t * result_ftime) {
+    int timestamp_pps_idx, timestamp_pps_idx_next, timestamp_pps_idx_prev;
+    int nb_metrics;
     int32_t ftime_sum;
-    int32_t ftime[256];
-    float ftime_mean;
+    int32_t dc_notch_delay;
+    int64_t pkt_ftime;
     uint32_t timestamp_cnt_end_of_preamble;
     uint32_t timestamp_pps = 0;
-    uint32_t timestamp_pps_reg = 0;
     uint32_t offset_preamble_hdr;
-    uint8_t buff[4];
     uint32_t diff_pps;
-    double pkt_ftime;
+    uint32_t pps_period;
     uint8_t ts_metrics_nb_clipped;
     double xtal_correct;
 
     /* Check input parameters */
     CHECK_NULL(ts_metrics);
     CHECK_NULL(result_ftime);
+    if (ts_metrics_nb == 0) {
+        return -1;
+    }
 
     /* Check if we can calculate a ftime */
-    if (timestamp_pps_history.size < MAX_TIMESTAMP_PPS_HISTORY) {
+    if (lgw_inst->pps_history.size < MAX_TIMESTAMP_PPS_HISTORY) {
         printf("INFO: Cannot compute ftime yet, PPS history is too short\n");
         return -1;
     }
@@ -531,33 +508,18 @@ int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics
 #if 0
     printf("%s\n", __FUNCTION__);
     printf("ts_metrics_nb_clipped*2: %u\n", ts_metrics_nb_clipped * 2);
-    for (i = 0; i < (2 * ts_metrics_nb_clipped); i++) {
+    for (int i = 0; i < (2 * ts_metrics_nb_clipped); i++) {
         printf("%d ", ts_metrics[i]);
     }
     printf("\n");
 #endif
 
-    /* Compute the ftime cumulative sum */
-    ftime[0] = (int32_t)ts_metrics[0];
-    ftime_sum = ftime[0];
-    for (i = 1; i < (2 * ts_metrics_nb_clipped); i++) {
-        ftime[i] = ftime[i-1] + ts_metrics[i];
-        ftime_sum += ftime[i];
-    }
-
-    /* Compute the mean of the cumulative sum */
-    ftime_mean = (float)ftime_sum / (float)(2 * ts_metrics_nb_clipped);
+    /* Compute the sum of the ftime cumulative sum, its mean is applied below in fixed-point */
+    nb_metrics = 2 * ts_metrics_nb_clipped;
+    ftime_sum = ts_metrics_reduce(ts_metrics, nb_metrics);
 
-    /* Find the last timestamp_pps before packet to use as reference for ftime */
-    x = lgw_reg_rb(SX1302_REG_TIMESTAMP_TIMESTAMP_PPS_MSB2_TIMESTAMP_PPS , &buff[0], 4);
-    if (x != LGW_REG_SUCCESS) {
-        printf("ERROR: Failed to get timestamp counter value\n");
-        return 0;
-    }
-    timestamp_pps_reg  = (uint32_t)((buff[0] << 24) & 0xFF000000);
-    timestamp_pps_reg |= (uint32_t)((buff[1] << 16) & 0x00FF0000);
-    timestamp_pps_reg |= (uint32_t)((buff[2] << 8)  & 0x0000FF00);
-    timestamp_pps_reg |= (uint32_t)((buff[3] << 0)  & 0x000000FF);
+    /* Find the last timestamp_pps before packet to use as reference for ftime,
+       starting from the PPS counter read once for all the packets of the fetch */
 
     /* Ensure that the timestamp PPS history is up-to-date */
     timestamp_pps_history_save(timestamp_pps_reg);
@@ -565,33 +527,33 @@ int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics
     /* Check if timestamp_pps_reg we just read is the reference to be used to compute ftime or not */
     if ((timestamp_cnt - timestamp_pps_reg) > 32e6) {
         /* The timestamp_pps_reg we just read is after the packet timestamp, we need to rewind */
-        for (timestamp_pps_idx = 0; timestamp_pps_idx < timestamp_pps_history.size; timestamp_pps_idx++) {
+        for (timestamp_pps_idx = 0; timestamp_pps_idx < lgw_inst->pps_history.size; timestamp_pps_idx++) {
             /* search the pps counter in history */
-            if ((timestamp_cnt - timestamp_pps_history.history[timestamp_pps_idx]) < 32e6) {
-                timestamp_pps = timestamp_pps_history.history[timestamp_pps_idx];
+            if ((timestamp_cnt - lgw_inst->pps_history.history[timestamp_pps_idx]) < 32e6) {
+                timestamp_pps = lgw_inst->pps_history.history[timestamp_pps_idx];
                 DEBUG_PRINTF("==> timestamp_pps found at history[%d] => %u\n", timestamp_pps_idx, timestamp_pps);
                 break;
             }
         }
-        if (timestamp_pps_idx == timestamp_pps_history.size) {
+        if (timestamp_pps_idx == lgw_inst->pps_history.size) {
             printf("ERROR: failed to find the reference timestamp_pps, cannot compute ftime\n");
             return -1;
         }
 
         /* Calculate the Xtal error between the reference PPS we just found and the next one */
         timestamp_pps_idx_next = (timestamp_pps_idx == (MAX_TIMESTAMP_PPS_HISTORY - 1)) ? 0 : timestamp_pps_idx + 1;
-        diff_pps = timestamp_pps_history.history[timestamp_pps_idx_next] - timestamp_pps_history.history[timestamp_pps_idx];
-        xtal_correct = (double)32e6 / (double)(diff_pps);
+        pps_period = lgw_inst->pps_history.history[timestamp_pps_idx_next] - lgw_inst->pps_history.history[timestamp_pps_idx];
+        xtal_correct = (double)32e6 / (double)(pps_period);
     } else {
         /* The timestamp_pps_reg we just read is the reference we use to calculate the fine timestamp */
         timestamp_pps = timestamp_pps_reg;
         DEBUG_PRINTF("==> timestamp_pps => %u\n", timestamp_pps);
 
         /* Calculate the Xtal error between the reference PPS we just found and the previous one */
-        timestamp_pps_idx = timestamp_pps_history.idx;
+        timestamp_pps_idx = lgw_inst->pps_history.idx;
         timestamp_pps_idx_prev = (timestamp_pps_idx == 0) ? (MAX_TIMESTAMP_PPS_HISTORY - 1) : (timestamp_pps_idx - 1);
-        diff_pps = timestamp_pps_history.history[timestamp_pps_idx] - timestamp_pps_history.history[timestamp_pps_idx_prev];
-        xtal_correct = (double)32e6 / (double)(diff_pps);
+        pps_period = lgw_inst->pps_history.history[timestamp_pps_idx] - lgw_inst->pps_history.history[timestamp_pps_idx_prev];
+        xtal_correct = (double)32e6 / (double)(pps_period);
     }
 
     /* Sanity Check on xtal_correct */
@@ -607,26 +569,27 @@ int precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics
     DEBUG_PRINTF("timestamp_pps : %u\n", timestamp_pps);
     DEBUG_PRINTF("diff_pps : %d\n", diff_pps);
 
-    /* Compute the fine timestamp */
-    pkt_ftime = (double)diff_pps + (double)ftime_mean;
-    DEBUG_PRINTF("pkt_ftime = %f\n", pkt_ftime);
-
-    /* Add the DC notch filtering delay if necessary */
-    pkt_ftime += sx1302_dc_notch_delay((double)if_freq_hz / 1E3);
-
-    /* Convert fine timestamp from 32 Mhz clock to nanoseconds */
-    pkt_ftime *= 31.25;
+    /* Compute the fine timestamp, in 32MHz clock cycles with FTIME_FRAC_BITS fractional bits:
+        coarse timestamp + mean of the metrics cumulative sum + DC notch filtering delay (if necessary) */
+    dc_notch_delay = (int32_t)(sx1302_dc_notch_delay((double)if_freq_hz / 1E3) * (1 << FTIME_FRAC_BITS) + 0.5);
+    pkt_ftime = ((int64_t)diff_pps << FTIME_FRAC_BITS) + (((int64_t)ftime_sum << FTIME_FRAC_BITS) / nb_metrics) + dc_notch_delay;
+    DEBUG_PRINTF("pkt_ftime = %f\n", (double)pkt_ftime / (1 << FTIME_FRAC_BITS));
 
-    /* Apply current XTAL error correction */
-    pkt_ftime *= xtal_correct;
+    /* Convert fine timestamp from 32 Mhz clock to nanoseconds, with current XTAL error correction:
+        ns = cycles * 31.25 * (32e6 / pps_period) = cycles * 1e9 / pps_period */
+    if (pkt_ftime < 0) {
+        printf("ERROR: fine timestamp is out of range (%" PRId64 ")\n", pkt_ftime);
+        return -1;
+    }
+    pkt_ftime = (pkt_ftime * (1000000000 >> FTIME_FRAC_BITS)) / pps_period; /* 1e9 is a multiple of 2^9: no overflow on 64 bits */
 
-    *result_ftime = (uint32_t)pkt_ftime;
-    if (*result_ftime > 1E9) {
-        printf("ERROR: fine timestamp is out of range (%u)\n", *result_ftime);
+    if (pkt_ftime > 1000000000) {
+        printf("ERROR: fine timestamp is out of range (%" PRId64 ")\n", pkt_ftime);
         return -1;
     }
+    *result_ftime = (uint32_t)pkt_ftime;
 
-    DEBUG_PRINTF("==> ftime = %u ns since last PPS (%.15lf)\n", *result_ftime, pkt_ftime);
+    DEBUG_PRINTF("==> ftime = %u ns since last PPS (xtal correction %.15lf)\n", *result_ftime, xtal_correct);
 
     return 0;
 }
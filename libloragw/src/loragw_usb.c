@@ -32,6 +32,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_usb.h"
 #include "loragw_mcu.h"
 #include "loragw_aux.h"
+#include "loragw_handle.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -56,8 +57,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES  --------------------------------------------------- */
 
-static lgw_com_write_mode_t _lgw_write_mode = LGW_COM_WRITE_MODE_SINGLE;
-static uint8_t _lgw_spi_req_nb = 0;
+/* Write mode and SPI request counter are held by the current instance handle */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
@@ -300,16 +300,16 @@ int lgw_usb_rmw(void *com_target, uint16_t address, uint8_t offs, uint8_t leng,
     DEBUG_PRINTF("==> RMW register @ 0x%04X, offs:%u leng:%u value:0x%02X\n", address, offs, leng, data);
 
     /* prepare frame to be sent */
-    in_out_buf[0] = _lgw_spi_req_nb; /* Req ID */
+    in_out_buf[0] = lgw_inst->usb_spi_req_nb; /* Req ID */
     in_out_buf[1] = MCU_SPI_REQ_TYPE_READ_MODIFY_WRITE; /* Req type */
     in_out_buf[2] = (uint8_t)(address >> 8); /* Register address MSB */
     in_out_buf[3] = (uint8_t)(address >> 0); /* Register address LSB */
     in_out_buf[4] = ((1 << leng) - 1) << offs; /* Register bitmask */
     in_out_buf[5] = data << offs;
 
-    if (_lgw_write_mode == LGW_COM_WRITE_MODE_BULK) {
+    if (lgw_inst->usb_write_mode == LGW_COM_WRITE_MODE_BULK) {
         a = mcu_spi_store(in_out_buf, command_size);
-        _lgw_spi_req_nb += 1;
+        lgw_inst->usb_spi_req_nb += 1;
     } else {
         a = mcu_spi_write(usb_device, in_out_buf, command_size);
     }
@@ -342,7 +342,7 @@ int lgw_usb_wb(void *com_target, uint8_t spi_mux_target, uint16_t address, const
 
     /* prepare command */
     /* Request metadata */
-    in_out_buf[0] = _lgw_spi_req_nb; /* Req ID */
+    in_out_buf[0] = lgw_inst->usb_spi_req_nb; /* Req ID */
     in_out_buf[1] = MCU_SPI_REQ_TYPE_READ_WRITE; /* Req type */
     in_out_buf[2] = MCU_SPI_TARGET_SX1302; /* MCU -> SX1302 */
     in_out_buf[3] = (uint8_t)((size + 3) >> 8); /* payload size + spi_mux_target + address */
@@ -355,9 +355,9 @@ int lgw_usb_wb(void *com_target, uint8_t spi_mux_target, uint16_t address, const
         in_out_buf[i + 8] = data[i];
     }
 
-    if (_lgw_write_mode == LGW_COM_WRITE_MODE_BULK) {
+    if (lgw_inst->usb_write_mode == LGW_COM_WRITE_MODE_BULK) {
         a = mcu_spi_store(in_out_buf, command_size);
-        _lgw_spi_req_nb += 1;
+        lgw_inst->usb_spi_req_nb += 1;
     } else {
         a = mcu_spi_write(usb_device, in_out_buf, command_size);
     }
@@ -404,7 +404,7 @@ int lgw_usb_rb(void *com_target, uint8_t spi_mux_target, uint16_t address, uint8
         in_out_buf[i + 9] = data[i];
     }
 
-    if (_lgw_write_mode == LGW_COM_WRITE_MODE_BULK) {
+    if (lgw_inst->usb_write_mode == LGW_COM_WRITE_MODE_BULK) {
         /* makes no sense to read in bulk mode, as we can't get the result */
         printf("ERROR: USB READ BURST FAILURE - bulk mode is enabled\n");
         return -1;
@@ -433,7 +433,7 @@ int lgw_usb_set_write_mode(lgw_com_write_mode_t write_mode) {
 
     DEBUG_PRINTF("INFO: setting USB write mode to %s\n", (write_mode == LGW_COM_WRITE_MODE_SINGLE) ? "SINGLE" : "BULK");
 
-    _lgw_write_mode = write_mode;
+    lgw_inst->usb_write_mode = write_mode;
 
     return 0;
 }
@@ -446,15 +446,15 @@ int lgw_usb_flush(void *com_target) {
 
     /* Check input parameters */
     CHECK_NULL(com_target);
-    if (_lgw_write_mode != LGW_COM_WRITE_MODE_BULK) {
+    if (lgw_inst->usb_write_mode != LGW_COM_WRITE_MODE_BULK) {
         printf("ERROR: %s: cannot flush in single write mode\n", __FUNCTION__);
         return -1;
     }
 
     /* Restore single mode after flushing */
-    _lgw_write_mode = LGW_COM_WRITE_MODE_SINGLE;
+    lgw_inst->usb_write_mode = LGW_COM_WRITE_MODE_SINGLE;
 
-    if (_lgw_spi_req_nb == 0) {
+    if (lgw_inst->usb_spi_req_nb == 0) {
         printf("INFO: no SPI request to flush\n");
         return 0;
     }
@@ -468,13 +468,26 @@ int lgw_usb_flush(void *com_target) {
     }
 
     /* reset the pending request number */
-    _lgw_spi_req_nb = 0;
+    lgw_inst->usb_spi_req_nb = 0;
 
     return a;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+void lgw_usb_discard(void) {
+    if (lgw_inst->usb_spi_req_nb > 0) {
+        printf("WARNING: dropping %u pending USB SPI requests\n", lgw_inst->usb_spi_req_nb);
+    }
+    mcu_spi_discard();
+
+    /* reset the pending request number and restore single mode */
+    lgw_inst->usb_spi_req_nb = 0;
+    lgw_inst->usb_write_mode = LGW_COM_WRITE_MODE_SINGLE;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 uint16_t lgw_usb_chunk_size(void) {
     return (uint16_t)LGW_USB_BURST_CHUNK;
 }
@@ -64,6 +64,9 @@ int sx125x_com_r(lgw_com_type_t com_type, void *com_target, uint8_t spi_mux_targ
         case LGW_COM_USB:
             printf("ERROR: USB COM type is not supported for sx125x\n");
             return -1;
+        case LGW_COM_MOCK:
+            printf("ERROR: sx125x radios are not emulated by the software device\n");
+            return -1;
         default:
             printf("ERROR: wrong communication type (SHOULD NOT HAPPEN)\n");
             return -1;
@@ -87,6 +90,9 @@ int sx125x_com_w(lgw_com_type_t com_type, void *com_target, uint8_t spi_mux_targ
         case LGW_COM_USB:
             printf("ERROR: USB COM type is not supported for sx125x\n");
             return -1;
+        case LGW_COM_MOCK:
+            printf("ERROR: sx125x radios are not emulated by the software device\n");
+            return -1;
         default:
             printf("ERROR: wrong communication type (SHOULD NOT HAPPEN)\n");
             return -1;
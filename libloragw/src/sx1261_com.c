@@ -24,6 +24,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "sx1261_com.h"
 #include "sx1261_spi.h"
 #include "sx1261_usb.h"
+#include "loragw_mock.h"
+#include "loragw_handle.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -45,15 +47,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-/**
-@brief The current communication type in use (SPI, USB)
-*/
-static lgw_com_type_t _sx1261_com_type = LGW_COM_UNKNOWN;
-
-/**
-@brief A generic pointer to the COM device (file descriptor)
-*/
-static void* _sx1261_com_target = NULL;
+/* The communication type and target in use are held by the current instance
+   handle (lgw_inst->sx1261_com_type, lgw_inst->sx1261_com_target) */
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
@@ -64,12 +59,12 @@ static void* _sx1261_com_target = NULL;
 int sx1261_com_open(lgw_com_type_t com_type, const char *com_path) {
     int spi_stat = LGW_COM_SUCCESS;
 
-    _sx1261_com_type = com_type;
+    lgw_inst->sx1261_com_type = com_type;
 
     switch(com_type) {
         case LGW_COM_SPI:
             /* open the SPI link */
-            spi_stat = lgw_spi_open(com_path, &_sx1261_com_target);
+            spi_stat = lgw_spi_open(com_path, &lgw_inst->sx1261_com_target);
             if (spi_stat != LGW_SPI_SUCCESS) {
                 printf("ERROR: %s: Failed to connect to sx1261 radio on %s\n", __FUNCTION__, com_path);
                 return LGW_COM_ERROR;
@@ -78,9 +73,14 @@ int sx1261_com_open(lgw_com_type_t com_type, const char *com_path) {
             break;
         case LGW_COM_USB:
             /* the USB link has already been opened (lgw_connect) */
-            _sx1261_com_target = lgw_com_target();
+            lgw_inst->sx1261_com_target = lgw_com_target();
             DEBUG_MSG("SX1261: connected with USB\n");
             break;
+        case LGW_COM_MOCK:
+            /* the SX1261 is emulated by the software device (lgw_connect) */
+            lgw_inst->sx1261_com_target = lgw_com_target();
+            DEBUG_MSG("SX1261: connected to the software device\n");
+            break;
         default:
             printf("ERROR: %s: wrong COM type\n", __FUNCTION__);
             return LGW_COM_ERROR;
@@ -94,24 +94,25 @@ int sx1261_com_open(lgw_com_type_t com_type, const char *com_path) {
 int sx1261_com_close(void) {
     int spi_stat = LGW_COM_SUCCESS;
 
-    switch(_sx1261_com_type) {
+    switch(lgw_inst->sx1261_com_type) {
         case LGW_COM_SPI:
             /* Close the SPI link */
-            spi_stat = lgw_spi_close(_sx1261_com_target);
+            spi_stat = lgw_spi_close(lgw_inst->sx1261_com_target);
             if (spi_stat != LGW_SPI_SUCCESS) {
                 printf("ERROR: %s: Failed to disconnect SX1261 radio\n", __FUNCTION__);
                 return LGW_COM_ERROR;
             }
             break;
         case LGW_COM_USB:
+        case LGW_COM_MOCK:
             break;
         default:
             printf("ERROR: %s: sx1261 not connected\n", __FUNCTION__);
             return LGW_COM_ERROR;
     }
 
-    _sx1261_com_type = LGW_COM_UNKNOWN;
-    _sx1261_com_target = NULL;
+    lgw_inst->sx1261_com_type = LGW_COM_UNKNOWN;
+    lgw_inst->sx1261_com_target = NULL;
 
     return LGW_COM_SUCCESS;
 }
@@ -122,15 +123,18 @@ int sx1261_com_w(sx1261_op_code_t op_code, uint8_t *data, uint16_t size) {
     int com_stat;
 
     /* Check input parameters */
-    CHECK_NULL(_sx1261_com_target);
+    CHECK_NULL(lgw_inst->sx1261_com_target);
     CHECK_NULL(data);
 
-    switch (_sx1261_com_type) {
+    switch (lgw_inst->sx1261_com_type) {
         case LGW_COM_SPI:
-            com_stat = sx1261_spi_w(_sx1261_com_target, op_code, data, size);
+            com_stat = sx1261_spi_w(lgw_inst->sx1261_com_target, op_code, data, size);
             break;
         case LGW_COM_USB:
-            com_stat = sx1261_usb_w(_sx1261_com_target, op_code, data, size);
+            com_stat = sx1261_usb_w(lgw_inst->sx1261_com_target, op_code, data, size);
+            break;
+        case LGW_COM_MOCK:
+            com_stat = sx1261_mock_w(lgw_inst->sx1261_com_target, op_code, data, size);
             break;
         default:
             printf("ERROR: wrong communication type (SHOULD NOT HAPPEN)\n");
@@ -138,6 +142,8 @@ int sx1261_com_w(sx1261_op_code_t op_code, uint8_t *data, uint16_t size) {
             break;
     }
 
+    lgw_com_stat_account(1, size, 0, com_stat);
+
     return com_stat;
 }
 
@@ -147,15 +153,18 @@ int sx1261_com_r(sx1261_op_code_t op_code, uint8_t *data, uint16_t size) {
     int com_stat;
 
     /* Check input parameters */
-    CHECK_NULL(_sx1261_com_target);
+    CHECK_NULL(lgw_inst->sx1261_com_target);
     CHECK_NULL(data);
 
-    switch (_sx1261_com_type) {
+    switch (lgw_inst->sx1261_com_type) {
         case LGW_COM_SPI:
-            com_stat = sx1261_spi_r(_sx1261_com_target, op_code, data, size);
+            com_stat = sx1261_spi_r(lgw_inst->sx1261_com_target, op_code, data, size);
             break;
         case LGW_COM_USB:
-            com_stat = sx1261_usb_r(_sx1261_com_target, op_code, data, size);
+            com_stat = sx1261_usb_r(lgw_inst->sx1261_com_target, op_code, data, size);
+            break;
+        case LGW_COM_MOCK:
+            com_stat = sx1261_mock_r(lgw_inst->sx1261_com_target, op_code, data, size);
             break;
         default:
             printf("ERROR: wrong communication type (SHOULD NOT HAPPEN)\n");
@@ -163,6 +172,8 @@ int sx1261_com_r(sx1261_op_code_t op_code, uint8_t *data, uint16_t size) {
             break;
     }
 
+    lgw_com_stat_account(1, 0, size, com_stat);
+
     return com_stat;
 }
 
@@ -171,8 +182,9 @@ int sx1261_com_r(sx1261_op_code_t op_code, uint8_t *data, uint16_t size) {
 int sx1261_com_set_write_mode(lgw_com_write_mode_t write_mode) {
     int com_stat = LGW_COM_SUCCESS;
 
-    switch (_sx1261_com_type) {
+    switch (lgw_inst->sx1261_com_type) {
         case LGW_COM_SPI:
+        case LGW_COM_MOCK:
             /* Do nothing: only single mode is supported on SPI */
             break;
         case LGW_COM_USB:
@@ -192,12 +204,13 @@ int sx1261_com_set_write_mode(lgw_com_write_mode_t write_mode) {
 int sx1261_com_flush(void) {
     int com_stat = LGW_COM_SUCCESS;
 
-    switch (_sx1261_com_type) {
+    switch (lgw_inst->sx1261_com_type) {
         case LGW_COM_SPI:
+        case LGW_COM_MOCK:
             /* Do nothing: only single mode is supported on SPI */
             break;
         case LGW_COM_USB:
-            com_stat = sx1261_usb_flush(_sx1261_com_target);
+            com_stat = sx1261_usb_flush(lgw_inst->sx1261_com_target);
             break;
         default:
             printf("ERROR(%s:%d): wrong communication type (SHOULD NOT HAPPEN)\n", __FUNCTION__, __LINE__);
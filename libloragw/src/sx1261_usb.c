@@ -23,6 +23,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include "loragw_aux.h"
 #include "loragw_mcu.h"
 #include "sx1261_usb.h"
+#include "loragw_handle.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -44,8 +45,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-static lgw_com_write_mode_t _sx1261_write_mode = LGW_COM_WRITE_MODE_SINGLE;
-static uint8_t _sx1261_spi_req_nb = 0;
+/* Write mode and SPI request counter are held by the current instance handle */
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
@@ -65,7 +65,7 @@ int sx1261_usb_w(void *com_target, sx1261_op_code_t op_code, uint8_t *data, uint
 
     /* prepare command */
     /* Request metadata */
-    in_out_buf[0] = _sx1261_spi_req_nb; /* Req ID */
+    in_out_buf[0] = lgw_inst->sx1261_spi_req_nb; /* Req ID */
     in_out_buf[1] = MCU_SPI_REQ_TYPE_READ_WRITE; /* Req type */
     in_out_buf[2] = MCU_SPI_TARGET_SX1261; /* MCU -> SX1302 */
     in_out_buf[3] = (uint8_t)((size + 1) >> 8); /* payload size + op_code */
@@ -76,9 +76,9 @@ int sx1261_usb_w(void *com_target, sx1261_op_code_t op_code, uint8_t *data, uint
         in_out_buf[i + 6] = data[i];
     }
 
-    if (_sx1261_write_mode == LGW_COM_WRITE_MODE_BULK) {
+    if (lgw_inst->sx1261_write_mode == LGW_COM_WRITE_MODE_BULK) {
         a = mcu_spi_store(in_out_buf, command_size);
-        _sx1261_spi_req_nb += 1;
+        lgw_inst->sx1261_spi_req_nb += 1;
     } else {
         a = mcu_spi_write(usb_device, in_out_buf, command_size);
     }
@@ -110,7 +110,7 @@ int sx1261_usb_r(void *com_target, sx1261_op_code_t op_code, uint8_t *data, uint
 
     /* prepare command */
     /* Request metadata */
-    in_out_buf[0] = _sx1261_spi_req_nb; /* Req ID */
+    in_out_buf[0] = lgw_inst->sx1261_spi_req_nb; /* Req ID */
     in_out_buf[1] = MCU_SPI_REQ_TYPE_READ_WRITE; /* Req type */
     in_out_buf[2] = MCU_SPI_TARGET_SX1261; /* MCU -> SX1302 */
     in_out_buf[3] = (uint8_t)((size + 1) >> 8); /* payload size + op_code */
@@ -120,7 +120,7 @@ int sx1261_usb_r(void *com_target, sx1261_op_code_t op_code, uint8_t *data, uint
     for (i = 0; i < size; i++) {
         in_out_buf[i + 6] = data[i];
     }
-    if (_sx1261_write_mode == LGW_COM_WRITE_MODE_BULK) {
+    if (lgw_inst->sx1261_write_mode == LGW_COM_WRITE_MODE_BULK) {
         /* makes no sense to read in bulk mode, as we can't get the result */
         printf("ERROR: USB READ BURST FAILURE - bulk mode is enabled\n");
         return -1;
@@ -149,7 +149,7 @@ int sx1261_usb_set_write_mode(lgw_com_write_mode_t write_mode) {
 
     DEBUG_PRINTF("INFO: setting SX1261 USB write mode to %s\n", (write_mode == LGW_COM_WRITE_MODE_SINGLE) ? "SINGLE" : "BULK");
 
-    _sx1261_write_mode = write_mode;
+    lgw_inst->sx1261_write_mode = write_mode;
 
     return 0;
 }
@@ -162,15 +162,15 @@ int sx1261_usb_flush(void *com_target) {
 
     /* Check input parameters */
     CHECK_NULL(com_target);
-    if (_sx1261_write_mode != LGW_COM_WRITE_MODE_BULK) {
+    if (lgw_inst->sx1261_write_mode != LGW_COM_WRITE_MODE_BULK) {
         printf("ERROR: %s: cannot flush in single write mode\n", __FUNCTION__);
         return -1;
     }
 
     /* Restore single mode after flushing */
-    _sx1261_write_mode = LGW_COM_WRITE_MODE_SINGLE;
+    lgw_inst->sx1261_write_mode = LGW_COM_WRITE_MODE_SINGLE;
 
-    if (_sx1261_spi_req_nb == 0) {
+    if (lgw_inst->sx1261_spi_req_nb == 0) {
         printf("INFO: no SX1261 SPI request to flush\n");
         return 0;
     }
@@ -184,7 +184,7 @@ int sx1261_usb_flush(void *com_target) {
     }
 
     /* reset the pending request number */
-    _sx1261_spi_req_nb = 0;
+    lgw_inst->sx1261_spi_req_nb = 0;
 
     return a;
 }
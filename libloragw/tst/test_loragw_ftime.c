@@ -0,0 +1,298 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Check and benchmark the fine timestamp computation (fixed-point reduction
+    of the timestamp metrics) against the previous floating point
+    implementation, on random packets and PPS histories.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* EXIT_FAILURE, rand */
+#include <string.h>     /* memset */
+#include <math.h>       /* pow */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getopt */
+
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+#include "loragw_sx1302.h"
+#include "loragw_sx1302_timestamp.h"
+#include "loragw_handle.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_NB_PKT      100000
+#define TS_METRICS_NB_MAX   64      /* number of pairs of metrics given by the SX1302 */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct ftime_input_s {
+    uint8_t ts_metrics_nb;
+    int8_t ts_metrics[2 * TS_METRICS_NB_MAX];
+    uint32_t timestamp_cnt;
+    uint8_t sf;
+    int32_t if_freq_hz;
+    double pkt_freq_error;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+static void usage(void) {
+    printf("Library version information: %s\n", lgw_version_info());
+    printf("Available options:\n");
+    printf(" -h         print this help\n");
+    printf(" -n <uint>  number of random packets to be checked (default %d)\n", DEFAULT_NB_PKT);
+    printf(" -s <uint>  seed of the random packets generator\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double elapsed_us(struct timespec start, struct timespec stop) {
+    return ((double)(stop.tv_sec - start.tv_sec) * 1E6) + ((double)(stop.tv_nsec - start.tv_nsec) / 1E3);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Previous implementation, used as reference (the PPS history is already up-to-date) */
+
+static double legacy_dc_notch_delay(double if_freq_khz) {
+    if ((if_freq_khz < -75.0) || (if_freq_khz > 75.0)) {
+        return 0.0;
+    }
+    return 1.7e-6 * pow(if_freq_khz, 4) + 2.4e-6 * pow(if_freq_khz, 3) - 0.0101 * pow(if_freq_khz, 2) - 0.01275 * if_freq_khz + 10.2922;
+}
+
+static int legacy_precise_timestamp_calculate(uint8_t ts_metrics_nb, const int8_t * ts_metrics, uint32_t timestamp_cnt, uint32_t timestamp_pps_reg, uint8_t sf, int32_t if_freq_hz, double pkt_freq_error, uint32_t * result_ftime) {
+    int i, timestamp_pps_idx, timestamp_pps_idx_next, timestamp_pps_idx_prev;
+    int32_t ftime_sum;
+    int32_t ftime[256];
+    float ftime_mean;
+    uint32_t timestamp_pps = 0;
+    uint32_t offset_preamble_hdr;
+    uint32_t diff_pps;
+    double pkt_ftime;
+    uint8_t ts_metrics_nb_clipped;
+    double xtal_correct;
+
+    if (lgw_inst->pps_history.size < MAX_TIMESTAMP_PPS_HISTORY) {
+        return -1;
+    }
+
+    offset_preamble_hdr =   256 * (1 << sf) * (8 + 4 + (((sf == 5) || (sf == 6)) ? 2 : 0)) +
+                            256 * ((1 << sf) / 4 - 1);
+    offset_preamble_hdr += ((double)offset_preamble_hdr * pkt_freq_error + 0.5);
+    timestamp_cnt = timestamp_cnt - offset_preamble_hdr + 2138;
+
+    switch (sf) {
+        case 12: ts_metrics_nb_clipped = MIN(4, ts_metrics_nb); break;
+        case 11: ts_metrics_nb_clipped = MIN(8, ts_metrics_nb); break;
+        case 10: ts_metrics_nb_clipped = MIN(16, ts_metrics_nb); break;
+        default: ts_metrics_nb_clipped = MIN(32, ts_metrics_nb); break;
+    }
+
+    ftime[0] = (int32_t)ts_metrics[0];
+    ftime_sum = ftime[0];
+    for (i = 1; i < (2 * ts_metrics_nb_clipped); i++) {
+        ftime[i] = ftime[i-1] + ts_metrics[i];
+        ftime_sum += ftime[i];
+    }
+    ftime_mean = (float)ftime_sum / (float)(2 * ts_metrics_nb_clipped);
+
+    if ((timestamp_cnt - timestamp_pps_reg) > 32e6) {
+        for (timestamp_pps_idx = 0; timestamp_pps_idx < lgw_inst->pps_history.size; timestamp_pps_idx++) {
+            if ((timestamp_cnt - lgw_inst->pps_history.history[timestamp_pps_idx]) < 32e6) {
+                timestamp_pps = lgw_inst->pps_history.history[timestamp_pps_idx];
+                break;
+            }
+        }
+        if (timestamp_pps_idx == lgw_inst->pps_history.size) {
+            return -1;
+        }
+        timestamp_pps_idx_next = (timestamp_pps_idx == (MAX_TIMESTAMP_PPS_HISTORY - 1)) ? 0 : timestamp_pps_idx + 1;
+        diff_pps = lgw_inst->pps_history.history[timestamp_pps_idx_next] - lgw_inst->pps_history.history[timestamp_pps_idx];
+        xtal_correct = (double)32e6 / (double)(diff_pps);
+    } else {
+        timestamp_pps = timestamp_pps_reg;
+        timestamp_pps_idx = lgw_inst->pps_history.idx;
+        timestamp_pps_idx_prev = (timestamp_pps_idx == 0) ? (MAX_TIMESTAMP_PPS_HISTORY - 1) : (timestamp_pps_idx - 1);
+        diff_pps = lgw_inst->pps_history.history[timestamp_pps_idx] - lgw_inst->pps_history.history[timestamp_pps_idx_prev];
+        xtal_correct = (double)32e6 / (double)(diff_pps);
+    }
+
+    if ((xtal_correct > 1.2) || (xtal_correct < 0.8)) {
+        return -1;
+    }
+
+    diff_pps = timestamp_cnt - timestamp_pps;
+    pkt_ftime = (double)diff_pps + (double)ftime_mean;
+    pkt_ftime += legacy_dc_notch_delay((double)if_freq_hz / 1E3);
+    pkt_ftime *= 31.25;
+    pkt_ftime *= xtal_correct;
+
+    *result_ftime = (uint32_t)pkt_ftime;
+    if (*result_ftime > 1E9) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Fill the PPS history with 16 PPS, with a random xtal error, and return the last one */
+static uint32_t generate_pps_history(void) {
+    int32_t ppm = (rand() % 61) - 30;
+    uint32_t pps = (uint32_t)rand();
+    int i;
+
+    memset(&lgw_inst->pps_history, 0, sizeof lgw_inst->pps_history);
+    lgw_inst->pps_history.idx = rand() % MAX_TIMESTAMP_PPS_HISTORY;
+    lgw_inst->pps_history.size = MAX_TIMESTAMP_PPS_HISTORY;
+    for (i = 1; i <= MAX_TIMESTAMP_PPS_HISTORY; i++) {
+        pps += 32000000 + (ppm * 32) + (rand() % 5) - 2;
+        lgw_inst->pps_history.history[(lgw_inst->pps_history.idx + i) % MAX_TIMESTAMP_PPS_HISTORY] = pps;
+    }
+
+    return pps;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Generate a packet received between 2 PPS of the history, or after the last one */
+static void generate_packet(struct ftime_input_s * in) {
+    uint32_t pps_ref;
+    int i;
+
+    pps_ref = lgw_inst->pps_history.history[rand() % MAX_TIMESTAMP_PPS_HISTORY];
+    /* coarse timestamp at end of header, shifted by at most 13e6 cycles to end of preamble */
+    in->timestamp_cnt = pps_ref + 13000000 + (rand() % 18000000);
+    in->sf = 5 + (rand() % 8);
+    in->if_freq_hz = (rand() % 800001) - 400000;
+    if ((rand() % 2) == 0) {
+        in->if_freq_hz /= 5; /* within DC notch range */
+    }
+    in->pkt_freq_error = ((double)(rand() % 40001) - 20000.0) * 1E-9;
+    in->ts_metrics_nb = 1 + (rand() % TS_METRICS_NB_MAX);
+    for (i = 0; i < (2 * in->ts_metrics_nb); i++) {
+        in->ts_metrics[i] = ((rand() % 4) == 0) ? (int8_t)rand() : (int8_t)((rand() % 33) - 16);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv) {
+    int i, x;
+    unsigned int arg_u;
+    unsigned int nb_pkt = DEFAULT_NB_PKT;
+    unsigned int seed = 1;
+    unsigned long nb_ftime = 0;
+    int err_legacy, err_new;
+    uint32_t pps_reg = 0, ftime_legacy, ftime_new;
+    int64_t diff, diff_max = 0;
+    double t_legacy = 0.0, t_new = 0.0;
+    struct timespec start, stop;
+    struct ftime_input_s in;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "hn:s:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'n':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u == 0)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_pkt = arg_u;
+                break;
+            case 's':
+                x = sscanf(optarg, "%u", &arg_u);
+                if (x != 1) {
+                    printf("ERROR: argument parsing of -s argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                seed = arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    srand(seed);
+
+    for (i = 0; i < (int)nb_pkt; i++) {
+        if ((i % 100) == 0) {
+            pps_reg = generate_pps_history();
+        }
+        generate_packet(&in);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        err_legacy = legacy_precise_timestamp_calculate(in.ts_metrics_nb, in.ts_metrics, in.timestamp_cnt, pps_reg, in.sf, in.if_freq_hz, in.pkt_freq_error, &ftime_legacy);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        t_legacy += elapsed_us(start, stop);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        err_new = precise_timestamp_calculate(in.ts_metrics_nb, in.ts_metrics, in.timestamp_cnt, pps_reg, in.sf, in.if_freq_hz, in.pkt_freq_error, &ftime_new);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        t_new += elapsed_us(start, stop);
+
+        if (err_new != err_legacy) {
+            printf("ERROR: packet %d: status %d, %d expected (SF%u, %u metrics, tmst %u)\n", i, err_new, err_legacy, in.sf, in.ts_metrics_nb, in.timestamp_cnt);
+            return EXIT_FAILURE;
+        }
+        if (err_new != 0) {
+            continue;
+        }
+        diff = (int64_t)ftime_new - (int64_t)ftime_legacy;
+        if ((diff > 1) || (diff < -1)) {
+            printf("ERROR: packet %d: ftime %u ns, %u ns expected (SF%u, %u metrics, IF %d Hz)\n", i, ftime_new, ftime_legacy, in.sf, in.ts_metrics_nb, in.if_freq_hz);
+            return EXIT_FAILURE;
+        }
+        diff = (diff < 0) ? -diff : diff;
+        diff_max = (diff > diff_max) ? diff : diff_max;
+        nb_ftime += 1;
+    }
+
+    if (nb_ftime == 0) {
+        printf("ERROR: no fine timestamp computed\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%u packets checked, %lu fine timestamps computed, max difference with reference %lld ns\n", nb_pkt, nb_ftime, (long long)diff_max);
+    printf("reference: %.3f us/packet\n", t_legacy / nb_pkt);
+    printf("current  : %.3f us/packet (x%.1f)\n", t_new / nb_pkt, (t_new > 0.0) ? (t_legacy / t_new) : 0.0);
+
+    return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
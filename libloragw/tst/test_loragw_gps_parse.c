@@ -0,0 +1,394 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Feed the incremental GPS stream parser with synthetic NMEA/UBX bursts cut
+    in random chunks, check the frames completed and the resulting time and
+    position, then measure the parsing throughput. No hardware needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf snprintf */
+#include <stdlib.h>     /* EXIT_FAILURE, rand */
+#include <string.h>     /* memcpy, strlen */
+#include <math.h>       /* fabs */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getopt */
+
+#include "loragw_gps.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_NB_BURST    600         /* bursts (seconds of GPS output) to be parsed */
+#define DEFAULT_BENCH_MB    16          /* volume of data parsed for the throughput measurement */
+#define CHUNK_MAX           64          /* max size of the random chunks fed to the parser */
+#define BURST_MAX_SIZE      1024
+
+#define GPS_WEEK            2100
+#define TEST_LAT            47.285233   /* 4717.11399,N */
+#define TEST_LON            8.565265    /* 00833.91590,E */
+#define TEST_ALT            499
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* frames completed per burst, see build_burst() */
+static const int burst_nb_rmc = 1;
+static const int burst_nb_gga = 1;
+static const int burst_nb_timegps = 1;
+static const int burst_nb_ignored = 3; /* GSV, NAV-CLOCK with sync chars in payload, ACK-ACK */
+static const int burst_nb_invalid = 1; /* RMC with a corrupted char */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h          print this help\n");
+    printf(" -n <uint>   number of 1s bursts of GPS output to be parsed (default %d)\n", DEFAULT_NB_BURST);
+    printf(" -b <uint>   MB of data to be parsed for the throughput measurement, 0 to skip it (default %d)\n", DEFAULT_BENCH_MB);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* append a NMEA sentence, with its checksum, to buff */
+static int add_nmea(uint8_t *buff, const char *body) {
+    uint8_t ck = 0;
+    int i;
+
+    for (i = 0; body[i] != '\0'; i++) {
+        ck ^= (uint8_t)body[i];
+    }
+    return sprintf((char *)buff, "$%s*%02X\r\n", body, ck);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* append a UBX message, with its checksum, to buff */
+static int add_ubx(uint8_t *buff, uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t size) {
+    uint8_t ck_a = 0, ck_b = 0;
+    int i;
+
+    buff[0] = 0xB5;
+    buff[1] = 0x62;
+    buff[2] = cls;
+    buff[3] = id;
+    buff[4] = size & 0xFF;
+    buff[5] = size >> 8;
+    memcpy(&buff[6], payload, size);
+    for (i = 2; i < (6 + size); i++) {
+        ck_a += buff[i];
+        ck_b += ck_a;
+    }
+    buff[6 + size] = ck_a;
+    buff[7 + size] = ck_b;
+    return 8 + size;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* build the output of a u-blox module for second 'sec' of the day, return the
+   offset of the end of the NAV-TIMEGPS frame in timegps_end */
+static int build_burst(uint8_t *buff, int sec, size_t *timegps_end) {
+    char body[128];
+    uint8_t payload[20];
+    uint32_t itow = (uint32_t)(3 * 86400 + sec) * 1000; /* wednesday */
+    int32_t ftow = -12345;
+    int size = 0;
+    int pos;
+
+    snprintf(body, sizeof body, "GPRMC,%02d%02d%02d.00,A,4717.11437,N,00833.91522,E,0.004,77.52,140420,,,A", (sec / 3600) % 24, (sec / 60) % 60, sec % 60);
+    size += add_nmea(&buff[size], body);
+
+    snprintf(body, sizeof body, "GPGGA,%02d%02d%02d.00,4717.11399,N,00833.91590,E,1,%02d,1.01,%d.6,M,48.0,M,,", (sec / 3600) % 24, (sec / 60) % 60, sec % 60, 8 + (sec % 4), TEST_ALT);
+    size += add_nmea(&buff[size], body);
+
+    size += add_nmea(&buff[size], "GPGSV,3,1,10,23,38,230,44,29,71,156,47,07,29,116,41,08,09,081,36");
+
+    /* NAV-CLOCK, ignored, with sync chars in its payload */
+    memset(payload, LGW_GPS_NMEA_SYNC_CHAR, 10);
+    memset(&payload[10], LGW_GPS_UBX_SYNC_CHAR, 10);
+    size += add_ubx(&buff[size], 0x01, 0x22, payload, 20);
+
+    /* a corrupted RMC (one char flipped after checksum computation) */
+    pos = size;
+    size += add_nmea(&buff[size], "GPRMC,000000.00,A,0000.00000,N,00000.00000,E,0.004,77.52,010100,,,A");
+    buff[pos + 10] = '9';
+
+    memset(payload, 0, sizeof payload);
+    payload[0] = itow & 0xFF; payload[1] = (itow >> 8) & 0xFF; payload[2] = (itow >> 16) & 0xFF; payload[3] = itow >> 24;
+    payload[4] = ftow & 0xFF; payload[5] = (ftow >> 8) & 0xFF; payload[6] = (ftow >> 16) & 0xFF; payload[7] = (uint32_t)ftow >> 24;
+    payload[8] = GPS_WEEK & 0xFF; payload[9] = GPS_WEEK >> 8;
+    payload[10] = 18; /* leap seconds */
+    payload[11] = 0x07; /* towValid, weekValid, leapSValid */
+    size += add_ubx(&buff[size], 0x01, 0x20, payload, 16);
+    *timegps_end = size;
+
+    payload[0] = 0x06; payload[1] = 0x01;
+    size += add_ubx(&buff[size], 0x05, 0x01, payload, 2);
+
+    return size;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* check the values returned by lgw_gps_get after the burst of second 'sec' */
+static int check_values(int sec) {
+    struct timespec utc, gps_time;
+    struct coord_s loc;
+    time_t utc_expected = 1586822400 + sec; /* 2020-04-14T00:00:00Z */
+    time_t gps_expected = (time_t)GPS_WEEK * 604800 + (3 * 86400 + sec);
+
+    if (lgw_gps_get(&utc, &gps_time, &loc, NULL) != LGW_GPS_SUCCESS) {
+        printf("ERROR: no valid time or position after second %d\n", sec);
+        return -1;
+    }
+    if (utc.tv_sec != utc_expected) {
+        printf("ERROR: UTC time %ld, expected %ld\n", (long)utc.tv_sec, (long)utc_expected);
+        return -1;
+    }
+    /* iTOW in ms + negative fTOW: the fractional part borrows one second */
+    if ((gps_time.tv_sec != gps_expected - 1) || (labs(gps_time.tv_nsec - (1000000000 - 12345)) > 1000)) {
+        printf("ERROR: GPS time %ld.%09ld, expected %ld.%09d\n", (long)gps_time.tv_sec, gps_time.tv_nsec, (long)gps_expected - 1, 1000000000 - 12345);
+        return -1;
+    }
+    if ((fabs(loc.lat - TEST_LAT) > 1e-6) || (fabs(loc.lon - TEST_LON) > 1e-6) || (loc.alt != TEST_ALT)) {
+        printf("ERROR: position %.6f %.6f %d, expected %.6f %.6f %d\n", loc.lat, loc.lon, loc.alt, TEST_LAT, TEST_LON, TEST_ALT);
+        return -1;
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* feed nb_burst bursts cut in random chunks, check every completed frame */
+static int test_stream(int nb_burst) {
+    struct lgw_gps_parser_s parser;
+    uint8_t *stream;
+    size_t *timegps_end; /* end offset of the NAV-TIMEGPS frame of each burst */
+    size_t stream_size = 0;
+    size_t chunk, rd_idx, nb_read;
+    int nb_rmc = 0, nb_gga = 0, nb_timegps = 0, nb_ignored = 0, nb_invalid = 0;
+    int sec;
+    int ret = 0;
+    enum gps_msg msg;
+
+    stream = malloc((size_t)nb_burst * BURST_MAX_SIZE);
+    timegps_end = malloc((size_t)nb_burst * sizeof *timegps_end);
+    if ((stream == NULL) || (timegps_end == NULL)) {
+        printf("ERROR: failed to allocate test stream\n");
+        free(stream);
+        free(timegps_end);
+        return -1;
+    }
+    /* NAV-TIMEGPS offsets are made absolute in the stream */
+    for (sec = 0; sec < nb_burst; sec++) {
+        size_t burst_size = build_burst(&stream[stream_size], sec, &timegps_end[sec]);
+        timegps_end[sec] += stream_size;
+        stream_size += burst_size;
+    }
+
+    lgw_gps_parser_init(&parser);
+
+    rd_idx = 0;
+    while ((rd_idx < stream_size) && (ret == 0)) {
+        /* random read sizes, frames are split anywhere */
+        chunk = 1 + (rand() % CHUNK_MAX);
+        if (chunk > (stream_size - rd_idx)) {
+            chunk = stream_size - rd_idx;
+        }
+        while ((chunk > 0) && (ret == 0)) {
+            msg = lgw_gps_parse_stream(&parser, &stream[rd_idx], chunk, &nb_read);
+            rd_idx += nb_read;
+            chunk -= nb_read;
+            switch (msg) {
+                case NMEA_RMC: nb_rmc += 1; break;
+                case NMEA_GGA: nb_gga += 1; break;
+                case IGNORED: nb_ignored += 1; break;
+                case INVALID: nb_invalid += 1; break;
+                case INCOMPLETE: break;
+                case UBX_NAV_TIMEGPS:
+                    /* the frame completes on its last byte, not on the next sync char */
+                    if (rd_idx != timegps_end[nb_timegps]) {
+                        printf("ERROR: NAV-TIMEGPS %d completed at offset %zu, expected %zu\n", nb_timegps, rd_idx, timegps_end[nb_timegps]);
+                        ret = -1;
+                    } else if (check_values(nb_timegps) != 0) {
+                        ret = -1;
+                    }
+                    nb_timegps += 1;
+                    break;
+                default:
+                    printf("ERROR: unexpected message type %d\n", msg);
+                    ret = -1;
+                    break;
+            }
+        }
+    }
+    free(stream);
+    free(timegps_end);
+    if (ret != 0) {
+        return -1;
+    }
+
+    printf("INFO: %d bursts, %d RMC, %d GGA, %d NAV-TIMEGPS, %d ignored, %d invalid\n", nb_burst, nb_rmc, nb_gga, nb_timegps, nb_ignored, nb_invalid);
+    if ((nb_rmc != (nb_burst * burst_nb_rmc)) || (nb_gga != (nb_burst * burst_nb_gga)) || (nb_timegps != (nb_burst * burst_nb_timegps))
+        || (nb_ignored != (nb_burst * burst_nb_ignored)) || (nb_invalid != (nb_burst * burst_nb_invalid))) {
+        printf("ERROR: unexpected number of frames\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* lgw_parse_nmea() on whole sentences must give the same results */
+static int test_sentences(void) {
+    uint8_t buff[128];
+    int size;
+
+    size = add_nmea(buff, "GPRMC,083559.34,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A");
+    if (lgw_parse_nmea((char *)buff, size) != NMEA_RMC) {
+        printf("ERROR: RMC sentence not parsed\n");
+        return -1;
+    }
+    size = add_nmea(buff, "GNGGA,092725.00,4717.11399,N,00833.91590,E,1,08,1.01,-12.6,M,48.0,M,,");
+    if (lgw_parse_nmea((char *)buff, size) != NMEA_GGA) {
+        printf("ERROR: GGA sentence not parsed\n");
+        return -1;
+    }
+    size = add_nmea(buff, "GPRMC,,V,,,,,,,,,,N");
+    if ((lgw_parse_nmea((char *)buff, size) != NMEA_RMC) || (lgw_gps_get(&(struct timespec){0, 0}, NULL, NULL, NULL) == LGW_GPS_SUCCESS)) {
+        printf("ERROR: RMC sentence without fix not parsed or giving a valid time\n");
+        return -1;
+    }
+    buff[size - 3] ^= 0x01; /* corrupt the checksum */
+    if (lgw_parse_nmea((char *)buff, size) != INVALID) {
+        printf("ERROR: corrupted sentence not detected\n");
+        return -1;
+    }
+    size = add_nmea(buff, "GPRMC,083559.34,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A,V"); /* NMEA 4.1, extra field */
+    if (lgw_parse_nmea((char *)buff, size) != IGNORED) {
+        printf("ERROR: RMC sentence with unexpected fields not ignored\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* parse nb_mb MB of GPS output in LGW_GPS_READ_SIZE reads */
+static void bench_stream(int nb_mb) {
+    struct lgw_gps_parser_s parser;
+    uint8_t burst[BURST_MAX_SIZE];
+    size_t burst_size, timegps_end, rd_idx, nb_read, chunk;
+    size_t total = 0;
+    int nb_frames = 0;
+    struct timespec start, end;
+    double elapsed;
+
+    burst_size = build_burst(burst, 0, &timegps_end);
+    lgw_gps_parser_init(&parser);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (total < ((size_t)nb_mb << 20)) {
+        for (rd_idx = 0; rd_idx < burst_size; rd_idx += chunk) {
+            chunk = burst_size - rd_idx;
+            if (chunk > LGW_GPS_READ_SIZE) {
+                chunk = LGW_GPS_READ_SIZE;
+            }
+            while (chunk > 0) {
+                if (lgw_gps_parse_stream(&parser, &burst[rd_idx], chunk, &nb_read) != INCOMPLETE) {
+                    nb_frames += 1;
+                }
+                rd_idx += nb_read;
+                chunk -= nb_read;
+            }
+        }
+        total += burst_size;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    elapsed = (double)(end.tv_sec - start.tv_sec) + ((double)(end.tv_nsec - start.tv_nsec) / 1E9);
+    printf("INFO: parsed %zu bytes, %d frames in %.3fs: %.1f MB/s, %.1f ns/byte\n", total, nb_frames, elapsed, (double)total / elapsed / 1E6, elapsed * 1E9 / (double)total);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, x;
+    unsigned int arg_u;
+    int nb_burst = DEFAULT_NB_BURST;
+    int bench_mb = DEFAULT_BENCH_MB;
+    int ret = EXIT_SUCCESS;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "hn:b:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'n':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u == 0)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_burst = arg_u;
+                break;
+            case 'b':
+                x = sscanf(optarg, "%u", &arg_u);
+                if (x != 1) {
+                    printf("ERROR: argument parsing of -b argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                bench_mb = arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    printf("===== GPS stream parser test =====\n");
+
+    /* UTC conversion of lgw_gps_get relies on the timezone */
+    tzset();
+
+    srand(1);
+    if ((test_sentences() != 0) || (test_stream(nb_burst) != 0)) {
+        ret = EXIT_FAILURE;
+    }
+    if ((ret == EXIT_SUCCESS) && (bench_mb > 0)) {
+        bench_stream(bench_mb);
+    }
+
+    printf("=========== Test %s ===========\n", (ret == EXIT_SUCCESS) ? "successful" : "failed");
+
+    return ret;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
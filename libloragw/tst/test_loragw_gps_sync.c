@@ -0,0 +1,248 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Feed the GPS time model with synthetic PPS samples (jittered counter of a
+    drifting XTAL, counter wrap, outliers, GPS loss), check the fitted clock
+    error and the accuracy of the conversions in holdover. No hardware needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_FAILURE, rand */
+#include <string.h>     /* memset */
+#include <math.h>       /* fabs */
+#include <unistd.h>     /* getopt */
+
+#include "loragw_gps.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_XTAL_PPM    3.2         /* simulated clock error of the concentrator */
+#define DEFAULT_JITTER_US   1           /* simulated PPS jitter, uniform in [-jitter;+jitter] */
+#define COUNT_START         0xFFF00000  /* the counter wraps after about 1 s of sync */
+#define UTC_START           1600000000  /* 2020-09-13 */
+#define GPS_UTC_OFFSET      18          /* leap seconds, GPS time being given since the UNIX epoch here */
+#define NB_SYNC             120
+#define HOLDOVER_S          300
+#define CONV_MAX_US         3           /* max conversion error accepted close to the reference, per us of jitter */
+#define HOLDOVER_MAX_US     20          /* max conversion error accepted after HOLDOVER_S without sync, per us of jitter */
+#define XTAL_ERR_MAX_PPM    0.05        /* max error of the fitted clock error */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static double xtal_err = 1.0 + (DEFAULT_XTAL_PPM * 1E-6);
+static int jitter_us = DEFAULT_JITTER_US;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h          print this help\n");
+    printf(" -x <float>  simulated clock error, in ppm (default %.1f)\n", DEFAULT_XTAL_PPM);
+    printf(" -j <uint>   simulated PPS jitter, in us (default %d)\n", DEFAULT_JITTER_US);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* exact concentrator counter at t seconds from the start, without jitter */
+static uint32_t true_count(double t) {
+    return (uint32_t)COUNT_START + (uint32_t)(int64_t)(t * 1E6 * xtal_err);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* feed the PPS sample of second t to the time model, count_err_us being added to the counter */
+static int sync_pps(struct tref *ref, int t, int count_err_us, int utc_err_s) {
+    struct timespec utc, gps_time;
+    uint32_t count;
+
+    count = true_count(t) + (uint32_t)count_err_us;
+    if (jitter_us > 0) {
+        count += (uint32_t)((rand() % (2 * jitter_us + 1)) - jitter_us);
+    }
+    utc.tv_sec = UTC_START + t + utc_err_s;
+    utc.tv_nsec = 0;
+    gps_time.tv_sec = utc.tv_sec + GPS_UTC_OFFSET;
+    gps_time.tv_nsec = 0;
+
+    return lgw_gps_sync(ref, count, utc, gps_time);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* conversion error, in us, of the counter value at time t (counter -> UTC and GPS -> counter) */
+static double conversion_err_us(struct tref ref, double t) {
+    struct timespec utc, gps_time;
+    uint32_t count;
+    double err_utc_us, err_cnt_us;
+
+    lgw_cnt2utc(ref, true_count(t), &utc);
+    err_utc_us = ((double)(utc.tv_sec - UTC_START) - t) * 1E6 + (utc.tv_nsec / 1E3);
+
+    gps_time.tv_sec = UTC_START + GPS_UTC_OFFSET + (time_t)t;
+    gps_time.tv_nsec = (long)((t - (double)(time_t)t) * 1E9);
+    lgw_gps2cnt(ref, gps_time, &count);
+    err_cnt_us = (double)(int32_t)(count - true_count(t));
+
+    return (fabs(err_utc_us) > fabs(err_cnt_us)) ? fabs(err_utc_us) : fabs(err_cnt_us);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    struct tref ref, ref_ok, other;
+    double err_us, est_us, x;
+    double jitter_scale;
+    int i, t, ret = LGW_GPS_ERROR, nb_fail = 0;
+    unsigned int arg_u;
+
+    while ((i = getopt(argc, argv, "hx:j:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'x':
+                if (sscanf(optarg, "%lf", &x) != 1) {
+                    printf("ERROR: argument parsing of -x argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                xtal_err = 1.0 + (x * 1E-6);
+                break;
+            case 'j':
+                if (sscanf(optarg, "%u", &arg_u) != 1) {
+                    printf("ERROR: argument parsing of -j argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                jitter_us = (int)arg_u;
+                break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    srand(1);
+    jitter_scale = (jitter_us > 1) ? jitter_us : 1;
+    memset(&ref, 0, sizeof ref);
+
+    /* initial synchronization and tracking, across the counter wrap */
+    for (t = 0; t < NB_SYNC; t++) {
+        if (sync_pps(&ref, t, 0, 0) != LGW_GPS_SUCCESS) {
+            printf("ERROR: PPS sample %d rejected\n", t);
+            nb_fail++;
+        }
+    }
+    t -= 1;
+    printf("INFO: %d PPS samples: clock error %+.4f ppm (simulated %+.4f ppm, sd %.4f ppm), jitter %.2f us, fitted on %u samples\n",
+            NB_SYNC, (ref.xtal_err - 1.0) * 1E6, (xtal_err - 1.0) * 1E6, ref.xtal_err_sd * 1E6, ref.jitter_us, ref.nb_sync);
+    if (fabs(ref.xtal_err - xtal_err) > (XTAL_ERR_MAX_PPM * 1E-6)) {
+        printf("ERROR: clock error off by %.4f ppm\n", (ref.xtal_err - xtal_err) * 1E6);
+        nb_fail++;
+    }
+    if (ref.nb_sync != LGW_GPS_FIT_SIZE) {
+        printf("ERROR: time model fitted on %u samples instead of %d\n", ref.nb_sync, LGW_GPS_FIT_SIZE);
+        nb_fail++;
+    }
+
+    /* conversions of timestamps before and after the reference */
+    err_us = conversion_err_us(ref, t - 100.5);
+    x = conversion_err_us(ref, t + 0.5);
+    err_us = (x > err_us) ? x : err_us;
+    printf("INFO: conversion error %.2f us, 100 s before and 0.5 s after the reference\n", err_us);
+    if (err_us > (CONV_MAX_US * jitter_scale)) {
+        printf("ERROR: conversion error too high\n");
+        nb_fail++;
+    }
+
+    /* outliers are rejected and leave the reference untouched */
+    ref_ok = ref;
+    if ((sync_pps(&ref, t + 1, 500, 0) != LGW_GPS_ERROR) || (sync_pps(&ref, t + 2, 0, 1) != LGW_GPS_ERROR)) {
+        printf("ERROR: outlier accepted\n");
+        nb_fail++;
+    }
+    if ((ref.count_us != ref_ok.count_us) || (ref.xtal_err != ref_ok.xtal_err)) {
+        printf("ERROR: reference modified by an outlier\n");
+        nb_fail++;
+    }
+    ref = ref_ok;
+
+    /* another reference (eg. of another card) has its own time model */
+    memset(&other, 0, sizeof other);
+    sync_pps(&other, t + 1, 0, 0);
+    if ((sync_pps(&ref_ok, t + 1, 0, 0) != LGW_GPS_SUCCESS) || (ref_ok.nb_sync != LGW_GPS_FIT_SIZE) || (other.nb_sync != 1)) {
+        printf("ERROR: time models of 2 references mixed up (fitted on %u and %u samples)\n", ref_ok.nb_sync, other.nb_sync);
+        nb_fail++;
+    }
+    ref_ok = ref;
+
+    /* holdover: GPS lost, conversions keep on using the model */
+    err_us = conversion_err_us(ref, t + HOLDOVER_S);
+    est_us = lgw_gps_holdover_us(ref, HOLDOVER_S);
+    printf("INFO: conversion error %.2f us after %d s of holdover (estimated %.2f us)\n", err_us, HOLDOVER_S, est_us);
+    if ((err_us > (HOLDOVER_MAX_US * jitter_scale)) || (err_us > (3 * est_us))) {
+        printf("ERROR: holdover error too high\n");
+        nb_fail++;
+    }
+
+    /* GPS back: the model restarts on the new samples, keeping the clock error
+     * fitted before the holdover until there are enough samples to fit it again */
+    t += HOLDOVER_S;
+    for (i = 0; i < 10; i++) {
+        if (sync_pps(&ref, t + i, 0, 0) != LGW_GPS_SUCCESS) {
+            printf("ERROR: PPS sample %d rejected after holdover\n", t + i);
+            nb_fail++;
+        }
+        if ((ref.nb_sync <= 2) && (ref.xtal_err != ref_ok.xtal_err)) {
+            printf("ERROR: clock error changed from %+.4f to %+.4f ppm with %u samples after holdover\n",
+                    (ref_ok.xtal_err - 1.0) * 1E6, (ref.xtal_err - 1.0) * 1E6, ref.nb_sync);
+            nb_fail++;
+        }
+    }
+    t += i - 1;
+    printf("INFO: GPS back, fitted on %u samples, clock error %+.4f ppm\n", ref.nb_sync, (ref.xtal_err - 1.0) * 1E6);
+    if (ref.nb_sync != i) {
+        printf("ERROR: samples older than %d s kept in the time model\n", LGW_GPS_FIT_SPAN);
+        nb_fail++;
+    }
+
+    /* time jump: 3 successive aberrant samples reset the synchronization */
+    t += 100;
+    for (i = 0; i < 3; i++) {
+        ret = sync_pps(&ref, t + i, 0, 1000); /* UTC 1000 s ahead of the counter */
+    }
+    if ((ret != LGW_GPS_SUCCESS) || (ref.nb_sync != 1) || (ref.utc.tv_sec != (UTC_START + t + 2 + 1000))) {
+        printf("ERROR: no sync reset after 3 aberrant samples\n");
+        nb_fail++;
+    }
+
+    printf("=========== Test %s ===========\n", (nb_fail == 0) ? "successful" : "failed");
+    return (nb_fail == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
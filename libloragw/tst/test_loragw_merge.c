@@ -0,0 +1,275 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Check and benchmark the merge of duplicated packets (fine timestamping
+    double demodulation) on bursts of received packets, against the previous
+    implementation (full array sorting and quadratic duplicates search).
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* EXIT_FAILURE, qsort, rand */
+#include <string.h>     /* memcpy, memcmp */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getopt */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define BURST_SIZE          255
+#define DEFAULT_NB_BURST    1000
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_pkt_rx_s burst[BURST_SIZE];
+static struct lgw_pkt_rx_s pkt_legacy[BURST_SIZE];
+static struct lgw_pkt_rx_s pkt_new[BURST_SIZE];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+static void usage(void) {
+    printf("Library version information: %s\n", lgw_version_info());
+    printf("Available options:\n");
+    printf(" -h         print this help\n");
+    printf(" -n <uint>  number of bursts of %d packets to be merged (default %d)\n", BURST_SIZE, DEFAULT_NB_BURST);
+    printf(" -s <uint>  seed of the random packets generator\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double elapsed_us(struct timespec start, struct timespec stop) {
+    return ((double)(stop.tv_sec - start.tv_sec) * 1E6) + ((double)(stop.tv_nsec - start.tv_nsec) / 1E3);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Previous implementation, used as reference */
+
+static bool legacy_is_same_pkt(struct lgw_pkt_rx_s *p1, struct lgw_pkt_rx_s *p2) {
+    return ((abs((int)(p1->count_us - p2->count_us)) <= 24) &&
+            (p1->if_chain == p2->if_chain) &&
+            (p1->datarate == p2->datarate) &&
+            (p1->size == p2->size) &&
+            (memcmp(p1->payload, p2->payload, p1->size) == 0));
+}
+
+static int legacy_compare_pkt_tmst(const void *a, const void *b) {
+    const struct lgw_pkt_rx_s *p = (const struct lgw_pkt_rx_s *)a;
+    const struct lgw_pkt_rx_s *q = (const struct lgw_pkt_rx_s *)b;
+
+    return ((int)p->count_us - (int)q->count_us);
+}
+
+static void legacy_merge_packets(struct lgw_pkt_rx_s * p, uint8_t * nb_pkt) {
+    uint8_t cpt = *nb_pkt;
+    int j, k, pkt_dup_idx;
+    bool dup_restart = false;
+
+    j = 0;
+    while (j < cpt) {
+        for (k = (j+1); k < cpt; k++) {
+            if (legacy_is_same_pkt(&p[j], &p[k])) {
+                if ((p[j].status == STAT_CRC_OK) && (p[k].status == STAT_CRC_BAD)) {
+                    pkt_dup_idx = k;
+                } else if ((p[j].status == STAT_CRC_BAD) && (p[k].status == STAT_CRC_OK)) {
+                    pkt_dup_idx = j;
+                } else {
+                    pkt_dup_idx = (p[j].ftime_received == true) ? k : j;
+                }
+                /* replace removed packet with last packet of array */
+                if (pkt_dup_idx != (cpt - 1)) {
+                    memcpy(p + pkt_dup_idx, p + cpt - 1, sizeof(struct lgw_pkt_rx_s));
+                }
+                cpt -= 1;
+                dup_restart = true;
+                break;
+            }
+        }
+        if (dup_restart == true) {
+            j = 0;
+            dup_restart = false;
+        } else {
+            j += 1;
+        }
+    }
+
+    qsort(p, cpt, sizeof(p[0]), legacy_compare_pkt_tmst);
+
+    *nb_pkt = cpt;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Generate a burst of packets, about 1/3 of them received twice (one copy with a fine timestamp) */
+static int generate_burst(struct lgw_pkt_rx_s * p) {
+    uint32_t tmst = (uint32_t)(rand() & 0x3FFFFFFF);
+    struct lgw_pkt_rx_s tmp;
+    int n = 0;
+    int i, j;
+
+    while (n < BURST_SIZE) {
+        memset(&p[n], 0, sizeof p[n]);
+        tmst += 100 + (rand() % 50); /* more than 24us between different packets */
+        p[n].count_us = tmst;
+        p[n].if_chain = rand() % 10;
+        p[n].modulation = MOD_LORA;
+        p[n].datarate = 7 + (rand() % 6);
+        p[n].status = ((rand() % 4) == 0) ? STAT_CRC_BAD : STAT_CRC_OK;
+        p[n].size = 10 + (rand() % 50);
+        for (i = 0; i < p[n].size; i++) {
+            p[n].payload[i] = (uint8_t)rand();
+        }
+        p[n].ftime_received = ((rand() % 2) == 0);
+        p[n].ftime = (uint32_t)rand();
+        n += 1;
+
+        if ((n < BURST_SIZE) && ((rand() % 3) == 0)) {
+            memcpy(&p[n], &p[n - 1], sizeof p[n]);
+            p[n].count_us += rand() % 25;
+            p[n].ftime_received = !p[n - 1].ftime_received;
+            if ((rand() % 4) == 0) {
+                p[n].status = (p[n].status == STAT_CRC_OK) ? STAT_CRC_BAD : STAT_CRC_OK;
+            }
+            n += 1;
+        }
+    }
+
+    /* shuffle packets, as they may come from different RX buffer fetches */
+    for (i = BURST_SIZE - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        memcpy(&tmp, &p[i], sizeof tmp);
+        memcpy(&p[i], &p[j], sizeof tmp);
+        memcpy(&p[j], &tmp, sizeof tmp);
+    }
+
+    return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool is_same_result(const struct lgw_pkt_rx_s * p1, const struct lgw_pkt_rx_s * p2, int nb_pkt) {
+    int i;
+
+    for (i = 0; i < nb_pkt; i++) {
+        if ((p1[i].count_us != p2[i].count_us) ||
+            (p1[i].status != p2[i].status) ||
+            (p1[i].ftime_received != p2[i].ftime_received) ||
+            (p1[i].size != p2[i].size) ||
+            (memcmp(p1[i].payload, p2[i].payload, p1[i].size) != 0)) {
+            printf("ERROR: packet %d differs: tmst %u/%u, status %u/%u, ftime_received %d/%d\n", i,
+                    p1[i].count_us, p2[i].count_us, p1[i].status, p2[i].status, p1[i].ftime_received, p2[i].ftime_received);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv) {
+    int i, x;
+    unsigned int arg_u;
+    unsigned int nb_burst = DEFAULT_NB_BURST;
+    unsigned int seed = 1;
+    uint8_t nb_legacy, nb_new;
+    unsigned long nb_in = 0, nb_out = 0;
+    double t_legacy = 0.0, t_new = 0.0;
+    struct timespec start, stop;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "hn:s:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'n':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u == 0)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_burst = arg_u;
+                break;
+            case 's':
+                x = sscanf(optarg, "%u", &arg_u);
+                if (x != 1) {
+                    printf("ERROR: argument parsing of -s argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                seed = arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    srand(seed);
+
+    for (i = 0; i < (int)nb_burst; i++) {
+        nb_legacy = nb_new = (uint8_t)generate_burst(burst);
+        nb_in += nb_new;
+        memcpy(pkt_legacy, burst, sizeof burst);
+        memcpy(pkt_new, burst, sizeof burst);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        legacy_merge_packets(pkt_legacy, &nb_legacy);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        t_legacy += elapsed_us(start, stop);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        x = lgw_merge_packets(pkt_new, &nb_new);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        t_new += elapsed_us(start, stop);
+
+        if (x != LGW_HAL_SUCCESS) {
+            printf("ERROR: lgw_merge_packets failed\n");
+            return EXIT_FAILURE;
+        }
+        if (nb_new != nb_legacy) {
+            printf("ERROR: burst %d: %u packets kept, %u expected\n", i, nb_new, nb_legacy);
+            return EXIT_FAILURE;
+        }
+        if (is_same_result(pkt_new, pkt_legacy, nb_new) == false) {
+            printf("ERROR: burst %d: merged packets differ from reference\n", i);
+            return EXIT_FAILURE;
+        }
+        nb_out += nb_new;
+    }
+
+    printf("%u bursts merged (%lu packets in, %lu out), results identical to reference\n", nb_burst, nb_in, nb_out);
+    printf("reference: %.1f us/burst\n", t_legacy / nb_burst);
+    printf("current  : %.1f us/burst (x%.1f)\n", t_new / nb_burst, (t_new > 0.0) ? (t_legacy / t_new) : 0.0);
+
+    return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
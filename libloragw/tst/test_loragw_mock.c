@@ -0,0 +1,711 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Run the HAL against the software SX1302 device (mock com interface):
+    start the concentrator, receive injected packets, send packets and check
+    what has been emitted. No hardware needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* EXIT_FAILURE, rand */
+#include <string.h>     /* memset, memcmp, strcmp */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getopt */
+
+#include "loragw_hal.h"
+#include "loragw_mock.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_NB_PKT      200
+#define RX_SPACING_US       2000    /* time between 2 injected packets */
+#define RX_CORRECTION_MAX_US 100000  /* maximum timestamp correction applied by the HAL */
+#define TX_DELAY_US         100000  /* delay of the timestamped packet */
+#define TX_TOLERANCE_US     5000    /* TX start delay of the modem, counted in the emission start */
+#define TX_DURATION_US      10000   /* emission duration of the software device */
+#define TRACE_IDLE_MS       2000    /* end of the trace replay when nothing is received */
+#define TRACK_READ_MAX      10      /* TX status reads allowed to follow a whole emission */
+#define LBT_FREQ_HZ         868500000 /* single LBT channel */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const int32_t channel_if[9] = {-400000, -200000, 0, -400000, -200000, 0, 200000, 400000, -200000};
+static const uint8_t channel_rfchain[9] = {1, 1, 1, 0, 0, 0, 0, 0, 1};
+static const int8_t txlut_power[6] = {12, 14, 16, 20, 27, 17}; /* last one out of order */
+
+static struct lgw_pkt_rx_s rxpkt[16];
+
+static uint8_t tx_events[8];
+static int nb_tx_event = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+static void usage(void) {
+    printf("Library version information: %s\n", lgw_version_info());
+    printf("Available options:\n");
+    printf(" -h         print this help\n");
+    printf(" -n <uint>  number of packets to be injected and received (default %d)\n", DEFAULT_NB_PKT);
+    printf(" -t <path>  RX trace file to be replayed by the software device, instead of injected packets\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double elapsed_us(struct timespec start, struct timespec stop) {
+    return ((double)(stop.tv_sec - start.tv_sec) * 1E6) + ((double)(stop.tv_nsec - start.tv_nsec) / 1E3);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int configure(const char * trace) {
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_tx_gain_lut_s txlut;
+    int i;
+
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 0;
+    boardconf.full_duplex = false;
+    boardconf.com_type = LGW_COM_MOCK;
+    strncpy(boardconf.com_path, trace, sizeof boardconf.com_path);
+    boardconf.com_path[sizeof boardconf.com_path - 1] = '\0'; /* ensure string termination */
+    if (lgw_board_setconf(&boardconf) != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to configure board\n");
+        return -1;
+    }
+
+    for (i = 0; i < 2; i++) {
+        memset(&rfconf, 0, sizeof rfconf);
+        rfconf.enable = true;
+        rfconf.freq_hz = (i == 0) ? 867500000 : 868500000;
+        rfconf.type = LGW_RADIO_TYPE_SX1250;
+        rfconf.rssi_offset = -215.4;
+        rfconf.tx_enable = (i == 0);
+        if (lgw_rxrf_setconf(i, &rfconf) != LGW_HAL_SUCCESS) {
+            printf("ERROR: failed to configure rxrf %d\n", i);
+            return -1;
+        }
+    }
+
+    memset(&txlut, 0, sizeof txlut);
+    txlut.size = sizeof txlut_power;
+    for (i = 0; i < txlut.size; i++) {
+        txlut.lut[i].rf_power = txlut_power[i];
+        txlut.lut[i].pa_gain = 1;
+        txlut.lut[i].mix_gain = 5; /* checked even if not used by the SX1250 */
+        txlut.lut[i].pwr_idx = (uint8_t)(i + 10);
+    }
+    if (lgw_txgain_setconf(0, &txlut) != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to configure TX gain LUT\n");
+        return -1;
+    }
+
+    for (i = 0; i < 9; i++) {
+        memset(&ifconf, 0, sizeof ifconf);
+        ifconf.enable = true;
+        ifconf.rf_chain = channel_rfchain[i];
+        ifconf.freq_hz = channel_if[i];
+        if (i == 8) {
+            ifconf.bandwidth = BW_250KHZ;
+            ifconf.datarate = DR_LORA_SF7;
+        }
+        if (lgw_rxif_setconf(i, &ifconf) != LGW_HAL_SUCCESS) {
+            printf("ERROR: failed to configure rxif %d\n", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int test_rx(unsigned int nb_pkt) {
+    struct lgw_mock_rx_s inj;
+    uint32_t t0, inj_us;
+    unsigned int nb_inj = 0, nb_rx = 0, nb_fetch = 0;
+    int i, n;
+    struct timespec start, stop, t1, t2;
+    double t_fetch = 0.0;
+
+    if (lgw_get_instcnt(&t0) != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to get concentrator counter\n");
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (nb_rx < nb_pkt) {
+        /* keep a few packets ahead of the reception */
+        while ((nb_inj < nb_pkt) && ((nb_inj - nb_rx) < 32)) {
+            memset(&inj, 0, sizeof inj);
+            inj.time_us = t0 + 10000 + (nb_inj * RX_SPACING_US);
+            inj.if_chain = nb_inj % 8;
+            inj.datarate = 7 + (nb_inj % 6);
+            inj.coderate = 1;
+            inj.crc_en = true;
+            inj.crc_error = ((nb_inj % 10) == 9);
+            inj.snr = 7.25;
+            inj.rssi = 120;
+            inj.size = 10 + (nb_inj % 40);
+            for (i = 0; i < inj.size; i++) {
+                inj.payload[i] = (uint8_t)(nb_inj + i);
+            }
+            if (lgw_mock_rx_inject(&inj) != LGW_MOCK_SUCCESS) {
+                printf("ERROR: failed to inject packet %u\n", nb_inj);
+                return -1;
+            }
+            nb_inj += 1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        n = lgw_receive(16, rxpkt);
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        t_fetch += elapsed_us(t1, t2);
+        nb_fetch += 1;
+        if (n < 0) {
+            printf("ERROR: lgw_receive failed\n");
+            return -1;
+        }
+        for (i = 0; i < n; i++) {
+            if ((rxpkt[i].if_chain != (nb_rx % 8)) ||
+                (rxpkt[i].modulation != MOD_LORA) ||
+                (rxpkt[i].datarate != (7 + (nb_rx % 6))) ||
+                (rxpkt[i].status != (((nb_rx % 10) == 9) ? STAT_CRC_BAD : STAT_CRC_OK)) ||
+                (rxpkt[i].size != (10 + (nb_rx % 40))) ||
+                (rxpkt[i].payload[0] != (uint8_t)nb_rx) ||
+                (rxpkt[i].snr != 7.25f)) {
+                printf("ERROR: packet %u: wrong metadata (if_chain %u, SF%u, status 0x%02X, size %u, snr %.2f)\n", nb_rx,
+                        rxpkt[i].if_chain, rxpkt[i].datarate, rxpkt[i].status, rxpkt[i].size, rxpkt[i].snr);
+                return -1;
+            }
+            /* the HAL moves the timestamp from the end of the header back to the end of the preamble */
+            inj_us = t0 + 10000 + (nb_rx * RX_SPACING_US);
+            if ((uint32_t)(inj_us - rxpkt[i].count_us) > RX_CORRECTION_MAX_US) {
+                printf("ERROR: packet %u: timestamp %u, injected at %u\n", nb_rx, rxpkt[i].count_us, inj_us);
+                return -1;
+            }
+            nb_rx += 1;
+        }
+        if (n == 0) {
+            wait_ms(1);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        if (elapsed_us(start, stop) > (nb_pkt * RX_SPACING_US + 2E6)) {
+            printf("ERROR: %u packets received out of %u\n", nb_rx, nb_pkt);
+            return -1;
+        }
+    }
+
+    printf("RX: %u packets received, %.1f us per lgw_receive() call (%u calls)\n", nb_rx, t_fetch / nb_fetch, nb_fetch);
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int replay_trace(unsigned int nb_pkt) {
+    unsigned int nb_rx = 0, idle_ms = 0;
+    int i, j, n;
+
+    /* the trace is over when nothing has been received for a while */
+    while ((nb_rx < nb_pkt) && (idle_ms < TRACE_IDLE_MS)) {
+        n = lgw_receive(16, rxpkt);
+        if (n < 0) {
+            printf("ERROR: lgw_receive failed\n");
+            return -1;
+        }
+        for (i = 0; i < n; i++) {
+            printf("RX: count_us %u, if_chain %u, ", rxpkt[i].count_us, rxpkt[i].if_chain);
+            if (rxpkt[i].modulation == MOD_LORA) {
+                printf("SF%u, ", rxpkt[i].datarate);
+            } else {
+                printf("FSK, ");
+            }
+            printf("status 0x%02X, snr %.2f, rssi %.1f, size %u:", rxpkt[i].status, rxpkt[i].snr, rxpkt[i].rssis, rxpkt[i].size);
+            for (j = 0; j < rxpkt[i].size; j++) {
+                printf(" %02X", rxpkt[i].payload[j]);
+            }
+            printf("\n");
+            nb_rx += 1;
+        }
+        if (n == 0) {
+            wait_ms(1);
+            idle_ms += 1;
+        } else {
+            idle_ms = 0;
+        }
+    }
+
+    printf("RX: %u packets replayed from trace\n", nb_rx);
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* LoRa packet to be sent on rf_chain 0, the TX mode and timestamp being set by the caller */
+static void mock_tx_pkt(struct lgw_pkt_tx_s * pkt, uint32_t freq_hz, uint8_t datarate, uint16_t size) {
+    int i;
+
+    memset(pkt, 0, sizeof *pkt);
+    pkt->rf_chain = 0;
+    pkt->freq_hz = freq_hz;
+    pkt->rf_power = 14;
+    pkt->modulation = MOD_LORA;
+    pkt->bandwidth = BW_125KHZ;
+    pkt->datarate = datarate;
+    pkt->coderate = CR_LORA_4_5;
+    pkt->invert_pol = true;
+    pkt->preamble = 8;
+    pkt->size = size;
+    for (i = 0; i < pkt->size; i++) {
+        pkt->payload[i] = (uint8_t)(0xA0 + i);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int test_tx_power(void) {
+    int8_t rf_power, used, expected;
+    int i, x;
+
+    /* inside and outside of the precomputed range */
+    for (rf_power = -20; rf_power < 40; rf_power++) {
+        /* highest LUT power lower or equal to the requested one, the first entry if none */
+        expected = txlut_power[0];
+        for (i = 0; i < (int)sizeof txlut_power; i++) {
+            if ((txlut_power[i] <= rf_power) && ((expected > rf_power) || (txlut_power[i] > expected))) {
+                expected = txlut_power[i];
+            }
+        }
+        x = lgw_txgain_getpower(0, rf_power, &used);
+        if ((used != expected) || ((x == LGW_HAL_SUCCESS) != (expected <= rf_power))) {
+            printf("ERROR: TX power %d dBm: %d dBm used (%d) instead of %d dBm\n", rf_power, used, x, expected);
+            return -1;
+        }
+    }
+
+    printf("TX: RF power selected as expected in the TX gain LUT\n");
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int test_tx(void) {
+    struct lgw_pkt_tx_s pkt;
+    struct lgw_mock_tx_s tx[2];
+    struct lgw_tx_prep_s prep;
+    uint32_t count_us;
+    uint8_t status;
+    int i, n = 0, k;
+
+    mock_tx_pkt(&pkt, 868100000, DR_LORA_SF7, 20);
+
+    /* packet 0: immediate, packet 1: timestamped, packet 2: timestamped, sent in two phases */
+    for (k = 0; k < 3; k++) {
+        lgw_get_instcnt(&count_us);
+        pkt.tx_mode = (k == 0) ? IMMEDIATE : TIMESTAMPED;
+        pkt.count_us = count_us + TX_DELAY_US;
+        pkt.payload[0] = (uint8_t)k;
+        if (k < 2) {
+            if (lgw_send(&pkt) != LGW_HAL_SUCCESS) {
+                printf("ERROR: failed to send packet %d\n", k);
+                return -1;
+            }
+        } else {
+            if (lgw_send_prepare(&pkt, &prep) != LGW_HAL_SUCCESS) {
+                printf("ERROR: failed to prepare packet %d\n", k);
+                return -1;
+            }
+            if (lgw_send_commit(&prep) != LGW_HAL_SUCCESS) {
+                printf("ERROR: failed to commit packet %d\n", k);
+                return -1;
+            }
+            printf("TX: packet %d prepared in %u operations, %u data bytes\n", k, prep.nb_op, prep.data_size);
+        }
+
+        /* wait for the end of the emission */
+        for (i = 0; i < 500; i++) {
+            if ((lgw_status(pkt.rf_chain, TX_STATUS, &status) == LGW_HAL_SUCCESS) && (status == TX_FREE)) {
+                break;
+            }
+            wait_ms(1);
+        }
+        if (status != TX_FREE) {
+            printf("ERROR: packet %d: emission not completed (status %u)\n", k, status);
+            return -1;
+        }
+
+        n = lgw_mock_tx_get(2, tx);
+        if (n != 1) {
+            printf("ERROR: packet %d: %d packets emitted instead of 1\n", k, n);
+            return -1;
+        }
+        if ((tx[0].rf_chain != pkt.rf_chain) || (tx[0].size != pkt.size) || (memcmp(tx[0].payload, pkt.payload, pkt.size) != 0)) {
+            printf("ERROR: packet %d: wrong packet emitted (rf_chain %u, size %u)\n", k, tx[0].rf_chain, tx[0].size);
+            return -1;
+        }
+        if ((k > 0) && ((tx[0].trig != LGW_MOCK_TRIG_DELAYED) || ((pkt.count_us - tx[0].count_us) > TX_TOLERANCE_US))) {
+            printf("ERROR: timestamped packet emitted at %u, expected %u\n", tx[0].count_us, pkt.count_us);
+            return -1;
+        }
+    }
+
+    printf("TX: immediate, timestamped and two-phase packets emitted as expected\n");
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int test_tx_stage(void) {
+    struct lgw_pkt_tx_s pkt;
+    struct lgw_tx_prep_s prep;
+    struct lgw_mock_tx_s tx[4];
+    uint32_t count_us;
+    uint8_t status = TX_STATUS_UNKNOWN;
+    bool staged = true;
+    int i, n, k;
+
+    mock_tx_pkt(&pkt, 868300000, DR_LORA_SF9, 32);
+
+    /* packet 0: sent right away, packet 1: immediate, staged while packet 0 is
+     * emitted, packet 2: timestamped, staged while packet 1 is emitted */
+    for (k = 0; k < 3; k++) {
+        for (i = 0; (i < 100000) && (staged == true) && (k > 0); i++) {
+            if (lgw_tx_dispatch(pkt.rf_chain, &status, &staged) != LGW_HAL_SUCCESS) {
+                printf("ERROR: failed to dispatch packet %d\n", k - 1);
+                return -1;
+            }
+        }
+        lgw_get_instcnt(&count_us);
+        pkt.tx_mode = (k < 2) ? IMMEDIATE : TIMESTAMPED;
+        pkt.count_us = count_us + 2 * TX_DURATION_US;
+        pkt.payload[0] = (uint8_t)k;
+        if ((lgw_send_prepare(&pkt, &prep) != LGW_HAL_SUCCESS) || (lgw_send_stage(&prep) != LGW_HAL_SUCCESS)) {
+            printf("ERROR: failed to stage packet %d\n", k);
+            return -1;
+        }
+        if (lgw_tx_dispatch(pkt.rf_chain, &status, &staged) != LGW_HAL_SUCCESS) {
+            printf("ERROR: failed to dispatch packet %d\n", k);
+            return -1;
+        }
+        if ((k > 0) && ((staged == false) || (status == TX_FREE))) {
+            printf("ERROR: packet %d was not staged behind packet %d (status %u)\n", k, k - 1, status);
+            return -1;
+        }
+    }
+
+    /* dispatch the last staged packet and wait for the end of the emissions */
+    for (i = 0; i < 500; i++) {
+        if (lgw_tx_dispatch(pkt.rf_chain, &status, &staged) != LGW_HAL_SUCCESS) {
+            printf("ERROR: failed to dispatch packet %d\n", k - 1);
+            return -1;
+        }
+        if ((staged == false) && (status == TX_FREE)) {
+            break;
+        }
+        wait_ms(1);
+    }
+    if ((staged == true) || (status != TX_FREE)) {
+        printf("ERROR: staged emissions not completed (status %u)\n", status);
+        return -1;
+    }
+
+    n = lgw_mock_tx_get(4, tx);
+    if (n != 3) {
+        printf("ERROR: %d packets emitted instead of 3\n", n);
+        return -1;
+    }
+    for (k = 0; k < n; k++) {
+        if ((tx[k].size != pkt.size) || (tx[k].payload[0] != (uint8_t)k) || (memcmp(&tx[k].payload[1], &pkt.payload[1], pkt.size - 1) != 0)) {
+            printf("ERROR: packet %d: wrong packet emitted (size %u)\n", k, tx[k].size);
+            return -1;
+        }
+    }
+    if ((tx[1].count_us - tx[0].count_us) > (TX_DURATION_US + TX_TOLERANCE_US)) {
+        printf("ERROR: staged packet emitted %u us after the previous one\n", tx[1].count_us - tx[0].count_us);
+        return -1;
+    }
+    if (tx[2].trig != LGW_MOCK_TRIG_DELAYED) {
+        printf("ERROR: staged timestamped packet was not emitted on its timestamp\n");
+        return -1;
+    }
+
+    printf("TX: staged packets emitted back-to-back, gap %u us after a %u us emission\n", tx[1].count_us - tx[0].count_us - TX_DURATION_US, TX_DURATION_US);
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void tx_event(uint8_t rf_chain, uint8_t status, void * arg) {
+    (void)arg;
+
+    if ((rf_chain == 0) && (nb_tx_event < (int)sizeof tx_events)) {
+        tx_events[nb_tx_event++] = status;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int test_tx_track(void) {
+    const uint8_t expected[3] = {TX_SCHEDULED, TX_EMITTING, TX_FREE};
+    struct lgw_pkt_tx_s pkt;
+    struct lgw_mock_tx_s tx[2];
+    struct lgw_com_stat_s stat[LGW_COM_SUB_NB];
+    lgw_com_type_t com_type;
+    uint8_t status[LGW_RF_CHAIN_NB] = {TX_STATUS_UNKNOWN, TX_STATUS_UNKNOWN};
+    uint32_t count_us, next_us;
+    int i, n;
+
+    mock_tx_pkt(&pkt, 868500000, DR_LORA_SF7, 16);
+    pkt.tx_mode = TIMESTAMPED;
+
+    lgw_tx_event_setcb(tx_event, NULL);
+    lgw_get_instcnt(&count_us);
+    pkt.count_us = count_us + TX_DELAY_US;
+    if (lgw_send(&pkt) != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to send tracked packet\n");
+        lgw_tx_event_setcb(NULL, NULL);
+        return -1;
+    }
+    lgw_bus_stat_get(&com_type, stat, true);
+
+    /* poll the tracker every ms, it only reads the status when a transition is due */
+    for (i = 0; i < 500; i++) {
+        if ((lgw_tx_track(status, &next_us) != LGW_HAL_SUCCESS) || (status[0] == TX_FREE)) {
+            break;
+        }
+        wait_ms(1);
+    }
+    lgw_bus_stat_get(&com_type, stat, true);
+    lgw_tx_event_setcb(NULL, NULL);
+
+    if ((status[0] != TX_FREE) || (next_us != UINT32_MAX)) {
+        printf("ERROR: tracked emission not completed (status %u, next in %u us)\n", status[0], next_us);
+        return -1;
+    }
+    if ((nb_tx_event != 3) || (memcmp(tx_events, expected, sizeof expected) != 0)) {
+        printf("ERROR: %d TX events received, expected SCHEDULED, EMITTING, FREE\n", nb_tx_event);
+        return -1;
+    }
+    if (stat[LGW_COM_SUB_TX].nb_access > TRACK_READ_MAX) {
+        printf("ERROR: %u TX status accesses for %d tracker calls\n", stat[LGW_COM_SUB_TX].nb_access, i + 1);
+        return -1;
+    }
+    n = lgw_mock_tx_get(2, tx);
+    if (n != 1) {
+        printf("ERROR: %d packets emitted instead of 1\n", n);
+        return -1;
+    }
+
+    printf("TX: tracked emission notified in 3 transitions, %u bus accesses for %d tracker calls\n", stat[LGW_COM_SUB_TX].nb_access, i + 1);
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* restart the concentrator with Listen-Before-Talk enabled on LBT_FREQ_HZ */
+static int configure_lbt(void) {
+    struct lgw_conf_sx1261_s sx1261conf;
+
+    lgw_stop();
+
+    memset(&sx1261conf, 0, sizeof sx1261conf);
+    sx1261conf.enable = true;
+    sx1261conf.lbt_conf.enable = true;
+    sx1261conf.lbt_conf.rssi_target = -80;
+    sx1261conf.lbt_conf.nb_channel = 1;
+    sx1261conf.lbt_conf.channels[0].freq_hz = LBT_FREQ_HZ;
+    sx1261conf.lbt_conf.channels[0].bandwidth = BW_125KHZ;
+    sx1261conf.lbt_conf.channels[0].scan_time_us = LGW_LBT_SCAN_TIME_128_US;
+    sx1261conf.lbt_conf.channels[0].transmit_time_ms = 4000;
+    if (lgw_sx1261_setconf(&sx1261conf) != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to configure LBT\n");
+        return -1;
+    }
+
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the concentrator with LBT\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int test_tx_lbt(void) {
+    const uint8_t expected[3] = {TX_SCHEDULED, TX_EMITTING, TX_FREE};
+    struct lgw_pkt_tx_s pkt;
+    struct lgw_mock_tx_s tx[2];
+    uint8_t status[LGW_RF_CHAIN_NB] = {TX_STATUS_UNKNOWN, TX_STATUS_UNKNOWN};
+    uint32_t count_us, next_us;
+    int i, k, x;
+
+    mock_tx_pkt(&pkt, LBT_FREQ_HZ, DR_LORA_SF7, 16);
+    pkt.tx_mode = TIMESTAMPED;
+    lgw_tx_event_setcb(tx_event, NULL);
+
+    /* packet 0: channel busy, blocked by LBT, packet 1: channel free */
+    for (k = 0; k < 2; k++) {
+        nb_tx_event = 0;
+        lgw_mock_lbt_busy(k == 0);
+        lgw_get_instcnt(&count_us);
+        pkt.count_us = count_us + TX_DELAY_US;
+        x = lgw_send(&pkt);
+        if (x != ((k == 0) ? LGW_LBT_NOT_ALLOWED : LGW_HAL_SUCCESS)) {
+            printf("ERROR: packet %d: lgw_send returned %d with the channel %s\n", k, x, (k == 0) ? "busy" : "free");
+            lgw_tx_event_setcb(NULL, NULL);
+            return -1;
+        }
+        for (i = 0; i < 500; i++) {
+            if ((lgw_tx_track(status, &next_us) != LGW_HAL_SUCCESS) || (status[0] == TX_FREE)) {
+                break;
+            }
+            wait_ms(1);
+        }
+        if ((status[0] != TX_FREE) || (next_us != UINT32_MAX)) {
+            printf("ERROR: packet %d: TX not free after LBT (status %u, next in %u us)\n", k, status[0], next_us);
+            lgw_tx_event_setcb(NULL, NULL);
+            return -1;
+        }
+        if ((k == 0) && (nb_tx_event != 0)) {
+            printf("ERROR: %d TX events received for a packet blocked by LBT, expected none\n", nb_tx_event);
+            lgw_tx_event_setcb(NULL, NULL);
+            return -1;
+        }
+        if ((k == 1) && ((nb_tx_event != 3) || (memcmp(tx_events, expected, sizeof expected) != 0))) {
+            printf("ERROR: %d TX events received, expected SCHEDULED, EMITTING, FREE\n", nb_tx_event);
+            lgw_tx_event_setcb(NULL, NULL);
+            return -1;
+        }
+        if (lgw_mock_tx_get(2, tx) != k) {
+            printf("ERROR: packet %d: %s\n", k, (k == 0) ? "emitted while the channel is busy" : "not emitted");
+            lgw_tx_event_setcb(NULL, NULL);
+            return -1;
+        }
+    }
+    lgw_tx_event_setcb(NULL, NULL);
+
+    printf("TX: packet blocked by LBT left the TX free with no transition, next one tracked in 3 transitions\n");
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv) {
+    int i, x;
+    unsigned int arg_u;
+    unsigned int nb_pkt = DEFAULT_NB_PKT;
+    const char * trace = LGW_MOCK_PATH_NONE;
+    uint64_t eui;
+    int ret = EXIT_SUCCESS;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "hn:t:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'n':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u == 0)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_pkt = arg_u;
+                break;
+            case 't':
+                trace = optarg;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    printf("===== sx1302 HAL test against the software device =====\n");
+
+    if (configure(trace) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the concentrator\n");
+        return EXIT_FAILURE;
+    }
+
+    if (lgw_get_eui(&eui) != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to get concentrator EUI\n");
+        ret = EXIT_FAILURE;
+    } else {
+        printf("INFO: concentrator EUI: 0x%016llX\n", (unsigned long long)eui);
+    }
+
+    if (strcmp(trace, LGW_MOCK_PATH_NONE) != 0) {
+        /* injected packets would be mixed with the ones of the trace */
+        if ((ret == EXIT_SUCCESS) && (replay_trace(nb_pkt) != 0)) {
+            ret = EXIT_FAILURE;
+        }
+    } else if ((ret == EXIT_SUCCESS) && (test_rx(nb_pkt) != 0)) {
+        ret = EXIT_FAILURE;
+    }
+    if ((ret == EXIT_SUCCESS) && (test_tx_power() != 0)) {
+        ret = EXIT_FAILURE;
+    }
+    if ((ret == EXIT_SUCCESS) && (test_tx() != 0)) {
+        ret = EXIT_FAILURE;
+    }
+    if ((ret == EXIT_SUCCESS) && (test_tx_stage() != 0)) {
+        ret = EXIT_FAILURE;
+    }
+    if ((ret == EXIT_SUCCESS) && (test_tx_track() != 0)) {
+        ret = EXIT_FAILURE;
+    }
+    if ((ret == EXIT_SUCCESS) && ((configure_lbt() != 0) || (test_tx_lbt() != 0))) {
+        ret = EXIT_FAILURE;
+    }
+
+    lgw_stop();
+
+    printf("=========== Test %s ===========\n", (ret == EXIT_SUCCESS) ? "successful" : "failed");
+
+    return ret;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,463 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Run the HAL against the software SX1302 device with a virtual time
+    fast-forwarded over hours: check the counter, PPS, RX timestamps and TX
+    triggers across the 32MHz counter wrap (2^27us) and the count_us wrap
+    (2^32us, 71 minutes), in a few seconds. No hardware needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* EXIT_FAILURE, rand */
+#include <string.h>     /* memset, memcmp */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getopt */
+
+#include "loragw_hal.h"
+#include "loragw_mock.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_NB_WRAP     4           /* count_us wraps to be run through */
+#define DEFAULT_SCALE       1000.0      /* virtual time speed of the free-running test */
+#define SCALE_MAX           2000.0      /* the HAL must read the counter at least once per 2^27us */
+#define DEFAULT_DURATION_S  5           /* duration of the free-running test, in host seconds */
+
+#define COUNTER_WRAP_US     (1ULL << 27) /* 32MHz counter period */
+#define COUNT_US_WRAP_US    (1ULL << 32) /* count_us period */
+#define STEP_MIN_US         1000000     /* time warp between 2 HAL counter reads */
+#define STEP_MAX_US         120000000   /* must stay below the 32MHz counter period */
+#define READ_TOLERANCE_US   2000        /* host time elapsed between a HAL read and the virtual time read */
+#define RX_CORRECTION_MAX_US 100000     /* maximum timestamp correction applied by the HAL */
+#define RX_SPACING_US       20000       /* time between the 2 packets received across a wrap */
+#define TX_DELAY_US         200000      /* delay of the timestamped packet sent across a wrap */
+#define TX_TOLERANCE_US     5000        /* TX start delay of the modem, counted in the emission start */
+#define COUNTER_MASK        ((uint32_t)(COUNTER_WRAP_US - 1))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const int32_t channel_if[9] = {-400000, -200000, 0, -400000, -200000, 0, 200000, 400000, -200000};
+static const uint8_t channel_rfchain[9] = {1, 1, 1, 0, 0, 0, 0, 0, 1};
+
+static struct lgw_pkt_rx_s rxpkt[16];
+
+static unsigned long nb_read = 0;   /* HAL counter reads */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+static void usage(void) {
+    printf("Library version information: %s\n", lgw_version_info());
+    printf("Available options:\n");
+    printf(" -h          print this help\n");
+    printf(" -n <uint>   number of count_us wraps (71 minutes each) to be fast-forwarded (default %d)\n", DEFAULT_NB_WRAP);
+    printf(" -s <float>  virtual time speed of the free-running test, %.0f max (default %.0f)\n", SCALE_MAX, DEFAULT_SCALE);
+    printf(" -d <uint>   duration of the free-running test, in seconds, 0 to skip it (default %d)\n", DEFAULT_DURATION_S);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double elapsed_us(struct timespec start, struct timespec stop) {
+    return ((double)(stop.tv_sec - start.tv_sec) * 1E6) + ((double)(stop.tv_nsec - start.tv_nsec) / 1E3);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int configure(void) {
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    int i;
+
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 0;
+    boardconf.full_duplex = false;
+    boardconf.com_type = LGW_COM_MOCK;
+    strncpy(boardconf.com_path, LGW_MOCK_PATH_NONE, sizeof boardconf.com_path);
+    boardconf.com_path[sizeof boardconf.com_path - 1] = '\0'; /* ensure string termination */
+    if (lgw_board_setconf(&boardconf) != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to configure board\n");
+        return -1;
+    }
+
+    for (i = 0; i < 2; i++) {
+        memset(&rfconf, 0, sizeof rfconf);
+        rfconf.enable = true;
+        rfconf.freq_hz = (i == 0) ? 867500000 : 868500000;
+        rfconf.type = LGW_RADIO_TYPE_SX1250;
+        rfconf.rssi_offset = -215.4;
+        rfconf.tx_enable = (i == 0);
+        if (lgw_rxrf_setconf(i, &rfconf) != LGW_HAL_SUCCESS) {
+            printf("ERROR: failed to configure rxrf %d\n", i);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < 9; i++) {
+        memset(&ifconf, 0, sizeof ifconf);
+        ifconf.enable = true;
+        ifconf.rf_chain = channel_rfchain[i];
+        ifconf.freq_hz = channel_if[i];
+        if (i == 8) {
+            ifconf.bandwidth = BW_250KHZ;
+            ifconf.datarate = DR_LORA_SF7;
+        }
+        if (lgw_rxif_setconf(i, &ifconf) != LGW_HAL_SUCCESS) {
+            printf("ERROR: failed to configure rxif %d\n", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* read the HAL counters and check them against the virtual time of the device */
+static int check_counters(uint32_t * inst, uint32_t tolerance_us) {
+    uint32_t pps;
+    uint64_t virt;
+
+    /* in that order, as the virtual time may run between the reads */
+    lgw_get_trigcnt(&pps);
+    lgw_get_instcnt(inst);
+    lgw_mock_time_get(&virt);
+    nb_read += 1;
+
+    if ((uint32_t)((uint32_t)virt - *inst) > tolerance_us) {
+        printf("ERROR: count_us %u, device time %llu (0x%08X)\n", *inst, (unsigned long long)virt, (uint32_t)virt);
+        return -1;
+    }
+    if ((uint32_t)(*inst - pps) > (1000000 + tolerance_us)) {
+        printf("ERROR: PPS count_us %u, count_us %u\n", pps, *inst);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* fast-forward the device to a virtual time, the HAL reading its counter between each step */
+static int advance_to(uint64_t target_us) {
+    uint64_t virt;
+    uint32_t step, inst;
+
+    lgw_mock_time_get(&virt);
+    while (virt < target_us) {
+        step = STEP_MIN_US + (uint32_t)(rand() % (STEP_MAX_US - STEP_MIN_US));
+        if ((target_us - virt) < step) {
+            step = (uint32_t)(target_us - virt);
+        }
+        lgw_mock_time_warp(step);
+        if (check_counters(&inst, READ_TOLERANCE_US) != 0) {
+            return -1;
+        }
+        lgw_mock_time_get(&virt);
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* 2 packets received on each side of a wrap, fetched after the wrap */
+static int rx_across(uint64_t wrap_us) {
+    struct lgw_mock_rx_s inj;
+    uint32_t inj_us[2];
+    int i, k, n = 0, nb_rx = 0;
+
+    if (advance_to(wrap_us - (2 * RX_SPACING_US)) != 0) {
+        return -1;
+    }
+
+    for (k = 0; k < 2; k++) {
+        memset(&inj, 0, sizeof inj);
+        inj_us[k] = (uint32_t)(wrap_us - (RX_SPACING_US / 2) + (k * RX_SPACING_US));
+        inj.time_us = inj_us[k];
+        inj.if_chain = (uint8_t)k;
+        inj.datarate = 7;
+        inj.coderate = 1;
+        inj.crc_en = true;
+        inj.snr = 7.25;
+        inj.rssi = 120;
+        inj.size = 16;
+        for (i = 0; i < inj.size; i++) {
+            inj.payload[i] = (uint8_t)(k + i);
+        }
+        if (lgw_mock_rx_inject(&inj) != LGW_MOCK_SUCCESS) {
+            printf("ERROR: failed to inject packet %d\n", k);
+            return -1;
+        }
+    }
+
+    lgw_mock_time_warp(4 * RX_SPACING_US);
+    for (i = 0; (i < 10) && (nb_rx < 2); i++) {
+        n = lgw_receive(16 - nb_rx, &rxpkt[nb_rx]);
+        if (n < 0) {
+            printf("ERROR: lgw_receive failed\n");
+            return -1;
+        }
+        nb_rx += n;
+    }
+    if (nb_rx != 2) {
+        printf("ERROR: %d packets received across the wrap at %llu us instead of 2\n", nb_rx, (unsigned long long)wrap_us);
+        return -1;
+    }
+
+    for (k = 0; k < 2; k++) {
+        if ((rxpkt[k].if_chain != k) || ((uint32_t)(inj_us[k] - rxpkt[k].count_us) > RX_CORRECTION_MAX_US)) {
+            printf("ERROR: packet %d across the wrap at %llu us: timestamp %u, injected at %u\n", k, (unsigned long long)wrap_us, rxpkt[k].count_us, inj_us[k]);
+            return -1;
+        }
+    }
+    if ((uint32_t)(rxpkt[1].count_us - rxpkt[0].count_us) != RX_SPACING_US) {
+        printf("ERROR: packets across the wrap at %llu us: timestamps %u and %u, %u us apart instead of %u\n", (unsigned long long)wrap_us,
+                rxpkt[0].count_us, rxpkt[1].count_us, rxpkt[1].count_us - rxpkt[0].count_us, RX_SPACING_US);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* timestamped packet sent before a wrap, to be emitted after it */
+static int tx_across(uint64_t wrap_us) {
+    struct lgw_pkt_tx_s pkt;
+    struct lgw_mock_tx_s tx[2];
+    uint32_t count_us;
+    uint8_t status = TX_STATUS_UNKNOWN;
+    int i, n;
+
+    if (advance_to(wrap_us - (TX_DELAY_US / 2)) != 0) {
+        return -1;
+    }
+
+    memset(&pkt, 0, sizeof pkt);
+    pkt.rf_chain = 0;
+    pkt.freq_hz = 868100000;
+    pkt.rf_power = 14;
+    pkt.modulation = MOD_LORA;
+    pkt.bandwidth = BW_125KHZ;
+    pkt.datarate = DR_LORA_SF7;
+    pkt.coderate = CR_LORA_4_5;
+    pkt.invert_pol = true;
+    pkt.preamble = 8;
+    pkt.size = 12;
+    for (i = 0; i < pkt.size; i++) {
+        pkt.payload[i] = (uint8_t)(0xB0 + i);
+    }
+    lgw_get_instcnt(&count_us);
+    pkt.tx_mode = TIMESTAMPED;
+    pkt.count_us = count_us + TX_DELAY_US;
+    if (lgw_send(&pkt) != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to send packet across the wrap at %llu us\n", (unsigned long long)wrap_us);
+        return -1;
+    }
+
+    lgw_mock_time_warp(2 * TX_DELAY_US);
+    for (i = 0; i < 100; i++) {
+        if ((lgw_status(pkt.rf_chain, TX_STATUS, &status) == LGW_HAL_SUCCESS) && (status == TX_FREE)) {
+            break;
+        }
+        lgw_mock_time_warp(1000);
+    }
+    if (status != TX_FREE) {
+        printf("ERROR: emission across the wrap at %llu us not completed (status %u)\n", (unsigned long long)wrap_us, status);
+        return -1;
+    }
+
+    /* the device reports the 32MHz counter value of the emission start, in microseconds */
+    n = lgw_mock_tx_get(2, tx);
+    if ((n != 1) || (tx[0].trig != LGW_MOCK_TRIG_DELAYED) || (memcmp(tx[0].payload, pkt.payload, pkt.size) != 0) ||
+        (((pkt.count_us - tx[0].count_us) & COUNTER_MASK) > TX_TOLERANCE_US)) {
+        printf("ERROR: packet across the wrap at %llu us: %d emitted, at %u, expected %u\n", (unsigned long long)wrap_us, n,
+                (n > 0) ? tx[0].count_us : 0, pkt.count_us & COUNTER_MASK);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* fast-forward over count_us wraps, with packets received and sent across the wraps */
+static int test_warp(unsigned int nb_wrap_target) {
+    uint64_t virt, wrap_us, idx;
+    unsigned int nb_rx = 0, nb_tx = 0;
+    bool rx;
+    struct timespec start, stop;
+    double host_us;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    lgw_mock_time_get(&virt);
+    while (virt < (nb_wrap_target * COUNT_US_WRAP_US)) {
+        /* next 32MHz counter wrap, every 32 of them is a count_us wrap as well */
+        idx = (virt / COUNTER_WRAP_US) + 1;
+        wrap_us = idx * COUNTER_WRAP_US;
+        if ((wrap_us % COUNT_US_WRAP_US) == 0) {
+            rx = (((wrap_us / COUNT_US_WRAP_US) % 2) == 1);
+        } else {
+            rx = ((idx % 2) == 0);
+        }
+        if (rx) {
+            if (rx_across(wrap_us) != 0) {
+                return -1;
+            }
+            nb_rx += 2;
+        } else {
+            if (tx_across(wrap_us) != 0) {
+                return -1;
+            }
+            nb_tx += 1;
+        }
+        lgw_mock_time_get(&virt);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    host_us = elapsed_us(start, stop);
+    printf("WARP: %llu count_us wraps, %.2f hours in %.3f s (x%.0f), %lu counter reads, %u packets received and %u sent across wraps\n",
+            (unsigned long long)(virt / COUNT_US_WRAP_US), (double)virt / 3.6E9, host_us / 1E6, (double)virt / host_us, nb_read, nb_rx, nb_tx);
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* speed up the device time and poll the HAL counters as an application would */
+static int test_scale(double scale, unsigned int duration_s) {
+    uint32_t inst, prev;
+    unsigned int nb_wrap = 0;
+    uint64_t virt_start, virt_stop;
+    struct timespec start, now;
+
+    if (lgw_mock_time_scale(scale) != LGW_MOCK_SUCCESS) {
+        printf("ERROR: failed to set the time scale\n");
+        return -1;
+    }
+    lgw_mock_time_get(&virt_start);
+    lgw_get_instcnt(&prev);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        wait_ms(5);
+        if (check_counters(&inst, (uint32_t)(scale * READ_TOLERANCE_US)) != 0) {
+            lgw_mock_time_scale(1.0);
+            return -1;
+        }
+        if (inst < prev) {
+            nb_wrap += 1;
+        }
+        prev = inst;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (elapsed_us(start, now) < (duration_s * 1E6));
+    lgw_mock_time_get(&virt_stop);
+    lgw_mock_time_scale(1.0);
+
+    printf("SCALE: x%.0f, %.2f hours in %u s, %u count_us wraps\n", scale, (double)(virt_stop - virt_start) / 3.6E9, duration_s, nb_wrap);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv) {
+    int i, x;
+    unsigned int arg_u;
+    double arg_f;
+    unsigned int nb_wrap = DEFAULT_NB_WRAP;
+    double scale = DEFAULT_SCALE;
+    unsigned int duration_s = DEFAULT_DURATION_S;
+    int ret = EXIT_SUCCESS;
+
+    /* parse command line options */
+    while ((i = getopt(argc, argv, "hn:s:d:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 'n':
+                x = sscanf(optarg, "%u", &arg_u);
+                if ((x != 1) || (arg_u == 0)) {
+                    printf("ERROR: argument parsing of -n argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                nb_wrap = arg_u;
+                break;
+            case 's':
+                x = sscanf(optarg, "%lf", &arg_f);
+                if ((x != 1) || (arg_f < 1.0) || (arg_f > SCALE_MAX)) {
+                    printf("ERROR: argument parsing of -s argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                scale = arg_f;
+                break;
+            case 'd':
+                x = sscanf(optarg, "%u", &arg_u);
+                if (x != 1) {
+                    printf("ERROR: argument parsing of -d argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                duration_s = arg_u;
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    printf("===== sx1302 HAL counter wrap test against the software device =====\n");
+
+    if (configure() != 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the concentrator\n");
+        return EXIT_FAILURE;
+    }
+
+    srand(1);
+    if (test_warp(nb_wrap) != 0) {
+        ret = EXIT_FAILURE;
+    }
+    if ((ret == EXIT_SUCCESS) && (duration_s > 0) && (test_scale(scale, duration_s) != 0)) {
+        ret = EXIT_FAILURE;
+    }
+
+    lgw_stop();
+
+    printf("=========== Test %s ===========\n", (ret == EXIT_SUCCESS) ? "successful" : "failed");
+
+    return ret;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
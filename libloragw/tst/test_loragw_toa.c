@@ -29,8 +29,12 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include <stdlib.h>     /* EXIT_FAILURE */
 #include <getopt.h>     /* getopt_long */
 #include <string.h>     /* strcmp */
+#include <math.h>       /* ceil */
 
 #include "loragw_hal.h"
+#include "loragw_aux.h"
+#include "loragw_sx1302.h"
+#include "loragw_sx1302_timestamp.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -59,6 +63,172 @@ void usage(void) {
     printf(" -z <uint>  Payload length [0..255]\n");
     printf(" -i         Implicit header (no header)\n");
     printf(" -r         CRC enabled\n");
+    printf(" -x         Exhaustive check of ToA and timestamp correction tables against reference formulas\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Reference implementations (floating point formulas the library tables are built from) */
+
+static uint32_t ref_time_on_air(uint8_t bw, uint8_t sf, uint8_t cr, uint16_t n_symbol_preamble, bool no_header, bool no_crc, uint8_t size,
+                                double * out_nb_symbols, uint32_t * out_nb_symbols_payload, uint16_t * out_t_symbol_us) {
+    uint8_t H, DE, n_bit_crc;
+    uint8_t bw_pow = (bw == BW_125KHZ) ? 1 : ((bw == BW_250KHZ) ? 2 : 4);
+    uint16_t t_symbol_us;
+    double n_symbol;
+    uint32_t n_symbol_payload;
+
+    t_symbol_us = (1 << sf) * 8 / bw_pow;
+    H = (no_header == false) ? 1 : 0;
+    DE = (sf >= 11) ? 1 : 0;
+    n_bit_crc = (no_crc == false) ? 16 : 0;
+    n_symbol_payload = ceil(MAX((double)(8 * size + n_bit_crc - 4*sf + ((sf >= 7) ? 8 : 0) + 20*H), 0.0) / (double)(4 * (sf - 2*DE))) * (cr + 4);
+    n_symbol = (double)n_symbol_preamble + ((sf >= 7) ? 4.25 : 6.25) + 8.0 + (double)n_symbol_payload;
+
+    *out_nb_symbols = n_symbol;
+    *out_nb_symbols_payload = n_symbol_payload;
+    *out_t_symbol_us = t_symbol_us;
+
+    return (uint32_t)((double)n_symbol * (double)t_symbol_us);
+}
+
+static int32_t ref_legacy_correction(uint8_t bandwidth, uint8_t sf, uint8_t cr, bool crc_en, uint8_t payload_length, sx1302_rx_dft_peak_mode_t dft_peak_mode) {
+    uint64_t clk_period, filtering_delay, demap_delay, fft_delay_state3, fft_delay, decode_delay, total_delay;
+    uint32_t nb_nibble, nb_nibble_in_hdr, nb_nibble_in_last_block;
+    uint8_t nb_iter, bw_pow = (bandwidth == BW_125KHZ) ? 1 : ((bandwidth == BW_250KHZ) ? 2 : 4);
+    uint8_t dft_peak_en = (dft_peak_mode == RX_DFT_PEAK_MODE_DISABLED) ? 0 : 1;
+    uint8_t ppm = SET_PPM_ON(bandwidth, sf) ? 1 : 0;
+    bool payload_fits_in_header = false;
+    uint8_t cr_local = cr;
+
+    clk_period = 250E3 / bw_pow;
+    nb_nibble = (payload_length + 2 * crc_en) * 2 + 5;
+    nb_nibble_in_hdr = ((sf == 5) || (sf == 6)) ? sf : (sf - 2);
+    nb_nibble_in_last_block = nb_nibble - nb_nibble_in_hdr - (sf - 2 * ppm) * ((nb_nibble - nb_nibble_in_hdr) / (sf - 2 * ppm));
+    if (nb_nibble_in_last_block == 0) {
+        nb_nibble_in_last_block = sf - 2 * ppm;
+    }
+    nb_iter = (sf + 1) / 2;
+    if (((int)(2 * (payload_length + 2 * crc_en) - (sf - 7)) <= 0) || ((payload_length == 0) && (crc_en == false))) {
+        payload_fits_in_header = true;
+        dft_peak_en = 0;
+        cr_local = 4;
+        nb_nibble_in_last_block = (sf > 6) ? (sf - 2) : sf;
+    }
+    filtering_delay = 16000E3 / bw_pow + 2031250;
+    if (payload_fits_in_header == true) {
+        demap_delay = clk_period + (1 << sf) * clk_period * 3 / 4 + 3 * clk_period + (sf - 2) * clk_period;
+    } else {
+        demap_delay = clk_period + (1 << sf) * clk_period * (1 - ppm / 4) + 3 * clk_period + (sf - 2 * ppm) * clk_period;
+    }
+    fft_delay_state3 = clk_period * (((1 << sf) - 6) + 2 * ((1 << sf) * (nb_iter - 1) + 6)) + 4 * clk_period;
+    if (dft_peak_en) {
+        fft_delay = (5 - 2 * ppm) * ((1 << sf) * clk_period + 7 * clk_period) + 2 * clk_period;
+    } else {
+        fft_delay = (1 << sf) * 2 * clk_period + 3 * clk_period;
+    }
+    decode_delay = 5 * clk_period + (9 * clk_period + clk_period * cr_local) * nb_nibble_in_last_block + 3 * clk_period;
+    total_delay = (filtering_delay + fft_delay_state3 + fft_delay + demap_delay + decode_delay + 500E3) / 1E6;
+
+    return -((int32_t)total_delay);
+}
+
+static int32_t ref_precision_correction(uint8_t bandwidth, uint8_t datarate, uint8_t coderate, bool crc_en, uint8_t payload_length) {
+    uint32_t nb_symbols_payload;
+    uint16_t t_symbol_us;
+    double nb_symbols;
+    int32_t timestamp_correction;
+    uint8_t bw_pow = (bandwidth == BW_125KHZ) ? 1 : ((bandwidth == BW_250KHZ) ? 2 : 4);
+    uint32_t filtering_delay = 16000000 / bw_pow + 2031250;
+
+    ref_time_on_air(bandwidth, datarate, coderate, 0, false, !crc_en, payload_length, &nb_symbols, &nb_symbols_payload, &t_symbol_us);
+    timestamp_correction = 0;
+    timestamp_correction += (nb_symbols_payload * t_symbol_us);
+    timestamp_correction -= (filtering_delay + 500E3) / 1E6;
+
+    return timestamp_correction;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Check all the LoRa parameters combinations, return the number of mismatches */
+static int check_tables(void) {
+    const uint8_t bw_list[] = {BW_125KHZ, BW_250KHZ, BW_500KHZ};
+    const uint16_t preamble_list[] = {0, 6, 8, 12, 255, 65535};
+    const sx1302_rx_dft_peak_mode_t dft_list[] = {RX_DFT_PEAK_MODE_DISABLED, RX_DFT_PEAK_MODE_FULL, RX_DFT_PEAK_MODE_TRACK, RX_DFT_PEAK_MODE_AUTO};
+    lgw_context_t context;
+    struct lgw_pkt_tx_s pkt;
+    unsigned int b, sf, cr, h, crc, size, p, d;
+    uint32_t toa, toa_ref, nb_sym_payload, nb_sym_payload_ref;
+    uint16_t t_sym, t_sym_ref;
+    double nb_sym, nb_sym_ref;
+    int32_t corr, corr_ref;
+    unsigned long nb_check = 0;
+    int nb_err = 0;
+
+    memset(&context, 0, sizeof context);
+    memset(&pkt, 0, sizeof pkt);
+    pkt.modulation = MOD_LORA;
+
+    for (b = 0; b < sizeof bw_list; b++) {
+        for (sf = DR_LORA_SF5; sf <= DR_LORA_SF12; sf++) {
+            for (cr = CR_LORA_4_5; cr <= CR_LORA_4_8; cr++) {
+                for (crc = 0; crc < 2; crc++) {
+                    for (size = 0; size < 256; size++) {
+                        /* Time on air */
+                        for (h = 0; h < 2; h++) {
+                            for (p = 0; p < (sizeof preamble_list / sizeof preamble_list[0]); p++) {
+                                toa = lora_packet_time_on_air(bw_list[b], sf, cr, preamble_list[p], (h == 0), (crc == 0), size, &nb_sym, &nb_sym_payload, &t_sym);
+                                toa_ref = ref_time_on_air(bw_list[b], sf, cr, preamble_list[p], (h == 0), (crc == 0), size, &nb_sym_ref, &nb_sym_payload_ref, &t_sym_ref);
+                                if ((toa != toa_ref) || (nb_sym != nb_sym_ref) || (nb_sym_payload != nb_sym_payload_ref) || (t_sym != t_sym_ref)) {
+                                    printf("ERROR: ToA mismatch BW:0x%02X SF:%u CR:%u H:%u CRC:%u SIZE:%u PREAMBLE:%u => %u/%u us\n", bw_list[b], sf, cr, h, crc, size, preamble_list[p], toa, toa_ref);
+                                    nb_err += 1;
+                                }
+                                pkt.bandwidth = bw_list[b];
+                                pkt.datarate = sf;
+                                pkt.coderate = cr;
+                                pkt.preamble = preamble_list[p];
+                                pkt.no_header = (h == 0);
+                                pkt.no_crc = (crc == 0);
+                                pkt.size = size;
+                                if (lgw_time_on_air(&pkt) != (uint32_t)((double)toa_ref / 1000.0 + 0.5)) {
+                                    printf("ERROR: ToA (ms) mismatch BW:0x%02X SF:%u CR:%u H:%u CRC:%u SIZE:%u PREAMBLE:%u\n", bw_list[b], sf, cr, h, crc, size, preamble_list[p]);
+                                    nb_err += 1;
+                                }
+                                nb_check += 2;
+                            }
+                        }
+
+                        /* Timestamp correction, fine timestamping disabled */
+                        context.ftime_cfg.enable = false;
+                        for (d = 0; d < (sizeof dft_list / sizeof dft_list[0]); d++) {
+                            corr = timestamp_counter_correction(&context, bw_list[b], sf, cr, (crc == 1), size, dft_list[d]);
+                            corr_ref = ref_legacy_correction(bw_list[b], sf, cr, (crc == 1), size, dft_list[d]);
+                            if (corr != corr_ref) {
+                                printf("ERROR: legacy timestamp correction mismatch BW:0x%02X SF:%u CR:%u CRC:%u SIZE:%u DFT:%u => %d/%d us\n", bw_list[b], sf, cr, crc, size, dft_list[d], corr, corr_ref);
+                                nb_err += 1;
+                            }
+                            nb_check += 1;
+                        }
+
+                        /* Timestamp correction, fine timestamping enabled */
+                        context.ftime_cfg.enable = true;
+                        corr = timestamp_counter_correction(&context, bw_list[b], sf, cr, (crc == 1), size, RX_DFT_PEAK_MODE_AUTO);
+                        corr_ref = ref_precision_correction(bw_list[b], sf, cr, (crc == 1), size);
+                        if (corr != corr_ref) {
+                            printf("ERROR: precision timestamp correction mismatch BW:0x%02X SF:%u CR:%u CRC:%u SIZE:%u => %d/%d us\n", bw_list[b], sf, cr, crc, size, corr, corr_ref);
+                            nb_err += 1;
+                        }
+                        nb_check += 1;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("%lu combinations checked, %d mismatch(es)\n", nb_check, nb_err);
+
+    return nb_err;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -89,12 +259,14 @@ int main(int argc, char **argv) {
     pkt.modulation = MOD_LORA;
 
     /* parse command line options */
-    while ((i = getopt_long (argc, argv, "hirs:b:z:l:c:", long_options, &option_index)) != -1) {
+    while ((i = getopt_long (argc, argv, "hirxs:b:z:l:c:", long_options, &option_index)) != -1) {
         switch (i) {
             case 'h':
                 usage();
                 return -1;
                 break;
+            case 'x':
+                return (check_tables() == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
             case 'i':
                 pkt.no_header = true;
                 break;
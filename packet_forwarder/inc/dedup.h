@@ -0,0 +1,94 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    LoRa concentrator : de-duplication of uplinks received by several
+    concentrator cards
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORA_PKTFWD_DEDUP_H
+#define _LORA_PKTFWD_DEDUP_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define DEDUP_QUEUE_MAX     512     /* Maximum number of uplinks held in the de-duplication stage */
+#define DEDUP_WINDOW_US     20000   /* Maximum reception time difference between 2 copies of the same uplink */
+#define DEDUP_HOLD_US       50000   /* Time an uplink is held, waiting for copies from other cards, before being forwarded */
+#define DEDUP_REF_CARD      0       /* Card whose timestamp is used for forwarded uplinks when it heard them */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+struct dedup_stat_s {
+    uint32_t nb_pkt_in;             /* Number of uplinks pushed by the cards */
+    uint32_t nb_pkt_out;            /* Number of uplinks forwarded after de-duplication */
+    uint32_t nb_pkt_dup;            /* Number of copies removed */
+    uint32_t nb_pkt_drop;           /* Number of uplinks dropped because the stage was full */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Initialize the de-duplication stage, dropping all the uplinks held.
+*/
+void dedup_init(void);
+
+/**
+@brief Push an uplink received by a card in the de-duplication stage
+
+@param card[in] Index of the card which received the uplink
+@param pkt[in] Received uplink metadata
+@param payload[in] Received uplink payload
+@param rx_time_us[in] Reception time of the uplink, in microseconds, in a time base common to all cards
+@param now_us[in] Current time, in microseconds, same time base as rx_time_us
+@return 0 if the uplink is held (new uplink or copy merged), -1 if it has been dropped
+
+If a copy of this uplink is already held (same payload CRC and hash, same size
+and datarate, received within DEDUP_WINDOW_US), the best copy is kept: CRC OK
+first, then best SNR (LoRa) or best RSSI (FSK).
+*/
+int dedup_push(uint8_t card, const struct lgw_pkt_rx_meta_s *pkt, const uint8_t *payload, uint64_t rx_time_us, uint64_t now_us);
+
+/**
+@brief Get the uplinks which have been held long enough to be forwarded
+
+@param max_pkt[in] Maximum number of uplinks to be returned
+@param pkt[out] Array of uplinks metadata to be forwarded, sorted by reception time
+@param payload[out] Payload arena, at least LGW_RX_PAYLOAD_ARENA_SIZE(max_pkt) bytes
+@param card[out] Array of card indexes, card whose timestamp is given in pkt[].count_us
+@param now_us[in] Current time, in microseconds, same time base as rx_time_us
+@return the number of uplinks returned
+
+When the reference card (DEDUP_REF_CARD) received a copy of an uplink, its
+timestamp is used for the forwarded uplink, whatever the copy kept for the
+RF metadata, so that it can be used for downlink scheduling.
+*/
+int dedup_pop(int max_pkt, struct lgw_pkt_rx_meta_s *pkt, uint8_t *payload, uint8_t *card, uint64_t now_us);
+
+/**
+@brief Get and reset the de-duplication statistics
+
+@param stat[out] Statistics since last call
+*/
+void dedup_get_stat(struct dedup_stat_s *stat);
+
+#endif
+/* --- EOF ------------------------------------------------------------------ */
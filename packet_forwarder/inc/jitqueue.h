@@ -30,6 +30,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #define JIT_QUEUE_MAX           32  /* Maximum number of packets to be stored in JiT queue */
 #define JIT_NUM_BEACON_IN_QUEUE 3   /* Number of beacons to be loaded in JiT queue at any time */
+#define JIT_DELAY_MIN           15000   /* Minimum TX pre-delay in us: JIT thread period (10ms) with some margin */
+#define JIT_DELAY_MAX           1000000 /* Maximum TX pre-delay in us */
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
@@ -99,6 +101,18 @@ This function is used to reset every elements in the allocated queue.
 */
 void jit_queue_init(struct jit_queue_s *queue);
 
+/**
+@brief Set the pre-delay used to program packets for TX, for all the queues
+
+@param delay_us[in] Time before its timestamp at which a packet is peeked, in us (40000 by default)
+@return 0 if successful, -1 if out of [JIT_DELAY_MIN;JIT_DELAY_MAX]
+
+It has to cover the JIT thread period, the time the concentrator lock can be
+held by another thread, and the programming of the TX. To be set before the
+queues are used.
+*/
+int jit_set_delay(uint32_t delay_us);
+
 /**
 @brief Add a packet in a Just-in-Time queue
 
@@ -142,6 +156,19 @@ enough the current concentrator time.
 */
 enum jit_error_e jit_peek(struct jit_queue_s *queue, uint32_t time_us, int *pkt_idx);
 
+/**
+@brief Get the time left before the next packet of the JiT queue is peeked.
+
+@param queue[in] Just in Time queue to parse
+@param time_us[in] Current concentrator time
+@param gap_us[out] Time before the next packet is due for peeking, 0 if already due, UINT32_MAX if none
+@return success if the function was able to parse the queue.
+
+This function is typically used to fit background activities (spectral scan)
+between the downlinks, so that they do not have to be aborted.
+*/
+enum jit_error_e jit_get_gap(struct jit_queue_s *queue, uint32_t time_us, uint32_t *gap_us);
+
 /**
 @brief Debug function to print the queue's content on console
 
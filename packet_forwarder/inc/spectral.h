@@ -0,0 +1,126 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    LoRa concentrator : rolling RSSI histograms of the channels monitored by
+    the background spectral scan
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORA_PKTFWD_SPECTRAL_H
+#define _LORA_PKTFWD_SPECTRAL_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <time.h>       /* time_t */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define SPECTRAL_CHAN_MAX       64      /* Maximum number of channels monitored */
+#define SPECTRAL_CHAN_SPACING   200000  /* Spacing between 2 monitored channels, in Hz */
+#define SPECTRAL_RING_SIZE      16      /* Number of scan histograms kept per channel */
+
+#define SPECTRAL_LBT_CHAN_MAX   16      /* Number of frequencies whose LBT failures are tracked */
+#define SPECTRAL_LBT_PENALTY_DB 6       /* Interference score penalty of each recent LBT failure */
+#define SPECTRAL_LBT_COUNT_MAX  8       /* Maximum number of LBT failures counted in the score */
+#define SPECTRAL_LBT_HOLD_S     600     /* Time LBT failures are remembered after the last one */
+#define SPECTRAL_SCORE_PERCENT  90      /* RSSI percentile used as the base of the interference score */
+#define SPECTRAL_SELECT_MARGIN_DB 3     /* Score improvement required to move away from the default frequency */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Initialize the monitored channels, dropping all the histograms held.
+
+@param freq_hz_start[in] Frequency of the first channel, in Hz
+@param nb_chan[in] Number of channels, SPECTRAL_CHAN_SPACING apart
+@return 0 if successful, -1 if there are too many channels
+*/
+int spectral_init(uint32_t freq_hz_start, uint8_t nb_chan);
+
+/**
+@brief Add the result of a spectral scan to the histograms of a channel
+
+@param freq_hz[in] Frequency of the scanned channel, in Hz
+@param levels[in] RSSI thresholds, as returned by lgw_spectral_scan_get_results
+@param results[in] Number of RSSI points of each level, as returned by lgw_spectral_scan_get_results
+@return 0 if successful, -1 if the frequency is not a monitored channel
+
+The oldest histogram of the channel is replaced once SPECTRAL_RING_SIZE scans
+are held.
+*/
+int spectral_push(uint32_t freq_hz, const int16_t levels[LGW_SPECTRAL_SCAN_RESULT_SIZE], const uint16_t results[LGW_SPECTRAL_SCAN_RESULT_SIZE]);
+
+/**
+@brief Get a percentile of the RSSI measured on the channel closest to a frequency
+
+@param freq_hz[in] Frequency, in Hz
+@param percent[in] Percentile to be computed (0-100)
+@param level_dbm[out] RSSI level (bin threshold) at which percent% of the points measured is reached, from the lowest level
+@return 0 if successful, -1 if no scan is held for that channel
+*/
+int spectral_get_percentile(uint32_t freq_hz, uint8_t percent, int16_t *level_dbm);
+
+/**
+@brief Account a TX blocked by Listen-Before-Talk on a frequency
+
+@param freq_hz[in] Frequency of the TX, in Hz
+@param now[in] Current time
+*/
+void spectral_lbt_busy(uint32_t freq_hz, time_t now);
+
+/**
+@brief Get the interference score of a frequency
+
+@param freq_hz[in] Frequency, in Hz
+@param now[in] Current time
+@param score_db[out] SPECTRAL_SCORE_PERCENT RSSI percentile of the channel, plus SPECTRAL_LBT_PENALTY_DB per recent LBT failure (the higher, the busier)
+@return 0 if successful, -1 if nothing is known about that frequency
+*/
+int spectral_get_score(uint32_t freq_hz, time_t now, int16_t *score_db);
+
+/**
+@brief Select the quietest of several frequencies a downlink can be sent on
+
+@param freq_hz[in] Array of frequencies, in Hz
+@param nb_freq[in] Number of frequencies
+@param default_idx[in] Index of the frequency used when there is no better choice
+@param now[in] Current time
+@return index of the selected frequency
+
+A frequency which was never scanned gets the worst score of the scanned ones,
+plus its LBT penalty. The default frequency is kept unless another one scores
+at least SPECTRAL_SELECT_MARGIN_DB better, or if nothing is known.
+*/
+int spectral_select(const uint32_t *freq_hz, int nb_freq, int default_idx, time_t now);
+
+/**
+@brief Generate the JSON status report of the monitored channels
+
+@param json[out] Buffer to receive the report (empty string if nothing to report)
+@param size[in] Size of the buffer
+@return the number of channels reported
+
+The report is an array with, for each channel scanned, its frequency, the
+number of scans held and the 10th, 50th and 90th percentiles of the RSSI:
+    ,"spectral":[{"freq":<Hz>,"n":<scans>,"p":[<p10>,<p50>,<p90>]},...]
+Channels which do not fit in the buffer are dropped.
+*/
+int spectral_report(char *json, int size);
+
+#endif
+/* --- EOF ------------------------------------------------------------------ */
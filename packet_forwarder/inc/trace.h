@@ -21,6 +21,7 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define DEBUG_JIT_ERROR 1
 #define DEBUG_TIMERSYNC 0
 #define DEBUG_BEACON    0
+#define DEBUG_GPS       0
 #define DEBUG_LOG       1
 
 #define MSG(args...) printf(args) /* message that is destined to the user */
@@ -0,0 +1,245 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    LoRa concentrator : de-duplication of uplinks received by several
+    concentrator cards
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf, fprintf */
+#include <string.h>     /* memset, memcpy, memcmp */
+#include <pthread.h>
+
+#include "trace.h"
+#include "dedup.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define DEDUP_KEEP_US       (2 * DEDUP_HOLD_US) /* Time a forwarded uplink is remembered, to drop late copies */
+
+struct dedup_node_s {
+    struct lgw_pkt_rx_meta_s pkt;   /* Best copy received so far */
+    uint8_t payload[LGW_PKT_PAYLOAD_MAX]; /* Payload of the uplink */
+    uint8_t card;                   /* Card which received the best copy */
+    uint32_t hash;                  /* Payload hash */
+    uint64_t rx_time_us;            /* Reception time of the first copy */
+    uint64_t arrival_us;            /* Time the first copy has been pushed */
+    bool ref_valid;                 /* Reference card received a copy */
+    uint32_t ref_count_us;          /* Timestamp of the reference card copy */
+    bool released;                  /* Uplink has been forwarded, only kept to drop late copies */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
+
+static pthread_mutex_t mx_dedup = PTHREAD_MUTEX_INITIALIZER; /* control access to the de-duplication stage */
+
+static uint16_t dedup_num_node = 0;
+static struct dedup_node_s dedup_nodes[DEDUP_QUEUE_MAX];
+static struct dedup_stat_s dedup_stat;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint32_t payload_hash(const uint8_t *data, uint16_t size) {
+    uint32_t hash = 2166136261u; /* FNV-1a */
+    uint16_t i;
+
+    for (i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static bool is_same_uplink(const struct dedup_node_s *node, const struct lgw_pkt_rx_meta_s *pkt, const uint8_t *payload, uint32_t hash, uint64_t rx_time_us) {
+    uint64_t diff_us;
+
+    diff_us = (rx_time_us > node->rx_time_us) ? (rx_time_us - node->rx_time_us) : (node->rx_time_us - rx_time_us);
+
+    return ((node->hash == hash) &&
+            (node->pkt.crc == pkt->crc) &&
+            (node->pkt.size == pkt->size) &&
+            (node->pkt.modulation == pkt->modulation) &&
+            (node->pkt.datarate == pkt->datarate) &&
+            (diff_us <= DEDUP_WINDOW_US) &&
+            (memcmp(node->payload, payload, pkt->size) == 0));
+}
+
+static bool is_better_copy(const struct lgw_pkt_rx_meta_s *p1, const struct lgw_pkt_rx_meta_s *p2) {
+    /* A copy with a valid CRC is always preferred */
+    if ((p1->status == STAT_CRC_OK) && (p2->status != STAT_CRC_OK)) {
+        return true;
+    } else if ((p1->status != STAT_CRC_OK) && (p2->status == STAT_CRC_OK)) {
+        return false;
+    }
+
+    if (p1->modulation == MOD_LORA) {
+        return (p1->snr > p2->snr);
+    } else {
+        return (p1->rssic > p2->rssic);
+    }
+}
+
+static void purge_released(uint64_t now_us) {
+    int i = 0;
+
+    while (i < dedup_num_node) {
+        if ((dedup_nodes[i].released == true) && ((now_us - dedup_nodes[i].arrival_us) > DEDUP_KEEP_US)) {
+            /* replace it with the last node (order does not matter) */
+            dedup_num_node -= 1;
+            if (i < dedup_num_node) {
+                memcpy(&dedup_nodes[i], &dedup_nodes[dedup_num_node], sizeof dedup_nodes[i]);
+            }
+        } else {
+            i++;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ----------------------------------------- */
+
+void dedup_init(void) {
+    pthread_mutex_lock(&mx_dedup);
+
+    dedup_num_node = 0;
+    memset(&dedup_stat, 0, sizeof dedup_stat);
+
+    pthread_mutex_unlock(&mx_dedup);
+}
+
+int dedup_push(uint8_t card, const struct lgw_pkt_rx_meta_s *pkt, const uint8_t *payload, uint64_t rx_time_us, uint64_t now_us) {
+    struct dedup_node_s *node;
+    uint32_t hash;
+    int i;
+
+    hash = payload_hash(payload, pkt->size);
+
+    pthread_mutex_lock(&mx_dedup);
+
+    dedup_stat.nb_pkt_in += 1;
+    purge_released(now_us);
+
+    /* Search for a copy already held */
+    for (i = 0; i < dedup_num_node; i++) {
+        node = &dedup_nodes[i];
+        if (is_same_uplink(node, pkt, payload, hash, rx_time_us) == false) {
+            continue;
+        }
+
+        dedup_stat.nb_pkt_dup += 1;
+        if (node->released == true) {
+            MSG_DEBUG(DEBUG_PKT_FWD, "late copy from card %u dropped (count_us=%u)\n", card, pkt->count_us);
+        } else {
+            if ((card == DEDUP_REF_CARD) && (node->ref_valid == false)) {
+                node->ref_valid = true;
+                node->ref_count_us = pkt->count_us;
+            }
+            if (is_better_copy(pkt, &node->pkt) == true) {
+                memcpy(&node->pkt, pkt, sizeof node->pkt);
+                node->card = card;
+            }
+            MSG_DEBUG(DEBUG_PKT_FWD, "copy from card %u merged (count_us=%u, best card %u)\n", card, pkt->count_us, node->card);
+        }
+        pthread_mutex_unlock(&mx_dedup);
+        return 0;
+    }
+
+    /* New uplink */
+    if (dedup_num_node == DEDUP_QUEUE_MAX) {
+        dedup_stat.nb_pkt_drop += 1;
+        pthread_mutex_unlock(&mx_dedup);
+        MSG("WARNING: [dedup] stage is full, uplink from card %u dropped\n", card);
+        return -1;
+    }
+    node = &dedup_nodes[dedup_num_node];
+    memcpy(&node->pkt, pkt, sizeof node->pkt);
+    memcpy(node->payload, payload, pkt->size);
+    node->card = card;
+    node->hash = hash;
+    node->rx_time_us = rx_time_us;
+    node->arrival_us = now_us;
+    node->ref_valid = (card == DEDUP_REF_CARD);
+    node->ref_count_us = pkt->count_us;
+    node->released = false;
+    dedup_num_node += 1;
+
+    pthread_mutex_unlock(&mx_dedup);
+
+    return 0;
+}
+
+int dedup_pop(int max_pkt, struct lgw_pkt_rx_meta_s *pkt, uint8_t *payload, uint8_t *card, uint64_t now_us) {
+    uint16_t idx[DEDUP_QUEUE_MAX];
+    uint16_t tmp;
+    uint16_t offset = 0;
+    int nb_pkt = 0;
+    int i, j;
+
+    pthread_mutex_lock(&mx_dedup);
+
+    purge_released(now_us);
+
+    /* Select the uplinks which have been held long enough */
+    for (i = 0; (i < dedup_num_node) && (nb_pkt < max_pkt); i++) {
+        if ((dedup_nodes[i].released == false) && ((now_us - dedup_nodes[i].arrival_us) >= DEDUP_HOLD_US)) {
+            idx[nb_pkt++] = (uint16_t)i;
+        }
+    }
+
+    /* Sort them by reception time (few elements, insertion sort) */
+    for (i = 1; i < nb_pkt; i++) {
+        tmp = idx[i];
+        for (j = i; (j > 0) && (dedup_nodes[idx[j - 1]].rx_time_us > dedup_nodes[tmp].rx_time_us); j--) {
+            idx[j] = idx[j - 1];
+        }
+        idx[j] = tmp;
+    }
+
+    for (i = 0; i < nb_pkt; i++) {
+        struct dedup_node_s *node = &dedup_nodes[idx[i]];
+
+        memcpy(&pkt[i], &node->pkt, sizeof pkt[i]);
+        memcpy(payload + offset, node->payload, node->pkt.size);
+        pkt[i].payload_offset = offset;
+        offset += node->pkt.size;
+        if (node->ref_valid == true) {
+            pkt[i].count_us = node->ref_count_us;
+            card[i] = DEDUP_REF_CARD;
+        } else {
+            card[i] = node->card;
+        }
+        node->released = true;
+    }
+    dedup_stat.nb_pkt_out += nb_pkt;
+
+    pthread_mutex_unlock(&mx_dedup);
+
+    return nb_pkt;
+}
+
+void dedup_get_stat(struct dedup_stat_s *stat) {
+    pthread_mutex_lock(&mx_dedup);
+
+    *stat = dedup_stat;
+    memset(&dedup_stat, 0, sizeof dedup_stat);
+
+    pthread_mutex_unlock(&mx_dedup);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
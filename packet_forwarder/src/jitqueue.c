@@ -33,9 +33,14 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
 #define TX_START_DELAY          1500    /* microseconds */
 #define TX_MARGIN_DELAY         1000    /* Packet overlap margin in microseconds */
-#define TX_JIT_DELAY            40000   /* Pre-delay to program packet for TX in microseconds */
+#define TX_STAGE_DELAY          (LGW_TX_STAGE_ADVANCE_MIN + 3000) /* Min gap before a packet staged behind another: HAL commit advance + end of TX detection, in microseconds */
+#define TX_JIT_DELAY            40000   /* Default pre-delay to program packet for TX in microseconds (see jit_set_delay) */
 #define TX_MAX_ADVANCE_DELAY    ((JIT_NUM_BEACON_IN_QUEUE + 1) * 128 * 1E6) /* Maximum advance delay accepted for a TX packet, compared to current time */
 
+#if ((TX_START_DELAY + JIT_DELAY_MIN) < TX_STAGE_DELAY)
+    #error "the JIT pre-delay of a downlink must leave time to stage it behind the previous one"
+#endif
+
 #define BEACON_GUARD            3000000 /* Interval where no ping slot can be placed,
                                             to ensure beacon can be sent */
 #define BEACON_RESERVED         2120000 /* Time on air of the beacon, with some margin */
@@ -44,12 +49,27 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 static pthread_mutex_t mx_jit_queue = PTHREAD_MUTEX_INITIALIZER; /* control access to JIT queue */
 
+static uint32_t jit_delay_us = TX_JIT_DELAY; /* pre-delay to program packet for TX, common to all queues */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ----------------------------------------- */
 
+int jit_set_delay(uint32_t delay_us) {
+    if ((delay_us < JIT_DELAY_MIN) || (delay_us > JIT_DELAY_MAX)) {
+        MSG("ERROR: JIT pre-delay %u us out of range [%u;%u]\n", delay_us, JIT_DELAY_MIN, JIT_DELAY_MAX);
+        return -1;
+    }
+
+    pthread_mutex_lock(&mx_jit_queue);
+    jit_delay_us = delay_us;
+    pthread_mutex_unlock(&mx_jit_queue);
+
+    return 0;
+}
+
 bool jit_queue_is_full(struct jit_queue_s *queue) {
     bool result;
 
@@ -150,12 +170,12 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct
         case JIT_PKT_TYPE_DOWNLINK_CLASS_A:
         case JIT_PKT_TYPE_DOWNLINK_CLASS_B:
         case JIT_PKT_TYPE_DOWNLINK_CLASS_C:
-            packet_pre_delay = TX_START_DELAY + TX_JIT_DELAY;
+            packet_pre_delay = TX_START_DELAY + jit_delay_us;
             packet_post_delay = lgw_time_on_air(packet) * 1000UL; /* in us */
             break;
         case JIT_PKT_TYPE_BEACON:
             /* As defined in LoRaWAN spec */
-            packet_pre_delay = TX_START_DELAY + BEACON_GUARD + TX_JIT_DELAY;
+            packet_pre_delay = TX_START_DELAY + BEACON_GUARD + jit_delay_us;
             packet_post_delay = BEACON_RESERVED;
             break;
         default:
@@ -171,7 +191,7 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct
         packet->tx_mode = TIMESTAMPED;
 
         /* Search for the ASAP timestamp to be given to the packet */
-        asap_count_us = time_us + 2 * TX_JIT_DELAY; /* margin */
+        asap_count_us = time_us + 2 * jit_delay_us; /* margin */
         if (queue->num_pkt == 0) {
             /* If the jit queue is empty, we can insert this packet */
             MSG_DEBUG(DEBUG_JIT, "DEBUG: insert IMMEDIATE downlink, first in JiT queue (count_us=%u)\n", asap_count_us);
@@ -195,7 +215,7 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct
             } else {
                 /* Search for the best slot then */
                 for (i=0; i<queue->num_pkt; i++) {
-                    asap_count_us = queue->nodes[i].pkt.count_us + queue->nodes[i].post_delay + packet_pre_delay + TX_JIT_DELAY + TX_MARGIN_DELAY;
+                    asap_count_us = queue->nodes[i].pkt.count_us + queue->nodes[i].post_delay + packet_pre_delay + jit_delay_us + TX_MARGIN_DELAY;
                     if (i == (queue->num_pkt - 1)) {
                         /* Last packet index, we can insert after this one */
                         MSG_DEBUG(DEBUG_JIT, "DEBUG: insert IMMEDIATE downlink, last in JiT queue (count_us=%u)\n", asap_count_us);
@@ -225,7 +245,7 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct
      *  Warning: unsigned arithmetic (handle roll-over)
      *      t_packet < t_current + TX_START_DELAY + MARGIN
      */
-    if ((packet->count_us - time_us) <= (TX_START_DELAY + TX_MARGIN_DELAY + TX_JIT_DELAY)) {
+    if ((packet->count_us - time_us) <= (TX_START_DELAY + TX_MARGIN_DELAY + jit_delay_us)) {
         MSG_DEBUG(DEBUG_JIT_ERROR, "ERROR: Packet REJECTED, already too late to send it (current=%u, packet=%u, type=%d)\n", time_us, packet->count_us, pkt_type);
         pthread_mutex_unlock(&mx_jit_queue);
         return JIT_ERROR_TOO_LATE;
@@ -256,9 +276,10 @@ enum jit_error_e jit_enqueue(struct jit_queue_s *queue, uint32_t time_us, struct
      *        - Beacon guard can be ignored if we try to queue a Class A downlink
      */
     for (i=0; i<queue->num_pkt; i++) {
-        /* We ignore Beacon Guard for Class A/C downlinks */
+        /* We ignore Beacon Guard for Class A/C downlinks, but the beacon may have to be
+         * staged behind the downlink, and committed as soon as it ends */
         if (((pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_A) || (pkt_type == JIT_PKT_TYPE_DOWNLINK_CLASS_C)) && (queue->nodes[i].pkt_type == JIT_PKT_TYPE_BEACON)) {
-            target_pre_delay = TX_START_DELAY;
+            target_pre_delay = TX_STAGE_DELAY;
         } else {
             target_pre_delay = queue->nodes[i].pre_delay;
         }
@@ -415,11 +436,11 @@ enum jit_error_e jit_peek(struct jit_queue_s *queue, uint32_t time_us, int *pkt_
         }
     }
 
-    /* Peek criteria 1: look for a packet to be sent in next TX_JIT_DELAY ms timeframe
+    /* Peek criteria 1: look for a packet to be sent in next jit_delay_us timeframe
      *  Warning: unsigned arithmetic (handle roll-over)
-     *      t_packet < t_current + TX_JIT_DELAY
+     *      t_packet < t_current + jit_delay_us
      */
-    if ((queue->nodes[idx_highest_priority].pkt.count_us - time_us) < TX_JIT_DELAY) {
+    if ((queue->nodes[idx_highest_priority].pkt.count_us - time_us) < jit_delay_us) {
         *pkt_idx = idx_highest_priority;
         MSG_DEBUG(DEBUG_JIT, "peek packet with count_us=%u at index %d\n",
             queue->nodes[idx_highest_priority].pkt.count_us, idx_highest_priority);
@@ -432,6 +453,37 @@ enum jit_error_e jit_peek(struct jit_queue_s *queue, uint32_t time_us, int *pkt_
     return JIT_ERROR_OK;
 }
 
+enum jit_error_e jit_get_gap(struct jit_queue_s *queue, uint32_t time_us, uint32_t *gap_us) {
+    int i;
+    uint32_t delta;
+
+    if (gap_us == NULL) {
+        MSG("ERROR: invalid parameter\n");
+        return JIT_ERROR_INVALID;
+    }
+
+    pthread_mutex_lock(&mx_jit_queue);
+
+    /* Closest packet to be peeked (jit_delay_us before its timestamp)
+     *  Warning: unsigned arithmetic (handle roll-over), outdated packets are
+     *  left to jit_peek */
+    *gap_us = UINT32_MAX;
+    for (i = 0; i < queue->num_pkt; i++) {
+        delta = queue->nodes[i].pkt.count_us - time_us;
+        if (delta >= TX_MAX_ADVANCE_DELAY) {
+            continue;
+        }
+        delta = (delta > jit_delay_us) ? (delta - jit_delay_us) : 0;
+        if (delta < *gap_us) {
+            *gap_us = delta;
+        }
+    }
+
+    pthread_mutex_unlock(&mx_jit_queue);
+
+    return JIT_ERROR_OK;
+}
+
 void jit_print_queue(struct jit_queue_s *queue, bool show_all, int debug_level) {
     int i = 0;
     int loop_end;
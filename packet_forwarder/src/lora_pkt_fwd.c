@@ -48,6 +48,8 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #include "trace.h"
 #include "jitqueue.h"
+#include "dedup.h"
+#include "spectral.h"
 #include "parson.h"
 #include "base64.h"
 #include "loragw_hal.h"
@@ -81,8 +83,14 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define PUSH_TIMEOUT_MS     100
 #define PULL_TIMEOUT_MS     200
 #define GPS_REF_MAX_AGE     30          /* maximum admitted delay in seconds of GPS loss before considering latest GPS sync unusable */
+#define GPS_HOLDOVER_MAX_US 20          /* maximum estimated time error in us of the time model to keep on using it without GPS (about 200 s of GPS loss, well below half the counter wrap) */
 #define FETCH_SLEEP_MS      10          /* nb of ms waited when a fetch return no packets */
-#define BEACON_POLL_MS      50          /* time in ms between polling of beacon TX status */
+#define JIT_SLEEP_MS        10          /* max time in ms between two runs of the JIT thread */
+#define SCAN_DURATION_MS    100         /* initial estimate of a spectral scan duration, then measured */
+#define SCAN_GUARD_MS       20          /* margin between the end of a spectral scan and the next downlink */
+#define SCAN_RETRY_MS       1000        /* time in ms before retrying a spectral scan which did not fit (baseline pace, each retry accesses the bus) */
+#define SCAN_POLL_MS        10          /* time in ms between polling of spectral scan status */
+#define TX_FREQ_ALT_MAX     8           /* max number of alternative frequencies of a class C downlink */
 
 #define PROTOCOL_VERSION    2           /* v1.6 */
 #define PROTOCOL_JSON_RXPK_FRAME_FORMAT 1
@@ -99,12 +107,18 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 
 #define NB_PKT_MAX      255 /* max number of packets per fetch/send cycle */
 
+#define NB_CARD_MAX     4   /* max number of concentrator cards driven by the packet forwarder */
+
 #define MIN_LORA_PREAMB 6 /* minimum Lora preamble length for this application */
 #define STD_LORA_PREAMB 8
 #define MIN_FSK_PREAMB  3 /* minimum FSK preamble length for this application */
 #define STD_FSK_PREAMB  5
 
-#define STATUS_SIZE     200
+#define PERF_SIZE       2000 /* HAL performance counters part of the status report */
+#define BUS_SUB_SIZE    200  /* bus counters of one HAL subsystem, all counters at their max */
+#define BUS_SIZE        (10 + NB_CARD_MAX * (20 + LGW_COM_SUB_NB * BUS_SUB_SIZE)) /* HAL bus transactions counters part of the status report, for all the cards */
+#define SPECTRAL_SIZE   1500 /* spectral scan percentiles part of the status report */
+#define STATUS_SIZE     (200 + PERF_SIZE + BUS_SIZE + SPECTRAL_SIZE)
 #define TX_BUFF_SIZE    ((540 * NB_PKT_MAX) + 30 + STATUS_SIZE)
 #define ACK_BUFF_SIZE   64
 
@@ -131,6 +145,14 @@ typedef struct spectral_scan_s {
     uint32_t pace_s;        /* number of seconds between 2 scans in the thread */
 } spectral_scan_t;
 
+/* GPS time reference and XTAL correction, as seen by the readers */
+struct timeref_s {
+    struct tref gps;        /* time reference used for GPS <-> timestamp conversion */
+    bool gps_valid;         /* is GPS reference acceptable (ie. not too old) */
+    double xtal_correct;    /* XTAL correction factor of TX frequencies */
+    bool xtal_correct_ok;   /* is XTAL correction stable enough */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 
@@ -152,6 +174,7 @@ static int keepalive_time = DEFAULT_KEEPALIVE; /* send a PULL_DATA request every
 
 /* statistics collection configuration variables */
 static unsigned stat_interval = DEFAULT_STAT; /* time interval (in sec) at which statistics are collected and displayed */
+static bool perf_stats = true; /* HAL performance counters are displayed and reported in statistics */
 
 /* gateway <-> MAC protocol variables */
 static uint32_t net_mac_h; /* Most Significant Nibble, network order */
@@ -167,9 +190,8 @@ static struct timeval pull_timeout = {0, (PULL_TIMEOUT_MS * 1000)}; /* non criti
 
 /* hardware access control and correction */
 pthread_mutex_t mx_concent = PTHREAD_MUTEX_INITIALIZER; /* control access to the concentrator */
-static pthread_mutex_t mx_xcorr = PTHREAD_MUTEX_INITIALIZER; /* control access to the XTAL correction */
-static bool xtal_correct_ok = false; /* set true when XTAL correction is stable enough */
-static double xtal_correct = 1.0;
+static bool xtal_correct_ok = false; /* set true when XTAL correction is stable enough (written under mx_timeref) */
+static double xtal_correct = 1.0; /* (written under mx_timeref) */
 
 /* GPS configuration and synchronization */
 static char gps_tty_path[64] = "\0"; /* path of the TTY port GPS is connected on */
@@ -177,10 +199,19 @@ static int gps_tty_fd = -1; /* file descriptor of the GPS TTY port */
 static bool gps_enabled = false; /* is GPS enabled on that gateway ? */
 
 /* GPS time reference */
-static pthread_mutex_t mx_timeref = PTHREAD_MUTEX_INITIALIZER; /* control access to GPS time reference */
+static pthread_mutex_t mx_timeref = PTHREAD_MUTEX_INITIALIZER; /* serialize the writers of the GPS time reference and XTAL correction */
 static bool gps_ref_valid; /* is GPS reference acceptable (ie. not too old) */
 static struct tref time_reference_gps; /* time reference used for GPS <-> timestamp conversion */
 
+/* Copy of the GPS time reference and XTAL correction published to the other
+ * threads, which read it without locking (sequence lock) */
+static uint32_t timeref_seq = 0; /* odd while the copy is being written */
+static struct timeref_s timeref_pub = {
+    .gps_valid = false,
+    .xtal_correct = 1.0,
+    .xtal_correct_ok = false
+};
+
 /* Reference coordinates, for broadcasting (beacon) */
 static struct coord_s reference_coord;
 
@@ -230,6 +261,7 @@ static uint32_t beacon_period = 0; /* set beaconing period, must be a sub-multip
 static uint32_t beacon_freq_hz = DEFAULT_BEACON_FREQ_HZ; /* set beacon TX frequency, in Hz */
 static uint8_t beacon_freq_nb = DEFAULT_BEACON_FREQ_NB; /* set number of beaconing channels beacon */
 static uint32_t beacon_freq_step = DEFAULT_BEACON_FREQ_STEP; /* set frequency step between beacon channels, in Hz */
+static bool beacon_freq_select = false; /* emit beacons on the quietest channel instead of hopping */
 static uint8_t beacon_datarate = DEFAULT_BEACON_DATARATE; /* set beacon datarate (SF) */
 static uint32_t beacon_bw_hz = DEFAULT_BEACON_BW_HZ; /* set beacon bandwidth, in Hz */
 static int8_t beacon_power = DEFAULT_BEACON_POWER; /* set beacon TX power, in dBm */
@@ -249,6 +281,8 @@ static struct lgw_tx_gain_lut_s txlut[LGW_RF_CHAIN_NB]; /* TX gain table */
 static uint32_t tx_freq_min[LGW_RF_CHAIN_NB]; /* lowest frequency supported by TX chain */
 static uint32_t tx_freq_max[LGW_RF_CHAIN_NB]; /* highest frequency supported by TX chain */
 static bool tx_enable[LGW_RF_CHAIN_NB] = {false}; /* Is TX enabled for a given RF chain ? */
+static bool tx_staged[LGW_RF_CHAIN_NB] = {false}; /* Is a downlink waiting for the end of the current one ? (written under mx_concent) */
+static uint32_t tx_staged_freq[LGW_RF_CHAIN_NB]; /* frequency of the staged downlink, to account LBT failures */
 
 static uint32_t nb_pkt_log[LGW_IF_CHAIN_NB][8]; /* [CH][SF] */
 static uint32_t nb_pkt_received_lora = 0;
@@ -260,6 +294,16 @@ static uint32_t nb_pkt_received_ref[16];
 /* Interface type */
 static lgw_com_type_t com_type = LGW_COM_SPI;
 
+/* Concentrator cards (card 0 is the default HAL instance, the only one used for TX) */
+static uint8_t nb_card = 1;
+static lgw_handle_t * card_handle[NB_CARD_MAX];
+static uint8_t card_index[NB_CARD_MAX] = {0, 1, 2, 3}; /* thread arguments */
+
+/* Concentrator counter <-> host time reference of each card, updated on every fetch */
+static pthread_mutex_t mx_card_timeref = PTHREAD_MUTEX_INITIALIZER; /* control access to the cards time reference */
+static uint32_t card_timeref_cnt[NB_CARD_MAX]; /* concentrator counter, in us */
+static uint64_t card_timeref_host[NB_CARD_MAX]; /* host monotonic time, in us */
+
 /* Spectral Scan */
 static spectral_scan_t spectral_scan_params = {
     .enable = false,
@@ -276,7 +320,7 @@ static void usage(void);
 
 static void sig_handler(int sigio);
 
-static int parse_SX130x_configuration(const char * conf_file);
+static int parse_SX130x_configuration(const char * conf_file, uint8_t card);
 
 static int parse_gateway_configuration(const char * conf_file);
 
@@ -290,9 +334,21 @@ static void gps_process_sync(void);
 
 static void gps_process_coords(void);
 
-static int get_tx_gain_lut_index(uint8_t rf_chain, int8_t rf_power, uint8_t * lut_index);
+static uint64_t host_time_us(void);
+
+static void timeref_publish(void);
+static void timeref_get(struct timeref_s * ref);
+
+static uint32_t card_cnt_to_ref(uint8_t card, uint32_t count_us);
+
+static void perf_report(char * json, int size);
+static void bus_report(char * json, int size);
+
+static void jit_dispatch(int rf_chain);
+static void jit_tx_event(uint8_t rf_chain, uint8_t status, void * arg);
 
 /* threads */
+void * thread_fetch(void * arg);
 void thread_up(void);
 void thread_down(void);
 void thread_jit(void);
@@ -322,11 +378,11 @@ static void sig_handler(int sigio) {
     return;
 }
 
-static int parse_SX130x_configuration(const char * conf_file) {
+static int parse_SX130x_configuration(const char * conf_file, uint8_t card) {
     int i, j, number;
     char param_name[32]; /* used to generate variable parameter names */
     const char *str; /* used to store string value from JSON object */
-    const char conf_obj_name[] = "SX130x_conf";
+    char conf_obj_name[16];
     JSON_Value *root_val = NULL;
     JSON_Value *val = NULL;
     JSON_Object *conf_obj = NULL;
@@ -357,11 +413,17 @@ static int parse_SX130x_configuration(const char * conf_file) {
         exit(EXIT_FAILURE);
     }
 
-    /* point to the gateway configuration object */
+    /* point to the gateway configuration object (SX130x_conf for first card, SX130x_conf_<n> for the others) */
+    if (card == 0) {
+        snprintf(conf_obj_name, sizeof conf_obj_name, "SX130x_conf");
+    } else {
+        snprintf(conf_obj_name, sizeof conf_obj_name, "SX130x_conf_%u", card);
+    }
     conf_obj = json_object_get_object(json_value_get_object(root_val), conf_obj_name);
     if (conf_obj == NULL) {
         MSG("INFO: %s does not contain a JSON object named %s\n", conf_file, conf_obj_name);
-        return -1;
+        json_value_free(root_val);
+        return (card == 0) ? -1 : 1;
     } else {
         MSG("INFO: %s does contain a JSON object named %s, parsing SX1302 parameters\n", conf_file, conf_obj_name);
     }
@@ -376,11 +438,19 @@ static int parse_SX130x_configuration(const char * conf_file) {
         boardconf.com_type = LGW_COM_SPI;
     } else if (!strncmp(str, "USB", 3) || !strncmp(str, "usb", 3)) {
         boardconf.com_type = LGW_COM_USB;
+    } else if (!strncmp(str, "MOCK", 4) || !strncmp(str, "mock", 4)) {
+        boardconf.com_type = LGW_COM_MOCK;
     } else {
-        MSG("ERROR: invalid com type: %s (should be SPI or USB)\n", str);
+        MSG("ERROR: invalid com type: %s (should be SPI, USB or MOCK)\n", str);
+        return -1;
+    }
+    if (card == 0) {
+        com_type = boardconf.com_type;
+    } else if (boardconf.com_type == LGW_COM_SPI) {
+        /* reset_lgw.sh only drives the reset pins of the first board */
+        MSG("ERROR: %s: SPI is not supported for additional boards, there is no reset handling for them (use USB)\n", conf_obj_name);
         return -1;
     }
-    com_type = boardconf.com_type;
     str = json_object_get_string(conf_obj, "com_path");
     if (str != NULL) {
         strncpy(boardconf.com_path, str, sizeof boardconf.com_path);
@@ -410,16 +480,16 @@ static int parse_SX130x_configuration(const char * conf_file) {
         MSG("WARNING: Data type for full_duplex seems wrong, please check\n");
         boardconf.full_duplex = false;
     }
-    MSG("INFO: com_type %s, com_path %s, lorawan_public %d, clksrc %d, full_duplex %d\n", (boardconf.com_type == LGW_COM_SPI) ? "SPI" : "USB", boardconf.com_path, boardconf.lorawan_public, boardconf.clksrc, boardconf.full_duplex);
+    MSG("INFO: com_type %s, com_path %s, lorawan_public %d, clksrc %d, full_duplex %d\n", (boardconf.com_type == LGW_COM_SPI) ? "SPI" : ((boardconf.com_type == LGW_COM_USB) ? "USB" : "MOCK"), boardconf.com_path, boardconf.lorawan_public, boardconf.clksrc, boardconf.full_duplex);
     /* all parameters parsed, submitting configuration to the HAL */
     if (lgw_board_setconf(&boardconf) != LGW_HAL_SUCCESS) {
         MSG("ERROR: Failed to configure board\n");
         return -1;
     }
 
-    /* set antenna gain configuration */
+    /* set antenna gain configuration (TX only, first card) */
     val = json_object_get_value(conf_obj, "antenna_gain"); /* fetch value (if possible) */
-    if (val != NULL) {
+    if ((val != NULL) && (card == 0)) {
         if (json_value_get_type(val) == JSONNumber) {
             antenna_gain = (int8_t)json_value_get_number(val);
         } else {
@@ -494,7 +564,9 @@ static int parse_SX130x_configuration(const char * conf_file) {
             MSG("INFO: no configuration for Spectral Scan\n");
         } else {
             val = json_object_get_value(conf_scan_obj, "enable"); /* fetch value (if possible) */
-            if (json_value_get_type(val) == JSONBoolean) {
+            if (card != 0) {
+                MSG("WARNING: Spectral Scan is only supported on first card, ignored\n");
+            } else if (json_value_get_type(val) == JSONBoolean) {
                 /* Enable background spectral scan thread in packet forwarder */
                 spectral_scan_params.enable = (bool)json_value_get_boolean(val);
             } else {
@@ -705,7 +777,10 @@ static int parse_SX130x_configuration(const char * conf_file) {
 
             snprintf(param_name, sizeof param_name, "radio_%i.tx_enable", i);
             val = json_object_dotget_value(conf_obj, param_name);
-            if (json_value_get_type(val) == JSONBoolean) {
+            if (card != 0) {
+                /* downlinks are only sent through the first card */
+                rfconf.tx_enable = false;
+            } else if (json_value_get_type(val) == JSONBoolean) {
                 rfconf.tx_enable = (bool)json_value_get_boolean(val);
                 tx_enable[i] = rfconf.tx_enable; /* update global context for later check */
                 if (rfconf.tx_enable == true) {
@@ -1076,6 +1151,22 @@ static int parse_gateway_configuration(const char * conf_file) {
         MSG("INFO: statistics display interval is configured to %u seconds\n", stat_interval);
     }
 
+    /* get HAL performance counters reporting (optional) */
+    val = json_object_get_value(conf_obj, "perf_stats");
+    if (json_value_get_type(val) == JSONBoolean) {
+        perf_stats = (bool)json_value_get_boolean(val);
+    }
+    MSG("INFO: HAL performance counters will%s be reported\n", (perf_stats ? "" : " NOT"));
+
+    /* get the JIT TX pre-delay (optional, to be measured on the target before lowering it) */
+    val = json_object_get_value(conf_obj, "jit_delay_us");
+    if (val != NULL) {
+        if (jit_set_delay((uint32_t)json_value_get_number(val)) != 0) {
+            return -1;
+        }
+        MSG("INFO: downlinks programmed %u us before their departure time\n", (uint32_t)json_value_get_number(val));
+    }
+
     /* get time-out value (in ms) for upstream datagrams (optional) */
     val = json_object_get_value(conf_obj, "push_timeout_ms");
     if (val != NULL) {
@@ -1169,6 +1260,15 @@ static int parse_gateway_configuration(const char * conf_file) {
         MSG("INFO: Beaconing channel frequency step is set to %uHz\n", beacon_freq_step);
     }
 
+    /* Beacon channel selected from the channels occupancy (optional) */
+    val = json_object_get_value(conf_obj, "beacon_freq_select");
+    if (json_value_get_type(val) == JSONBoolean) {
+        beacon_freq_select = (bool)json_value_get_boolean(val);
+        if (beacon_freq_select == true) {
+            MSG("INFO: Beaconing channel is the quietest one instead of hopping\n");
+        }
+    }
+
     /* Beacon datarate (optional) */
     val = json_object_get_value(conf_obj, "beacon_datarate");
     if (val != NULL) {
@@ -1418,6 +1518,164 @@ static int send_tx_ack(uint8_t token_h, uint8_t token_l, enum jit_error_e error,
     return send(sock_down, (void *)buff_ack, buff_index, 0);
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint64_t host_time_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * 1000000UL) + ((uint64_t)now.tv_nsec / 1000UL);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Publish the GPS time reference and XTAL correction, mx_timeref being locked */
+static void timeref_publish(void) {
+    uint32_t seq = __atomic_load_n(&timeref_seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&timeref_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); /* sequence odd before the copy is modified */
+    timeref_pub.gps = time_reference_gps;
+    timeref_pub.gps_valid = gps_ref_valid;
+    timeref_pub.xtal_correct = xtal_correct;
+    timeref_pub.xtal_correct_ok = xtal_correct_ok;
+    __atomic_store_n(&timeref_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Get a consistent copy of the published time reference, without blocking:
+ * the copy is done again if it was being written meanwhile */
+static void timeref_get(struct timeref_s * ref) {
+    uint32_t seq;
+
+    do {
+        seq = __atomic_load_n(&timeref_seq, __ATOMIC_ACQUIRE);
+        *ref = timeref_pub;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE); /* copy done before the sequence is checked again */
+    } while (((seq & 1) != 0) || (seq != __atomic_load_n(&timeref_seq, __ATOMIC_RELAXED)));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t card_cnt_to_ref(uint8_t card, uint32_t count_us) {
+    uint64_t host_us;
+    uint32_t ref_cnt;
+
+    /* Concentrator counters are not synchronized: go through the host time
+       reference recorded by each card on its last fetch */
+    pthread_mutex_lock(&mx_card_timeref);
+    host_us = card_timeref_host[card] - (uint32_t)(card_timeref_cnt[card] - count_us);
+    ref_cnt = card_timeref_cnt[0] + (uint32_t)(host_us - card_timeref_host[0]);
+    pthread_mutex_unlock(&mx_card_timeref);
+
+    return ref_cnt;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void perf_report(char * json, int size) {
+    struct lgw_perf_s perf[LGW_PERF_NB];
+    int i, j, k, n;
+    int last;
+    int index = 0;
+
+    json[0] = '\0';
+    if (lgw_perf_get(perf, true) != LGW_HAL_SUCCESS) {
+        return;
+    }
+
+    /* display a summary, and generate a JSON object with the call sites measured:
+        "perf":{"<call site>":{"n":<count>,"avg":<us>,"max":<us>,"hist":[<log2 buckets up to the last non-empty one>]},...} */
+    printf("### [PERF] ###\n");
+    n = snprintf(json, size, ",\"perf\":{");
+    for (i = 0, k = 0; i < LGW_PERF_NB; i++) {
+        if (perf[i].count == 0) {
+            continue;
+        }
+        printf("# %s: %u calls, avg %u us, max %u us\n", lgw_perf_name(i), perf[i].count, (uint32_t)(perf[i].total_us / perf[i].count), perf[i].max_us);
+        for (last = LGW_PERF_HIST_NB - 1; (last > 0) && (perf[i].hist[last] == 0); last--);
+        if ((n < 0) || (n >= (size - 2))) {
+            continue; /* no more space in JSON report, keep displaying */
+        }
+        index = n;
+        n += snprintf(json + n, size - n, "%s\"%s\":{\"n\":%u,\"avg\":%u,\"max\":%u,\"hist\":[", (k > 0) ? "," : "", lgw_perf_name(i), perf[i].count, (uint32_t)(perf[i].total_us / perf[i].count), perf[i].max_us);
+        for (j = 0; (j <= last) && (n < size); j++) {
+            n += snprintf(json + n, size - n, "%s%u", (j > 0) ? "," : "", perf[i].hist[j]);
+        }
+        if (n < (size - 4)) {
+            n += snprintf(json + n, size - n, "]}");
+            k += 1;
+        } else {
+            n = index; /* truncated, drop this call site */
+        }
+    }
+    if (k == 0) {
+        printf("# no call measured\n");
+        json[0] = '\0';
+    } else {
+        snprintf(json + n, size - n, "}");
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void bus_report(char * json, int size) {
+    struct lgw_com_stat_s stat[LGW_COM_SUB_NB];
+    lgw_com_type_t com_type;
+    int i, x;
+    int n = 0;
+
+    /* display a summary, and generate a JSON array with one object per card:
+        "bus":[{"com":"spi"|"usb","<subsystem>":{"n":<accesses>,"err":<errors>,"w":<bytes>,"r":<bytes>[,"req":<nb>,"ack":<nb>,"flush":<nb>,"ww":<bytes>,"wr":<bytes>]},...},...]
+       BUS_SIZE holds all the cards, the JSON array is only dropped if that does not hold anymore */
+    printf("### [BUS] ###\n");
+    n += snprintf(json + n, size - n, ",\"bus\":[");
+    for (x = 0; x < nb_card; x++) {
+        lgw_handle_select(card_handle[x]);
+        i = lgw_bus_stat_get(&com_type, stat, true);
+        lgw_handle_select(NULL);
+        if (i != LGW_HAL_SUCCESS) {
+            printf("# card %d: bus counters unavailable\n", x);
+            com_type = LGW_COM_UNKNOWN;
+            memset(stat, 0, sizeof stat);
+        }
+        if (n < size) {
+            n += snprintf(json + n, size - n, "%s{\"com\":\"%s\"", (x > 0) ? "," : "", (com_type == LGW_COM_USB) ? "usb" : ((com_type == LGW_COM_MOCK) ? "mock" : "spi"));
+        }
+        for (i = 0; i < LGW_COM_SUB_NB; i++) {
+            if ((stat[i].nb_access == 0) && (stat[i].usb_nb_req == 0)) {
+                continue;
+            }
+            printf("# card %d %s: %u accesses, %u errors, %llu bytes written, %llu bytes read", x, lgw_bus_subsystem_name(i), stat[i].nb_access, stat[i].nb_error, (unsigned long long)stat[i].data_w, (unsigned long long)stat[i].data_r);
+            if (n < size) {
+                n += snprintf(json + n, size - n, ",\"%s\":{\"n\":%u,\"err\":%u,\"w\":%llu,\"r\":%llu", lgw_bus_subsystem_name(i), stat[i].nb_access, stat[i].nb_error, (unsigned long long)stat[i].data_w, (unsigned long long)stat[i].data_r);
+            }
+            if (com_type == LGW_COM_USB) {
+                printf(", %u req, %u ack, %u bulk flushes, %llu/%llu bytes on wire (w/r)", stat[i].usb_nb_req, stat[i].usb_nb_ack, stat[i].usb_nb_flush, (unsigned long long)stat[i].usb_wire_w, (unsigned long long)stat[i].usb_wire_r);
+                if (n < size) {
+                    n += snprintf(json + n, size - n, ",\"req\":%u,\"ack\":%u,\"flush\":%u,\"ww\":%llu,\"wr\":%llu", stat[i].usb_nb_req, stat[i].usb_nb_ack, stat[i].usb_nb_flush, (unsigned long long)stat[i].usb_wire_w, (unsigned long long)stat[i].usb_wire_r);
+                }
+            }
+            printf("\n");
+            if (n < size) {
+                n += snprintf(json + n, size - n, "}");
+            }
+        }
+        if (n < size) {
+            n += snprintf(json + n, size - n, "}");
+        }
+    }
+    if (n < size) {
+        n += snprintf(json + n, size - n, "]");
+    }
+    if (n >= size) {
+        printf("WARNING: [main] bus counters of %d cards too large for the status report (%d bytes), dropped\n", nb_card, size);
+        json[0] = '\0';
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- MAIN FUNCTION -------------------------------------------------------- */
 
@@ -1439,6 +1697,7 @@ int main(int argc, char ** argv)
     pthread_t thrid_valid;
     pthread_t thrid_jit;
     pthread_t thrid_ss;
+    pthread_t thrid_fetch[NB_CARD_MAX];
 
     /* network socket creation */
     struct addrinfo hints;
@@ -1472,10 +1731,15 @@ int main(int argc, char ** argv)
     uint32_t cp_nb_beacon_queued = 0;
     uint32_t cp_nb_beacon_sent = 0;
     uint32_t cp_nb_beacon_rejected = 0;
+    struct dedup_stat_s dedup_stat;
+    char perf_json[PERF_SIZE];
+    char bus_json[BUS_SIZE];
+    char spectral_json[SPECTRAL_SIZE];
 
     /* GPS coordinates variables */
     bool coord_ok = false;
     struct coord_s cp_gps_coord = {0.0, 0.0, 0};
+    struct timeref_s cp_timeref;
 
     /* SX1302 data variables */
     uint32_t trig_tstamp;
@@ -1529,10 +1793,31 @@ int main(int argc, char ** argv)
     /* load configuration files */
     if (access(conf_fname, R_OK) == 0) { /* if there is a global conf, parse it  */
         MSG("INFO: found configuration file %s, parsing it\n", conf_fname);
-        x = parse_SX130x_configuration(conf_fname);
+        x = parse_SX130x_configuration(conf_fname, 0);
         if (x != 0) {
             exit(EXIT_FAILURE);
         }
+        /* additional cards, each one driven by its own HAL instance */
+        card_handle[0] = lgw_handle_get();
+        for (nb_card = 1; nb_card < NB_CARD_MAX; nb_card++) {
+            card_handle[nb_card] = lgw_handle_new();
+            if (card_handle[nb_card] == NULL) {
+                MSG("ERROR: [main] failed to allocate HAL instance for card %u\n", nb_card);
+                exit(EXIT_FAILURE);
+            }
+            lgw_handle_select(card_handle[nb_card]);
+            x = parse_SX130x_configuration(conf_fname, nb_card);
+            lgw_handle_select(NULL);
+            if (x == 1) {
+                /* no more card configured */
+                lgw_handle_delete(card_handle[nb_card]);
+                card_handle[nb_card] = NULL;
+                break;
+            } else if (x != 0) {
+                exit(EXIT_FAILURE);
+            }
+        }
+        MSG("INFO: %u concentrator card(s) configured\n", nb_card);
         x = parse_gateway_configuration(conf_fname);
         if (x != 0) {
             exit(EXIT_FAILURE);
@@ -1653,6 +1938,12 @@ int main(int argc, char ** argv)
         }
     }
 
+    /* HAL performance counters are enabled by default */
+    lgw_perf_enable(perf_stats);
+
+    /* TX status transitions are logged by the HAL status tracker */
+    lgw_tx_event_setcb(jit_tx_event, NULL);
+
     /* starting the concentrator */
     i = lgw_start();
     if (i == LGW_HAL_SUCCESS) {
@@ -1662,6 +1953,19 @@ int main(int argc, char ** argv)
         exit(EXIT_FAILURE);
     }
 
+    /* starting the additional concentrators (RX only) */
+    for (x = 1; x < nb_card; x++) {
+        lgw_handle_select(card_handle[x]);
+        i = lgw_start();
+        lgw_handle_select(NULL);
+        if (i == LGW_HAL_SUCCESS) {
+            MSG("INFO: [main] concentrator card %d started, packet can now be received\n", x);
+        } else {
+            MSG("ERROR: [main] failed to start the concentrator card %d\n", x);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     /* get the concentrator EUI */
     i = lgw_get_eui(&eui);
     if (i != LGW_HAL_SUCCESS) {
@@ -1670,6 +1974,18 @@ int main(int argc, char ** argv)
         printf("INFO: concentrator EUI: 0x%016" PRIx64 "\n", eui);
     }
 
+    /* spawn one fetch thread per card when several cards are used, thread_up then gets de-duplicated uplinks */
+    if (nb_card > 1) {
+        dedup_init();
+        for (x = 0; x < nb_card; x++) {
+            i = pthread_create(&thrid_fetch[x], NULL, thread_fetch, (void *)&card_index[x]);
+            if (i != 0) {
+                MSG("ERROR: [main] impossible to create fetch thread for card %d\n", x);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
     /* spawn threads to manage upstream and downstream */
     i = pthread_create(&thrid_up, NULL, (void * (*)(void *))thread_up, NULL);
     if (i != 0) {
@@ -1688,6 +2004,10 @@ int main(int argc, char ** argv)
     }
 
     /* spawn thread for background spectral scan */
+    if ((spectral_scan_params.enable == true) && (spectral_init(spectral_scan_params.freq_hz_start, spectral_scan_params.nb_chan) != 0)) {
+        MSG("WARNING: [main] spectral scan disabled\n");
+        spectral_scan_params.enable = false;
+    }
     if (spectral_scan_params.enable == true) {
         i = pthread_create(&thrid_ss, NULL, (void * (*)(void *))thread_spectral_scan, NULL);
         if (i != 0) {
@@ -1823,6 +2143,10 @@ int main(int argc, char ** argv)
         printf("# RF packets forwarded: %u (%u bytes)\n", cp_up_pkt_fwd, cp_up_payload_byte);
         printf("# PUSH_DATA datagrams sent: %u (%u bytes)\n", cp_up_dgram_sent, cp_up_network_byte);
         printf("# PUSH_DATA acknowledged: %.2f%%\n", 100.0 * up_ack_ratio);
+        if (nb_card > 1) {
+            dedup_get_stat(&dedup_stat);
+            printf("# Uplinks received by %u cards: %u, duplicates removed: %u, dropped: %u\n", nb_card, dedup_stat.nb_pkt_in, dedup_stat.nb_pkt_dup, dedup_stat.nb_pkt_drop);
+        }
         printf("### [DOWNSTREAM] ###\n");
         printf("# PULL_DATA sent: %u (%.2f%% acknowledged)\n", cp_dw_pull_sent, 100.0 * dw_ack_ratio);
         printf("# PULL_RESP(onse) datagrams received: %u (%u bytes)\n", cp_dw_dgram_rcv, cp_dw_network_byte);
@@ -1855,11 +2179,11 @@ int main(int argc, char ** argv)
         jit_print_queue (&jit_queue[1], false, DEBUG_LOG);
         printf("### [GPS] ###\n");
         if (gps_enabled == true) {
-            /* no need for mutex, display is not critical */
-            if (gps_ref_valid == true) {
-                printf("# Valid time reference (age: %li sec)\n", (long)difftime(time(NULL), time_reference_gps.systime));
+            timeref_get(&cp_timeref);
+            if (cp_timeref.gps_valid == true) {
+                printf("# Valid time reference (age: %li sec)\n", (long)difftime(time(NULL), cp_timeref.gps.systime));
             } else {
-                printf("# Invalid time reference (age: %li sec)\n", (long)difftime(time(NULL), time_reference_gps.systime));
+                printf("# Invalid time reference (age: %li sec)\n", (long)difftime(time(NULL), cp_timeref.gps.systime));
             }
             if (coord_ok == true) {
                 printf("# GPS coordinates: latitude %.5f, longitude %.5f, altitude %i m\n", cp_gps_coord.lat, cp_gps_coord.lon, cp_gps_coord.alt);
@@ -1879,20 +2203,40 @@ int main(int argc, char ** argv)
         } else {
             printf("### Concentrator temperature: %.0f C ###\n", temperature);
         }
+        if (perf_stats == true) {
+            perf_report(perf_json, sizeof perf_json);
+            bus_report(bus_json, sizeof bus_json);
+        } else {
+            perf_json[0] = '\0';
+            bus_json[0] = '\0';
+        }
+        if (spectral_scan_params.enable == true) {
+            spectral_report(spectral_json, sizeof spectral_json);
+        } else {
+            spectral_json[0] = '\0';
+        }
         printf("##### END #####\n");
 
         /* generate a JSON report (will be sent to server by upstream thread) */
         pthread_mutex_lock(&mx_stat_rep);
         if (((gps_enabled == true) && (coord_ok == true)) || (gps_fake_enable == true)) {
-            snprintf(status_report, STATUS_SIZE, "\"stat\":{\"time\":\"%s\",\"lati\":%.5f,\"long\":%.5f,\"alti\":%i,\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"temp\":%.1f}", stat_timestamp, cp_gps_coord.lat, cp_gps_coord.lon, cp_gps_coord.alt, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, temperature);
+            snprintf(status_report, STATUS_SIZE, "\"stat\":{\"time\":\"%s\",\"lati\":%.5f,\"long\":%.5f,\"alti\":%i,\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"temp\":%.1f%s%s%s}", stat_timestamp, cp_gps_coord.lat, cp_gps_coord.lon, cp_gps_coord.alt, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, temperature, perf_json, bus_json, spectral_json);
         } else {
-            snprintf(status_report, STATUS_SIZE, "\"stat\":{\"time\":\"%s\",\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"temp\":%.1f}", stat_timestamp, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, temperature);
+            snprintf(status_report, STATUS_SIZE, "\"stat\":{\"time\":\"%s\",\"rxnb\":%u,\"rxok\":%u,\"rxfw\":%u,\"ackr\":%.1f,\"dwnb\":%u,\"txnb\":%u,\"temp\":%.1f%s%s%s}", stat_timestamp, cp_nb_rx_rcv, cp_nb_rx_ok, cp_up_pkt_fwd, 100.0 * up_ack_ratio, cp_dw_dgram_rcv, cp_nb_tx_ok, temperature, perf_json, bus_json, spectral_json);
         }
         report_ready = true;
         pthread_mutex_unlock(&mx_stat_rep);
     }
 
     /* wait for all threads with a COM with the concentrator board to finish (1 fetch cycle max) */
+    if (nb_card > 1) {
+        for (x = 0; x < nb_card; x++) {
+            i = pthread_join(thrid_fetch[x], NULL);
+            if (i != 0) {
+                printf("ERROR: failed to join fetch thread of card %d with %d - %s\n", x, i, strerror(errno));
+            }
+        }
+    }
     i = pthread_join(thrid_up, NULL);
     if (i != 0) {
         printf("ERROR: failed to join upstream thread with %d - %s\n", i, strerror(errno));
@@ -1935,6 +2279,17 @@ int main(int argc, char ** argv)
         } else {
             MSG("WARNING: failed to stop concentrator successfully\n");
         }
+        for (x = 1; x < nb_card; x++) {
+            lgw_handle_select(card_handle[x]);
+            i = lgw_stop();
+            lgw_handle_select(NULL);
+            if (i == LGW_HAL_SUCCESS) {
+                MSG("INFO: concentrator card %d stopped successfully\n", x);
+            } else {
+                MSG("WARNING: failed to stop concentrator card %d successfully\n", x);
+            }
+            lgw_handle_delete(card_handle[x]);
+        }
     }
 
     if (com_type == LGW_COM_SPI) {
@@ -1958,14 +2313,18 @@ void thread_up(void) {
     char stat_timestamp[24];
     time_t t;
 
-    /* allocate memory for packet fetching and processing */
-    struct lgw_pkt_rx_s rxpkt[NB_PKT_MAX]; /* array containing inbound packets + metadata */
-    struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
+    /* allocate memory for packet fetching and processing (payloads kept apart, not on the stack) */
+    struct lgw_pkt_rx_meta_s rxpkt[NB_PKT_MAX]; /* array containing inbound packets metadata */
+    static uint8_t rxpayload[LGW_RX_PAYLOAD_ARENA_SIZE(NB_PKT_MAX)]; /* inbound packets payloads */
+    uint8_t rxcard[NB_PKT_MAX]; /* card whose timestamp is given by each packet */
+    struct lgw_pkt_rx_meta_s *p; /* pointer on a RX packet */
+    uint8_t *payload; /* pointer on a RX packet payload */
     int nb_pkt;
 
     /* local copy of GPS time reference */
     bool ref_ok = false; /* determine if GPS time reference must be used or not */
     struct tref local_ref; /* time reference used for UTC <-> timestamp conversion */
+    struct timeref_s local_timeref;
 
     /* data buffers */
     uint8_t buff_up[TX_BUFF_SIZE]; /* buffer to compose the upstream packet */
@@ -2009,9 +2368,19 @@ void thread_up(void) {
     while (!exit_sig && !quit_sig) {
 
         /* fetch packets */
-        pthread_mutex_lock(&mx_concent);
-        nb_pkt = lgw_receive(NB_PKT_MAX, rxpkt);
-        pthread_mutex_unlock(&mx_concent);
+        if (nb_card > 1) {
+            /* packets fetched by thread_fetch, once de-duplicated */
+            nb_pkt = dedup_pop(NB_PKT_MAX, rxpkt, rxpayload, rxcard, host_time_us());
+            for (i = 0; i < nb_pkt; i++) {
+                if (rxcard[i] != 0) {
+                    rxpkt[i].count_us = card_cnt_to_ref(rxcard[i], rxpkt[i].count_us);
+                }
+            }
+        } else {
+            pthread_mutex_lock(&mx_concent);
+            nb_pkt = lgw_receive_compact(NB_PKT_MAX, rxpkt, rxpayload, sizeof rxpayload);
+            pthread_mutex_unlock(&mx_concent);
+        }
         if (nb_pkt == LGW_HAL_ERROR) {
             MSG("ERROR: [up] failed packet fetch, exiting\n");
             exit(EXIT_FAILURE);
@@ -2027,12 +2396,11 @@ void thread_up(void) {
             continue;
         }
 
-        /* get a copy of GPS time reference (avoid 1 mutex per packet) */
+        /* get a copy of GPS time reference (avoid 1 copy per packet) */
         if ((nb_pkt > 0) && (gps_enabled == true)) {
-            pthread_mutex_lock(&mx_timeref);
-            ref_ok = gps_ref_valid;
-            local_ref = time_reference_gps;
-            pthread_mutex_unlock(&mx_timeref);
+            timeref_get(&local_timeref);
+            ref_ok = local_timeref.gps_valid;
+            local_ref = local_timeref.gps;
         } else {
             ref_ok = false;
         }
@@ -2057,17 +2425,18 @@ void thread_up(void) {
         pkt_in_dgram = 0;
         for (i = 0; i < nb_pkt; ++i) {
             p = &rxpkt[i];
+            payload = rxpayload + p->payload_offset;
 
             /* Get mote information from current packet (addr, fcnt) */
             /* FHDR - DevAddr */
             if (p->size >= 8) {
-                mote_addr  = p->payload[1];
-                mote_addr |= p->payload[2] << 8;
-                mote_addr |= p->payload[3] << 16;
-                mote_addr |= p->payload[4] << 24;
+                mote_addr  = payload[1];
+                mote_addr |= payload[2] << 8;
+                mote_addr |= payload[3] << 16;
+                mote_addr |= payload[4] << 24;
                 /* FHDR - FCnt */
-                mote_fcnt  = p->payload[6];
-                mote_fcnt |= p->payload[7] << 8;
+                mote_fcnt  = payload[6];
+                mote_fcnt |= payload[7] << 8;
             } else {
                 mote_addr = 0;
                 mote_fcnt = 0;
@@ -2356,7 +2725,7 @@ void thread_up(void) {
             /* Packet base64-encoded payload, 14-350 useful chars */
             memcpy((void *)(buff_up + buff_index), (void *)",\"data\":\"", 9);
             buff_index += 9;
-            j = bin_to_b64(p->payload, p->size, (char *)(buff_up + buff_index), 341); /* 255 bytes = 340 chars in b64 + null char */
+            j = bin_to_b64(payload, p->size, (char *)(buff_up + buff_index), 341); /* 255 bytes = 340 chars in b64 + null char */
             if (j>=0) {
                 buff_index += j;
             } else {
@@ -2378,10 +2747,10 @@ void thread_up(void) {
 
                 /* Log nb of packets for ref_payload (DEBUG) */
                 for (k = 0; k < debugconf.nb_ref_payload; k++) {
-                    if ((p->payload[0] == (uint8_t)(debugconf.ref_payload[k].id >> 24)) &&
-                        (p->payload[1] == (uint8_t)(debugconf.ref_payload[k].id >> 16)) &&
-                        (p->payload[2] == (uint8_t)(debugconf.ref_payload[k].id >> 8))  &&
-                        (p->payload[3] == (uint8_t)(debugconf.ref_payload[k].id >> 0))) {
+                    if ((payload[0] == (uint8_t)(debugconf.ref_payload[k].id >> 24)) &&
+                        (payload[1] == (uint8_t)(debugconf.ref_payload[k].id >> 16)) &&
+                        (payload[2] == (uint8_t)(debugconf.ref_payload[k].id >> 8))  &&
+                        (payload[3] == (uint8_t)(debugconf.ref_payload[k].id >> 0))) {
                             nb_pkt_received_ref[k] += 1;
                         }
                 }
@@ -2490,51 +2859,14 @@ void thread_up(void) {
 /* -------------------------------------------------------------------------- */
 /* --- THREAD 2: POLLING SERVER AND ENQUEUING PACKETS IN JIT QUEUE ---------- */
 
-static int get_tx_gain_lut_index(uint8_t rf_chain, int8_t rf_power, uint8_t * lut_index) {
-    uint8_t pow_index;
-    int current_best_index = -1;
-    uint8_t current_best_match = 0xFF;
-    int diff;
-
-    /* Check input parameters */
-    if (lut_index == NULL) {
-        MSG("ERROR: %s - wrong parameter\n", __FUNCTION__);
-        return -1;
-    }
-
-    /* Search requested power in TX gain LUT */
-    for (pow_index = 0; pow_index < txlut[rf_chain].size; pow_index++) {
-        diff = rf_power - txlut[rf_chain].lut[pow_index].rf_power;
-        if (diff < 0) {
-            /* The selected power must be lower or equal to requested one */
-            continue;
-        } else {
-            /* Record the index corresponding to the closest rf_power available in LUT */
-            if ((current_best_index == -1) || (diff < current_best_match)) {
-                current_best_match = diff;
-                current_best_index = pow_index;
-            }
-        }
-    }
-
-    /* Return corresponding index */
-    if (current_best_index > -1) {
-        *lut_index = (uint8_t)current_best_index;
-    } else {
-        *lut_index = 0;
-        MSG("ERROR: %s - failed to find tx gain lut index\n", __FUNCTION__);
-        return -1;
-    }
-
-    return 0;
-}
-
 void thread_down(void) {
     int i; /* loop variables */
 
     /* configuration and metadata for an outbound packet */
     struct lgw_pkt_tx_s txpkt;
     bool sent_immediate = false; /* option to sent the packet immediately */
+    uint32_t freq_alt[TX_FREQ_ALT_MAX + 1]; /* requested frequency followed by its alternatives, in Hz */
+    int nb_freq_alt;
 
     /* local timekeeping variables */
     struct timespec send_time; /* time of the pull request */
@@ -2554,6 +2886,7 @@ void thread_down(void) {
     JSON_Value *root_val = NULL;
     JSON_Object *txpk_obj = NULL;
     JSON_Value *val = NULL; /* needed to detect the absence of some fields */
+    JSON_Array *alt_array = NULL;
     const char *str; /* pointer to sub-strings in the JSON data */
     short x0, x1;
     uint64_t x2;
@@ -2561,11 +2894,13 @@ void thread_down(void) {
 
     /* variables to send on GPS timestamp */
     struct tref local_ref; /* time reference used for GPS <-> timestamp conversion */
+    struct timeref_s local_timeref; /* copy of the published GPS time reference and XTAL correction */
     struct timespec gps_tx; /* GPS time that needs to be converted to timestamp */
 
     /* beacon variables */
     struct lgw_pkt_tx_s beacon_pkt;
     uint8_t beacon_chan;
+    uint32_t beacon_freqs[256];
     uint8_t beacon_loop;
     size_t beacon_RFU1_size = 0;
     size_t beacon_RFU2_size = 0;
@@ -2589,7 +2924,7 @@ void thread_down(void) {
     enum jit_pkt_type_e downlink_type;
     enum jit_error_e warning_result = JIT_ERROR_OK;
     int32_t warning_value = 0;
-    uint8_t tx_lut_idx = 0;
+    int8_t tx_power_used = 0;
 
     /* set downstream socket RX timeout */
     i = setsockopt(sock_down, SOL_SOCKET, SO_RCVTIMEO, (void *)&pull_timeout, sizeof pull_timeout);
@@ -2740,17 +3075,17 @@ void thread_down(void) {
             beacon_loop = JIT_NUM_BEACON_IN_QUEUE - jit_queue[0].num_beacon;
             retry = 0;
             while (beacon_loop && (beacon_period != 0)) {
-                pthread_mutex_lock(&mx_timeref);
+                timeref_get(&local_timeref);
                 /* Wait for GPS to be ready before inserting beacons in JiT queue */
-                if ((gps_ref_valid == true) && (xtal_correct_ok == true)) {
+                if ((local_timeref.gps_valid == true) && (local_timeref.xtal_correct_ok == true)) {
 
                     /* compute GPS time for next beacon to come      */
                     /*   LoRaWAN: T = k*beacon_period + TBeaconDelay */
                     /*            with TBeaconDelay = [1.5ms +/- 1µs]*/
                     if (last_beacon_gps_time.tv_sec == 0) {
                         /* if no beacon has been queued, get next slot from current GPS time */
-                        diff_beacon_time = time_reference_gps.gps.tv_sec % ((time_t)beacon_period);
-                        next_beacon_gps_time.tv_sec = time_reference_gps.gps.tv_sec +
+                        diff_beacon_time = local_timeref.gps.gps.tv_sec % ((time_t)beacon_period);
+                        next_beacon_gps_time.tv_sec = local_timeref.gps.gps.tv_sec +
                                                         ((time_t)beacon_period - diff_beacon_time);
                     } else {
                         /* if there is already a beacon, take it as reference */
@@ -2764,7 +3099,7 @@ void thread_down(void) {
                     {
                     time_t time_unix;
 
-                    time_unix = time_reference_gps.gps.tv_sec + UNIX_GPS_EPOCH_OFFSET;
+                    time_unix = local_timeref.gps.gps.tv_sec + UNIX_GPS_EPOCH_OFFSET;
                     MSG_DEBUG(DEBUG_BEACON, "GPS-now : %s", ctime(&time_unix));
                     time_unix = last_beacon_gps_time.tv_sec + UNIX_GPS_EPOCH_OFFSET;
                     MSG_DEBUG(DEBUG_BEACON, "GPS-last: %s", ctime(&time_unix));
@@ -2774,12 +3109,19 @@ void thread_down(void) {
 #endif
 
                     /* convert GPS time to concentrator time, and set packet counter for JiT trigger */
-                    lgw_gps2cnt(time_reference_gps, next_beacon_gps_time, &(beacon_pkt.count_us));
-                    pthread_mutex_unlock(&mx_timeref);
+                    lgw_gps2cnt(local_timeref.gps, next_beacon_gps_time, &(beacon_pkt.count_us));
 
                     /* apply frequency correction to beacon TX frequency */
                     if (beacon_freq_nb > 1) {
                         beacon_chan = (next_beacon_gps_time.tv_sec / beacon_period) % beacon_freq_nb; /* floor rounding */
+                        if (beacon_freq_select == true) {
+                            /* the hopping channel, unless another one is clearly quieter */
+                            for (i = 0; i < beacon_freq_nb; i++) {
+                                beacon_freqs[i] = beacon_freq_hz + (i * beacon_freq_step);
+                            }
+                            beacon_chan = (uint8_t)spectral_select(beacon_freqs, beacon_freq_nb, beacon_chan, time(NULL));
+                            MSG_DEBUG(DEBUG_BEACON, "beacon channel %u selected\n", beacon_chan);
+                        }
                     } else {
                         beacon_chan = 0;
                     }
@@ -2836,7 +3178,6 @@ void thread_down(void) {
                         MSG_DEBUG(DEBUG_BEACON, "--> beacon queuing retry=%d\n", retry);
                     }
                 } else {
-                    pthread_mutex_unlock(&mx_timeref);
                     break;
                 }
             }
@@ -2919,12 +3260,10 @@ void thread_down(void) {
                         continue;
                     }
                     if (gps_enabled == true) {
-                        pthread_mutex_lock(&mx_timeref);
-                        if (gps_ref_valid == true) {
-                            local_ref = time_reference_gps;
-                            pthread_mutex_unlock(&mx_timeref);
+                        timeref_get(&local_timeref);
+                        if (local_timeref.gps_valid == true) {
+                            local_ref = local_timeref.gps;
                         } else {
-                            pthread_mutex_unlock(&mx_timeref);
                             MSG("WARNING: [down] no valid GPS time reference yet, impossible to send packet on specific GPS time, TX aborted\n");
                             json_value_free(root_val);
 
@@ -2999,6 +3338,32 @@ void thread_down(void) {
                 continue;
             }
 
+            /* parse alternative frequencies of a class C downlink (optional field) */
+            alt_array = json_object_get_array(txpk_obj, "falt");
+            if ((alt_array != NULL) && (sent_immediate == true)) {
+                freq_alt[0] = txpkt.freq_hz;
+                nb_freq_alt = 1;
+                for (i = 0; (i < (int)json_array_get_count(alt_array)) && (nb_freq_alt <= TX_FREQ_ALT_MAX); i++) {
+                    val = json_array_get_value(alt_array, i);
+                    if (json_value_get_type(val) != JSONNumber) {
+                        MSG("WARNING: [down] wrong type for \"txpk.falt\" element, ignored\n");
+                        continue;
+                    }
+                    freq_alt[nb_freq_alt] = (uint32_t)((double)(1.0e6) * json_value_get_number(val));
+                    if ((freq_alt[nb_freq_alt] < tx_freq_min[txpkt.rf_chain]) || (freq_alt[nb_freq_alt] > tx_freq_max[txpkt.rf_chain])) {
+                        MSG("WARNING: [down] unsupported alternative frequency - %u, ignored\n", freq_alt[nb_freq_alt]);
+                        continue;
+                    }
+                    nb_freq_alt += 1;
+                }
+                /* the requested frequency, unless an alternative is clearly quieter */
+                i = spectral_select(freq_alt, nb_freq_alt, 0, time(NULL));
+                if (i != 0) {
+                    MSG("INFO: [down] class C downlink moved from %u Hz to %u Hz\n", txpkt.freq_hz, freq_alt[i]);
+                    txpkt.freq_hz = freq_alt[i];
+                }
+            }
+
             /* parse TX power (optional field) */
             val = json_object_get_value(txpk_obj,"powe");
             if (val != NULL) {
@@ -3182,13 +3547,13 @@ void thread_down(void) {
 
             /* check TX power before trying to queue packet, send a warning if not supported */
             if (jit_result == JIT_ERROR_OK) {
-                i = get_tx_gain_lut_index(txpkt.rf_chain, txpkt.rf_power, &tx_lut_idx);
-                if ((i < 0) || (txlut[txpkt.rf_chain].lut[tx_lut_idx].rf_power != txpkt.rf_power)) {
+                i = lgw_txgain_getpower(txpkt.rf_chain, txpkt.rf_power, &tx_power_used);
+                if ((i != LGW_HAL_SUCCESS) || (tx_power_used != txpkt.rf_power)) {
                     /* this RF power is not supported, throw a warning, and use the closest lower power supported */
                     warning_result = JIT_ERROR_TX_POWER;
-                    warning_value = (int32_t)txlut[txpkt.rf_chain].lut[tx_lut_idx].rf_power;
+                    warning_value = (int32_t)tx_power_used;
                     printf("WARNING: Requested TX power is not supported (%ddBm), actual power used: %ddBm\n", txpkt.rf_power, warning_value);
-                    txpkt.rf_power = txlut[txpkt.rf_chain].lut[tx_lut_idx].rf_power;
+                    txpkt.rf_power = tx_power_used;
                 }
             }
 
@@ -3237,23 +3602,94 @@ void print_tx_status(uint8_t tx_status) {
 }
 
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Commit the downlink staged on a RF chain if the previous one is over, and
+ * account it once it has left the staging slot */
+static void jit_dispatch(int rf_chain) {
+    int result;
+    uint8_t tx_status;
+
+    pthread_mutex_lock(&mx_concent); /* may have to wait for a fetch to finish */
+    result = lgw_tx_dispatch((uint8_t)rf_chain, &tx_status, &tx_staged[rf_chain]);
+    pthread_mutex_unlock(&mx_concent); /* free concentrator ASAP */
+    if (tx_staged[rf_chain] == true) {
+        return; /* still waiting for the end of the current downlink */
+    }
+
+    pthread_mutex_lock(&mx_meas_dw);
+    if (result == LGW_HAL_SUCCESS) {
+        meas_nb_tx_ok += 1;
+    } else {
+        meas_nb_tx_fail += 1;
+    }
+    pthread_mutex_unlock(&mx_meas_dw);
+    if (result == LGW_LBT_NOT_ALLOWED) {
+        /* the channel is busy, lower its rank for the next downlink frequency selection */
+        spectral_lbt_busy(tx_staged_freq[rf_chain], time(NULL));
+        MSG("WARNING: [jit] TX blocked by LBT on rf_chain %d at %u Hz\n", rf_chain, tx_staged_freq[rf_chain]);
+    } else if (result != LGW_HAL_SUCCESS) {
+        MSG("WARNING: [jit] lgw_tx_dispatch failed on rf_chain %d\n", rf_chain);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* TX status transition, called by the HAL with the concentrator locked */
+static void jit_tx_event(uint8_t rf_chain, uint8_t status, void * arg) {
+    (void)arg;
+
+    switch (status) {
+        case TX_FREE:
+            MSG_DEBUG(DEBUG_PKT_FWD, "INFO: [jit%u] TX_FREE\n", rf_chain);
+            break;
+        case TX_SCHEDULED:
+            MSG_DEBUG(DEBUG_PKT_FWD, "INFO: [jit%u] TX_SCHEDULED\n", rf_chain);
+            break;
+        case TX_EMITTING:
+            MSG_DEBUG(DEBUG_PKT_FWD, "INFO: [jit%u] TX_EMITTING\n", rf_chain);
+            break;
+        default:
+            MSG_DEBUG(DEBUG_PKT_FWD, "INFO: [jit%u] TX status %u\n", rf_chain, status);
+            break;
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- THREAD 3: CHECKING PACKETS TO BE SENT FROM JIT QUEUE AND SEND THEM --- */
 
 void thread_jit(void) {
     int result = LGW_HAL_SUCCESS;
     struct lgw_pkt_tx_s pkt;
+    struct lgw_tx_prep_s prep;
     int pkt_index = -1;
     uint32_t current_concentrator_time;
     enum jit_error_e jit_result;
     enum jit_pkt_type_e pkt_type;
-    uint8_t tx_status;
+    uint8_t tx_status[LGW_RF_CHAIN_NB];
+    uint32_t next_us = UINT32_MAX;
+    struct timeref_s local_timeref;
     int i;
 
     while (!exit_sig && !quit_sig) {
-        wait_ms(10);
+        /* wake up for the next expected TX transition if a downlink waits for it */
+        if (((tx_staged[0] == true) || (tx_staged[1] == true)) && (next_us < (JIT_SLEEP_MS * 1000))) {
+            wait_ms((next_us + 999) / 1000);
+        } else {
+            wait_ms(JIT_SLEEP_MS);
+        }
+
+        /* the tracker only reads the TX status when a transition is due */
+        pthread_mutex_lock(&mx_concent);
+        lgw_tx_track(tx_status, &next_us);
+        pthread_mutex_unlock(&mx_concent);
 
         for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+            /* commit the staged downlink as soon as the RF chain is free */
+            if ((tx_staged[i] == true) && (tx_status[i] == TX_FREE)) {
+                jit_dispatch(i);
+            }
+
             /* transfer data and metadata to the concentrator, and schedule TX */
             pthread_mutex_lock(&mx_concent);
             lgw_get_instcnt(&current_concentrator_time);
@@ -3266,10 +3702,9 @@ void thread_jit(void) {
                         /* update beacon stats */
                         if (pkt_type == JIT_PKT_TYPE_BEACON) {
                             /* Compensate breacon frequency with xtal error */
-                            pthread_mutex_lock(&mx_xcorr);
-                            pkt.freq_hz = (uint32_t)(xtal_correct * (double)pkt.freq_hz);
-                            MSG_DEBUG(DEBUG_BEACON, "beacon_pkt.freq_hz=%u (xtal_correct=%.15lf)\n", pkt.freq_hz, xtal_correct);
-                            pthread_mutex_unlock(&mx_xcorr);
+                            timeref_get(&local_timeref);
+                            pkt.freq_hz = (uint32_t)(local_timeref.xtal_correct * (double)pkt.freq_hz);
+                            MSG_DEBUG(DEBUG_BEACON, "beacon_pkt.freq_hz=%u (xtal_correct=%.15lf)\n", pkt.freq_hz, local_timeref.xtal_correct);
 
                             /* Update statistics */
                             pthread_mutex_lock(&mx_meas_dw);
@@ -3278,26 +3713,37 @@ void thread_jit(void) {
                             MSG("INFO: Beacon dequeued (count_us=%u)\n", pkt.count_us);
                         }
 
+                        /* compute the TX register image without holding the concentrator */
+                        result = lgw_send_prepare(&pkt, &prep);
+                        if (result != LGW_HAL_SUCCESS) {
+                            pthread_mutex_lock(&mx_meas_dw);
+                            meas_nb_tx_fail += 1;
+                            pthread_mutex_unlock(&mx_meas_dw);
+                            MSG("WARNING: [jit] lgw_send_prepare failed on rf_chain %d\n", i);
+                            continue;
+                        }
+
                         /* check if concentrator is free for sending new packet */
                         pthread_mutex_lock(&mx_concent); /* may have to wait for a fetch to finish */
-                        result = lgw_status(pkt.rf_chain, TX_STATUS, &tx_status);
+                        lgw_tx_track(tx_status, &next_us);
                         pthread_mutex_unlock(&mx_concent); /* free concentrator ASAP */
-                        if (result == LGW_HAL_ERROR) {
-                            MSG("WARNING: [jit%d] lgw_status failed\n", i);
-                        } else {
-                            if (tx_status == TX_EMITTING) {
-                                MSG("ERROR: concentrator is currently emitting on rf_chain %d\n", i);
-                                print_tx_status(tx_status);
+                        if ((tx_status[i] == TX_EMITTING) || (tx_status[i] == TX_SCHEDULED)) {
+                            /* load it at the end of the current downlink */
+                            MSG_DEBUG(DEBUG_PKT_FWD, "INFO: [jit%d] downlink staged behind the current one\n", i);
+                        }
+                        if (tx_staged[i] == true) {
+                            jit_dispatch(i);
+                            if (tx_staged[i] == true) {
+                                MSG("ERROR: concentrator is busy on rf_chain %d and a downlink is already staged\n", i);
+                                print_tx_status(tx_status[i]);
+                                pthread_mutex_lock(&mx_meas_dw);
+                                meas_nb_tx_fail += 1;
+                                pthread_mutex_unlock(&mx_meas_dw);
                                 continue;
-                            } else if (tx_status == TX_SCHEDULED) {
-                                MSG("WARNING: a downlink was already scheduled on rf_chain %d, overwritting it...\n", i);
-                                print_tx_status(tx_status);
-                            } else {
-                                /* Nothing to do */
                             }
                         }
 
-                        /* send packet to concentrator */
+                        /* send packet to concentrator, or stage it if the RF chain is busy */
                         pthread_mutex_lock(&mx_concent); /* may have to wait for a fetch to finish */
                         if (spectral_scan_params.enable == true) {
                             result = lgw_spectral_scan_abort();
@@ -3305,20 +3751,28 @@ void thread_jit(void) {
                                 MSG("WARNING: [jit%d] lgw_spectral_scan_abort failed\n", i);
                             }
                         }
-                        result = lgw_send(&pkt);
+                        /* tune the LBT radio now, while the current downlink is emitted */
+                        result = lgw_send_arm(&prep);
+                        if (result != LGW_HAL_SUCCESS) {
+                            MSG("WARNING: [jit%d] lgw_send_arm failed\n", i);
+                        }
+                        result = lgw_send_stage(&prep);
+                        if (result == LGW_HAL_SUCCESS) {
+                            tx_staged[i] = true;
+                            tx_staged_freq[i] = pkt.freq_hz;
+                        }
                         pthread_mutex_unlock(&mx_concent); /* free concentrator ASAP */
                         if (result != LGW_HAL_SUCCESS) {
                             pthread_mutex_lock(&mx_meas_dw);
                             meas_nb_tx_fail += 1;
                             pthread_mutex_unlock(&mx_meas_dw);
-                            MSG("WARNING: [jit] lgw_send failed on rf_chain %d\n", i);
+                            MSG("WARNING: [jit] lgw_send_stage failed on rf_chain %d\n", i);
                             continue;
-                        } else {
-                            pthread_mutex_lock(&mx_meas_dw);
-                            meas_nb_tx_ok += 1;
-                            pthread_mutex_unlock(&mx_meas_dw);
-                            MSG_DEBUG(DEBUG_PKT_FWD, "lgw_send done on rf_chain %d: count_us=%u\n", i, pkt.count_us);
                         }
+                        MSG_DEBUG(DEBUG_PKT_FWD, "lgw_send_stage done on rf_chain %d: count_us=%u\n", i, pkt.count_us);
+
+                        /* commit it right away if the RF chain is free */
+                        jit_dispatch(i);
                     } else {
                         MSG("ERROR: jit_dequeue failed on rf_chain %d with %d\n", i, jit_result);
                     }
@@ -3361,6 +3815,9 @@ static void gps_process_sync(void) {
     /* try to update time reference with the new GPS time & timestamp */
     pthread_mutex_lock(&mx_timeref);
     i = lgw_gps_sync(&time_reference_gps, trig_tstamp, utc, gps_time);
+    if (i == LGW_GPS_SUCCESS) {
+        timeref_publish();
+    }
     pthread_mutex_unlock(&mx_timeref);
     if (i != LGW_GPS_SUCCESS) {
         MSG("WARNING: [gps] GPS out of sync, keeping previous time reference\n");
@@ -3388,95 +3845,42 @@ static void gps_process_coords(void) {
 
 void thread_gps(void) {
     /* serial variables */
-    char serial_buff[128]; /* buffer to receive GPS data */
-    size_t wr_idx = 0;     /* pointer to end of chars in buffer */
+    uint8_t serial_buff[LGW_GPS_READ_SIZE]; /* buffer to receive GPS data */
+    struct lgw_gps_parser_s parser; /* framing state, kept across reads */
 
     /* variables for PPM pulse GPS synchronization */
     enum gps_msg latest_msg; /* keep track of latest NMEA message parsed */
 
     /* initialize some variables before loop */
-    memset(serial_buff, 0, sizeof serial_buff);
+    lgw_gps_parser_init(&parser);
 
     while (!exit_sig && !quit_sig) {
         size_t rd_idx = 0;
-        size_t frame_end_idx = 0;
+        size_t frame_size;
 
-        /* blocking non-canonical read on serial port */
-        ssize_t nb_char = read(gps_tty_fd, serial_buff + wr_idx, LGW_GPS_MIN_MSG_SIZE);
+        /* blocking non-canonical read on serial port, returns the chars received so far */
+        ssize_t nb_char = read(gps_tty_fd, serial_buff, sizeof serial_buff);
         if (nb_char <= 0) {
             MSG("WARNING: [gps] read() returned value %zd\n", nb_char);
             continue;
         }
-        wr_idx += (size_t)nb_char;
-
-        /*******************************************
-         * Scan buffer for UBX/NMEA sync chars and *
-         * attempt to decode frame if one is found *
-         *******************************************/
-        while (rd_idx < wr_idx) {
-            size_t frame_size = 0;
-
-            /* Scan buffer for UBX sync char */
-            if (serial_buff[rd_idx] == (char)LGW_GPS_UBX_SYNC_CHAR) {
-
-                /***********************
-                 * Found UBX sync char *
-                 ***********************/
-                latest_msg = lgw_parse_ubx(&serial_buff[rd_idx], (wr_idx - rd_idx), &frame_size);
-
-                if (frame_size > 0) {
-                    if (latest_msg == INCOMPLETE) {
-                        /* UBX header found but frame appears to be missing bytes */
-                        frame_size = 0;
-                    } else if (latest_msg == INVALID) {
-                        /* message header received but message appears to be corrupted */
-                        MSG("WARNING: [gps] could not get a valid message from GPS (no time)\n");
-                        frame_size = 0;
-                    } else if (latest_msg == UBX_NAV_TIMEGPS) {
-                        gps_process_sync();
-                    }
-                }
-            } else if (serial_buff[rd_idx] == (char)LGW_GPS_NMEA_SYNC_CHAR) {
-                /************************
-                 * Found NMEA sync char *
-                 ************************/
-                /* scan for NMEA end marker (LF = 0x0a) */
-                char* nmea_end_ptr = memchr(&serial_buff[rd_idx],(int)0x0a, (wr_idx - rd_idx));
-
-                if(nmea_end_ptr) {
-                    /* found end marker */
-                    frame_size = nmea_end_ptr - &serial_buff[rd_idx] + 1;
-                    latest_msg = lgw_parse_nmea(&serial_buff[rd_idx], frame_size);
-
-                    if(latest_msg == INVALID || latest_msg == UNKNOWN) {
-                        /* checksum failed */
-                        frame_size = 0;
-                    } else if (latest_msg == NMEA_RMC) { /* Get location from RMC frames */
-                        gps_process_coords();
-                    }
-                }
-            }
 
-            if (frame_size > 0) {
-                /* At this point message is a checksum verified frame
-                   we're processed or ignored. Remove frame from buffer */
-                rd_idx += frame_size;
-                frame_end_idx = rd_idx;
-            } else {
-                rd_idx++;
+        /**********************************************
+         * Feed the stream parser, frames may span    *
+         * several reads, act on each completed frame *
+         **********************************************/
+        while (rd_idx < (size_t)nb_char) {
+            latest_msg = lgw_gps_parse_stream(&parser, &serial_buff[rd_idx], (size_t)nb_char - rd_idx, &frame_size);
+            rd_idx += frame_size;
+
+            if (latest_msg == UBX_NAV_TIMEGPS) {
+                gps_process_sync();
+            } else if (latest_msg == NMEA_RMC) { /* Get location from RMC frames */
+                gps_process_coords();
+            } else if (latest_msg == INVALID) {
+                /* frame received but appears to be corrupted, not unusual on a live stream */
+                MSG_DEBUG(DEBUG_GPS, "WARNING: [gps] could not get a valid message from GPS (no time)\n");
             }
-        } /* ...for(rd_idx = 0... */
-
-        if (frame_end_idx) {
-          /* Frames have been processed. Remove bytes to end of last processed frame */
-          memcpy(serial_buff, &serial_buff[frame_end_idx], wr_idx - frame_end_idx);
-          wr_idx -= frame_end_idx;
-        } /* ...for(rd_idx = 0... */
-
-        /* Prevent buffer overflow */
-        if ((sizeof(serial_buff) - wr_idx) < LGW_GPS_MIN_MSG_SIZE) {
-            memcpy(serial_buff, &serial_buff[LGW_GPS_MIN_MSG_SIZE], wr_idx - LGW_GPS_MIN_MSG_SIZE);
-            wr_idx -= LGW_GPS_MIN_MSG_SIZE;
         }
     }
     MSG("\nINFO: End of GPS thread\n");
@@ -3490,6 +3894,7 @@ void thread_valid(void) {
     /* GPS reference validation variables */
     long gps_ref_age = 0;
     bool ref_valid_local = false;
+    bool holdover = false;
     double xtal_err_cpy;
 
     /* variables for XTAL correction averaging */
@@ -3520,48 +3925,56 @@ void thread_valid(void) {
             /* time ref is ok, validate and  */
             gps_ref_valid = true;
             ref_valid_local = true;
+            holdover = false;
             xtal_err_cpy = time_reference_gps.xtal_err;
             //printf("XTAL err: %.15lf (1/XTAL_err:%.15lf)\n", xtal_err_cpy, 1/xtal_err_cpy); // DEBUG
+        } else if ((gps_ref_age >= 0) && (gps_ref_valid == true) && (lgw_gps_holdover_us(time_reference_gps, gps_ref_age) <= GPS_HOLDOVER_MAX_US)) {
+            /* no recent sync, but the fitted time model is still accurate enough: holdover */
+            if (holdover == false) {
+                MSG("INFO: [gps] no GPS sync for %ld s, holdover on the time model (%.1f us error estimated)\n", gps_ref_age, lgw_gps_holdover_us(time_reference_gps, gps_ref_age));
+                holdover = true;
+            }
         } else {
             /* time ref is too old, invalidate */
+            if (holdover == true) {
+                MSG("WARNING: [gps] end of holdover after %ld s without GPS sync\n", gps_ref_age);
+                holdover = false;
+            }
             gps_ref_valid = false;
             ref_valid_local = false;
         }
-        pthread_mutex_unlock(&mx_timeref);
 
-        /* manage XTAL correction */
+        /* manage XTAL correction, frozen during holdover as there is no new sync to track */
         if (ref_valid_local == false) {
             /* couldn't sync, or sync too old -> invalidate XTAL correction */
-            pthread_mutex_lock(&mx_xcorr);
             xtal_correct_ok = false;
             xtal_correct = 1.0;
-            pthread_mutex_unlock(&mx_xcorr);
             init_cpt = 0;
             init_acc = 0.0;
-        } else {
+        } else if (holdover == false) {
             if (init_cpt < XERR_INIT_AVG) {
                 /* initial accumulation */
                 init_acc += xtal_err_cpy;
                 ++init_cpt;
             } else if (init_cpt == XERR_INIT_AVG) {
                 /* initial average calculation */
-                pthread_mutex_lock(&mx_xcorr);
                 xtal_correct = (double)(XERR_INIT_AVG) / init_acc;
                 //printf("XERR_INIT_AVG=%d, init_acc=%.15lf\n", XERR_INIT_AVG, init_acc);
                 xtal_correct_ok = true;
-                pthread_mutex_unlock(&mx_xcorr);
                 ++init_cpt;
                 // fprintf(log_file,"%.18lf,\"average\"\n", xtal_correct); // DEBUG
             } else {
                 /* tracking with low-pass filter */
                 x = 1 / xtal_err_cpy;
-                pthread_mutex_lock(&mx_xcorr);
                 xtal_correct = xtal_correct - xtal_correct/XERR_FILT_COEF + x/XERR_FILT_COEF;
-                pthread_mutex_unlock(&mx_xcorr);
                 // fprintf(log_file,"%.18lf,\"track\"\n", xtal_correct); // DEBUG
             }
         }
 
+        /* make the validated reference and correction visible to the other threads */
+        timeref_publish();
+        pthread_mutex_unlock(&mx_timeref);
+
         //printf("Time ref: %s, XTAL correct: %s (%.15lf)\n", ref_valid_local?"valid":"invalid", xtal_correct_ok?"valid":"invalid", xtal_correct); // DEBUG
     }
     MSG("\nINFO: End of validation thread\n");
@@ -3573,114 +3986,194 @@ void thread_valid(void) {
 void thread_spectral_scan(void) {
     int i, x;
     uint32_t freq_hz = spectral_scan_params.freq_hz_start;
-    uint32_t freq_hz_stop = spectral_scan_params.freq_hz_start + spectral_scan_params.nb_chan * 200E3;
+    uint32_t freq_hz_stop = spectral_scan_params.freq_hz_start + spectral_scan_params.nb_chan * SPECTRAL_CHAN_SPACING;
     int16_t levels[LGW_SPECTRAL_SCAN_RESULT_SIZE];
     uint16_t results[LGW_SPECTRAL_SCAN_RESULT_SIZE];
     struct timeval tm_start;
     lgw_spectral_scan_status_t status;
-    uint8_t tx_status = TX_FREE;
-    bool spectral_scan_started;
+    uint8_t tx_status[LGW_RF_CHAIN_NB];
+    uint32_t count_us, gap_us, next_us;
+    uint32_t scan_ms = SCAN_DURATION_MS; /* duration of a scan, measured */
+    uint32_t elapsed_ms;
+    uint64_t start_us;
+    int nb_poll;
+    bool tx_busy;
     bool exit_thread = false;
 
     /* main loop task */
     while (!exit_sig && !quit_sig) {
-        /* Pace the scan thread (1 sec min), and avoid waiting several seconds when exit */
-        for (i = 0; i < (int)(spectral_scan_params.pace_s ? spectral_scan_params.pace_s : 1); i++) {
-            if (exit_sig || quit_sig) {
-                exit_thread = true;
-                break;
-            }
-            wait_ms(1000);
-        }
-        if (exit_thread == true) {
-            break;
-        }
-
-        spectral_scan_started = false;
-
-        /* Start spectral scan (if no downlink programmed) */
+        /* Start spectral scan, only in a gap of the TX timeline long enough for it */
         pthread_mutex_lock(&mx_concent);
-        /* -- Check if there is a downlink programmed */
-        for (i = 0; i < LGW_RF_CHAIN_NB; i++) {
+        tx_busy = false;
+        gap_us = UINT32_MAX;
+        x = lgw_tx_track(tx_status, NULL);
+        x |= lgw_get_instcnt(&count_us);
+        if (x != LGW_HAL_SUCCESS) {
+            MSG("ERROR: [spectral] failed to get TX status\n");
+            tx_busy = true;
+        }
+        for (i = 0; (i < LGW_RF_CHAIN_NB) && (tx_busy == false); i++) {
             if (tx_enable[i] == true) {
-                x = lgw_status((uint8_t)i, TX_STATUS, &tx_status);
-                if (x != LGW_HAL_SUCCESS) {
-                    printf("ERROR: failed to get TX status on chain %d\n", i);
-                } else {
-                    if (tx_status == TX_SCHEDULED || tx_status == TX_EMITTING) {
-                        printf("INFO: skip spectral scan (downlink programmed on RF chain %d)\n", i);
-                        break; /* exit for loop */
-                    }
+                if ((tx_status[i] == TX_SCHEDULED) || (tx_status[i] == TX_EMITTING) || (tx_staged[i] == true)) {
+                    MSG_DEBUG(DEBUG_PKT_FWD, "INFO: [spectral] skip scan (downlink programmed on RF chain %d)\n", i);
+                    tx_busy = true;
+                } else if ((jit_get_gap(&jit_queue[i], count_us, &next_us) == JIT_ERROR_OK) && (next_us < gap_us)) {
+                    gap_us = next_us;
                 }
             }
         }
-        if (tx_status != TX_SCHEDULED && tx_status != TX_EMITTING) {
+        if ((tx_busy == false) && (gap_us < ((scan_ms + SCAN_GUARD_MS) * 1000))) {
+            MSG_DEBUG(DEBUG_PKT_FWD, "INFO: [spectral] skip scan (downlink due in %u us)\n", gap_us);
+            tx_busy = true;
+        }
+        if (tx_busy == false) {
             x = lgw_spectral_scan_start(freq_hz, spectral_scan_params.nb_scan);
             if (x != 0) {
-                printf("ERROR: spectral scan start failed\n");
-                pthread_mutex_unlock(&mx_concent);
-                continue; /* main while loop */
+                MSG("ERROR: [spectral] spectral scan start failed\n");
+                tx_busy = true;
             }
-            spectral_scan_started = true;
         }
         pthread_mutex_unlock(&mx_concent);
+        if (tx_busy == true) {
+            wait_ms(SCAN_RETRY_MS);
+            continue; /* main while loop */
+        }
 
-        if (spectral_scan_started == true) {
-            /* Wait for scan to be completed */
-            status = LGW_SPECTRAL_SCAN_STATUS_UNKNOWN;
-            timeout_start(&tm_start);
-            do {
-                /* handle timeout */
-                if (timeout_check(tm_start, 2000) != 0) {
-                    printf("ERROR: %s: TIMEOUT on Spectral Scan\n", __FUNCTION__);
-                    break;  /* do while */
-                }
+        /* Wait for the expected scan duration, then poll for its completion */
+        timeout_start(&tm_start);
+        start_us = host_time_us();
+        wait_ms(scan_ms);
+        status = LGW_SPECTRAL_SCAN_STATUS_UNKNOWN;
+        nb_poll = 0;
+        do {
+            /* handle timeout */
+            if (timeout_check(tm_start, 2000) != 0) {
+                MSG("ERROR: [spectral] TIMEOUT on Spectral Scan\n");
+                break;  /* do while */
+            }
 
-                /* get spectral scan status */
-                pthread_mutex_lock(&mx_concent);
-                x = lgw_spectral_scan_get_status(&status);
-                pthread_mutex_unlock(&mx_concent);
-                if (x != 0) {
-                    printf("ERROR: spectral scan status failed\n");
-                    break; /* do while */
-                }
+            /* get spectral scan status */
+            pthread_mutex_lock(&mx_concent);
+            x = lgw_spectral_scan_get_status(&status);
+            pthread_mutex_unlock(&mx_concent);
+            nb_poll += 1;
+            if (x != 0) {
+                MSG("ERROR: [spectral] spectral scan status failed\n");
+                break; /* do while */
+            }
+            if ((status == LGW_SPECTRAL_SCAN_STATUS_COMPLETED) || (status == LGW_SPECTRAL_SCAN_STATUS_ABORTED)) {
+                break; /* do while */
+            }
 
-                /* wait a bit before checking status again */
-                wait_ms(10);
-            } while (status != LGW_SPECTRAL_SCAN_STATUS_COMPLETED && status != LGW_SPECTRAL_SCAN_STATUS_ABORTED);
+            /* wait a bit before checking status again */
+            wait_ms(SCAN_POLL_MS);
+        } while (!exit_sig && !quit_sig);
+
+        if (status == LGW_SPECTRAL_SCAN_STATUS_COMPLETED) {
+            /* Update the scan duration: shorten it while it is completed on the first poll */
+            elapsed_ms = (uint32_t)((host_time_us() - start_us) / 1000);
+            if (nb_poll > 1) {
+                scan_ms = elapsed_ms;
+            } else if (scan_ms > 1) {
+                scan_ms -= (scan_ms + 7) / 8;
+            }
 
-            if (status == LGW_SPECTRAL_SCAN_STATUS_COMPLETED) {
-                /* Get spectral scan results */
-                memset(levels, 0, sizeof levels);
-                memset(results, 0, sizeof results);
-                pthread_mutex_lock(&mx_concent);
-                x = lgw_spectral_scan_get_results(levels, results);
-                pthread_mutex_unlock(&mx_concent);
-                if (x != 0) {
-                    printf("ERROR: spectral scan get results failed\n");
-                    continue; /* main while loop */
-                }
+            /* Get spectral scan results */
+            memset(levels, 0, sizeof levels);
+            memset(results, 0, sizeof results);
+            pthread_mutex_lock(&mx_concent);
+            x = lgw_spectral_scan_get_results(levels, results);
+            pthread_mutex_unlock(&mx_concent);
+            if (x != 0) {
+                MSG("ERROR: [spectral] spectral scan get results failed\n");
+                continue; /* main while loop */
+            }
+            spectral_push(freq_hz, levels, results);
+            MSG_DEBUG(DEBUG_PKT_FWD, "INFO: [spectral] %u Hz scanned in %u ms\n", freq_hz, elapsed_ms);
 
-                /* print results */
-                printf("SPECTRAL SCAN - %u Hz: ", freq_hz);
-                for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
-                    printf("%u ", results[i]);
-                }
-                printf("\n");
+            /* Next frequency to scan */
+            freq_hz += SPECTRAL_CHAN_SPACING;
+            if (freq_hz >= freq_hz_stop) {
+                freq_hz = spectral_scan_params.freq_hz_start;
+            }
+        } else if (status == LGW_SPECTRAL_SCAN_STATUS_ABORTED) {
+            MSG_DEBUG(DEBUG_PKT_FWD, "INFO: [spectral] spectral scan has been aborted\n");
+            continue; /* main while loop, retry the same channel */
+        } else {
+            MSG("ERROR: [spectral] spectral scan status is unexpected 0x%02X\n", status);
+        }
 
-                /* Next frequency to scan */
-                freq_hz += 200000; /* 200kHz channels */
-                if (freq_hz >= freq_hz_stop) {
-                    freq_hz = spectral_scan_params.freq_hz_start;
-                }
-            } else if (status == LGW_SPECTRAL_SCAN_STATUS_ABORTED) {
-                printf("INFO: %s: spectral scan has been aborted\n", __FUNCTION__);
-            } else {
-                printf("ERROR: %s: spectral scan status us unexpected 0x%02X\n", __FUNCTION__, status);
+        /* Pace the scan thread (at least 1 sec), and avoid waiting several seconds when exit */
+        for (i = 0; i < (int)(spectral_scan_params.pace_s ? spectral_scan_params.pace_s : 1); i++) {
+            if (exit_sig || quit_sig) {
+                exit_thread = true;
+                break;
             }
+            wait_ms(1000);
+        }
+        if (exit_thread == true) {
+            break;
+        }
+    }
+    MSG("\nINFO: End of Spectral Scan thread\n");
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- THREAD 7: FETCHING PACKETS FROM ONE CARD (SEVERAL CARDS CONFIGURED) -- */
+
+void * thread_fetch(void * arg) {
+    uint8_t card = *(uint8_t *)arg;
+    /* preallocated buffers of each card, kept off the thread stack */
+    static struct lgw_pkt_rx_meta_s rxpkt_card[NB_CARD_MAX][NB_PKT_MAX]; /* inbound packets metadata */
+    static uint8_t rxpayload_card[NB_CARD_MAX][LGW_RX_PAYLOAD_ARENA_SIZE(NB_PKT_MAX)]; /* inbound packets payloads */
+    struct lgw_pkt_rx_meta_s *rxpkt = rxpkt_card[card];
+    uint8_t *rxpayload = rxpayload_card[card];
+    uint32_t inst_cnt;
+    uint64_t now_us;
+    int nb_pkt;
+    int i, x;
+
+    /* all HAL calls of this thread are done on the card instance */
+    lgw_handle_select(card_handle[card]);
+
+    MSG("INFO: [fetch] thread started for card %u\n", card);
+
+    while (!exit_sig && !quit_sig) {
+        /* the first card is shared with the downstream, GPS and validation threads */
+        if (card == 0) {
+            pthread_mutex_lock(&mx_concent);
+        }
+        nb_pkt = lgw_receive_compact(NB_PKT_MAX, rxpkt, rxpayload, sizeof rxpayload_card[card]);
+        x = lgw_get_instcnt(&inst_cnt);
+        now_us = host_time_us();
+        if (card == 0) {
+            pthread_mutex_unlock(&mx_concent);
+        }
+        if ((nb_pkt == LGW_HAL_ERROR) || (x != LGW_HAL_SUCCESS)) {
+            MSG("ERROR: [fetch] failed packet fetch on card %u, exiting\n", card);
+            exit(EXIT_FAILURE);
+        }
+
+        /* update the card counter <-> host time reference */
+        pthread_mutex_lock(&mx_card_timeref);
+        card_timeref_cnt[card] = inst_cnt;
+        card_timeref_host[card] = now_us;
+        pthread_mutex_unlock(&mx_card_timeref);
+
+        if (nb_pkt == 0) {
+            wait_ms(FETCH_SLEEP_MS);
+            continue;
+        }
+
+        for (i = 0; i < nb_pkt; i++) {
+            /* reception time in host time base, common to all cards */
+            dedup_push(card, &rxpkt[i], rxpayload + rxpkt[i].payload_offset, now_us - (uint32_t)(inst_cnt - rxpkt[i].count_us), now_us);
         }
     }
-    printf("\nINFO: End of Spectral Scan thread\n");
+
+    MSG("\nINFO: End of fetch thread for card %u\n", card);
+
+    return NULL;
 }
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,320 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2019 Semtech
+
+Description:
+    LoRa concentrator : rolling RSSI histograms of the channels monitored by
+    the background spectral scan
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf, fprintf, snprintf */
+#include <string.h>     /* memset, memcpy */
+#include <pthread.h>
+
+#include "trace.h"
+#include "spectral.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+struct spectral_chan_s {
+    int16_t levels[LGW_SPECTRAL_SCAN_RESULT_SIZE];  /* RSSI thresholds of the last scan */
+    uint16_t hist[SPECTRAL_RING_SIZE][LGW_SPECTRAL_SCAN_RESULT_SIZE]; /* Last scans, oldest at index head when full */
+    uint32_t sum[LGW_SPECTRAL_SCAN_RESULT_SIZE];    /* Sum of the histograms held */
+    uint8_t head;                                   /* Next histogram to be replaced */
+    uint8_t count;                                  /* Number of histograms held */
+};
+
+struct spectral_lbt_s {
+    uint32_t freq_hz;                               /* Frequency of the blocked TX, 0 if unused */
+    uint8_t count;                                  /* Number of LBT failures, up to SPECTRAL_LBT_COUNT_MAX */
+    time_t last;                                    /* Time of the last failure */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
+
+static pthread_mutex_t mx_spectral = PTHREAD_MUTEX_INITIALIZER; /* control access to the histograms */
+
+static uint32_t spectral_freq_start = 0;
+static uint8_t spectral_nb_chan = 0;
+static struct spectral_chan_s spectral_chan[SPECTRAL_CHAN_MAX];
+static struct spectral_lbt_s spectral_lbt[SPECTRAL_LBT_CHAN_MAX];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static bool chan_is_same(uint32_t a, uint32_t b) {
+    return ((a > b) ? (a - b) : (b - a)) < (SPECTRAL_CHAN_SPACING / 2);
+}
+
+static int chan_index(uint32_t freq_hz) {
+    uint32_t i;
+
+    if (freq_hz + (SPECTRAL_CHAN_SPACING / 2) < spectral_freq_start) {
+        return -1;
+    }
+    i = (freq_hz + (SPECTRAL_CHAN_SPACING / 2) - spectral_freq_start) / SPECTRAL_CHAN_SPACING;
+
+    return (i < spectral_nb_chan) ? (int)i : -1;
+}
+
+/* The histogram bins go from the highest level (index 0) to the lowest one
+ * (last index, points below the lowest threshold) */
+static int16_t chan_percentile(const struct spectral_chan_s *chan, uint8_t percent) {
+    uint64_t total = 0;
+    uint64_t cumul = 0;
+    int i;
+
+    for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
+        total += chan->sum[i];
+    }
+    for (i = LGW_SPECTRAL_SCAN_RESULT_SIZE - 1; i > 0; i--) {
+        cumul += chan->sum[i];
+        if ((cumul * 100) >= (total * percent)) {
+            break;
+        }
+    }
+
+    return chan->levels[i];
+}
+
+static int lbt_penalty(uint32_t freq_hz, time_t now) {
+    int i;
+
+    for (i = 0; i < SPECTRAL_LBT_CHAN_MAX; i++) {
+        if ((spectral_lbt[i].freq_hz != 0) && (chan_is_same(spectral_lbt[i].freq_hz, freq_hz) == true)) {
+            if (difftime(now, spectral_lbt[i].last) > SPECTRAL_LBT_HOLD_S) {
+                return 0;
+            }
+            return spectral_lbt[i].count * SPECTRAL_LBT_PENALTY_DB;
+        }
+    }
+
+    return 0;
+}
+
+/* Base of the score: RSSI percentile of the scanned channel */
+static int chan_base(uint32_t freq_hz, int16_t *base_db) {
+    int x = chan_index(freq_hz);
+
+    if ((x < 0) || (spectral_chan[x].count == 0)) {
+        return -1;
+    }
+    *base_db = chan_percentile(&spectral_chan[x], SPECTRAL_SCORE_PERCENT);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ----------------------------------------- */
+
+int spectral_init(uint32_t freq_hz_start, uint8_t nb_chan) {
+    if (nb_chan > SPECTRAL_CHAN_MAX) {
+        MSG("ERROR: [spectral] %u channels to be scanned, %u max\n", nb_chan, SPECTRAL_CHAN_MAX);
+        return -1;
+    }
+
+    pthread_mutex_lock(&mx_spectral);
+    spectral_freq_start = freq_hz_start;
+    spectral_nb_chan = nb_chan;
+    memset(spectral_chan, 0, sizeof spectral_chan);
+    pthread_mutex_unlock(&mx_spectral);
+
+    return 0;
+}
+
+int spectral_push(uint32_t freq_hz, const int16_t levels[LGW_SPECTRAL_SCAN_RESULT_SIZE], const uint16_t results[LGW_SPECTRAL_SCAN_RESULT_SIZE]) {
+    struct spectral_chan_s *chan;
+    int i, x;
+
+    pthread_mutex_lock(&mx_spectral);
+
+    x = chan_index(freq_hz);
+    if (x < 0) {
+        pthread_mutex_unlock(&mx_spectral);
+        return -1;
+    }
+    chan = &spectral_chan[x];
+
+    /* Replace the oldest histogram, keeping the sum up to date */
+    for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
+        if (chan->count == SPECTRAL_RING_SIZE) {
+            chan->sum[i] -= chan->hist[chan->head][i];
+        }
+        chan->hist[chan->head][i] = results[i];
+        chan->sum[i] += results[i];
+    }
+    memcpy(chan->levels, levels, sizeof chan->levels);
+    chan->head = (chan->head + 1) % SPECTRAL_RING_SIZE;
+    if (chan->count < SPECTRAL_RING_SIZE) {
+        chan->count += 1;
+    }
+
+    pthread_mutex_unlock(&mx_spectral);
+
+    return 0;
+}
+
+int spectral_get_percentile(uint32_t freq_hz, uint8_t percent, int16_t *level_dbm) {
+    int x;
+
+    if ((level_dbm == NULL) || (percent > 100)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&mx_spectral);
+
+    x = chan_index(freq_hz);
+    if ((x < 0) || (spectral_chan[x].count == 0)) {
+        pthread_mutex_unlock(&mx_spectral);
+        return -1;
+    }
+    *level_dbm = chan_percentile(&spectral_chan[x], percent);
+
+    pthread_mutex_unlock(&mx_spectral);
+
+    return 0;
+}
+
+void spectral_lbt_busy(uint32_t freq_hz, time_t now) {
+    int i;
+    int x = -1;
+
+    pthread_mutex_lock(&mx_spectral);
+
+    /* Entry of that frequency, or the oldest one to be reused */
+    for (i = 0; i < SPECTRAL_LBT_CHAN_MAX; i++) {
+        if ((spectral_lbt[i].freq_hz != 0) && (chan_is_same(spectral_lbt[i].freq_hz, freq_hz) == true)) {
+            x = i;
+            break;
+        }
+        if ((x == -1) || (spectral_lbt[i].freq_hz == 0) || ((spectral_lbt[x].freq_hz != 0) && (spectral_lbt[i].last < spectral_lbt[x].last))) {
+            x = i;
+        }
+    }
+    if ((spectral_lbt[x].freq_hz == 0) || (chan_is_same(spectral_lbt[x].freq_hz, freq_hz) == false) || (difftime(now, spectral_lbt[x].last) > SPECTRAL_LBT_HOLD_S)) {
+        spectral_lbt[x].freq_hz = freq_hz;
+        spectral_lbt[x].count = 0;
+    }
+    if (spectral_lbt[x].count < SPECTRAL_LBT_COUNT_MAX) {
+        spectral_lbt[x].count += 1;
+    }
+    spectral_lbt[x].last = now;
+
+    pthread_mutex_unlock(&mx_spectral);
+}
+
+int spectral_get_score(uint32_t freq_hz, time_t now, int16_t *score_db) {
+    int16_t base_db = 0;
+    int penalty;
+    int x;
+
+    if (score_db == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&mx_spectral);
+    x = chan_base(freq_hz, &base_db);
+    penalty = lbt_penalty(freq_hz, now);
+    pthread_mutex_unlock(&mx_spectral);
+
+    if ((x != 0) && (penalty == 0)) {
+        return -1;
+    }
+    *score_db = base_db + penalty;
+
+    return 0;
+}
+
+int spectral_select(const uint32_t *freq_hz, int nb_freq, int default_idx, time_t now) {
+    int16_t base_db[nb_freq];
+    bool known[nb_freq];
+    int16_t worst_db = INT16_MIN;
+    int score, best_score = 0, default_score = 0;
+    int i, best = default_idx;
+    bool any = false;
+
+    if ((freq_hz == NULL) || (nb_freq <= 1) || (default_idx < 0) || (default_idx >= nb_freq)) {
+        return default_idx;
+    }
+
+    pthread_mutex_lock(&mx_spectral);
+
+    for (i = 0; i < nb_freq; i++) {
+        known[i] = (chan_base(freq_hz[i], &base_db[i]) == 0);
+        if ((known[i] == true) && (base_db[i] > worst_db)) {
+            worst_db = base_db[i];
+        }
+    }
+    for (i = 0; i < nb_freq; i++) {
+        score = lbt_penalty(freq_hz[i], now);
+        any |= (known[i] == true) || (score > 0);
+        score += (known[i] == true) ? base_db[i] : ((worst_db != INT16_MIN) ? worst_db : 0);
+        if (i == default_idx) {
+            default_score = score;
+        }
+        if ((i == 0) || (score < best_score)) {
+            best_score = score;
+            best = i;
+        }
+    }
+
+    pthread_mutex_unlock(&mx_spectral);
+
+    if ((any == false) || ((default_score - best_score) < SPECTRAL_SELECT_MARGIN_DB)) {
+        return default_idx;
+    }
+
+    return best;
+}
+
+int spectral_report(char *json, int size) {
+    int i, n, last;
+    int k = 0;
+
+    json[0] = '\0';
+    n = snprintf(json, size, ",\"spectral\":[");
+    if (n >= (size - 1)) {
+        json[0] = '\0'; /* not even room for the closing bracket */
+        return 0;
+    }
+
+    pthread_mutex_lock(&mx_spectral);
+    for (i = 0; i < spectral_nb_chan; i++) {
+        if (spectral_chan[i].count == 0) {
+            continue;
+        }
+        last = n;
+        n += snprintf(json + n, size - n, "%s{\"freq\":%u,\"n\":%u,\"p\":[%d,%d,%d]}", (k > 0) ? "," : "",
+                        spectral_freq_start + i * SPECTRAL_CHAN_SPACING, spectral_chan[i].count,
+                        chan_percentile(&spectral_chan[i], 10), chan_percentile(&spectral_chan[i], 50), chan_percentile(&spectral_chan[i], 90));
+        if (n >= (size - 1)) {
+            n = last; /* does not fit with the closing bracket, drop it */
+            break;
+        }
+        k += 1;
+    }
+    pthread_mutex_unlock(&mx_spectral);
+
+    if (k == 0) {
+        json[0] = '\0';
+    } else {
+        snprintf(json + n, size - n, "]");
+    }
+
+    return k;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,342 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Feed the spectral monitor with synthetic scan histograms and check the
+    RSSI percentiles, the eviction of the oldest scans, the downlink frequency
+    selection (margin and LBT penalty) and the truncation of the JSON report.
+    No hardware needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_FAILURE */
+#include <string.h>     /* memset, strcmp, strstr */
+#include <time.h>       /* time_t */
+
+#include "spectral.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define FREQ_START      868100000   /* first monitored channel */
+#define NB_CHAN         8
+
+#define FREQ_PERCENTILE (FREQ_START + 0 * SPECTRAL_CHAN_SPACING)
+#define FREQ_RING       (FREQ_START + 1 * SPECTRAL_CHAN_SPACING)
+#define FREQ_QUIET      (FREQ_START + 2 * SPECTRAL_CHAN_SPACING)
+#define FREQ_CLOSE      (FREQ_START + 3 * SPECTRAL_CHAN_SPACING) /* 2 dB above FREQ_QUIET */
+#define FREQ_LOUD       (FREQ_START + 4 * SPECTRAL_CHAN_SPACING) /* 4 dB above FREQ_QUIET */
+#define FREQ_UNSCANNED  (FREQ_START + 5 * SPECTRAL_CHAN_SPACING)
+
+#define BIN_QUIET       30          /* histogram bin of all the points of FREQ_QUIET */
+
+#define TEST_TIME       1586822400  /* 2020-04-14T00:00:00Z */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static int16_t levels[LGW_SPECTRAL_SCAN_RESULT_SIZE];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* push a scan with all its points in one bin */
+static int push_bin(uint32_t freq_hz, int bin, uint16_t nb_points) {
+    uint16_t results[LGW_SPECTRAL_SCAN_RESULT_SIZE];
+
+    memset(results, 0, sizeof results);
+    results[bin] = nb_points;
+    return spectral_push(freq_hz, levels, results);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int check_percentile(uint32_t freq_hz, uint8_t percent, int bin) {
+    int16_t level = 0;
+
+    if (spectral_get_percentile(freq_hz, percent, &level) != 0) {
+        printf("ERROR: no %u%% percentile for %u Hz\n", percent, freq_hz);
+        return -1;
+    }
+    if (level != levels[bin]) {
+        printf("ERROR: %u%% percentile of %u Hz is %d dBm, expected %d dBm\n", percent, freq_hz, level, levels[bin]);
+        return -1;
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int test_percentile(void) {
+    uint16_t results[LGW_SPECTRAL_SCAN_RESULT_SIZE];
+    int16_t level;
+
+    if ((push_bin(FREQ_START - SPECTRAL_CHAN_SPACING, 0, 100) != -1) || (push_bin(FREQ_START + NB_CHAN * SPECTRAL_CHAN_SPACING, 0, 100) != -1)) {
+        printf("ERROR: scan accepted for a frequency which is not monitored\n");
+        return -1;
+    }
+    if (spectral_get_percentile(FREQ_PERCENTILE, 50, &level) != -1) {
+        printf("ERROR: percentile returned for a channel never scanned\n");
+        return -1;
+    }
+
+    /* 10 points in bin 30, 40 in bin 20, 50 in bin 10 (the lower the bin, the higher the level) */
+    memset(results, 0, sizeof results);
+    results[30] = 10;
+    results[20] = 40;
+    results[10] = 50;
+    if (spectral_push(FREQ_PERCENTILE, levels, results) != 0) {
+        printf("ERROR: failed to push a scan\n");
+        return -1;
+    }
+    if ((check_percentile(FREQ_PERCENTILE, 0, LGW_SPECTRAL_SCAN_RESULT_SIZE - 1) != 0) ||
+        (check_percentile(FREQ_PERCENTILE, 10, 30) != 0) ||
+        (check_percentile(FREQ_PERCENTILE, 11, 20) != 0) ||
+        (check_percentile(FREQ_PERCENTILE, 50, 20) != 0) ||
+        (check_percentile(FREQ_PERCENTILE, 51, 10) != 0) ||
+        (check_percentile(FREQ_PERCENTILE, 100, 10) != 0)) {
+        return -1;
+    }
+    /* a frequency within half a channel spacing reads the same channel */
+    if (check_percentile(FREQ_PERCENTILE + (SPECTRAL_CHAN_SPACING / 2) - 1, 50, 20) != 0) {
+        return -1;
+    }
+    if (spectral_get_percentile(FREQ_PERCENTILE, 101, &level) != -1) {
+        printf("ERROR: percentile above 100%% accepted\n");
+        return -1;
+    }
+
+    printf("PERCENTILE: 0/10/50/100%% percentiles of a 3 levels histogram are right\n");
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int test_ring(void) {
+    int i;
+
+    /* fill the ring with loud scans, then replace them one by one with quiet ones */
+    for (i = 0; i < SPECTRAL_RING_SIZE; i++) {
+        push_bin(FREQ_RING, 5, 100);
+    }
+    if (check_percentile(FREQ_RING, 1, 5) != 0) {
+        return -1;
+    }
+    for (i = 1; i <= SPECTRAL_RING_SIZE; i++) {
+        push_bin(FREQ_RING, 25, 100);
+        /* i quiet scans over SPECTRAL_RING_SIZE */
+        if ((check_percentile(FREQ_RING, (100 * i) / SPECTRAL_RING_SIZE, 25) != 0) ||
+            (check_percentile(FREQ_RING, 100, (i < SPECTRAL_RING_SIZE) ? 5 : 25) != 0)) {
+            printf("ERROR: after %d scans pushed on a full ring\n", i);
+            return -1;
+        }
+    }
+    /* more scans than the ring size, the sum must not drift */
+    for (i = 0; i < (3 * SPECTRAL_RING_SIZE) + 1; i++) {
+        push_bin(FREQ_RING, (i % 2) ? 5 : 25, 100);
+    }
+    if ((check_percentile(FREQ_RING, 50, 25) != 0) || (check_percentile(FREQ_RING, 51, 5) != 0)) {
+        return -1;
+    }
+
+    printf("RING: oldest scans evicted once %d scans are held\n", SPECTRAL_RING_SIZE);
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int check_select(const uint32_t *freq_hz, int nb_freq, int default_idx, time_t now, int expected, const char *desc) {
+    int x = spectral_select(freq_hz, nb_freq, default_idx, now);
+
+    if (x != expected) {
+        printf("ERROR: %s: frequency %d selected, expected %d\n", desc, x, expected);
+        return -1;
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int test_select(void) {
+    const uint32_t freq_hz[3] = {FREQ_QUIET, FREQ_CLOSE, FREQ_LOUD};
+    const uint32_t freq_unscanned[2] = {FREQ_QUIET, FREQ_UNSCANNED};
+    time_t now = TEST_TIME;
+    int16_t score;
+
+    if (check_select(freq_hz, 3, 1, now, 1, "nothing known") != 0) {
+        return -1;
+    }
+    if (spectral_get_score(FREQ_QUIET, now, &score) != -1) {
+        printf("ERROR: score returned for a frequency never scanned nor blocked\n");
+        return -1;
+    }
+
+    push_bin(FREQ_QUIET, BIN_QUIET, 100);
+    push_bin(FREQ_CLOSE, BIN_QUIET - 1, 100);
+    push_bin(FREQ_LOUD, BIN_QUIET - 2, 100);
+    if ((spectral_get_score(FREQ_QUIET, now, &score) != 0) || (score != levels[BIN_QUIET])) {
+        printf("ERROR: score of a scanned frequency is not its %d%% percentile\n", SPECTRAL_SCORE_PERCENT);
+        return -1;
+    }
+
+    /* 2 dB better is below the margin, 4 dB better is above */
+    if ((check_select(freq_hz, 3, 1, now, 1, "2 dB quieter") != 0) ||
+        (check_select(freq_hz, 3, 2, now, 0, "4 dB quieter") != 0) ||
+        (check_select(freq_hz, 3, 0, now, 0, "default is the quietest") != 0)) {
+        return -1;
+    }
+
+    /* an unscanned frequency gets the worst score: it is never better */
+    if ((check_select(freq_unscanned, 2, 0, now, 0, "unscanned alternative") != 0) ||
+        (check_select(freq_unscanned, 2, 1, now, 1, "unscanned default") != 0)) {
+        return -1;
+    }
+
+    /* 1 LBT failure: quietest frequency now 4 dB above the 2nd one */
+    spectral_lbt_busy(FREQ_QUIET, now);
+    if ((spectral_get_score(FREQ_QUIET, now, &score) != 0) || (score != levels[BIN_QUIET] + SPECTRAL_LBT_PENALTY_DB)) {
+        printf("ERROR: LBT penalty not accounted in the score\n");
+        return -1;
+    }
+    if (check_select(freq_hz, 3, 0, now, 1, "1 LBT failure") != 0) {
+        return -1;
+    }
+    /* 2 LBT failures: the 2nd one is still only 2 dB better than the loudest */
+    spectral_lbt_busy(FREQ_QUIET, now + 1);
+    if (check_select(freq_hz, 3, 2, now + 1, 2, "2 LBT failures, loudest default") != 0) {
+        return -1;
+    }
+    /* LBT failures forgotten after SPECTRAL_LBT_HOLD_S */
+    if (check_select(freq_hz, 3, 0, now + 2 + SPECTRAL_LBT_HOLD_S, 0, "LBT failures expired") != 0) {
+        return -1;
+    }
+    /* an unscanned frequency with LBT failures is known */
+    spectral_lbt_busy(FREQ_UNSCANNED, now);
+    if ((spectral_get_score(FREQ_UNSCANNED, now, &score) != 0) || (score != SPECTRAL_LBT_PENALTY_DB)) {
+        printf("ERROR: score of an unscanned frequency blocked by LBT is %d, expected %d\n", score, SPECTRAL_LBT_PENALTY_DB);
+        return -1;
+    }
+
+    printf("SELECT: %d dB margin and %d dB LBT penalty applied\n", SPECTRAL_SELECT_MARGIN_DB, SPECTRAL_LBT_PENALTY_DB);
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int test_report(void) {
+    char full[1024];
+    char json[1024];
+    char expected[1024];
+    const char *third;
+    int nb_chan, x, i;
+
+    /* 3 more channels scanned, after the ones of the previous tests */
+    for (i = 2; i < 5; i++) {
+        push_bin(FREQ_START + i * SPECTRAL_CHAN_SPACING, 30, 100);
+    }
+
+    nb_chan = spectral_report(full, sizeof full);
+    if ((nb_chan != 5) || (strncmp(full, ",\"spectral\":[{", 14) != 0) || (full[strlen(full) - 1] != ']')) {
+        printf("ERROR: report of %d channels, expected 5: %s\n", nb_chan, full);
+        return -1;
+    }
+    if (strstr(full, "{\"freq\":868300000,\"n\":16,") == NULL) {
+        printf("ERROR: number of scans held not capped to %d: %s\n", SPECTRAL_RING_SIZE, full);
+        return -1;
+    }
+
+    /* buffer just large enough for the first 2 channels, then 1 byte short */
+    third = strstr(full, "},{");
+    third = (third != NULL) ? strstr(third + 1, "},{") : NULL;
+    if (third == NULL) {
+        printf("ERROR: unexpected report: %s\n", full);
+        return -1;
+    }
+    snprintf(expected, sizeof expected, "%.*s]", (int)(third + 1 - full), full);
+    x = spectral_report(json, strlen(expected) + 1);
+    if ((x != 2) || (strcmp(json, expected) != 0)) {
+        printf("ERROR: truncated report of %d channels, expected 2: %s\n", x, json);
+        return -1;
+    }
+    x = spectral_report(json, strlen(expected));
+    if ((x != 1) || (json[strlen(json) - 1] != ']') || (strncmp(json, full, strlen(json) - 1) != 0)) {
+        printf("ERROR: truncated report of %d channels, expected 1: %s\n", x, json);
+        return -1;
+    }
+
+    /* not even the header fits */
+    memset(json, 'x', sizeof json);
+    x = spectral_report(json, 8);
+    if ((x != 0) || (json[0] != '\0') || (json[8] != 'x')) {
+        printf("ERROR: report in a buffer too small\n");
+        return -1;
+    }
+
+    /* nothing scanned */
+    spectral_init(FREQ_START, NB_CHAN);
+    if ((spectral_report(json, sizeof json) != 0) || (json[0] != '\0')) {
+        printf("ERROR: report of channels never scanned: %s\n", json);
+        return -1;
+    }
+
+    printf("REPORT: channels which do not fit dropped, report kept valid\n");
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(void)
+{
+    int i;
+    int ret = EXIT_SUCCESS;
+
+    printf("===== Spectral monitor test =====\n");
+
+    /* same RSSI thresholds as the sx1261 scan: 2 dB steps from the highest one */
+    for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
+        levels[i] = -32 - (2 * i);
+    }
+
+    if (spectral_init(FREQ_START, SPECTRAL_CHAN_MAX + 1) != -1) {
+        printf("ERROR: more than %d channels accepted\n", SPECTRAL_CHAN_MAX);
+        ret = EXIT_FAILURE;
+    }
+    if ((ret == EXIT_SUCCESS) && (spectral_init(FREQ_START, NB_CHAN) != 0)) {
+        ret = EXIT_FAILURE;
+    }
+
+    if ((ret == EXIT_SUCCESS) && ((test_percentile() != 0) || (test_ring() != 0) || (test_select() != 0) || (test_report() != 0))) {
+        ret = EXIT_FAILURE;
+    }
+
+    printf("=========== Test %s ===========\n", (ret == EXIT_SUCCESS) ? "successful" : "failed");
+
+    return ret;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
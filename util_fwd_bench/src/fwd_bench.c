@@ -0,0 +1,723 @@
+/*
+  ______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Load generator and latency harness for the packet forwarder.
+    Runs lora_pkt_fwd on the software SX1302 of the HAL, injects uplinks at a
+    given rate and acts as the network server to measure the forwarding
+    latencies, the losses and the CPU time of the forwarder.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>      /* open */
+#include <poll.h>       /* poll */
+#include <time.h>       /* clock_gettime */
+#include <signal.h>     /* sigaction, kill */
+#include <getopt.h>     /* getopt_long */
+#include <limits.h>     /* PATH_MAX */
+#include <sys/stat.h>   /* mkdir */
+#include <sys/wait.h>   /* waitpid */
+#include <sys/socket.h> /* socket specific definitions */
+#include <netinet/in.h> /* INET constants and stuff */
+#include <arpa/inet.h>  /* IP address conversion stuff */
+
+#include "parson.h"
+#include "base64.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define MSG(args...) printf(args) /* message that is destined to the user */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define PROTOCOL_VERSION    2
+#define PKT_PUSH_DATA       0
+#define PKT_PUSH_ACK        1
+#define PKT_PULL_DATA       2
+#define PKT_PULL_RESP       3
+#define PKT_PULL_ACK        4
+#define PKT_TX_ACK          5
+
+#define DEFAULT_FWD_PATH    "../packet_forwarder/lora_pkt_fwd"
+#define DEFAULT_PORT        1780
+#define DEFAULT_RATE        50      /* uplinks per second */
+#define DEFAULT_DURATION_S  10
+#define DEFAULT_DOWN_RATE   2       /* downlinks per second */
+#define DEFAULT_WARMUP_S    3       /* time given to the forwarder to start the concentrator */
+#define DRAIN_S             2       /* time waited for late packets after the last injection */
+#define POLL_PERIOD_MS      2
+
+#define UP_SEQ_SIZE         4       /* sequence number at the beginning of each uplink/downlink payload */
+#define DOWN_SEQ_FLAG       0x80000000
+#define DOWN_PAYLOAD_SIZE   16
+#define DOWN_FREQ_MHZ       868.1
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct bench_stat_s {
+    uint32_t nb;            /* number of latencies */
+    uint32_t * lat_us;      /* latencies, in microseconds */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static volatile bool exit_sig = false; /* 1 -> application terminates cleanly */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void usage(void);
+
+static void sig_handler(int sigio);
+
+static uint64_t host_time_us(void);
+
+static int parse_range(const char * arg, unsigned int * min, unsigned int * max);
+
+static int write_trace(const char * path, const char * tx_log_path, uint64_t origin_us, uint32_t nb_pkt, unsigned int rate, unsigned int sf_min, unsigned int sf_max, unsigned int size_min, unsigned int size_max);
+
+static int write_conf(const char * path, const char * trace_path, unsigned int port);
+
+static int read_cpu_ticks(pid_t pid, unsigned long long * ticks);
+
+static int cmp_u32(const void * a, const void * b);
+
+static void print_lat(const char * name, struct bench_stat_s * s);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+static void usage(void) {
+    printf("Available options:\n");
+    printf(" -h            Print this help\n");
+    printf(" -f <path>     Packet forwarder executable (default %s)\n", DEFAULT_FWD_PATH);
+    printf(" -p <uint>     UDP port of the network server stand-in (default %u)\n", DEFAULT_PORT);
+    printf(" -r <uint>     Uplinks injected per second (default %u)\n", DEFAULT_RATE);
+    printf(" -d <uint>     Duration of the injection, in seconds (default %u)\n", DEFAULT_DURATION_S);
+    printf(" -s <min-max>  Spreading factors of the uplinks, uniformly drawn (default 7-12)\n");
+    printf(" -z <min-max>  Payload sizes of the uplinks, uniformly drawn (default 10-60)\n");
+    printf(" -x <uint>     Downlinks (PULL_RESP) sent per second, 0 to disable (default %u)\n", DEFAULT_DOWN_RATE);
+    printf(" -w <uint>     Time given to the forwarder to start, in seconds (default %u)\n", DEFAULT_WARMUP_S);
+    printf(" -k            Keep the working directory (configuration, trace and forwarder log)\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sig_handler(int sigio) {
+    if ((sigio == SIGQUIT) || (sigio == SIGINT) || (sigio == SIGTERM)) {
+        exit_sig = true;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* CLOCK_MONOTONIC is shared with the software SX1302 of the forwarder (see @origin trace directive) */
+static uint64_t host_time_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * 1000000) + (uint64_t)(now.tv_nsec / 1000);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int parse_range(const char * arg, unsigned int * min, unsigned int * max) {
+    int i;
+
+    i = sscanf(arg, "%u-%u", min, max);
+    if (i == 1) {
+        *max = *min;
+    } else if ((i != 2) || (*min > *max)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* RX trace of the software SX1302, one uplink every 1/rate second from origin_us */
+static int write_trace(const char * path, const char * tx_log_path, uint64_t origin_us, uint32_t nb_pkt, unsigned int rate, unsigned int sf_min, unsigned int sf_max, unsigned int size_min, unsigned int size_max) {
+    FILE * f;
+    uint32_t k;
+    unsigned int sf, size, i;
+
+    f = fopen(path, "w");
+    if (f == NULL) {
+        MSG("ERROR: failed to create %s - %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    fprintf(f, "# generated by fwd_bench: %u uplinks, %u per second\n", nb_pkt, rate);
+    fprintf(f, "@origin %llu\n", (unsigned long long)origin_us);
+    fprintf(f, "@txlog %s\n", tx_log_path);
+    srand(1);
+    for (k = 0; k < nb_pkt; k++) {
+        sf = sf_min + ((unsigned int)rand() % (sf_max - sf_min + 1));
+        size = size_min + ((unsigned int)rand() % (size_max - size_min + 1));
+        fprintf(f, "%u %u %u 1 ok 9.5 120 %08X", (unsigned int)(((uint64_t)k * 1000000) / rate), k % 8, sf, k);
+        for (i = UP_SEQ_SIZE; i < size; i++) {
+            fprintf(f, "%02X", (unsigned int)rand() & 0xFF);
+        }
+        fputc('\n', f);
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* forwarder configuration: software SX1302, 8 multi-SF channels, server on localhost */
+static int write_conf(const char * path, const char * trace_path, unsigned int port) {
+    FILE * f;
+    int i;
+
+    f = fopen(path, "w");
+    if (f == NULL) {
+        MSG("ERROR: failed to create %s - %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    fprintf(f, "{\n    \"SX130x_conf\": {\n");
+    fprintf(f, "        \"com_type\": \"MOCK\",\n        \"com_path\": \"%s\",\n", trace_path);
+    fprintf(f, "        \"lorawan_public\": true,\n        \"clksrc\": 0,\n        \"antenna_gain\": 0,\n        \"full_duplex\": false,\n");
+    fprintf(f, "        \"fine_timestamp\": {\"enable\": false, \"mode\": \"all_sf\"},\n");
+    fprintf(f, "        \"radio_0\": {\"enable\": true, \"type\": \"SX1250\", \"freq\": 867500000, \"rssi_offset\": -215.4,\n");
+    fprintf(f, "                    \"rssi_tcomp\": {\"coeff_a\": 0, \"coeff_b\": 0, \"coeff_c\": 20.41, \"coeff_d\": 2162.56, \"coeff_e\": 0},\n");
+    fprintf(f, "                    \"tx_enable\": true, \"tx_freq_min\": 863000000, \"tx_freq_max\": 870000000,\n");
+    fprintf(f, "                    \"tx_gain_lut\": [{\"rf_power\": 14, \"pa_gain\": 0, \"pwr_idx\": 17}]},\n");
+    fprintf(f, "        \"radio_1\": {\"enable\": true, \"type\": \"SX1250\", \"freq\": 868500000, \"rssi_offset\": -215.4,\n");
+    fprintf(f, "                    \"rssi_tcomp\": {\"coeff_a\": 0, \"coeff_b\": 0, \"coeff_c\": 20.41, \"coeff_d\": 2162.56, \"coeff_e\": 0},\n");
+    fprintf(f, "                    \"tx_enable\": false},\n");
+    fprintf(f, "        \"chan_multiSF_All\": {\"spreading_factor_enable\": [5, 6, 7, 8, 9, 10, 11, 12]},\n");
+    for (i = 0; i < 8; i++) {
+        fprintf(f, "        \"chan_multiSF_%d\": {\"enable\": true, \"radio\": %d, \"if\": %d},\n", i, (i < 3) ? 1 : 0, (i < 3) ? (-400000 + (i * 200000)) : (-400000 + ((i - 3) * 200000)));
+    }
+    fprintf(f, "        \"chan_Lora_std\": {\"enable\": false},\n");
+    fprintf(f, "        \"chan_FSK\": {\"enable\": false}\n");
+    fprintf(f, "    },\n    \"gateway_conf\": {\n");
+    fprintf(f, "        \"gateway_ID\": \"AA555A0000000000\",\n        \"server_address\": \"127.0.0.1\",\n");
+    fprintf(f, "        \"serv_port_up\": %u,\n        \"serv_port_down\": %u,\n", port, port);
+    fprintf(f, "        \"keepalive_interval\": 1,\n        \"stat_interval\": 30,\n        \"push_timeout_ms\": 100,\n");
+    fprintf(f, "        \"forward_crc_valid\": true,\n        \"forward_crc_error\": false,\n        \"forward_crc_disabled\": false\n");
+    fprintf(f, "    }\n}\n");
+
+    fclose(f);
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* user + system time of a process, in clock ticks */
+static int read_cpu_ticks(pid_t pid, unsigned long long * ticks) {
+    char path[64];
+    char buf[512];
+    char * p;
+    unsigned long long utime, stime;
+    FILE * f;
+    size_t n;
+
+    snprintf(path, sizeof path, "/proc/%d/stat", (int)pid);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    n = fread(buf, 1, sizeof buf - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    /* fields after the command name, which may contain spaces: state is field 3, utime 14, stime 15 */
+    p = strrchr(buf, ')');
+    if ((p == NULL) || (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)) {
+        return -1;
+    }
+    *ticks = utime + stime;
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int cmp_u32(const void * a, const void * b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void print_lat(const char * name, struct bench_stat_s * s) {
+    uint64_t sum = 0;
+    uint32_t i;
+
+    if (s->nb == 0) {
+        MSG("%-9s latency (us): no sample\n", name);
+        return;
+    }
+    qsort(s->lat_us, s->nb, sizeof s->lat_us[0], cmp_u32);
+    for (i = 0; i < s->nb; i++) {
+        sum += s->lat_us[i];
+    }
+    MSG("%-9s latency (us): min %u, avg %llu, p50 %u, p90 %u, p99 %u, max %u\n", name,
+        s->lat_us[0], (unsigned long long)(sum / s->nb), s->lat_us[s->nb / 2], s->lat_us[(s->nb * 9) / 10], s->lat_us[(s->nb * 99) / 100], s->lat_us[s->nb - 1]);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, x;
+    unsigned int arg_u;
+    const char * fwd_arg = DEFAULT_FWD_PATH;
+    char fwd_path[PATH_MAX];
+    unsigned int port = DEFAULT_PORT;
+    unsigned int rate = DEFAULT_RATE;
+    unsigned int duration_s = DEFAULT_DURATION_S;
+    unsigned int down_rate = DEFAULT_DOWN_RATE;
+    unsigned int warmup_s = DEFAULT_WARMUP_S;
+    unsigned int sf_min = 7, sf_max = 12;
+    unsigned int size_min = 10, size_max = 60;
+    bool keep_dir = false;
+    struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
+
+    /* working directory */
+    char work_dir[64];
+    char conf_path[PATH_MAX];
+    char trace_path[PATH_MAX];
+    char tx_log_path[PATH_MAX];
+    char log_path[PATH_MAX];
+
+    /* forwarder process */
+    pid_t pid;
+    int status;
+    bool fwd_running = true;
+    unsigned long long ticks_start = 0, ticks_end = 0;
+    bool ticks_valid = false;
+
+    /* network server stand-in */
+    int sock;
+    struct sockaddr_in addr;
+    struct sockaddr_in addr_up, addr_down;
+    socklen_t addr_len;
+    bool down_valid = false;
+    struct pollfd pfd;
+    uint8_t buf[65536];
+    uint8_t ack[12];
+    char json[512];
+    char data_b64[64];
+    uint8_t payload[256];
+    ssize_t n;
+
+    /* measurements */
+    uint32_t nb_up, nb_down_max;
+    uint64_t origin_us, end_us, now_us, next_down_us;
+    uint64_t * down_sent_us = NULL;
+    uint8_t * up_rcv = NULL;
+    uint32_t nb_rcv = 0, nb_dup = 0, nb_foreign = 0, nb_push = 0;
+    uint32_t nb_down = 0, nb_tx_ack = 0, nb_tx_err = 0, nb_tx_load = 0;
+    struct bench_stat_s up_stat = {0, NULL};
+    struct bench_stat_s down_stat = {0, NULL};
+    uint32_t seq;
+
+    /* TX log of the software SX1302 */
+    int tx_log_fd = -1;
+    char tx_line[1024];
+    size_t tx_line_len = 0;
+    char c;
+    unsigned long long load_us;
+    unsigned int rf, trig, cnt, size;
+    char hex[16];
+
+    JSON_Value * root_val;
+    JSON_Array * rxpk_array;
+    JSON_Object * rxpk;
+    const char * str;
+
+    /* Parameter parsing */
+    int option_index = 0;
+    static struct option long_options[] = {
+        {0, 0, 0, 0}
+    };
+
+    /* parse command line options */
+    while ((i = getopt_long (argc, argv, "hf:p:r:d:s:z:x:w:k", long_options, &option_index)) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+
+            case 'f':
+                fwd_arg = optarg;
+                break;
+
+            case 'p': /* <uint> UDP port */
+                i = sscanf(optarg, "%u", &arg_u);
+                if ((i != 1) || (arg_u == 0) || (arg_u > 65535)) {
+                    printf("ERROR: argument parsing of -p argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                port = arg_u;
+                break;
+
+            case 'r': /* <uint> Uplink rate */
+                i = sscanf(optarg, "%u", &arg_u);
+                if ((i != 1) || (arg_u == 0) || (arg_u > 100000)) {
+                    printf("ERROR: argument parsing of -r argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                rate = arg_u;
+                break;
+
+            case 'd': /* <uint> Duration */
+                i = sscanf(optarg, "%u", &arg_u);
+                if ((i != 1) || (arg_u == 0) || (arg_u > 3600)) {
+                    printf("ERROR: argument parsing of -d argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                duration_s = arg_u;
+                break;
+
+            case 's': /* <min-max> Spreading factors */
+                if ((parse_range(optarg, &sf_min, &sf_max) != 0) || (sf_min < 5) || (sf_max > 12)) {
+                    printf("ERROR: argument parsing of -s argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'z': /* <min-max> Payload sizes */
+                if ((parse_range(optarg, &size_min, &size_max) != 0) || (size_min < UP_SEQ_SIZE) || (size_max > 255)) {
+                    printf("ERROR: argument parsing of -z argument (sizes %u to 255). Use -h to print help\n", UP_SEQ_SIZE);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'x': /* <uint> Downlink rate */
+                i = sscanf(optarg, "%u", &arg_u);
+                if ((i != 1) || (arg_u > 1000)) {
+                    printf("ERROR: argument parsing of -x argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                down_rate = arg_u;
+                break;
+
+            case 'w': /* <uint> Warm-up */
+                i = sscanf(optarg, "%u", &arg_u);
+                if ((i != 1) || (arg_u > 60)) {
+                    printf("ERROR: argument parsing of -w argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                warmup_s = arg_u;
+                break;
+
+            case 'k':
+                keep_dir = true;
+                break;
+
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    if (realpath(fwd_arg, fwd_path) == NULL) {
+        MSG("ERROR: packet forwarder %s not found - %s\n", fwd_arg, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* configure signal handling */
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigact.sa_handler = sig_handler;
+    sigaction(SIGQUIT, &sigact, NULL);
+    sigaction(SIGINT, &sigact, NULL);
+    sigaction(SIGTERM, &sigact, NULL);
+
+    /* measurement buffers */
+    nb_up = rate * duration_s;
+    nb_down_max = down_rate * duration_s;
+    up_rcv = calloc(nb_up, sizeof *up_rcv);
+    up_stat.lat_us = calloc(nb_up, sizeof *up_stat.lat_us);
+    down_sent_us = calloc(nb_down_max + 1, sizeof *down_sent_us);
+    down_stat.lat_us = calloc(nb_down_max + 1, sizeof *down_stat.lat_us);
+    if ((up_rcv == NULL) || (up_stat.lat_us == NULL) || (down_sent_us == NULL) || (down_stat.lat_us == NULL)) {
+        MSG("ERROR: MALLOC FAIL\n");
+        return EXIT_FAILURE;
+    }
+
+    /* network server socket, bound before the forwarder starts */
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((sock < 0) || (bind(sock, (struct sockaddr *)&addr, sizeof addr) != 0)) {
+        MSG("ERROR: failed to bind UDP port %u - %s\n", port, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* working directory: forwarder configuration, RX trace, TX log and forwarder output */
+    snprintf(work_dir, sizeof work_dir, "/tmp/fwd_bench.%d", (int)getpid());
+    if (mkdir(work_dir, 0755) != 0) {
+        MSG("ERROR: failed to create working directory - %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    snprintf(conf_path, sizeof conf_path, "%s/global_conf.json", work_dir);
+    snprintf(trace_path, sizeof trace_path, "%s/rx_trace.txt", work_dir);
+    snprintf(tx_log_path, sizeof tx_log_path, "%s/tx_log.txt", work_dir);
+    snprintf(log_path, sizeof log_path, "%s/lora_pkt_fwd.log", work_dir);
+
+    origin_us = host_time_us() + ((uint64_t)warmup_s * 1000000);
+    end_us = origin_us + ((uint64_t)duration_s * 1000000);
+    if ((write_trace(trace_path, tx_log_path, origin_us, nb_up, rate, sf_min, sf_max, size_min, size_max) != 0) ||
+        (write_conf(conf_path, trace_path, port) != 0)) {
+        return EXIT_FAILURE;
+    }
+
+    MSG("INFO: %u uplinks/s (SF%u-%u, %u-%u bytes) for %u s, %u downlinks/s, working directory %s\n", rate, sf_min, sf_max, size_min, size_max, duration_s, down_rate, work_dir);
+    fflush(stdout);
+
+    /* start the forwarder, its output is logged in the working directory */
+    pid = fork();
+    if (pid < 0) {
+        MSG("ERROR: fork failed - %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (pid == 0) {
+        x = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if ((x < 0) || (chdir(work_dir) != 0)) {
+            _exit(EXIT_FAILURE);
+        }
+        dup2(x, STDOUT_FILENO);
+        dup2(x, STDERR_FILENO);
+        close(x);
+        close(sock);
+        execl(fwd_path, "lora_pkt_fwd", "-c", conf_path, (char *)NULL);
+        _exit(EXIT_FAILURE);
+    }
+
+    next_down_us = origin_us;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    while (!exit_sig) {
+        now_us = host_time_us();
+        if (now_us >= (end_us + (DRAIN_S * 1000000))) {
+            break;
+        }
+
+        /* forwarder still alive */
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            MSG("ERROR: packet forwarder exited prematurely, see %s\n", log_path);
+            fwd_running = false;
+            keep_dir = true;
+            break;
+        }
+
+        /* CPU time of the forwarder during the injection */
+        if (!ticks_valid && (now_us >= origin_us)) {
+            ticks_valid = (read_cpu_ticks(pid, &ticks_start) == 0);
+        }
+
+        /* downlinks */
+        if (down_valid && (down_rate > 0) && (now_us >= next_down_us) && (now_us < end_us) && (nb_down < nb_down_max)) {
+            seq = DOWN_SEQ_FLAG | nb_down;
+            memset(payload, 0, DOWN_PAYLOAD_SIZE);
+            payload[0] = (uint8_t)(seq >> 24);
+            payload[1] = (uint8_t)(seq >> 16);
+            payload[2] = (uint8_t)(seq >> 8);
+            payload[3] = (uint8_t)(seq >> 0);
+            bin_to_b64(payload, DOWN_PAYLOAD_SIZE, data_b64, sizeof data_b64);
+            x = snprintf(json, sizeof json, "{\"txpk\":{\"imme\":true,\"freq\":%.1f,\"rfch\":0,\"powe\":14,\"modu\":\"LORA\",\"datr\":\"SF7BW125\",\"codr\":\"4/5\",\"ipol\":true,\"size\":%u,\"data\":\"%s\"}}", DOWN_FREQ_MHZ, DOWN_PAYLOAD_SIZE, data_b64);
+            buf[0] = PROTOCOL_VERSION;
+            buf[1] = (uint8_t)(nb_down >> 8);
+            buf[2] = (uint8_t)(nb_down >> 0);
+            buf[3] = PKT_PULL_RESP;
+            memcpy(buf + 4, json, (size_t)x);
+            down_sent_us[nb_down] = host_time_us();
+            if (sendto(sock, buf, 4 + (size_t)x, 0, (struct sockaddr *)&addr_down, sizeof addr_down) > 0) {
+                nb_down += 1;
+            }
+            next_down_us += 1000000 / down_rate;
+        }
+
+        /* TX log: downlinks loaded in the concentrator */
+        if ((tx_log_fd < 0) && (access(tx_log_path, R_OK) == 0)) {
+            tx_log_fd = open(tx_log_path, O_RDONLY);
+        }
+        while ((tx_log_fd >= 0) && (read(tx_log_fd, &c, 1) == 1)) {
+            if (c != '\n') {
+                if (tx_line_len < (sizeof tx_line - 1)) {
+                    tx_line[tx_line_len++] = c;
+                }
+                continue;
+            }
+            tx_line[tx_line_len] = '\0';
+            tx_line_len = 0;
+            if ((sscanf(tx_line, "%llu %u %u %u %u %8s", &load_us, &rf, &trig, &cnt, &size, hex) == 6) && (sscanf(hex, "%8x", &seq) == 1) && ((seq & DOWN_SEQ_FLAG) != 0)) {
+                seq &= ~DOWN_SEQ_FLAG;
+                if (seq < nb_down) {
+                    down_stat.lat_us[down_stat.nb++] = (uint32_t)(load_us - down_sent_us[seq]);
+                    nb_tx_load += 1;
+                }
+            }
+        }
+
+        x = poll(&pfd, 1, POLL_PERIOD_MS);
+        if ((x <= 0) || ((pfd.revents & POLLIN) == 0)) {
+            continue;
+        }
+        addr_len = sizeof addr_up;
+        n = recvfrom(sock, buf, sizeof buf - 1, 0, (struct sockaddr *)&addr_up, &addr_len);
+        now_us = host_time_us();
+        if ((n < 4) || (buf[0] != PROTOCOL_VERSION)) {
+            continue;
+        }
+        buf[n] = '\0';
+
+        switch (buf[3]) {
+            case PKT_PUSH_DATA:
+                ack[0] = PROTOCOL_VERSION;
+                ack[1] = buf[1];
+                ack[2] = buf[2];
+                ack[3] = PKT_PUSH_ACK;
+                sendto(sock, ack, 4, 0, (struct sockaddr *)&addr_up, addr_len);
+                nb_push += 1;
+                if (n <= 12) {
+                    break;
+                }
+                /* header, gateway EUI, JSON */
+                root_val = json_parse_string((const char *)(buf + 12));
+                rxpk_array = json_object_get_array(json_value_get_object(root_val), "rxpk");
+                for (i = 0; i < (int)json_array_get_count(rxpk_array); i++) {
+                    rxpk = json_array_get_object(rxpk_array, i);
+                    str = json_object_get_string(rxpk, "data");
+                    if ((str == NULL) || (b64_to_bin(str, strlen(str), payload, sizeof payload) < UP_SEQ_SIZE)) {
+                        nb_foreign += 1;
+                        continue;
+                    }
+                    seq = ((uint32_t)payload[0] << 24) | ((uint32_t)payload[1] << 16) | ((uint32_t)payload[2] << 8) | payload[3];
+                    if (seq >= nb_up) {
+                        nb_foreign += 1;
+                    } else if (up_rcv[seq] != 0) {
+                        nb_dup += 1;
+                    } else {
+                        up_rcv[seq] = 1;
+                        nb_rcv += 1;
+                        up_stat.lat_us[up_stat.nb++] = (uint32_t)(now_us - (origin_us + (((uint64_t)seq * 1000000) / rate)));
+                    }
+                }
+                json_value_free(root_val);
+                break;
+
+            case PKT_PULL_DATA:
+                ack[0] = PROTOCOL_VERSION;
+                ack[1] = buf[1];
+                ack[2] = buf[2];
+                ack[3] = PKT_PULL_ACK;
+                sendto(sock, ack, 4, 0, (struct sockaddr *)&addr_up, addr_len);
+                addr_down = addr_up;
+                down_valid = true;
+                break;
+
+            case PKT_TX_ACK:
+                nb_tx_ack += 1;
+                if ((n > 12) && (strstr((const char *)(buf + 12), "\"error\"") != NULL) && (strstr((const char *)(buf + 12), "\"NONE\"") == NULL)) {
+                    nb_tx_err += 1;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    /* stop the forwarder */
+    if (fwd_running) {
+        if (ticks_valid && (read_cpu_ticks(pid, &ticks_end) != 0)) {
+            ticks_valid = false;
+        }
+        kill(pid, SIGTERM);
+        for (i = 0; (i < 50) && (waitpid(pid, &status, WNOHANG) != pid); i++) {
+            usleep(100000);
+        }
+        if (i == 50) {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+        }
+    }
+
+    /* report */
+    MSG("\n");
+    MSG("uplink:   injected %u, received %u, lost %u (%.2f%%), duplicated %u, unknown %u, PUSH_DATA %u\n",
+        nb_up, nb_rcv, nb_up - nb_rcv, (100.0 * (nb_up - nb_rcv)) / nb_up, nb_dup, nb_foreign, nb_push);
+    print_lat("uplink", &up_stat);
+    if (down_rate > 0) {
+        MSG("downlink: PULL_RESP %u, TX_ACK %u (%u errors), loaded %u, lost %u (%.2f%%)\n",
+            nb_down, nb_tx_ack, nb_tx_err, nb_tx_load, nb_down - nb_tx_load, (nb_down > 0) ? ((100.0 * (nb_down - nb_tx_load)) / nb_down) : 0.0);
+        print_lat("downlink", &down_stat);
+    }
+    if (ticks_valid) {
+        MSG("forwarder CPU: %.3f s (user+sys) during injection, %.1f us per uplink\n",
+            (double)(ticks_end - ticks_start) / sysconf(_SC_CLK_TCK), (1e6 * (double)(ticks_end - ticks_start) / sysconf(_SC_CLK_TCK)) / nb_up);
+    }
+
+    /* clean up */
+    if (tx_log_fd >= 0) {
+        close(tx_log_fd);
+    }
+    close(sock);
+    if (!keep_dir) {
+        unlink(conf_path);
+        unlink(trace_path);
+        unlink(tx_log_path);
+        unlink(log_path);
+        rmdir(work_dir);
+    } else {
+        MSG("INFO: working directory kept: %s\n", work_dir);
+    }
+    free(up_rcv);
+    free(up_stat.lat_us);
+    free(down_sent_us);
+    free(down_stat.lat_us);
+
+    return (fwd_running) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
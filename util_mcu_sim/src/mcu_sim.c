@@ -0,0 +1,542 @@
+/*
+  ______                              _
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2020 Semtech
+
+Description:
+    Simulator of the concentrator STM32 MCU (USB gateway), on a pseudo-terminal.
+    SPI requests are executed on the software SX1302 device of the HAL.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>      /* open */
+#include <poll.h>       /* poll */
+#include <termios.h>    /* POSIX terminal control definitions */
+#include <time.h>       /* clock_gettime, nanosleep */
+#include <signal.h>     /* sigaction */
+#include <getopt.h>     /* getopt_long */
+
+#include "loragw_hal.h"
+#include "loragw_com.h"
+#include "loragw_mcu.h"
+#include "loragw_mock.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define MSG(args...) printf(args) /* message that is destined to the user */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define HEADER_CMD_SIZE     4
+#define MCU_VERSION         "V01.00.00"     /* release firmware, compatible with the HAL */
+#define MCU_UNIQUE_ID       { 0x00, 0x53, 0x49, 0x4D, 0x00, 0x4D, 0x43, 0x55, 0x00, 0x00, 0x00, 0x01 }
+#define MCU_TEMPERATURE     2500            /* 0.01 degC */
+
+#define GPIO_PORT_A         0
+#define GPIO_SX1302_RESET   2               /* PA2 */
+
+#define POLL_PERIOD_MS      100
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct sim_stat_s {
+    uint32_t nb_order[ORDER_ID__REQ_MULTIPLE_SPI + 1];  /* requests received, by order */
+    uint32_t nb_unknown;    /* requests with an unknown order */
+    uint32_t nb_spi_rw;     /* SPI read/write requests */
+    uint32_t nb_spi_rmw;    /* SPI read-modify-write requests */
+    uint32_t nb_spi_fail;   /* SPI requests not executed */
+    uint32_t max_spi_req;   /* largest number of SPI requests in one order */
+    uint64_t bytes_in;      /* bytes received from the host */
+    uint64_t bytes_out;     /* bytes sent to the host */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static volatile bool exit_sig = false; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
+static volatile bool quit_sig = false; /* 1 -> application terminates without shutting down the hardware */
+
+static void * sx1302 = NULL; /* software SX1302 device */
+static const char * trace_path = LGW_MOCK_PATH_NONE;
+static struct timespec time_start;
+static struct sim_stat_s stat;
+
+static uint8_t buf_req[MAX_SIZE_COMMAND];
+static uint8_t buf_ack[HEADER_CMD_SIZE + MAX_SIZE_COMMAND];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void usage(void);
+
+static void sig_handler(int sigio);
+
+static int sx1302_reset(void);
+
+static int read_all(int fd, uint8_t * buf, size_t size);
+
+static bool sx1250_is_read(uint8_t op_code);
+
+static uint16_t process_spi(uint8_t * payload, uint16_t size);
+
+static uint16_t process_req(uint8_t order, uint8_t * payload, uint16_t size, uint8_t * ack);
+
+static void print_stat(void);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+static void usage(void) {
+    printf("Library version information: %s\n", lgw_version_info());
+    printf("Available options:\n");
+    printf(" -h         Print this help\n");
+    printf(" -l <uint>  Latency added to each request, in microseconds (default 0)\n");
+    printf(" -p <path>  Symbolic link to be created to the pseudo-terminal\n");
+    printf(" -s <uint>  Period of the statistics display, in seconds (default 0: at exit only)\n");
+    printf(" -t <path>  RX trace file to be replayed by the software SX1302\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sig_handler(int sigio) {
+    if (sigio == SIGQUIT) {
+        quit_sig = true;
+    } else if ((sigio == SIGINT) || (sigio == SIGTERM)) {
+        exit_sig = true;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int sx1302_reset(void) {
+    if (sx1302 != NULL) {
+        lgw_mock_close(sx1302);
+        sx1302 = NULL;
+    }
+    if (lgw_mock_open(trace_path, &sx1302) != LGW_MOCK_SUCCESS) {
+        MSG("ERROR: failed to create the software SX1302\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int read_all(int fd, uint8_t * buf, size_t size) {
+    size_t nb_read = 0;
+    ssize_t n;
+
+    while (nb_read < size) {
+        n = read(fd, buf + nb_read, size - nb_read);
+        if (n > 0) {
+            nb_read += (size_t)n;
+        } else if ((n < 0) && (errno == EINTR)) {
+            if (exit_sig || quit_sig) {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* the SPI frame does not tell a radio read from a write, the op code does */
+static bool sx1250_is_read(uint8_t op_code) {
+    switch (op_code) {
+        case GET_STATUS:
+        case GET_IRQ_STATUS:
+        case GET_RX_BUFFER_STATUS:
+        case GET_PACKET_STATUS:
+        case GET_DEVICE_ERRORS:
+        case READ_REGISTER:
+        case READ_BUFFER:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* execute the SPI requests of a REQ_MULTIPLE_SPI order, the answers are written in place */
+static uint16_t process_spi(uint8_t * payload, uint16_t size) {
+    uint16_t i = 0, j = 0;
+    uint16_t frame_size, addr;
+    uint8_t id, type, target, mux, mask, value, prev;
+    uint8_t * frame;
+    uint32_t nb_req = 0;
+    int x;
+
+    while (i < size) {
+        id = payload[i];
+        type = payload[i + 1];
+        nb_req += 1;
+        if ((type == MCU_SPI_REQ_TYPE_READ_WRITE) && ((i + 5) <= size)) {
+            /* REQ: id, type, target, size (2), frame -> ACK: id, type, status, size (2), frame */
+            target = payload[i + 2];
+            frame_size = (uint16_t)(payload[i + 3] << 8) | payload[i + 4];
+            frame = &payload[i + 5];
+            if ((i + 5 + frame_size) > size) {
+                break;
+            }
+            x = -1;
+            if ((target == MCU_SPI_TARGET_SX1302) && (frame_size >= 2)) {
+                mux = frame[0];
+                if (mux == LGW_SPI_MUX_TARGET_SX1302) {
+                    addr = (uint16_t)((frame[1] & 0x7F) << 8) | frame[2];
+                    if (frame_size < 3) {
+                        x = -1;
+                    } else if ((frame[1] & 0x80) != 0) {
+                        x = (frame_size == 3) ? 0 : lgw_mock_wb(sx1302, mux, addr, &frame[3], frame_size - 3);
+                    } else {
+                        /* one dummy byte before the data read */
+                        x = (frame_size <= 4) ? 0 : lgw_mock_rb(sx1302, mux, addr, &frame[4], frame_size - 4);
+                    }
+                } else if (sx1250_is_read(frame[1])) {
+                    /* SX1250 command: op code then parameters, the answer replaces the parameters */
+                    x = sx1250_mock_r(sx1302, mux, (sx1250_op_code_t)frame[1], &frame[2], frame_size - 2);
+                } else {
+                    x = sx1250_mock_w(sx1302, mux, (sx1250_op_code_t)frame[1], &frame[2], frame_size - 2);
+                }
+            }
+            stat.nb_spi_rw += 1;
+            if (x != 0) {
+                stat.nb_spi_fail += 1;
+            }
+            /* answers are never longer than requests, they are written in place */
+            memmove(&payload[j + 5], frame, frame_size);
+            payload[j + 0] = id;
+            payload[j + 1] = type;
+            payload[j + 2] = (x == 0) ? SPI_STATUS_OK : SPI_STATUS_FAIL;
+            payload[j + 3] = (uint8_t)(frame_size >> 8);
+            payload[j + 4] = (uint8_t)(frame_size >> 0);
+            i += 5 + frame_size;
+            j += 5 + frame_size;
+        } else if ((type == MCU_SPI_REQ_TYPE_READ_MODIFY_WRITE) && ((i + 6) <= size)) {
+            /* REQ: id, type, address (2), mask, value -> ACK: id, type, status, read value, modified value */
+            addr = (uint16_t)(payload[i + 2] << 8) | payload[i + 3];
+            mask = payload[i + 4];
+            value = payload[i + 5];
+            x = lgw_mock_r(sx1302, LGW_SPI_MUX_TARGET_SX1302, addr, &prev);
+            if (x == 0) {
+                value = (prev & ~mask) | (value & mask);
+                x = lgw_mock_w(sx1302, LGW_SPI_MUX_TARGET_SX1302, addr, value);
+            }
+            stat.nb_spi_rmw += 1;
+            if (x != 0) {
+                stat.nb_spi_fail += 1;
+            }
+            payload[j + 0] = id;
+            payload[j + 1] = type;
+            payload[j + 2] = (x == 0) ? SPI_STATUS_OK : SPI_STATUS_FAIL;
+            payload[j + 3] = prev;
+            payload[j + 4] = value;
+            i += 6;
+            j += 5;
+        } else {
+            MSG("WARNING: malformed SPI request %u (type 0x%02X)\n", id, type);
+            stat.nb_spi_fail += 1;
+            break;
+        }
+    }
+
+    if (nb_req > stat.max_spi_req) {
+        stat.max_spi_req = nb_req;
+    }
+
+    return j;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* execute an order, the ACK payload is written in ack, returns its size */
+static uint16_t process_req(uint8_t order, uint8_t * payload, uint16_t size, uint8_t * ack) {
+    const uint8_t unique_id[] = MCU_UNIQUE_ID;
+    struct timespec now;
+    uint32_t time_ms;
+
+    if (order <= ORDER_ID__REQ_MULTIPLE_SPI) {
+        stat.nb_order[order] += 1;
+    }
+
+    switch (order) {
+        case ORDER_ID__REQ_PING:
+            memcpy(&ack[ACK_PING__UNIQUE_ID_0], unique_id, sizeof unique_id);
+            memcpy(&ack[ACK_PING__VERSION_0], MCU_VERSION, ACK_PING_SIZE - ACK_PING__VERSION_0);
+            return ACK_PING_SIZE;
+        case ORDER_ID__REQ_GET_STATUS:
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            time_ms = (uint32_t)((now.tv_sec - time_start.tv_sec) * 1000 + (now.tv_nsec - time_start.tv_nsec) / 1000000);
+            ack[ACK_GET_STATUS__SYSTEM_TIME_31_24] = (uint8_t)(time_ms >> 24);
+            ack[ACK_GET_STATUS__SYSTEM_TIME_23_16] = (uint8_t)(time_ms >> 16);
+            ack[ACK_GET_STATUS__SYSTEM_TIME_15_8] = (uint8_t)(time_ms >> 8);
+            ack[ACK_GET_STATUS__SYSTEM_TIME_7_0] = (uint8_t)(time_ms >> 0);
+            ack[ACK_GET_STATUS__TEMPERATURE_15_8] = (uint8_t)((uint16_t)MCU_TEMPERATURE >> 8);
+            ack[ACK_GET_STATUS__TEMPERATURE_7_0] = (uint8_t)((uint16_t)MCU_TEMPERATURE >> 0);
+            return ACK_GET_STATUS_SIZE;
+        case ORDER_ID__REQ_BOOTLOADER_MODE:
+            MSG("INFO: bootloader mode requested, ignored\n");
+            return 0;
+        case ORDER_ID__REQ_RESET:
+            ack[ACK_RESET__STATUS] = (uint8_t)((sx1302_reset() == 0) ? 0 : 1);
+            return ACK_RESET_SIZE;
+        case ORDER_ID__REQ_WRITE_GPIO:
+            ack[ACK_GPIO_WRITE__STATUS] = 0;
+            if (size < REQ_WRITE_GPIO_SIZE) {
+                ack[ACK_GPIO_WRITE__STATUS] = 1;
+            } else if ((payload[REQ_WRITE_GPIO__PORT] == GPIO_PORT_A) && (payload[REQ_WRITE_GPIO__PIN] == GPIO_SX1302_RESET) && (payload[REQ_WRITE_GPIO__STATE] == 1)) {
+                /* registers are back to their reset values and the counter restarts */
+                ack[ACK_GPIO_WRITE__STATUS] = (uint8_t)((sx1302_reset() == 0) ? 0 : 1);
+            }
+            return ACK_GPIO_WRITE_SIZE;
+        case ORDER_ID__REQ_MULTIPLE_SPI:
+            size = process_spi(payload, size);
+            memcpy(ack, payload, size);
+            return size;
+        default:
+            stat.nb_unknown += 1;
+            return 0;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void print_stat(void) {
+    uint32_t nb_req = stat.nb_unknown;
+    int i;
+
+    for (i = 0; i <= ORDER_ID__REQ_MULTIPLE_SPI; i++) {
+        nb_req += stat.nb_order[i];
+    }
+
+    MSG("##### MCU simulator statistics #####\n");
+    MSG("# requests (round-trips): %u\n", nb_req);
+    MSG("#   PING %u, GET_STATUS %u, WRITE_GPIO %u, RESET %u, BOOTLOADER_MODE %u, MULTIPLE_SPI %u, unknown %u\n",
+        stat.nb_order[ORDER_ID__REQ_PING], stat.nb_order[ORDER_ID__REQ_GET_STATUS], stat.nb_order[ORDER_ID__REQ_WRITE_GPIO],
+        stat.nb_order[ORDER_ID__REQ_RESET], stat.nb_order[ORDER_ID__REQ_BOOTLOADER_MODE], stat.nb_order[ORDER_ID__REQ_MULTIPLE_SPI],
+        stat.nb_unknown);
+    MSG("# SPI requests: %u read/write, %u read-modify-write, %u failed, up to %u per order\n",
+        stat.nb_spi_rw, stat.nb_spi_rmw, stat.nb_spi_fail, stat.max_spi_req);
+    MSG("# bytes: %llu received, %llu sent\n", (unsigned long long)stat.bytes_in, (unsigned long long)stat.bytes_out);
+    MSG("####################################\n");
+    fflush(stdout);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, x;
+    unsigned int arg_u;
+    unsigned int latency_us = 0;
+    unsigned int stat_period_s = 0;
+    const char * link_path = NULL;
+    struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
+    struct termios tty;
+    struct pollfd pfd;
+    struct timespec latency, now, last_stat;
+    int fd_master, fd_slave;
+    const char * slave_name;
+    uint8_t hdr[HEADER_CMD_SIZE];
+    uint16_t size;
+
+    /* Parameter parsing */
+    int option_index = 0;
+    static struct option long_options[] = {
+        {0, 0, 0, 0}
+    };
+
+    /* parse command line options */
+    while ((i = getopt_long (argc, argv, "hl:p:s:t:", long_options, &option_index)) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+
+            case 'l': /* <uint> Latency */
+                i = sscanf(optarg, "%u", &arg_u);
+                if (i != 1) {
+                    printf("ERROR: argument parsing of -l argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                latency_us = arg_u;
+                break;
+
+            case 'p':
+                link_path = optarg;
+                break;
+
+            case 's': /* <uint> Statistics period */
+                i = sscanf(optarg, "%u", &arg_u);
+                if (i != 1) {
+                    printf("ERROR: argument parsing of -s argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                }
+                stat_period_s = arg_u;
+                break;
+
+            case 't':
+                trace_path = optarg;
+                break;
+
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
+    /* configure signal handling */
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigact.sa_handler = sig_handler;
+    sigaction(SIGQUIT, &sigact, NULL);
+    sigaction(SIGINT, &sigact, NULL);
+    sigaction(SIGTERM, &sigact, NULL);
+
+    /* create the pseudo-terminal */
+    fd_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((fd_master < 0) || (grantpt(fd_master) != 0) || (unlockpt(fd_master) != 0) || ((slave_name = ptsname(fd_master)) == NULL)) {
+        MSG("ERROR: failed to create pseudo-terminal - %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* keep the slave side open so that the master does not see a hang-up between two HAL sessions */
+    fd_slave = open(slave_name, O_RDWR | O_NOCTTY);
+    if (fd_slave < 0) {
+        MSG("ERROR: failed to open %s - %s\n", slave_name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* raw mode: the HAL only clears the input processing and the local modes */
+    if (tcgetattr(fd_slave, &tty) != 0) {
+        MSG("ERROR: tcgetattr failed - %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF | IXANY);
+    tty.c_oflag &= ~OPOST;
+    tty.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    tty.c_cflag = (tty.c_cflag & ~(CSIZE | PARENB)) | CS8;
+    if (tcsetattr(fd_slave, TCSANOW, &tty) != 0) {
+        MSG("ERROR: tcsetattr failed - %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (link_path != NULL) {
+        unlink(link_path);
+        if (symlink(slave_name, link_path) != 0) {
+            MSG("ERROR: failed to create link %s - %s\n", link_path, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (sx1302_reset() != 0) {
+        return EXIT_FAILURE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &time_start);
+    last_stat = time_start;
+    latency.tv_sec = latency_us / 1000000;
+    latency.tv_nsec = (latency_us % 1000000) * 1000;
+
+    MSG("INFO: MCU simulator ready on %s%s%s (latency %u us per request)\n", slave_name, (link_path != NULL) ? " -> " : "", (link_path != NULL) ? link_path : "", latency_us);
+    fflush(stdout);
+
+    pfd.fd = fd_master;
+    pfd.events = POLLIN;
+    while (!exit_sig && !quit_sig) {
+        if (stat_period_s > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if ((now.tv_sec - last_stat.tv_sec) >= (time_t)stat_period_s) {
+                print_stat();
+                last_stat = now;
+            }
+        }
+
+        x = poll(&pfd, 1, POLL_PERIOD_MS);
+        if ((x <= 0) || ((pfd.revents & POLLIN) == 0)) {
+            continue;
+        }
+
+        /* request: id, size (2), order, payload */
+        if (read_all(fd_master, hdr, HEADER_CMD_SIZE) != 0) {
+            break;
+        }
+        size = (uint16_t)(hdr[CMD_OFFSET__SIZE_MSB] << 8) | hdr[CMD_OFFSET__SIZE_LSB];
+        if (size > MAX_SIZE_COMMAND) {
+            MSG("WARNING: request 0x%02X too large (%u bytes), flushing\n", hdr[CMD_OFFSET__CMD], size);
+            tcflush(fd_master, TCIFLUSH);
+            continue;
+        }
+        if (read_all(fd_master, buf_req, size) != 0) {
+            break;
+        }
+        stat.bytes_in += HEADER_CMD_SIZE + size;
+
+        /* ack: same id, size (2), order | 0x40, payload */
+        size = process_req(hdr[CMD_OFFSET__CMD], buf_req, size, &buf_ack[HEADER_CMD_SIZE]);
+        buf_ack[CMD_OFFSET__ID] = hdr[CMD_OFFSET__ID];
+        buf_ack[CMD_OFFSET__SIZE_MSB] = (uint8_t)(size >> 8);
+        buf_ack[CMD_OFFSET__SIZE_LSB] = (uint8_t)(size >> 0);
+        buf_ack[CMD_OFFSET__CMD] = (hdr[CMD_OFFSET__CMD] <= ORDER_ID__REQ_MULTIPLE_SPI) ? (hdr[CMD_OFFSET__CMD] | 0x40) : ORDER_ID__CMD_ERROR;
+
+        if (latency_us > 0) {
+            nanosleep(&latency, NULL);
+        }
+
+        /* the header and the payload are sent at once, the HAL reads the header in one call */
+        if (write(fd_master, buf_ack, HEADER_CMD_SIZE + size) != (HEADER_CMD_SIZE + size)) {
+            MSG("ERROR: failed to write ack - %s\n", strerror(errno));
+            break;
+        }
+        stat.bytes_out += HEADER_CMD_SIZE + size;
+    }
+
+    print_stat();
+
+    lgw_mock_close(sx1302);
+    if (link_path != NULL) {
+        unlink(link_path);
+    }
+    close(fd_slave);
+    close(fd_master);
+
+    MSG("INFO: Exiting MCU simulator\n");
+
+    return 0;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
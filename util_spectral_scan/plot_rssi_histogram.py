@@ -10,7 +10,7 @@
 #   (C)2020 Semtech
 #
 # Description:
-#    Spectral Scan CSV result file plot - v0.3.0
+#    Spectral Scan CSV or binary result file plot - v0.4.0
 #
 # License: Revised BSD License, see LICENSE.TXT file include in the project
 
@@ -18,6 +18,7 @@
 import pylab as pl
 import numpy as np
 import csv
+import struct
 import sys
 
 #Read argument
@@ -31,18 +32,37 @@ else:
 rssi = []
 freq = []
 
-#Process .csv file
-with open(filename, 'r') as csvfile:
-    reader = csv.reader(csvfile, delimiter=',', quotechar='|')
-    for row in reader:
-        f=int(row[0])//1000 #frequency
-        freq.append(f)
-        rssi_line=[]
-        rssi_val=[]
-        for k in range(1,(len(row)-1)//2):
-            rssi_line.append(int(row[k*2]))
-            rssi_val.append(int(row[k*2-1]))
-        rssi.append(rssi_line)
+if filename.endswith('.bin'):
+    #Process .bin file: histograms of all the sweeps summed per frequency
+    with open(filename, 'rb') as binfile:
+        data = binfile.read()
+    magic, version, offset, nb_scan, freq_start, nb_chan, nb_levels, rec_size = struct.unpack_from('<4sBbHIBBH', data, 0)
+    if magic != b'SSCN' or version != 1:
+        print ("Unsupported binary file %s" %filename)
+        sys.exit()
+    hist = {}
+    for pos in range(16, len(data) - rec_size + 1, rec_size):
+        f, t = struct.unpack_from('<II', data, pos)
+        counts = struct.unpack_from('<%dH' %nb_levels, data, pos + 8)
+        hist.setdefault(f, np.zeros(nb_levels, dtype=np.uint64))
+        hist[f] += np.array(counts, dtype=np.uint64)
+    rssi_val = [-4*k + offset for k in range(nb_levels - 1)]
+    for f in sorted(hist):
+        freq.append(f//1000)
+        rssi.append([int(v) for v in hist[f][:nb_levels - 1]])
+else:
+    #Process .csv file
+    with open(filename, 'r') as csvfile:
+        reader = csv.reader(csvfile, delimiter=',', quotechar='|')
+        for row in reader:
+            f=int(row[0])//1000 #frequency
+            freq.append(f)
+            rssi_line=[]
+            rssi_val=[]
+            for k in range(1,(len(row)-1)//2):
+                rssi_line.append(int(row[k*2]))
+                rssi_val.append(int(row[k*2-1]))
+            rssi.append(rssi_line)
 
 #Set x to frequency axis and y to signal level axis
 A = np.array(rssi).T
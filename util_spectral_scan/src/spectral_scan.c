@@ -33,6 +33,10 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #include <math.h>
 #include <signal.h>     /* sigaction */
 #include <getopt.h>     /* getopt_long */
+#include <time.h>       /* clock_gettime */
+#include <fcntl.h>      /* open */
+#include <sys/mman.h>   /* mmap, msync, munmap */
+#include <sys/stat.h>
 
 #include "loragw_hal.h"
 #include "loragw_aux.h"
@@ -55,13 +59,225 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 #define DEFAULT_RSSI_OFFSET -11 /* RSSI offset of SX1261 */
 
 #define DEFAULT_LOG_NAME    "rssi_histogram"
+#define DEFAULT_NB_SWEEP    1
+
+#define CHAN_SPACING_HZ     200000  /* 200kHz channels */
+#define SCAN_POINT_NS       8200    /* interval between 2 RSSI points, as set by sx1261_spectral_scan_start */
+#define SCAN_POLL_US        500     /* interval between 2 status polls, once the scan should be over */
+#define SCAN_TIMEOUT_MS     2000
+
+#define BIN_MAGIC           "SSCN"
+#define BIN_VERSION         1
+#define BIN_HEADER_SIZE     16
+#define BIN_RECORD_SIZE     (8 + (2 * LGW_SPECTRAL_SCAN_RESULT_SIZE))
+#define MMAP_RECORD_MAX     ((SIZE_MAX - BIN_HEADER_SIZE) / BIN_RECORD_SIZE) /* max nb of scans of a memory-mapped log */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+typedef enum {
+    LOG_CSV,
+    LOG_BIN,
+    LOG_MMAP
+} log_format_t;
+
+struct log_s {
+    log_format_t format;
+    FILE * file;            /* CSV and binary outputs */
+    int fd;                 /* memory-mapped output */
+    uint8_t * map;
+    size_t map_size;
+    size_t offset;          /* number of bytes written */
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
+static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
+static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
 
+static void sig_handler(int sigio) {
+    if (sigio == SIGQUIT) {
+        quit_sig = 1;
+    } else if ((sigio == SIGINT) || (sigio == SIGTERM)) {
+        exit_sig = 1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint64_t time_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void put_u16(uint8_t * buff, uint16_t v) {
+    buff[0] = (uint8_t)(v >> 0);
+    buff[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t * buff, uint32_t v) {
+    buff[0] = (uint8_t)(v >> 0);
+    buff[1] = (uint8_t)(v >> 8);
+    buff[2] = (uint8_t)(v >> 16);
+    buff[3] = (uint8_t)(v >> 24);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Create the log file, the memory-mapped one being sized for nb_record scans */
+static int log_open(struct log_s * log, const char * name, uint64_t nb_record) {
+    log->file = NULL;
+    log->fd = -1;
+    log->map = NULL;
+    log->map_size = 0;
+    log->offset = 0;
+
+    switch (log->format) {
+        case LOG_CSV:
+            log->file = fopen(name, "w");
+            break;
+        case LOG_BIN:
+            log->file = fopen(name, "wb");
+            break;
+        case LOG_MMAP:
+            if (nb_record > MMAP_RECORD_MAX) {
+                return -1;
+            }
+            log->fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (log->fd < 0) {
+                return -1;
+            }
+            log->map_size = BIN_HEADER_SIZE + ((size_t)nb_record * BIN_RECORD_SIZE);
+            if (ftruncate(log->fd, (off_t)log->map_size) != 0) {
+                close(log->fd);
+                return -1;
+            }
+            log->map = mmap(NULL, log->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, log->fd, 0);
+            if (log->map == MAP_FAILED) {
+                log->map = NULL;
+                close(log->fd);
+                return -1;
+            }
+            return 0;
+    }
+
+    return (log->file == NULL) ? -1 : 0;
+}
+
+/* Append raw bytes to a binary log */
+static int log_put(struct log_s * log, const uint8_t * buff, size_t size) {
+    if (log->format == LOG_MMAP) {
+        if ((log->offset + size) > log->map_size) {
+            return -1;
+        }
+        memcpy(log->map + log->offset, buff, size);
+    } else if (fwrite(buff, 1, size, log->file) != size) {
+        return -1;
+    }
+    log->offset += size;
+
+    return 0;
+}
+
+/* Write the binary log header, all fields being little-endian */
+static int log_header(struct log_s * log, uint32_t freq_hz, uint8_t nb_chan, uint16_t nb_scan, int8_t rssi_offset) {
+    uint8_t buff[BIN_HEADER_SIZE];
+
+    if (log->format == LOG_CSV) {
+        return 0;
+    }
+
+    memcpy(buff, BIN_MAGIC, 4);
+    buff[4] = BIN_VERSION;
+    buff[5] = (uint8_t)rssi_offset;
+    put_u16(&buff[6], nb_scan);
+    put_u32(&buff[8], freq_hz);
+    buff[12] = nb_chan;
+    buff[13] = LGW_SPECTRAL_SCAN_RESULT_SIZE;
+    put_u16(&buff[14], BIN_RECORD_SIZE);
+
+    return log_put(log, buff, sizeof buff);
+}
+
+/* Log the histogram of a scan, time_ms being relative to the start of the capture */
+static int log_record(struct log_s * log, uint32_t freq_hz, uint32_t time_ms, const int16_t * levels, const uint16_t * results) {
+    uint8_t buff[BIN_RECORD_SIZE];
+    int i;
+
+    if (log->format == LOG_CSV) {
+        fprintf(log->file, "%u", freq_hz);
+        for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
+            fprintf(log->file, ",%d,%u", levels[i], results[i]);
+        }
+        fprintf(log->file, "\n");
+        return 0;
+    }
+
+    put_u32(&buff[0], freq_hz);
+    put_u32(&buff[4], time_ms);
+    for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
+        put_u16(&buff[8 + (2 * i)], results[i]);
+    }
+
+    return log_put(log, buff, sizeof buff);
+}
+
+/* Flush and close the log, trimming the memory-mapped file to what was written */
+static void log_close(struct log_s * log) {
+    if (log->format == LOG_MMAP) {
+        if (log->map != NULL) {
+            msync(log->map, log->map_size, MS_SYNC);
+            munmap(log->map, log->map_size);
+        }
+        if (log->fd >= 0) {
+            if (ftruncate(log->fd, (off_t)log->offset) != 0) {
+                printf("WARNING: failed to trim log file\n");
+            }
+            close(log->fd);
+        }
+    } else if (log->file != NULL) {
+        fclose(log->file);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Wait for the end of the scan started at start_us, expected to last wait_us */
+static int scan_wait(uint64_t start_us, uint32_t expect_us, lgw_spectral_scan_status_t * status) {
+    uint64_t elapsed_us = time_us() - start_us;
+    int x;
+
+    if (elapsed_us < expect_us) {
+        wait_us(expect_us - elapsed_us);
+    }
+
+    while (1) {
+        *status = LGW_SPECTRAL_SCAN_STATUS_UNKNOWN;
+        x = lgw_spectral_scan_get_status(status);
+        if (x != 0) {
+            printf("ERROR: spectral scan status failed\n");
+            return -1;
+        }
+        if ((*status == LGW_SPECTRAL_SCAN_STATUS_COMPLETED) || (*status == LGW_SPECTRAL_SCAN_STATUS_ABORTED)) {
+            return 0;
+        }
+        if ((time_us() - start_us) > (SCAN_TIMEOUT_MS * 1000)) {
+            printf("ERROR: %s: TIMEOUT on Spectral Scan\n", __FUNCTION__);
+            return -1;
+        }
+        wait_us(SCAN_POLL_US);
+    }
+}
+
 /* describe command line options */
 void usage(void) {
     printf("Library version information: %s\n", lgw_version_info());
@@ -77,6 +293,9 @@ void usage(void) {
     printf(" -s <uint>  Number of scan points per frequency step [1..65535]\n");
     printf(" -o <int>   RSSI Offset of the sx1261 path, in dB [-127..128]\n");
     printf(" -l <char>  Log file name\n");
+    printf(" -r <uint>  Number of sweeps over the channels, 0 to sweep until stopped (default %u)\n", DEFAULT_NB_SWEEP);
+    printf(" -b         Log in a compact binary file (.bin) instead of CSV\n");
+    printf(" -m         Log in a memory-mapped binary file (.bin), sized for all the sweeps\n");
 }
 
 /* -------------------------------------------------------------------------- */
@@ -106,14 +325,26 @@ int main(int argc, char **argv)
     uint8_t nb_channels = DEFAULT_NB_CHAN;
     uint16_t nb_scan = DEFAULT_NB_SCAN;
     int8_t rssi_offset = DEFAULT_RSSI_OFFSET;
+    uint32_t nb_sweep = DEFAULT_NB_SWEEP;
     int16_t levels[LGW_SPECTRAL_SCAN_RESULT_SIZE];
     uint16_t results[LGW_SPECTRAL_SCAN_RESULT_SIZE];
     char log_file_name[64] = DEFAULT_LOG_NAME;
-    FILE * log_file = NULL;
-
-    struct timeval tm_start;
+    struct log_s log = { .format = LOG_CSV };
+
+    /* Sweep pipeline */
+    uint64_t nb_step, step;
+    uint32_t freq_scan; /* frequency of the scan on going */
+    uint32_t time_scan_ms;
+    uint64_t start_us, scan_start_us, capture_start_us;
+    uint32_t expect_us;
+    bool scan_ok;
+    uint64_t nb_scan_ok = 0, nb_scan_fail = 0;
+    double elapsed_s;
     lgw_spectral_scan_status_t status;
 
+    /* signal handling variables */
+    struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
+
     /* Parameter parsing */
     int option_index = 0;
     static struct option long_options[] = {
@@ -121,7 +352,7 @@ int main(int argc, char **argv)
     };
 
     /* parse command line options */
-    while ((i = getopt_long (argc, argv, "hud:f:n:o:s:l:D:", long_options, &option_index)) != -1) {
+    while ((i = getopt_long (argc, argv, "hud:f:n:o:s:l:D:r:bm", long_options, &option_index)) != -1) {
         switch (i) {
             case 'h':
                 usage();
@@ -202,6 +433,26 @@ int main(int argc, char **argv)
                 }
                 break;
 
+            case 'r': /* <uint> Number of sweeps */
+                i = sscanf(optarg, "%u", &arg_u);
+                if (i != 1) {
+                    printf("ERROR: argument parsing of -r argument. Use -h to print help\n");
+                    return EXIT_FAILURE;
+                } else {
+                    nb_sweep = (uint32_t)arg_u;
+                }
+                break;
+
+            case 'b':
+                if (log.format == LOG_CSV) {
+                    log.format = LOG_BIN;
+                }
+                break;
+
+            case 'm':
+                log.format = LOG_MMAP;
+                break;
+
             default:
                 printf("ERROR: argument parsing\n");
                 usage();
@@ -209,10 +460,31 @@ int main(int argc, char **argv)
         }
     }
 
+    if ((log.format == LOG_MMAP) && (nb_sweep == 0)) {
+        printf("ERROR: the number of sweeps must be given for a memory-mapped log file\n");
+        return EXIT_FAILURE;
+    }
+    if ((log.format == LOG_MMAP) && (((uint64_t)nb_sweep * nb_channels) > MMAP_RECORD_MAX)) {
+        printf("ERROR: %u sweeps of %u channels do not fit in a memory-mapped log file (%" PRIu64 " scans max)\n", nb_sweep, nb_channels, (uint64_t)MMAP_RECORD_MAX);
+        return EXIT_FAILURE;
+    }
+    if ((nb_channels == 0) || (nb_scan == 0)) {
+        printf("ERROR: nothing to scan\n");
+        return EXIT_FAILURE;
+    }
+
     printf("==\n");
-    printf("== Spectral Scan: freq_hz=%uHz, nb_channels=%u, nb_scan=%u, rssi_offset=%ddB\n", freq_hz, nb_channels, nb_scan, rssi_offset);
+    printf("== Spectral Scan: freq_hz=%uHz, nb_channels=%u, nb_scan=%u, rssi_offset=%ddB, nb_sweep=%u\n", freq_hz, nb_channels, nb_scan, rssi_offset, nb_sweep);
     printf("==\n");
 
+    /* configure signal handling */
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigact.sa_handler = sig_handler;
+    sigaction(SIGQUIT, &sigact, NULL);
+    sigaction(SIGINT, &sigact, NULL);
+    sigaction(SIGTERM, &sigact, NULL);
+
     if (com_type == LGW_COM_SPI) {
         /* Board reset */
         if (system("./reset_lgw.sh start") != 0) {
@@ -276,75 +548,101 @@ int main(int argc, char **argv)
     }
 
     /* create log file */
-    strcat(log_file_name,".csv");
-    log_file = fopen(log_file_name, "w");
-    if (log_file == NULL) {
+    nb_step = (uint64_t)nb_sweep * nb_channels; /* 0: until stopped */
+    strcat(log_file_name, (log.format == LOG_CSV) ? ".csv" : ".bin");
+    if (log_open(&log, log_file_name, nb_step) != 0) {
         printf("ERROR: impossible to create log file %s\n", log_file_name);
         return EXIT_FAILURE;
     }
+    if (log_header(&log, freq_hz, nb_channels, nb_scan, rssi_offset) != 0) {
+        printf("ERROR: failed to write log file header\n");
+        log_close(&log);
+        return EXIT_FAILURE;
+    }
 
-    /* Launch Spectral Scan on each channels */
-    for (j = 0; j < nb_channels; j++) {
-        x = lgw_spectral_scan_start(freq_hz, nb_scan);
-        if (x != 0) {
-            printf("ERROR: spectral scan start failed\n");
-            continue;
-        }
-
-        /* Wait for scan to be completed */
-        timeout_start(&tm_start);
-        do {
-            /* handle timeout */
-            if (timeout_check(tm_start, 2000) != 0) {
-                printf("ERROR: %s: TIMEOUT on Spectral Scan\n", __FUNCTION__);
-                continue;
-            }
-
-            /* get spectral scan status */
-            status = LGW_SPECTRAL_SCAN_STATUS_UNKNOWN;
-            x = lgw_spectral_scan_get_status(&status);
+    /* Sweep the channels: the scan of the next channel is started as soon as
+     * the results of the current one are read, and they are logged while the
+     * sx1261 scans */
+    expect_us = (uint32_t)(((uint64_t)nb_scan * SCAN_POINT_NS) / 1000);
+    capture_start_us = time_us();
+    freq_scan = freq_hz;
+    scan_start_us = time_us();
+    x = lgw_spectral_scan_start(freq_scan, nb_scan);
+    scan_ok = (x == 0);
+    if (x != 0) {
+        printf("ERROR: spectral scan start failed\n");
+    }
+    for (step = 0; ((nb_step == 0) || (step < nb_step)) && !exit_sig && !quit_sig; step++) {
+        /* Wait for scan to be completed, and get its results */
+        if (scan_ok == true) {
+            scan_ok = false;
+            x = scan_wait(scan_start_us, expect_us, &status);
             if (x != 0) {
-                printf("ERROR: spectral scan status failed\n");
-                break;
+                lgw_spectral_scan_abort();
+            } else if (status == LGW_SPECTRAL_SCAN_STATUS_COMPLETED) {
+                memset(levels, 0, sizeof levels);
+                memset(results, 0, sizeof results);
+                x = lgw_spectral_scan_get_results(levels, results);
+                if (x != 0) {
+                    printf("ERROR: spectral scan get results failed\n");
+                } else {
+                    scan_ok = true;
+                }
+            } else if (status == LGW_SPECTRAL_SCAN_STATUS_ABORTED) {
+                printf("INFO: spectral scan has been aborted\n");
+            } else {
+                printf("ERROR: spectral scan status us unexpected 0x%02X\n", status);
             }
-
-            wait_ms(10);
-        } while (status != LGW_SPECTRAL_SCAN_STATUS_COMPLETED && status != LGW_SPECTRAL_SCAN_STATUS_ABORTED);
-
-        if (status == LGW_SPECTRAL_SCAN_STATUS_COMPLETED) {
-            memset(levels, 0, sizeof levels);
-            memset(results, 0, sizeof results);
-            x = lgw_spectral_scan_get_results(levels, results);
+        }
+        freq_hz = freq_scan;
+        time_scan_ms = (uint32_t)((scan_start_us - capture_start_us) / 1000);
+
+        /* Retune and start the next scan */
+        if (((nb_step == 0) || ((step + 1) < nb_step)) && !exit_sig && !quit_sig) {
+            freq_scan = (((step + 1) % nb_channels) == 0) ? (freq_scan - ((nb_channels - 1) * CHAN_SPACING_HZ)) : (freq_scan + CHAN_SPACING_HZ);
+            start_us = time_us();
+            x = lgw_spectral_scan_start(freq_scan, nb_scan);
             if (x != 0) {
-                printf("ERROR: spectral scan get results failed\n");
-                continue;
+                printf("ERROR: spectral scan start failed\n");
             }
+            scan_start_us = start_us;
+        } else {
+            x = -1;
+        }
 
-            /* log results */
-            fprintf(log_file, "%u", freq_hz);
-            for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
-                fprintf(log_file, ",%d,%u", levels[i], results[i]);
+        /* Log the results of the previous scan, while the next one is on going */
+        if (scan_ok == true) {
+            nb_scan_ok += 1;
+            if (log_record(&log, freq_hz, time_scan_ms, levels, results) != 0) {
+                printf("ERROR: failed to write log file\n");
+                exit_sig = 1;
             }
-            fprintf(log_file, "\n");
-
-            /* print results */
-            printf("%u: ", freq_hz);
-            for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
-                printf("%u ", results[i]);
+            if (log.format == LOG_CSV) {
+                printf("%u: ", freq_hz);
+                for (i = 0; i < LGW_SPECTRAL_SCAN_RESULT_SIZE; i++) {
+                    printf("%u ", results[i]);
+                }
+                printf("\n");
             }
-            printf("\n");
-
-            /* Next frequency to scan */
-            freq_hz += 200000; /* 200kHz channels */
-        } else if (status == LGW_SPECTRAL_SCAN_STATUS_ABORTED) {
-            printf("INFO: spectral scan has been aborted\n");
         } else {
-            printf("ERROR: spectral scan status us unexpected 0x%02X\n", status);
+            nb_scan_fail += 1;
         }
+        if ((log.format != LOG_CSV) && (((step + 1) % nb_channels) == 0)) {
+            printf("INFO: sweep %" PRIu64 " done\n", (step + 1) / nb_channels);
+        }
+        scan_ok = (x == 0);
+    }
+    if (scan_ok == true) {
+        /* stopped by a signal while scanning */
+        lgw_spectral_scan_abort();
     }
+    elapsed_s = (double)(time_us() - capture_start_us) / 1e6;
 
     /* close log file */
-    fclose(log_file);
+    log_close(&log);
+
+    /* Throughput report */
+    printf("INFO: %" PRIu64 " scans logged (%" PRIu64 " failed) in %.3f s: %.1f scans/s, %.0f RSSI points/s\n", nb_scan_ok, nb_scan_fail, elapsed_s, (elapsed_s > 0) ? ((double)nb_scan_ok / elapsed_s) : 0.0, (elapsed_s > 0) ? ((double)nb_scan_ok * nb_scan / elapsed_s) : 0.0);
 
     /* Stop the gateway */
     x = lgw_stop();